@@ -83,6 +83,7 @@ static const pa_daemon_conf default_conf = {
     .log_time = false,
     .resample_method = PA_RESAMPLER_AUTO,
     .avoid_resampling = false,
+    .wide_mixing = false,
     .disable_remixing = false,
     .remixing_use_all_sink_channels = true,
     .remixing_produce_lfe = false,
@@ -98,6 +99,7 @@ static const pa_daemon_conf default_conf = {
     .disable_shm = false,
     .disable_memfd = false,
     .lock_memory = false,
+    .lock_mempool = false,
     .deferred_volume = true,
     .default_n_fragments = 4,
     .default_fragment_size_msec = 25,
@@ -179,6 +181,8 @@ void pa_daemon_conf_free(pa_daemon_conf *c) {
     pa_xfree(c->script_commands);
     pa_xfree(c->dl_search_path);
     pa_xfree(c->default_script_file);
+    pa_xfree(c->main_thread_cpu_affinity);
+    pa_xfree(c->io_thread_cpu_affinity);
 
     if (c->log_target)
         pa_log_target_free(c->log_target);
@@ -472,6 +476,24 @@ static int parse_nice_level(pa_config_parser_state *state) {
     return 0;
 }
 
+static int parse_cpu_affinity(pa_config_parser_state *state) {
+    char **cpus;
+    pa_cpu_set set;
+
+    pa_assert(state);
+
+    cpus = state->data;
+
+    if (*state->rvalue && !pa_streq(state->rvalue, "auto") && pa_cpu_set_parse(&set, state->rvalue) < 0) {
+        pa_log(_("[%s:%u] Invalid CPU list '%s'."), state->filename, state->lineno, state->rvalue);
+        return -1;
+    }
+
+    pa_xfree(*cpus);
+    *cpus = *state->rvalue ? pa_xstrdup(state->rvalue) : NULL;
+    return 0;
+}
+
 static int parse_rtprio(pa_config_parser_state *state) {
 #if !defined(OS_IS_WIN32) && defined(HAVE_SCHED_H)
     pa_daemon_conf *c;
@@ -583,6 +605,7 @@ int pa_daemon_conf_load(pa_daemon_conf *c, const char *filename) {
         { "flat-volumes",               pa_config_parse_bool,     &c->flat_volumes, NULL },
         { "rescue-streams",             pa_config_parse_bool,     &c->rescue_streams, NULL },
         { "lock-memory",                pa_config_parse_bool,     &c->lock_memory, NULL },
+        { "lock-mempool",               pa_config_parse_bool,     &c->lock_mempool, NULL },
         { "enable-deferred-volume",     pa_config_parse_bool,     &c->deferred_volume, NULL },
         { "exit-idle-time",             pa_config_parse_int,      &c->exit_idle_time, NULL },
         { "scache-idle-time",           pa_config_parse_int,      &c->scache_idle_time, NULL },
@@ -605,7 +628,10 @@ int pa_daemon_conf_load(pa_daemon_conf *c, const char *filename) {
         { "deferred-volume-extra-delay-usec",
                                         pa_config_parse_int,      &c->deferred_volume_extra_delay_usec, NULL },
         { "nice-level",                 parse_nice_level,         c, NULL },
+        { "main-thread-cpu-affinity",   parse_cpu_affinity,       &c->main_thread_cpu_affinity, NULL },
+        { "io-thread-cpu-affinity",     parse_cpu_affinity,       &c->io_thread_cpu_affinity, NULL },
         { "avoid-resampling",           pa_config_parse_bool,     &c->avoid_resampling, NULL },
+        { "wide-mixing",                pa_config_parse_bool,     &c->wide_mixing, NULL },
         { "disable-remixing",           pa_config_parse_bool,     &c->disable_remixing, NULL },
         { "enable-remixing",            pa_config_parse_not_bool, &c->disable_remixing, NULL },
         { "remixing-use-all-sink-channels",
@@ -798,6 +824,8 @@ char *pa_daemon_conf_dump(pa_daemon_conf *c) {
     pa_strbuf_printf(s, "nice-level = %i\n", c->nice_level);
     pa_strbuf_printf(s, "realtime-scheduling = %s\n", pa_yes_no(c->realtime_scheduling));
     pa_strbuf_printf(s, "realtime-priority = %i\n", c->realtime_priority);
+    pa_strbuf_printf(s, "main-thread-cpu-affinity = %s\n", pa_strempty(c->main_thread_cpu_affinity));
+    pa_strbuf_printf(s, "io-thread-cpu-affinity = %s\n", pa_strempty(c->io_thread_cpu_affinity));
     pa_strbuf_printf(s, "allow-module-loading = %s\n", pa_yes_no(!c->disallow_module_loading));
     pa_strbuf_printf(s, "allow-exit = %s\n", pa_yes_no(!c->disallow_exit));
     pa_strbuf_printf(s, "use-pid-file = %s\n", pa_yes_no(c->use_pid_file));
@@ -810,6 +838,7 @@ char *pa_daemon_conf_dump(pa_daemon_conf *c) {
     pa_strbuf_printf(s, "flat-volumes = %s\n", pa_yes_no(c->flat_volumes));
     pa_strbuf_printf(s, "rescue-streams = %s\n", pa_yes_no(c->rescue_streams));
     pa_strbuf_printf(s, "lock-memory = %s\n", pa_yes_no(c->lock_memory));
+    pa_strbuf_printf(s, "lock-mempool = %s\n", pa_yes_no(c->lock_mempool));
     pa_strbuf_printf(s, "exit-idle-time = %i\n", c->exit_idle_time);
     pa_strbuf_printf(s, "scache-idle-time = %i\n", c->scache_idle_time);
     pa_strbuf_printf(s, "dl-search-path = %s\n", pa_strempty(c->dl_search_path));
@@ -819,6 +848,7 @@ char *pa_daemon_conf_dump(pa_daemon_conf *c) {
     pa_strbuf_printf(s, "log-level = %s\n", log_level_to_string[c->log_level]);
     pa_strbuf_printf(s, "resample-method = %s\n", pa_resample_method_to_string(c->resample_method));
     pa_strbuf_printf(s, "avoid-resampling = %s\n", pa_yes_no(c->avoid_resampling));
+    pa_strbuf_printf(s, "wide-mixing = %s\n", pa_yes_no(c->wide_mixing));
     pa_strbuf_printf(s, "enable-remixing = %s\n", pa_yes_no(!c->disable_remixing));
     pa_strbuf_printf(s, "remixing-use-all-sink-channels = %s\n", pa_yes_no(c->remixing_use_all_sink_channels));
     pa_strbuf_printf(s, "remixing-produce-lfe = %s\n", pa_yes_no(c->remixing_produce_lfe));
@@ -68,6 +68,7 @@ typedef struct pa_daemon_conf {
         disable_shm,
         disable_memfd,
         avoid_resampling,
+        wide_mixing,
         disable_remixing,
         remixing_use_all_sink_channels,
         remixing_produce_lfe,
@@ -79,6 +80,7 @@ typedef struct pa_daemon_conf {
         flat_volumes,
         rescue_streams,
         lock_memory,
+        lock_mempool,
         deferred_volume;
     pa_server_type_t local_server_type;
     int exit_idle_time,
@@ -87,6 +89,7 @@ typedef struct pa_daemon_conf {
         nice_level,
         resample_method;
     char *script_commands, *dl_search_path, *default_script_file;
+    char *main_thread_cpu_affinity, *io_thread_cpu_affinity;
     pa_log_target *log_target;
     pa_log_level_t log_level;
     unsigned log_backtrace;
@@ -1194,6 +1194,9 @@ int main(int argc, char *argv[]) {
         goto finish;
     }
 
+    if (conf->lock_mempool && pa_mempool_lock(c->mempool) < 0)
+        pa_log_warn("Failed to lock the memory pool into memory.");
+
     c->default_sample_spec = conf->default_sample_spec;
     c->alternate_sample_rate = conf->alternate_sample_rate;
     c->default_channel_map = conf->default_channel_map;
@@ -1208,6 +1211,7 @@ int main(int argc, char *argv[]) {
     c->realtime_priority = conf->realtime_priority;
     c->realtime_scheduling = conf->realtime_scheduling;
     c->avoid_resampling = conf->avoid_resampling;
+    c->wide_mixing = conf->wide_mixing;
     c->disable_remixing = conf->disable_remixing;
     c->remixing_use_all_sink_channels = conf->remixing_use_all_sink_channels;
     c->remixing_produce_lfe = conf->remixing_produce_lfe;
@@ -1217,6 +1221,9 @@ int main(int argc, char *argv[]) {
     c->disallow_exit = conf->disallow_exit;
     c->flat_volumes = conf->flat_volumes;
     c->rescue_streams = conf->rescue_streams;
+
+    if (pa_core_set_cpu_affinity(c, conf->main_thread_cpu_affinity, conf->io_thread_cpu_affinity) < 0)
+        pa_log_warn("Failed to set up the CPU affinity of the daemon threads.");
 #ifdef HAVE_DBUS
     c->server_type = conf->local_server_type;
 #endif
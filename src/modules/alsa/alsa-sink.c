@@ -80,6 +80,9 @@
 /* Note that TSCHED_WATERMARK_INC_THRESHOLD_USEC == 0 means that we
  * will increase the watermark only if we hit a real underrun. */
 
+#define TSCHED_WATERMARK_MIN_SAMPLES (32)                          /* Trust the measured scheduling delay only after this many wakeups */
+#define TSCHED_WATERMARK_SAFETY_FACTOR (2)                         /* Keep the watermark at twice the measured scheduling delay */
+
 #define TSCHED_MIN_SLEEP_USEC (10*PA_USEC_PER_MSEC)                /* 10ms  -- Sleep at least 10ms on each iteration */
 #define TSCHED_MIN_WAKEUP_USEC (4*PA_USEC_PER_MSEC)                /* 4ms   -- Wakeup at least this long before the buffer runs empty*/
 
@@ -154,6 +157,11 @@ struct userdata {
     pa_usec_t min_latency_ref;
     pa_usec_t tsched_watermark_usec;
 
+    /* Wakeup lateness plus render time since the watermark last
+     * changed, and the buffer level seen first after a timer wakeup */
+    pa_histogram watermark_window;
+    size_t left_to_play_at_wakeup;
+
     pa_memchunk memchunk;
 
     char *device_name;  /* name of the PCM device */
@@ -358,6 +366,19 @@ static void fix_tsched_watermark(struct userdata *u) {
     u->tsched_watermark_usec = pa_bytes_to_usec(u->tsched_watermark, &u->sink->sample_spec);
 }
 
+/* The watermark that the measured scheduling delay calls for, 0 if
+ * there are not enough measurements yet */
+static size_t measured_watermark(struct userdata *u) {
+    pa_usec_t usec;
+
+    if (u->watermark_window.count < TSCHED_WATERMARK_MIN_SAMPLES)
+        return 0;
+
+    usec = pa_histogram_percentile(&u->watermark_window, 0.99) * TSCHED_WATERMARK_SAFETY_FACTOR;
+
+    return pa_usec_to_bytes(usec, &u->sink->sample_spec);
+}
+
 static void increase_watermark(struct userdata *u) {
     size_t old_watermark;
     pa_usec_t old_min_latency, new_min_latency;
@@ -365,12 +386,15 @@ static void increase_watermark(struct userdata *u) {
     pa_assert(u);
     pa_assert(u->use_tsched);
 
-    /* First, just try to increase the watermark */
+    /* First, just try to increase the watermark. If we know that the
+     * scheduling delay needs more than one step, go there directly. */
     old_watermark = u->tsched_watermark;
     u->tsched_watermark = PA_MIN(u->tsched_watermark * 2, u->tsched_watermark + u->watermark_inc_step);
+    u->tsched_watermark = PA_MAX(u->tsched_watermark, measured_watermark(u));
     fix_tsched_watermark(u);
 
     if (old_watermark != u->tsched_watermark) {
+        pa_histogram_reset(&u->watermark_window);
         pa_log_info("Increasing wakeup watermark to %0.2f ms",
                     (double) u->tsched_watermark_usec / PA_USEC_PER_MSEC);
         return;
@@ -397,7 +421,7 @@ static void increase_watermark(struct userdata *u) {
 }
 
 static void decrease_watermark(struct userdata *u) {
-    size_t old_watermark;
+    size_t old_watermark, measured;
     pa_usec_t now;
 
     pa_assert(u);
@@ -413,16 +437,22 @@ static void decrease_watermark(struct userdata *u) {
 
     old_watermark = u->tsched_watermark;
 
-    if (u->tsched_watermark < u->watermark_dec_step)
+    if ((measured = measured_watermark(u)) > 0)
+        /* Step down to what the measured scheduling delay calls for,
+         * but never by more than half at once */
+        u->tsched_watermark = PA_MIN(u->tsched_watermark, PA_MAX(u->tsched_watermark / 2, measured));
+    else if (u->tsched_watermark < u->watermark_dec_step)
         u->tsched_watermark = u->tsched_watermark / 2;
     else
         u->tsched_watermark = PA_MAX(u->tsched_watermark / 2, u->tsched_watermark - u->watermark_dec_step);
 
     fix_tsched_watermark(u);
 
-    if (old_watermark != u->tsched_watermark)
+    if (old_watermark != u->tsched_watermark) {
+        pa_histogram_reset(&u->watermark_window);
         pa_log_info("Decreasing wakeup watermark to %0.2f ms",
                     (double) u->tsched_watermark_usec / PA_USEC_PER_MSEC);
+    }
 
     /* We don't change the latency range*/
 
@@ -444,6 +474,8 @@ static void reset_watermark(struct userdata *u, size_t tsched_watermark, pa_samp
     fix_min_sleep_wakeup(u);
     fix_tsched_watermark(u);
 
+    pa_histogram_reset(&u->watermark_window);
+
     if (in_thread)
         pa_sink_set_latency_range_within_thread(u->sink,
                                                 u->min_latency_ref,
@@ -578,6 +610,9 @@ static size_t check_left_to_play(struct userdata *u, size_t n_bytes, bool on_tim
                 pa_log_info("Underrun!");
     }
 
+    if (u->left_to_play_at_wakeup == (size_t) -1)
+        u->left_to_play_at_wakeup = left_to_play;
+
 #ifdef DEBUG_TIMING
     pa_log_debug("%0.2f ms left to play; inc threshold = %0.2f ms; dec threshold = %0.2f ms",
                  (double) pa_bytes_to_usec(left_to_play, &u->sink->sample_spec) / PA_USEC_PER_MSEC,
@@ -1960,9 +1995,24 @@ rewind_done:
     return 0;
 }
 
+/* Called from IO context after a write that followed a timer wakeup */
+static void record_timing(struct userdata *u, pa_usec_t wakeup_lateness, pa_usec_t render_time) {
+    pa_usec_t slack = (pa_usec_t) -1;
+
+    if (u->left_to_play_at_wakeup != (size_t) -1) {
+        pa_usec_t left = pa_bytes_to_usec(u->left_to_play_at_wakeup, &u->sink->sample_spec);
+
+        slack = left > render_time ? left - render_time : 0;
+    }
+
+    pa_sink_record_timing(u->sink, wakeup_lateness, render_time, slack);
+    pa_histogram_add(&u->watermark_window, wakeup_lateness + render_time);
+}
+
 static void thread_func(void *userdata) {
     struct userdata *u = userdata;
     unsigned short revents = 0;
+    pa_usec_t wakeup_lateness = (pa_usec_t) -1;
 
     pa_assert(u);
 
@@ -1972,6 +2022,7 @@ static void thread_func(void *userdata) {
         pa_thread_make_realtime(u->core->realtime_priority);
 
     pa_thread_mq_install(&u->thread_mq);
+    pa_mempool_enable_thread_cache(u->core->mempool);
 
     for (;;) {
         int ret;
@@ -1989,9 +2040,16 @@ static void thread_func(void *userdata) {
         /* Render some data and write it to the dsp */
         if (PA_SINK_IS_OPENED(u->sink->thread_info.state)) {
             int work_done;
-            pa_usec_t sleep_usec = 0;
+            pa_usec_t sleep_usec = 0, render_start = 0;
             bool on_timeout = pa_rtpoll_timer_elapsed(u->rtpoll);
 
+            /* Only measure wakeups that are part of the regular timer
+             * driven playback */
+            if (u->use_tsched && on_timeout && wakeup_lateness != (pa_usec_t) -1 && !u->first && !u->after_rewind) {
+                render_start = pa_rtclock_now();
+                u->left_to_play_at_wakeup = (size_t) -1;
+            }
+
             if (u->use_mmap)
                 work_done = mmap_write(u, &sleep_usec, revents & POLLOUT, on_timeout);
             else
@@ -2000,6 +2058,9 @@ static void thread_func(void *userdata) {
             if (work_done < 0)
                 goto fail;
 
+            if (render_start > 0)
+                record_timing(u, wakeup_lateness, pa_rtclock_now() - render_start);
+
 /*             pa_log_debug("work_done = %i", work_done); */
 
             if (work_done) {
@@ -2086,8 +2147,13 @@ static void thread_func(void *userdata) {
         if ((ret = pa_rtpoll_run(u->rtpoll)) < 0)
             goto fail;
 
+        wakeup_lateness = (pa_usec_t) -1;
+
         if (rtpoll_sleep > 0) {
             real_sleep = pa_rtclock_now() - real_sleep;
+
+            if (pa_rtpoll_timer_elapsed(u->rtpoll))
+                wakeup_lateness = real_sleep > rtpoll_sleep ? real_sleep - rtpoll_sleep : 0;
 #ifdef DEBUG_TIMING
             pa_log_debug("Expected sleep: %0.2fms, real sleep: %0.2fms (diff %0.2f ms)",
                 (double) rtpoll_sleep / PA_USEC_PER_MSEC, (double) real_sleep / PA_USEC_PER_MSEC,
@@ -2343,9 +2409,11 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
     bool deferred_volume = false;
     bool set_formats = false;
     bool fixed_latency_range = false;
+    pa_cpu_set cpu_affinity;
+    const char *cpus;
     bool b;
     bool d;
-    bool avoid_resampling;
+    bool avoid_resampling, wide_mixing;
     pa_sink_new_data data;
     bool volume_is_set;
     bool mute_is_set;
@@ -2362,6 +2430,7 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
     ss = m->core->default_sample_spec;
     map = m->core->default_channel_map;
     avoid_resampling = m->core->avoid_resampling;
+    wide_mixing = m->core->wide_mixing;
 
     /* Pick sample spec overrides from the mapping, if any */
     if (mapping) {
@@ -2443,6 +2512,12 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
         goto fail;
     }
 
+    pa_cpu_set_clear(&cpu_affinity);
+    if ((cpus = pa_modargs_get_value(ma, "cpu_affinity", NULL)) && pa_cpu_set_parse(&cpu_affinity, cpus) < 0) {
+        pa_log("Failed to parse cpu_affinity argument.");
+        goto fail;
+    }
+
     use_tsched = pa_alsa_may_tsched(use_tsched);
 
     u = pa_xnew0(struct userdata, 1);
@@ -2642,6 +2717,13 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
     }
     pa_sink_new_data_set_avoid_resampling(&data, avoid_resampling);
 
+    if (pa_modargs_get_value_boolean(ma, "wide_mixing", &wide_mixing) < 0) {
+        pa_log("Failed to parse wide_mixing argument.");
+        pa_sink_new_data_done(&data);
+        goto fail;
+    }
+    pa_sink_new_data_set_wide_mixing(&data, wide_mixing);
+
     pa_sink_new_data_set_sample_spec(&data, &ss);
     pa_sink_new_data_set_channel_map(&data, &map);
     pa_sink_new_data_set_alternate_sample_rate(&data, alternate_sample_rate);
@@ -2795,6 +2877,8 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
     pa_xfree(thread_name);
     thread_name = NULL;
 
+    pa_core_place_io_thread(m->core, u->thread, &cpu_affinity, u->sink->proplist);
+
     /* Get initial mixer settings */
     if (volume_is_set) {
         if (u->sink->set_volume)
@@ -1704,6 +1704,7 @@ static void thread_func(void *userdata) {
         pa_thread_make_realtime(u->core->realtime_priority);
 
     pa_thread_mq_install(&u->thread_mq);
+    pa_mempool_enable_thread_cache(u->core->mempool);
 
     for (;;) {
         int ret;
@@ -2046,6 +2047,8 @@ pa_source *pa_alsa_source_new(pa_module *m, pa_modargs *ma, const char*driver, p
     bool namereg_fail = false;
     bool deferred_volume = false;
     bool fixed_latency_range = false;
+    pa_cpu_set cpu_affinity;
+    const char *cpus;
     bool b;
     bool d;
     bool avoid_resampling;
@@ -2136,6 +2139,12 @@ pa_source *pa_alsa_source_new(pa_module *m, pa_modargs *ma, const char*driver, p
         goto fail;
     }
 
+    pa_cpu_set_clear(&cpu_affinity);
+    if ((cpus = pa_modargs_get_value(ma, "cpu_affinity", NULL)) && pa_cpu_set_parse(&cpu_affinity, cpus) < 0) {
+        pa_log("Failed to parse cpu_affinity argument.");
+        goto fail;
+    }
+
     use_tsched = pa_alsa_may_tsched(use_tsched);
 
     u = pa_xnew0(struct userdata, 1);
@@ -2447,6 +2456,8 @@ pa_source *pa_alsa_source_new(pa_module *m, pa_modargs *ma, const char*driver, p
     pa_xfree(thread_name);
     thread_name = NULL;
 
+    pa_core_place_io_thread(m->core, u->thread, &cpu_affinity, u->source->proplist);
+
     /* Get initial mixer settings */
     if (volume_is_set) {
         if (u->source->set_volume)
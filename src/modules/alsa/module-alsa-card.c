@@ -69,7 +69,9 @@ PA_MODULE_USAGE(
         "paths_dir=<directory containing the path configuration files> "
         "use_ucm=<load use case manager> "
         "avoid_resampling=<use stream original sample rate if possible?> "
+        "wide_mixing=<mix streams in a wide accumulator?> "
         "control=<name of mixer control> "
+        "cpu_affinity=<list of CPUs to pin the IO thread to> "
 );
 
 static const char* const valid_modargs[] = {
@@ -98,7 +100,9 @@ static const char* const valid_modargs[] = {
     "paths_dir",
     "use_ucm",
     "avoid_resampling",
+    "wide_mixing",
     "control",
+    "cpu_affinity",
     NULL
 };
 
@@ -37,6 +37,9 @@ static void handle_get_current_memblocks_size(DBusConnection *conn, DBusMessage
 static void handle_get_accumulated_memblocks(DBusConnection *conn, DBusMessage *msg, void *userdata);
 static void handle_get_accumulated_memblocks_size(DBusConnection *conn, DBusMessage *msg, void *userdata);
 static void handle_get_sample_cache_size(DBusConnection *conn, DBusMessage *msg, void *userdata);
+static void handle_get_mempool_locked(DBusConnection *conn, DBusMessage *msg, void *userdata);
+static void handle_get_mempool_locked_size(DBusConnection *conn, DBusMessage *msg, void *userdata);
+static void handle_get_mempool_huge_pages(DBusConnection *conn, DBusMessage *msg, void *userdata);
 
 static void handle_get_all(DBusConnection *conn, DBusMessage *msg, void *userdata);
 
@@ -52,6 +55,9 @@ enum property_handler_index {
     PROPERTY_HANDLER_ACCUMULATED_MEMBLOCKS,
     PROPERTY_HANDLER_ACCUMULATED_MEMBLOCKS_SIZE,
     PROPERTY_HANDLER_SAMPLE_CACHE_SIZE,
+    PROPERTY_HANDLER_MEMPOOL_LOCKED,
+    PROPERTY_HANDLER_MEMPOOL_LOCKED_SIZE,
+    PROPERTY_HANDLER_MEMPOOL_HUGE_PAGES,
     PROPERTY_HANDLER_MAX
 };
 
@@ -60,7 +66,10 @@ static pa_dbus_property_handler property_handlers[PROPERTY_HANDLER_MAX] = {
     [PROPERTY_HANDLER_CURRENT_MEMBLOCKS_SIZE]     = { .property_name = "CurrentMemblocksSize",     .type = "u", .get_cb = handle_get_current_memblocks_size,     .set_cb = NULL },
     [PROPERTY_HANDLER_ACCUMULATED_MEMBLOCKS]      = { .property_name = "AccumulatedMemblocks",     .type = "u", .get_cb = handle_get_accumulated_memblocks,      .set_cb = NULL },
     [PROPERTY_HANDLER_ACCUMULATED_MEMBLOCKS_SIZE] = { .property_name = "AccumulatedMemblocksSize", .type = "u", .get_cb = handle_get_accumulated_memblocks_size, .set_cb = NULL },
-    [PROPERTY_HANDLER_SAMPLE_CACHE_SIZE]          = { .property_name = "SampleCacheSize",          .type = "u", .get_cb = handle_get_sample_cache_size,          .set_cb = NULL }
+    [PROPERTY_HANDLER_SAMPLE_CACHE_SIZE]          = { .property_name = "SampleCacheSize",          .type = "u", .get_cb = handle_get_sample_cache_size,          .set_cb = NULL },
+    [PROPERTY_HANDLER_MEMPOOL_LOCKED]             = { .property_name = "MempoolLocked",            .type = "b", .get_cb = handle_get_mempool_locked,             .set_cb = NULL },
+    [PROPERTY_HANDLER_MEMPOOL_LOCKED_SIZE]        = { .property_name = "MempoolLockedSize",        .type = "u", .get_cb = handle_get_mempool_locked_size,        .set_cb = NULL },
+    [PROPERTY_HANDLER_MEMPOOL_HUGE_PAGES]         = { .property_name = "MempoolHugePages",         .type = "b", .get_cb = handle_get_mempool_huge_pages,         .set_cb = NULL }
 };
 
 static pa_dbus_interface_info memstats_interface_info = {
@@ -151,6 +160,48 @@ static void handle_get_sample_cache_size(DBusConnection *conn, DBusMessage *msg,
     pa_dbus_send_basic_variant_reply(conn, msg, DBUS_TYPE_UINT32, &sample_cache_size);
 }
 
+static void handle_get_mempool_locked(DBusConnection *conn, DBusMessage *msg, void *userdata) {
+    pa_dbusiface_memstats *m = userdata;
+    dbus_bool_t mempool_locked;
+
+    pa_assert(conn);
+    pa_assert(msg);
+    pa_assert(m);
+
+    mempool_locked = pa_mempool_is_locked(m->core->mempool);
+
+    pa_dbus_send_basic_variant_reply(conn, msg, DBUS_TYPE_BOOLEAN, &mempool_locked);
+}
+
+static void handle_get_mempool_locked_size(DBusConnection *conn, DBusMessage *msg, void *userdata) {
+    pa_dbusiface_memstats *m = userdata;
+    const pa_mempool_stat *stat;
+    dbus_uint32_t mempool_locked_size;
+
+    pa_assert(conn);
+    pa_assert(msg);
+    pa_assert(m);
+
+    stat = pa_mempool_get_stat(m->core->mempool);
+
+    mempool_locked_size = pa_atomic_load(&stat->locked_size);
+
+    pa_dbus_send_basic_variant_reply(conn, msg, DBUS_TYPE_UINT32, &mempool_locked_size);
+}
+
+static void handle_get_mempool_huge_pages(DBusConnection *conn, DBusMessage *msg, void *userdata) {
+    pa_dbusiface_memstats *m = userdata;
+    dbus_bool_t mempool_huge_pages;
+
+    pa_assert(conn);
+    pa_assert(msg);
+    pa_assert(m);
+
+    mempool_huge_pages = pa_mempool_uses_huge_pages(m->core->mempool);
+
+    pa_dbus_send_basic_variant_reply(conn, msg, DBUS_TYPE_BOOLEAN, &mempool_huge_pages);
+}
+
 static void handle_get_all(DBusConnection *conn, DBusMessage *msg, void *userdata) {
     pa_dbusiface_memstats *m = userdata;
     const pa_mempool_stat *stat;
@@ -159,6 +210,9 @@ static void handle_get_all(DBusConnection *conn, DBusMessage *msg, void *userdat
     dbus_uint32_t accumulated_memblocks;
     dbus_uint32_t accumulated_memblocks_size;
     dbus_uint32_t sample_cache_size;
+    dbus_bool_t mempool_locked;
+    dbus_uint32_t mempool_locked_size;
+    dbus_bool_t mempool_huge_pages;
     DBusMessage *reply = NULL;
     DBusMessageIter msg_iter;
     DBusMessageIter dict_iter;
@@ -174,6 +228,9 @@ static void handle_get_all(DBusConnection *conn, DBusMessage *msg, void *userdat
     accumulated_memblocks = pa_atomic_load(&stat->n_accumulated);
     accumulated_memblocks_size = pa_atomic_load(&stat->accumulated_size);
     sample_cache_size = pa_scache_total_size(m->core);
+    mempool_locked = pa_mempool_is_locked(m->core->mempool);
+    mempool_locked_size = pa_atomic_load(&stat->locked_size);
+    mempool_huge_pages = pa_mempool_uses_huge_pages(m->core->mempool);
 
     pa_assert_se((reply = dbus_message_new_method_return(msg)));
 
@@ -185,6 +242,9 @@ static void handle_get_all(DBusConnection *conn, DBusMessage *msg, void *userdat
     pa_dbus_append_basic_variant_dict_entry(&dict_iter, property_handlers[PROPERTY_HANDLER_ACCUMULATED_MEMBLOCKS].property_name, DBUS_TYPE_UINT32, &accumulated_memblocks);
     pa_dbus_append_basic_variant_dict_entry(&dict_iter, property_handlers[PROPERTY_HANDLER_ACCUMULATED_MEMBLOCKS_SIZE].property_name, DBUS_TYPE_UINT32, &accumulated_memblocks_size);
     pa_dbus_append_basic_variant_dict_entry(&dict_iter, property_handlers[PROPERTY_HANDLER_SAMPLE_CACHE_SIZE].property_name, DBUS_TYPE_UINT32, &sample_cache_size);
+    pa_dbus_append_basic_variant_dict_entry(&dict_iter, property_handlers[PROPERTY_HANDLER_MEMPOOL_LOCKED].property_name, DBUS_TYPE_BOOLEAN, &mempool_locked);
+    pa_dbus_append_basic_variant_dict_entry(&dict_iter, property_handlers[PROPERTY_HANDLER_MEMPOOL_LOCKED_SIZE].property_name, DBUS_TYPE_UINT32, &mempool_locked_size);
+    pa_dbus_append_basic_variant_dict_entry(&dict_iter, property_handlers[PROPERTY_HANDLER_MEMPOOL_HUGE_PAGES].property_name, DBUS_TYPE_BOOLEAN, &mempool_huge_pages);
 
     pa_assert_se(dbus_message_iter_close_container(&msg_iter, &dict_iter));
 
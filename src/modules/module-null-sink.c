@@ -36,6 +36,7 @@
 #include <pulsecore/sink.h>
 #include <pulsecore/module.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/io-thread-pool.h>
 #include <pulsecore/modargs.h>
 #include <pulsecore/log.h>
 #include <pulsecore/thread.h>
@@ -54,7 +55,10 @@ PA_MODULE_USAGE(
         "channels=<number of channels> "
         "channel_map=<channel map>"
         "formats=<semi-colon separated sink formats>"
-        "norewinds=<disable rewinds>");
+        "norewinds=<disable rewinds> "
+        "io_thread_pool=<run in the shared IO thread pool instead of a thread of its own?> "
+        "cpu_affinity=<list of CPUs to pin the IO thread to, unless in the IO thread pool> "
+        "wide_mixing=<mix streams in a wide accumulator?>");
 
 #define DEFAULT_SINK_NAME "null"
 #define BLOCK_USEC (2 * PA_USEC_PER_SEC)
@@ -69,6 +73,9 @@ struct userdata {
     pa_thread_mq thread_mq;
     pa_rtpoll *rtpoll;
 
+    pa_io_thread_pool *pool;
+    pa_io_thread_pool_client *pool_client;
+
     pa_usec_t block_usec;
     pa_usec_t timestamp;
 
@@ -86,6 +93,9 @@ static const char* const valid_modargs[] = {
     "channel_map",
     "formats",
     "norewinds",
+    "io_thread_pool",
+    "cpu_affinity",
+    "wide_mixing",
     NULL
 };
 
@@ -261,6 +271,36 @@ static void process_render(struct userdata *u, pa_usec_t now) {
 /*     pa_log_debug("Ate in sum %lu bytes (of %lu)", (unsigned long) ate, (unsigned long) nbytes); */
 }
 
+/* Called from the IO thread. Returns when to wake up next, or 0 if
+ * only a message can give us something to do. */
+static pa_usec_t process(void *userdata) {
+    struct userdata *u = userdata;
+    pa_usec_t now = 0;
+
+    pa_assert(u);
+
+    if (PA_SINK_IS_OPENED(u->sink->thread_info.state))
+        now = pa_rtclock_now();
+
+    if (PA_UNLIKELY(u->sink->thread_info.rewind_requested))
+        process_rewind(u, now);
+
+    if (!PA_SINK_IS_OPENED(u->sink->thread_info.state))
+        return 0;
+
+    /* Render some data and drop it immediately */
+    if (u->timestamp <= now) {
+        pa_usec_t lateness = now - u->timestamp;
+
+        process_render(u, now);
+
+        /* Nothing is buffered when we wake up, hence there is no slack */
+        pa_sink_record_timing(u->sink, lateness, pa_rtclock_now() - now, (pa_usec_t) -1);
+    }
+
+    return u->timestamp;
+}
+
 static void thread_func(void *userdata) {
     struct userdata *u = userdata;
 
@@ -272,26 +312,17 @@ static void thread_func(void *userdata) {
         pa_thread_make_realtime(u->core->realtime_priority);
 
     pa_thread_mq_install(&u->thread_mq);
+    pa_mempool_enable_thread_cache(u->core->mempool);
 
     u->timestamp = pa_rtclock_now();
 
     for (;;) {
-        pa_usec_t now = 0;
+        pa_usec_t next;
         int ret;
 
-        if (PA_SINK_IS_OPENED(u->sink->thread_info.state))
-            now = pa_rtclock_now();
-
-        if (PA_UNLIKELY(u->sink->thread_info.rewind_requested))
-            process_rewind(u, now);
-
-        /* Render some data and drop it immediately */
-        if (PA_SINK_IS_OPENED(u->sink->thread_info.state)) {
-            if (u->timestamp <= now)
-                process_render(u, now);
-
-            pa_rtpoll_set_timer_absolute(u->rtpoll, u->timestamp);
-        } else
+        if ((next = process(u)) > 0)
+            pa_rtpoll_set_timer_absolute(u->rtpoll, next);
+        else
             pa_rtpoll_set_timer_disabled(u->rtpoll);
 
         /* Hmm, nothing to do. Let's sleep */
@@ -321,6 +352,10 @@ int pa__init(pa_module*m) {
     pa_format_info *format;
     const char *formats;
     size_t nbytes;
+    bool use_pool = false;
+    pa_cpu_set cpu_affinity;
+    const char *cpus;
+    bool wide_mixing;
 
     pa_assert(m);
 
@@ -336,12 +371,34 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
+    if (pa_modargs_get_value_boolean(ma, "io_thread_pool", &use_pool) < 0) {
+        pa_log("Invalid argument, io_thread_pool expects a boolean value.");
+        goto fail;
+    }
+
+    pa_cpu_set_clear(&cpu_affinity);
+    if ((cpus = pa_modargs_get_value(ma, "cpu_affinity", NULL)) && pa_cpu_set_parse(&cpu_affinity, cpus) < 0) {
+        pa_log("Invalid argument, cpu_affinity expects a list of CPUs.");
+        goto fail;
+    }
+
+    wide_mixing = m->core->wide_mixing;
+    if (pa_modargs_get_value_boolean(ma, "wide_mixing", &wide_mixing) < 0) {
+        pa_log("Invalid argument, wide_mixing expects a boolean value.");
+        goto fail;
+    }
+
     m->userdata = u = pa_xnew0(struct userdata, 1);
     u->core = m->core;
     u->module = m;
-    u->rtpoll = pa_rtpoll_new();
     u->block_usec = BLOCK_USEC;
 
+    /* The pool thread attaches the thread side of the queues itself */
+    if (use_pool)
+        u->pool = pa_io_thread_pool_get(m->core);
+    else
+        u->rtpoll = pa_rtpoll_new();
+
     if (pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll) < 0) {
         pa_log("pa_thread_mq_init() failed.");
         goto fail;
@@ -353,6 +410,7 @@ int pa__init(pa_module*m) {
     pa_sink_new_data_set_name(&data, pa_modargs_get_value(ma, "sink_name", DEFAULT_SINK_NAME));
     pa_sink_new_data_set_sample_spec(&data, &ss);
     pa_sink_new_data_set_channel_map(&data, &map);
+    pa_sink_new_data_set_wide_mixing(&data, wide_mixing);
     pa_proplist_sets(data.proplist, PA_PROP_DEVICE_DESCRIPTION, _("Null Output"));
     pa_proplist_sets(data.proplist, PA_PROP_DEVICE_CLASS, "abstract");
 
@@ -402,7 +460,16 @@ int pa__init(pa_module*m) {
     u->sink->userdata = u;
 
     pa_sink_set_asyncmsgq(u->sink, u->thread_mq.inq);
-    pa_sink_set_rtpoll(u->sink, u->rtpoll);
+
+    if (u->pool) {
+        if (!(u->pool_client = pa_io_thread_pool_client_new(u->pool, m, &u->thread_mq, process, u))) {
+            pa_log("Failed to join the IO thread pool.");
+            goto fail;
+        }
+
+        pa_sink_set_rtpoll(u->sink, pa_io_thread_pool_client_get_rtpoll(u->pool_client));
+    } else
+        pa_sink_set_rtpoll(u->sink, u->rtpoll);
 
     if(pa_modargs_get_value_boolean(ma, "norewinds", &u->norewinds) < 0){
         pa_log("Invalid argument, norewinds expects a boolean value.");
@@ -421,9 +488,16 @@ int pa__init(pa_module*m) {
 
     pa_sink_set_max_request(u->sink, nbytes);
 
-    if (!(u->thread = pa_thread_new("null-sink", thread_func, u))) {
-        pa_log("Failed to create thread.");
-        goto fail;
+    if (u->pool_client) {
+        u->timestamp = pa_rtclock_now();
+        pa_io_thread_pool_client_start(u->pool_client);
+    } else {
+        if (!(u->thread = pa_thread_new("null-sink", thread_func, u))) {
+            pa_log("Failed to create thread.");
+            goto fail;
+        }
+
+        pa_core_place_io_thread(m->core, u->thread, &cpu_affinity, u->sink->proplist);
     }
 
     pa_sink_set_latency_range(u->sink, 0, u->block_usec);
@@ -468,6 +542,9 @@ void pa__done(pa_module*m) {
         pa_thread_free(u->thread);
     }
 
+    if (u->pool_client)
+        pa_io_thread_pool_client_free(u->pool_client);
+
     pa_thread_mq_done(&u->thread_mq);
 
     if (u->sink)
@@ -476,6 +553,9 @@ void pa__done(pa_module*m) {
     if (u->rtpoll)
         pa_rtpoll_free(u->rtpoll);
 
+    if (u->pool)
+        pa_io_thread_pool_unref(u->pool);
+
     if (u->formats)
         pa_idxset_free(u->formats, (pa_free_cb_t) pa_format_info_free);
 
@@ -33,6 +33,7 @@
 #include <pulse/xmalloc.h>
 
 #include <pulsecore/core-util.h>
+#include <pulsecore/io-thread-pool.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/modargs.h>
@@ -53,7 +54,9 @@ PA_MODULE_USAGE(
         "source_name=<name of source> "
         "channel_map=<channel map> "
         "max_latency_msec=<maximum latency in ms> "
-        "description=<description for the source> ");
+        "description=<description for the source> "
+        "io_thread_pool=<run in the shared IO thread pool instead of a thread of its own?> "
+        "cpu_affinity=<list of CPUs to pin the IO thread to, unless in the IO thread pool> ");
 
 #define DEFAULT_SOURCE_NAME "source.null"
 #define MAX_LATENCY_USEC (PA_USEC_PER_SEC * 2)
@@ -68,6 +71,9 @@ struct userdata {
     pa_thread_mq thread_mq;
     pa_rtpoll *rtpoll;
 
+    pa_io_thread_pool *pool;
+    pa_io_thread_pool_client *pool_client;
+
     size_t block_size;
 
     pa_usec_t block_usec;
@@ -82,6 +88,8 @@ static const char* const valid_modargs[] = {
     "channel_map",
     "max_latency_msec",
     "description",
+    "io_thread_pool",
+    "cpu_affinity",
     NULL
 };
 
@@ -132,10 +140,42 @@ static void source_update_requested_latency_cb(pa_source *s) {
     pa_source_set_max_rewind_within_thread(s, pa_usec_to_bytes(u->block_usec, &u->source->sample_spec));
 }
 
+/* Called from the IO thread. Returns when to wake up next, or 0 if
+ * only a message can give us something to do. */
+static pa_usec_t process(void *userdata) {
+    struct userdata *u = userdata;
+    pa_usec_t now;
+    pa_memchunk chunk;
+
+    pa_assert(u);
+
+    if (!PA_SOURCE_IS_OPENED(u->source->thread_info.state))
+        return 0;
+
+    now = pa_rtclock_now();
+
+    /* Generate some null data once a block is due. Checking the
+     * deadline instead of asking the rtpoll whether its timer elapsed
+     * works the same in the IO thread pool. */
+    if (now >= u->timestamp + u->block_usec &&
+        (chunk.length = pa_usec_to_bytes(now - u->timestamp, &u->source->sample_spec)) > 0) {
+
+        chunk.length = PA_MIN(pa_frame_align(pa_mempool_block_size_max(u->core->mempool), &u->source->sample_spec), chunk.length);
+
+        chunk.memblock = pa_memblock_new(u->core->mempool, chunk.length);
+        chunk.index = 0;
+        pa_silence_memchunk(&chunk, &u->source->sample_spec);
+        pa_source_post(u->source, &chunk);
+        pa_memblock_unref(chunk.memblock);
+
+        u->timestamp += pa_bytes_to_usec(chunk.length, &u->source->sample_spec);
+    }
+
+    return u->timestamp + u->block_usec;
+}
+
 static void thread_func(void *userdata) {
     struct userdata *u = userdata;
-    bool timer_elapsed = false;
-    size_t max_block_size;
 
     pa_assert(u);
 
@@ -146,42 +186,21 @@ static void thread_func(void *userdata) {
 
     pa_thread_mq_install(&u->thread_mq);
 
-    max_block_size = pa_frame_align(pa_mempool_block_size_max(u->core->mempool), &u->source->sample_spec);
     u->timestamp = pa_rtclock_now();
 
     for (;;) {
+        pa_usec_t next;
         int ret;
 
-        /* Generate some null data */
-        if (PA_SOURCE_IS_OPENED(u->source->thread_info.state)) {
-            pa_usec_t now;
-            pa_memchunk chunk;
-
-            now = pa_rtclock_now();
-
-            if (timer_elapsed && (chunk.length = pa_usec_to_bytes(now - u->timestamp, &u->source->sample_spec)) > 0) {
-
-                chunk.length = PA_MIN(max_block_size, chunk.length);
-
-                chunk.memblock = pa_memblock_new(u->core->mempool, chunk.length);
-                chunk.index = 0;
-                pa_silence_memchunk(&chunk, &u->source->sample_spec);
-                pa_source_post(u->source, &chunk);
-                pa_memblock_unref(chunk.memblock);
-
-                u->timestamp += pa_bytes_to_usec(chunk.length, &u->source->sample_spec);
-            }
-
-            pa_rtpoll_set_timer_absolute(u->rtpoll, u->timestamp + u->block_usec);
-        } else
+        if ((next = process(u)) > 0)
+            pa_rtpoll_set_timer_absolute(u->rtpoll, next);
+        else
             pa_rtpoll_set_timer_disabled(u->rtpoll);
 
         /* Hmm, nothing to do. Let's sleep */
         if ((ret = pa_rtpoll_run(u->rtpoll)) < 0)
             goto fail;
 
-        timer_elapsed = pa_rtpoll_timer_elapsed(u->rtpoll);
-
         if (ret == 0)
             goto finish;
     }
@@ -203,6 +222,9 @@ int pa__init(pa_module*m) {
     pa_modargs *ma = NULL;
     pa_source_new_data data;
     uint32_t max_latency_msec;
+    bool use_pool = false;
+    pa_cpu_set cpu_affinity;
+    const char *cpus;
 
     pa_assert(m);
 
@@ -218,10 +240,26 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
+    if (pa_modargs_get_value_boolean(ma, "io_thread_pool", &use_pool) < 0) {
+        pa_log("Invalid argument, io_thread_pool expects a boolean value.");
+        goto fail;
+    }
+
+    pa_cpu_set_clear(&cpu_affinity);
+    if ((cpus = pa_modargs_get_value(ma, "cpu_affinity", NULL)) && pa_cpu_set_parse(&cpu_affinity, cpus) < 0) {
+        pa_log("Invalid argument, cpu_affinity expects a list of CPUs.");
+        goto fail;
+    }
+
     m->userdata = u = pa_xnew0(struct userdata, 1);
     u->core = m->core;
     u->module = m;
-    u->rtpoll = pa_rtpoll_new();
+
+    /* The pool thread attaches the thread side of the queues itself */
+    if (use_pool)
+        u->pool = pa_io_thread_pool_get(m->core);
+    else
+        u->rtpoll = pa_rtpoll_new();
 
     if (pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll) < 0) {
         pa_log("pa_thread_mq_init() failed.");
@@ -251,7 +289,16 @@ int pa__init(pa_module*m) {
     u->source->userdata = u;
 
     pa_source_set_asyncmsgq(u->source, u->thread_mq.inq);
-    pa_source_set_rtpoll(u->source, u->rtpoll);
+
+    if (u->pool) {
+        if (!(u->pool_client = pa_io_thread_pool_client_new(u->pool, m, &u->thread_mq, process, u))) {
+            pa_log("Failed to join the IO thread pool.");
+            goto fail;
+        }
+
+        pa_source_set_rtpoll(u->source, pa_io_thread_pool_client_get_rtpoll(u->pool_client));
+    } else
+        pa_source_set_rtpoll(u->source, u->rtpoll);
 
     max_latency_msec = MAX_LATENCY_USEC / PA_USEC_PER_MSEC;
     if (pa_modargs_get_value_u32(ma, "max_latency_msec", &max_latency_msec) < 0) {
@@ -266,9 +313,16 @@ int pa__init(pa_module*m) {
     u->source->thread_info.max_rewind =
         pa_usec_to_bytes(u->block_usec, &u->source->sample_spec);
 
-    if (!(u->thread = pa_thread_new("null-source", thread_func, u))) {
-        pa_log("Failed to create thread.");
-        goto fail;
+    if (u->pool_client) {
+        u->timestamp = pa_rtclock_now();
+        pa_io_thread_pool_client_start(u->pool_client);
+    } else {
+        if (!(u->thread = pa_thread_new("null-source", thread_func, u))) {
+            pa_log("Failed to create thread.");
+            goto fail;
+        }
+
+        pa_core_place_io_thread(m->core, u->thread, &cpu_affinity, u->source->proplist);
     }
 
     pa_source_put(u->source);
@@ -302,6 +356,9 @@ void pa__done(pa_module*m) {
         pa_thread_free(u->thread);
     }
 
+    if (u->pool_client)
+        pa_io_thread_pool_client_free(u->pool_client);
+
     pa_thread_mq_done(&u->thread_mq);
 
     if (u->source)
@@ -310,5 +367,8 @@ void pa__done(pa_module*m) {
     if (u->rtpoll)
         pa_rtpoll_free(u->rtpoll);
 
+    if (u->pool)
+        pa_io_thread_pool_unref(u->pool);
+
     pa_xfree(u);
 }
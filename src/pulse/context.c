@@ -555,6 +555,11 @@ static void setup_complete_callback(pa_pdispatch *pd, uint32_t command, uint32_t
             pa_log_debug("Negotiated SHM: %s", pa_yes_no(c->do_shm));
             pa_pstream_enable_shm(c->pstream, c->do_shm);
 
+            /* Starting with protocol version 36, SHM memblock releases and
+             * revokes may be sent in batches */
+            if (c->do_shm && c->version >= 36)
+                pa_pstream_enable_batches(c->pstream);
+
             c->shm_type = PA_MEM_TYPE_PRIVATE;
             if (c->do_shm) {
                 if (c->version >= 31 && memfd_on_remote && c->memfd_on_local) {
@@ -1518,6 +1523,7 @@ static void pa_command_enable_srbchannel(pa_pdispatch *pd, uint32_t command, uin
 
     c->srb_template.readfd = ancil->fds[0];
     c->srb_template.writefd = ancil->fds[1];
+    c->srb_template.with_busy_poll = c->version >= 37;
     c->srb_setup_tag = tag;
 
     pa_context_unref(c);
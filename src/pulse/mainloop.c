@@ -36,6 +36,10 @@
 #include <winsock2.h>
 #endif
 
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
 #include <pulse/rtclock.h>
 #include <pulse/timeval.h>
 #include <pulse/xmalloc.h>
@@ -49,6 +53,7 @@
 #include <pulsecore/core-error.h>
 #include <pulsecore/socket.h>
 #include <pulsecore/macro.h>
+#include <pulsecore/idxset.h>
 
 #include "mainloop.h"
 #include "internal.h"
@@ -61,6 +66,12 @@ struct pa_io_event {
     pa_io_event_flags_t events;
     struct pollfd *pollfd;
 
+#ifdef HAVE_SYS_EPOLL_H
+    /* The fd registered with epoll: fd itself, a duplicate of it if
+     * another event watches fd too, or -1 */
+    int registered_fd;
+#endif
+
     pa_io_event_cb_t callback;
     void *userdata;
     pa_io_event_destroy_cb_t destroy_callback;
@@ -76,6 +87,15 @@ struct pa_time_event {
     bool use_rtclock:1;
     pa_usec_t time;
 
+    /* Position in the time heap while enabled, PA_IDXSET_INVALID otherwise */
+    uint32_t heap_idx;
+    unsigned dispatch_serial;
+
+    /* Set while taken out of the heap by dispatch_timeout() after being
+     * rearmed for the past by its own callback */
+    bool parked:1;
+    pa_time_event *parked_next;
+
     pa_time_event_cb_t callback;
     void *userdata;
     pa_time_event_destroy_cb_t destroy_callback;
@@ -108,8 +128,21 @@ struct pa_mainloop {
     struct pollfd *pollfds;
     unsigned max_pollfds, n_pollfds;
 
+#ifdef HAVE_SYS_EPOLL_H
+    /* If this is not -1 all IO events are registered with epoll and
+     * only the epoll fd is polled */
+    int epoll_fd;
+    struct epoll_event *epoll_events;
+    unsigned max_epoll_events;
+    int n_epoll_events;
+#endif
+
+    /* Binary min-heap of the enabled time events */
+    pa_time_event **time_heap;
+    unsigned max_time_heap;
+    unsigned time_dispatch_serial;
+
     pa_usec_t prepared_timeout;
-    pa_time_event *cached_next_time_event;
 
     pa_mainloop_api api;
 
@@ -148,6 +181,143 @@ static pa_io_event_flags_t map_flags_from_libc(short flags) {
         (flags & POLLHUP ? PA_IO_EVENT_HANGUP : 0);
 }
 
+#ifdef HAVE_SYS_EPOLL_H
+static int epoll_register(pa_mainloop *m, pa_io_event *e) {
+    struct epoll_event ev;
+    int fd = e->fd;
+
+    pa_assert(m->epoll_fd >= 0);
+    pa_assert(e->registered_fd < 0);
+
+    pa_zero(ev);
+    ev.events = (uint32_t) map_flags_to_libc(e->events);
+    ev.data.ptr = e;
+
+    if (epoll_ctl(m->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        if (errno != EEXIST)
+            return -1;
+
+        /* epoll can't watch the same fd twice, but duplicates are fine */
+        if ((fd = fcntl(e->fd, F_DUPFD_CLOEXEC, 0)) < 0)
+            return -1;
+
+        if (epoll_ctl(m->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            pa_close(fd);
+            return -1;
+        }
+    }
+
+    e->registered_fd = fd;
+    return 0;
+}
+
+static void epoll_unregister(pa_mainloop *m, pa_io_event *e) {
+    if (e->registered_fd < 0)
+        return;
+
+    /* Fails harmlessly if the fd has been closed already, closing
+     * removes it from the epoll set anyway */
+    epoll_ctl(m->epoll_fd, EPOLL_CTL_DEL, e->registered_fd, NULL);
+
+    if (e->registered_fd != e->fd)
+        pa_close(e->registered_fd);
+
+    e->registered_fd = -1;
+}
+
+/* Go back to poll(), for fds epoll doesn't support like regular files */
+static void epoll_disable(pa_mainloop *m) {
+    pa_io_event *e;
+
+    pa_log_debug("Falling back to poll() for the main loop: %s", pa_cstrerror(errno));
+
+    PA_LLIST_FOREACH(e, m->io_events)
+        epoll_unregister(m, e);
+
+    pa_close(m->epoll_fd);
+    m->epoll_fd = -1;
+    m->n_epoll_events = 0;
+
+    m->rebuild_pollfds = true;
+}
+#endif
+
+static void time_heap_up(pa_mainloop *m, uint32_t i) {
+    pa_time_event *e = m->time_heap[i];
+
+    while (i > 0) {
+        uint32_t parent = (i - 1) / 2;
+
+        if (m->time_heap[parent]->time <= e->time)
+            break;
+
+        m->time_heap[i] = m->time_heap[parent];
+        m->time_heap[i]->heap_idx = i;
+        i = parent;
+    }
+
+    m->time_heap[i] = e;
+    e->heap_idx = i;
+}
+
+static void time_heap_down(pa_mainloop *m, uint32_t i) {
+    pa_time_event *e = m->time_heap[i];
+
+    for (;;) {
+        uint32_t child = 2 * i + 1;
+
+        if (child >= m->n_enabled_time_events)
+            break;
+
+        if (child + 1 < m->n_enabled_time_events && m->time_heap[child + 1]->time < m->time_heap[child]->time)
+            child++;
+
+        if (e->time <= m->time_heap[child]->time)
+            break;
+
+        m->time_heap[i] = m->time_heap[child];
+        m->time_heap[i]->heap_idx = i;
+        i = child;
+    }
+
+    m->time_heap[i] = e;
+    e->heap_idx = i;
+}
+
+/* To be called after n_enabled_time_events has been increased */
+static void time_heap_insert(pa_mainloop *m, pa_time_event *e) {
+    uint32_t i = m->n_enabled_time_events - 1;
+
+    pa_assert(e->heap_idx == PA_IDXSET_INVALID);
+
+    if (m->max_time_heap <= i) {
+        m->max_time_heap = PA_MAX(16U, m->max_time_heap * 2);
+        m->time_heap = pa_xrealloc(m->time_heap, sizeof(pa_time_event*) * m->max_time_heap);
+    }
+
+    m->time_heap[i] = e;
+    time_heap_up(m, i);
+}
+
+/* To be called after n_enabled_time_events has been decreased */
+static void time_heap_remove(pa_mainloop *m, pa_time_event *e) {
+    uint32_t i = e->heap_idx, last = m->n_enabled_time_events;
+    pa_time_event *moved;
+
+    pa_assert(i <= last);
+    pa_assert(m->time_heap[i] == e);
+
+    e->heap_idx = PA_IDXSET_INVALID;
+
+    if (i == last)
+        return;
+
+    /* Fill the hole with the last entry and move that into place */
+    moved = m->time_heap[i] = m->time_heap[last];
+    time_heap_up(m, i);
+    time_heap_down(m, moved->heap_idx);
+}
+
 /* IO events */
 static pa_io_event* mainloop_io_new(
         pa_mainloop_api *a,
@@ -180,6 +350,13 @@ static pa_io_event* mainloop_io_new(
     m->rebuild_pollfds = true;
     m->n_io_events ++;
 
+#ifdef HAVE_SYS_EPOLL_H
+    e->registered_fd = -1;
+
+    if (m->epoll_fd >= 0 && epoll_register(m, e) < 0)
+        epoll_disable(m);
+#endif
+
     pa_mainloop_wakeup(m);
 
     return e;
@@ -194,6 +371,23 @@ static void mainloop_io_enable(pa_io_event *e, pa_io_event_flags_t events) {
 
     e->events = events;
 
+#ifdef HAVE_SYS_EPOLL_H
+    if (e->registered_fd >= 0) {
+        struct epoll_event ev;
+
+        pa_zero(ev);
+        ev.events = (uint32_t) map_flags_to_libc(events);
+        ev.data.ptr = e;
+
+        if (epoll_ctl(e->mainloop->epoll_fd, EPOLL_CTL_MOD, e->registered_fd, &ev) >= 0) {
+            pa_mainloop_wakeup(e->mainloop);
+            return;
+        }
+
+        epoll_disable(e->mainloop);
+    }
+#endif
+
     if (e->pollfd)
         e->pollfd->events = map_flags_to_libc(events);
     else
@@ -212,6 +406,10 @@ static void mainloop_io_free(pa_io_event *e) {
     e->mainloop->n_io_events --;
     e->mainloop->rebuild_pollfds = true;
 
+#ifdef HAVE_SYS_EPOLL_H
+    epoll_unregister(e->mainloop, e);
+#endif
+
     pa_mainloop_wakeup(e->mainloop);
 }
 
@@ -331,19 +529,14 @@ static pa_time_event* mainloop_time_new(
 
     e = pa_xnew0(pa_time_event, 1);
     e->mainloop = m;
+    e->heap_idx = PA_IDXSET_INVALID;
 
     if ((e->enabled = (t != PA_USEC_INVALID))) {
         e->time = t;
         e->use_rtclock = use_rtclock;
 
         m->n_enabled_time_events++;
-
-        if (m->cached_next_time_event) {
-            pa_assert(m->cached_next_time_event->enabled);
-
-            if (t < m->cached_next_time_event->time)
-                m->cached_next_time_event = e;
-        }
+        time_heap_insert(m, e);
     }
 
     e->callback = callback;
@@ -366,28 +559,28 @@ static void mainloop_time_restart(pa_time_event *e, const struct timeval *tv) {
     pa_assert(!e->dead);
 
     t = make_rt(tv, &use_rtclock);
+    e->parked = false;
 
     valid = (t != PA_USEC_INVALID);
     if (e->enabled && !valid) {
         pa_assert(e->mainloop->n_enabled_time_events > 0);
         e->mainloop->n_enabled_time_events--;
+        time_heap_remove(e->mainloop, e);
     } else if (!e->enabled && valid)
         e->mainloop->n_enabled_time_events++;
 
     if ((e->enabled = valid)) {
         e->time = t;
         e->use_rtclock = use_rtclock;
-        pa_mainloop_wakeup(e->mainloop);
-    }
-
-    if (e->mainloop->cached_next_time_event == e)
-        e->mainloop->cached_next_time_event = NULL;
 
-    if (e->mainloop->cached_next_time_event && e->enabled) {
-        pa_assert(e->mainloop->cached_next_time_event->enabled);
+        if (e->heap_idx == PA_IDXSET_INVALID)
+            time_heap_insert(e->mainloop, e);
+        else {
+            time_heap_up(e->mainloop, e->heap_idx);
+            time_heap_down(e->mainloop, e->heap_idx);
+        }
 
-        if (t < e->mainloop->cached_next_time_event->time)
-            e->mainloop->cached_next_time_event = e;
+        pa_mainloop_wakeup(e->mainloop);
     }
 }
 
@@ -396,17 +589,16 @@ static void mainloop_time_free(pa_time_event *e) {
     pa_assert(!e->dead);
 
     e->dead = true;
+    e->parked = false;
     e->mainloop->time_events_please_scan ++;
 
     if (e->enabled) {
         pa_assert(e->mainloop->n_enabled_time_events > 0);
         e->mainloop->n_enabled_time_events--;
+        time_heap_remove(e->mainloop, e);
         e->enabled = false;
     }
 
-    if (e->mainloop->cached_next_time_event == e)
-        e->mainloop->cached_next_time_event = NULL;
-
     /* no wakeup needed here. Think about it! */
 }
 
@@ -478,6 +670,25 @@ pa_mainloop *pa_mainloop_new(void) {
     pa_make_fd_nonblock(m->wakeup_pipe[0]);
     pa_make_fd_nonblock(m->wakeup_pipe[1]);
 
+#ifdef HAVE_SYS_EPOLL_H
+    m->epoll_fd = -1;
+
+    if (!getenv("PULSE_NO_EPOLL")) {
+        if ((m->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) >= 0) {
+            struct epoll_event ev;
+
+            pa_zero(ev);
+            ev.events = EPOLLIN;
+            ev.data.ptr = NULL;
+
+            if (epoll_ctl(m->epoll_fd, EPOLL_CTL_ADD, m->wakeup_pipe[0], &ev) < 0) {
+                pa_close(m->epoll_fd);
+                m->epoll_fd = -1;
+            }
+        }
+    }
+#endif
+
     m->rebuild_pollfds = true;
 
     m->api = vtable;
@@ -506,6 +717,10 @@ static void cleanup_io_events(pa_mainloop *m, bool force) {
                 m->io_events_please_scan--;
             }
 
+#ifdef HAVE_SYS_EPOLL_H
+            epoll_unregister(m, e);
+#endif
+
             if (e->destroy_callback)
                 e->destroy_callback(&m->api, e, e->userdata);
 
@@ -537,6 +752,7 @@ static void cleanup_time_events(pa_mainloop *m, bool force) {
             if (!e->dead && e->enabled) {
                 pa_assert(m->n_enabled_time_events > 0);
                 m->n_enabled_time_events--;
+                time_heap_remove(m, e);
                 e->enabled = false;
             }
 
@@ -590,6 +806,13 @@ void pa_mainloop_free(pa_mainloop *m) {
     cleanup_time_events(m, true);
 
     pa_xfree(m->pollfds);
+    pa_xfree(m->time_heap);
+
+#ifdef HAVE_SYS_EPOLL_H
+    if (m->epoll_fd >= 0)
+        pa_close(m->epoll_fd);
+    pa_xfree(m->epoll_events);
+#endif
 
     pa_close_pipe(m->wakeup_pipe);
 
@@ -620,6 +843,32 @@ static void rebuild_pollfds(pa_mainloop *m) {
     struct pollfd *p;
     unsigned l;
 
+#ifdef HAVE_SYS_EPOLL_H
+    if (m->epoll_fd >= 0) {
+        l = m->n_io_events + 1;
+        if (m->max_epoll_events < l) {
+            l *= 2;
+            m->epoll_events = pa_xrealloc(m->epoll_events, sizeof(struct epoll_event)*l);
+            m->max_epoll_events = l;
+        }
+
+        if (!m->pollfds) {
+            m->pollfds = pa_xnew(struct pollfd, 1);
+            m->max_pollfds = 1;
+        }
+
+        /* Only the epoll fd itself is polled, so that poll functions
+         * set with pa_mainloop_set_poll_func() keep working */
+        m->pollfds[0].fd = m->epoll_fd;
+        m->pollfds[0].events = POLLIN;
+        m->pollfds[0].revents = 0;
+        m->n_pollfds = 1;
+
+        m->rebuild_pollfds = false;
+        return;
+    }
+#endif
+
     l = m->n_io_events + 1;
     if (m->max_pollfds < l) {
         l *= 2;
@@ -682,6 +931,34 @@ static unsigned dispatch_pollfds(pa_mainloop *m) {
     return r;
 }
 
+#ifdef HAVE_SYS_EPOLL_H
+static unsigned dispatch_epoll(pa_mainloop *m) {
+    unsigned r = 0;
+    int i;
+
+    /* A callback may fall back to poll(), which drops the rest */
+    for (i = 0; i < m->n_epoll_events; i++) {
+        pa_io_event *e;
+
+        if (m->quit)
+            break;
+
+        /* The wakeup pipe has no event */
+        if (!(e = m->epoll_events[i].data.ptr) || e->dead)
+            continue;
+
+        pa_assert(e->callback);
+
+        e->callback(&m->api, e, e->fd, map_flags_from_libc((short) m->epoll_events[i].events), e->userdata);
+        r++;
+    }
+
+    m->n_epoll_events = 0;
+
+    return r;
+}
+#endif
+
 static unsigned dispatch_defer(pa_mainloop *m) {
     pa_defer_event *e;
     unsigned r = 0;
@@ -706,28 +983,12 @@ static unsigned dispatch_defer(pa_mainloop *m) {
 }
 
 static pa_time_event* find_next_time_event(pa_mainloop *m) {
-    pa_time_event *t, *n = NULL;
     pa_assert(m);
 
-    if (m->cached_next_time_event)
-        return m->cached_next_time_event;
-
-    PA_LLIST_FOREACH(t, m->time_events) {
-
-        if (t->dead || !t->enabled)
-            continue;
-
-        if (!n || t->time < n->time) {
-            n = t;
-
-            /* Shortcut for time == 0 */
-            if (n->time == 0)
-                break;
-        }
-    }
+    if (m->n_enabled_time_events <= 0)
+        return NULL;
 
-    m->cached_next_time_event = n;
-    return n;
+    return m->time_heap[0];
 }
 
 static pa_usec_t calc_next_timeout(pa_mainloop *m) {
@@ -751,7 +1012,7 @@ static pa_usec_t calc_next_timeout(pa_mainloop *m) {
 }
 
 static unsigned dispatch_timeout(pa_mainloop *m) {
-    pa_time_event *e;
+    pa_time_event *e, *parked = NULL;
     pa_usec_t now;
     unsigned r = 0;
     pa_assert(m);
@@ -760,26 +1021,52 @@ static unsigned dispatch_timeout(pa_mainloop *m) {
         return 0;
 
     now = pa_rtclock_now();
+    m->time_dispatch_serial++;
 
-    PA_LLIST_FOREACH(e, m->time_events) {
+    while ((e = find_next_time_event(m))) {
+        struct timeval tv;
 
         if (m->quit)
             break;
 
-        if (e->dead || !e->enabled)
+        if (e->time > now)
+            break;
+
+        /* Events rearmed for the past by a callback are left for the
+         * next iteration. Take them out of the heap until then, so that
+         * they don't hide the other expired events. */
+        if (e->dispatch_serial == m->time_dispatch_serial) {
+            m->n_enabled_time_events--;
+            time_heap_remove(m, e);
+            e->enabled = false;
+            e->parked = true;
+            e->parked_next = parked;
+            parked = e;
             continue;
+        }
 
-        if (e->time <= now) {
-            struct timeval tv;
-            pa_assert(e->callback);
+        pa_assert(!e->dead);
+        pa_assert(e->callback);
 
-            /* Disable time event */
-            mainloop_time_restart(e, NULL);
+        e->dispatch_serial = m->time_dispatch_serial;
 
-            e->callback(&m->api, e, pa_timeval_rtstore(&tv, e->time, e->use_rtclock), e->userdata);
+        /* Disable time event */
+        mainloop_time_restart(e, NULL);
 
-            r++;
-        }
+        e->callback(&m->api, e, pa_timeval_rtstore(&tv, e->time, e->use_rtclock), e->userdata);
+
+        r++;
+    }
+
+    /* Callbacks might have restarted or freed parked events meanwhile */
+    for (; parked; parked = parked->parked_next) {
+        if (!parked->parked)
+            continue;
+
+        parked->parked = false;
+        parked->enabled = true;
+        m->n_enabled_time_events++;
+        time_heap_insert(m, parked);
     }
 
     return r;
@@ -885,6 +1172,18 @@ int pa_mainloop_poll(pa_mainloop *m) {
             else
                 pa_log("poll(): %s", pa_cstrerror(errno));
         }
+
+#ifdef HAVE_SYS_EPOLL_H
+        if (m->epoll_fd >= 0 && m->poll_func_ret > 0) {
+            if ((m->n_epoll_events = epoll_wait(m->epoll_fd, m->epoll_events, (int) m->max_epoll_events, 0)) < 0) {
+                if (errno != EINTR)
+                    pa_log("epoll_wait(): %s", pa_cstrerror(errno));
+                m->n_epoll_events = 0;
+            }
+
+            m->poll_func_ret = m->n_epoll_events;
+        }
+#endif
     }
 
     m->state = m->poll_func_ret < 0 ? STATE_PASSIVE : STATE_POLLED;
@@ -913,8 +1212,14 @@ int pa_mainloop_dispatch(pa_mainloop *m) {
         if (m->quit)
             goto quit;
 
-        if (m->poll_func_ret > 0)
-            dispatched += dispatch_pollfds(m);
+        if (m->poll_func_ret > 0) {
+#ifdef HAVE_SYS_EPOLL_H
+            if (m->epoll_fd >= 0)
+                dispatched += dispatch_epoll(m);
+            else
+#endif
+                dispatched += dispatch_pollfds(m);
+        }
     }
 
     if (m->quit)
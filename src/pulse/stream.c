@@ -1187,6 +1187,8 @@ void pa_create_stream_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag,
                 0,
                 0,
                 NULL);
+
+        pa_memblockq_enable_ring(s->record_memblockq);
     }
 
     s->channel_valid = true;
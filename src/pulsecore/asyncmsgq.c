@@ -52,7 +52,7 @@ struct asyncmsgq_item {
 struct pa_asyncmsgq {
     PA_REFCNT_DECLARE;
     pa_asyncq *asyncq;
-    pa_mutex *mutex; /* only for the writer side */
+    pa_mutex *mutex; /* only for the writer side, and only for fixed size queues */
 
     struct asyncmsgq_item *current;
 };
@@ -61,7 +61,7 @@ pa_asyncmsgq *pa_asyncmsgq_new(unsigned size) {
     pa_asyncq *asyncq;
     pa_asyncmsgq *a;
 
-    asyncq = pa_asyncq_new(size);
+    asyncq = size > 0 ? pa_asyncq_new(size) : pa_asyncq_new_mp();
     if (!asyncq)
         return NULL;
 
@@ -69,7 +69,9 @@ pa_asyncmsgq *pa_asyncmsgq_new(unsigned size) {
 
     PA_REFCNT_INIT(a);
     a->asyncq = asyncq;
-    pa_assert_se(a->mutex = pa_mutex_new(false, true));
+    a->mutex = NULL;
+    if (size > 0)
+        pa_assert_se(a->mutex = pa_mutex_new(false, true));
     a->current = NULL;
 
     return a;
@@ -97,7 +99,8 @@ static void asyncmsgq_free(pa_asyncmsgq *a) {
     }
 
     pa_asyncq_free(a->asyncq, NULL);
-    pa_mutex_free(a->mutex);
+    if (a->mutex)
+        pa_mutex_free(a->mutex);
     pa_xfree(a);
 }
 
@@ -136,9 +139,11 @@ void pa_asyncmsgq_post(pa_asyncmsgq *a, pa_msgobject *object, int code, const vo
     i->semaphore = NULL;
 
     /* This mutex makes the queue multiple-writer safe. This lock is only used on the writing side */
-    pa_mutex_lock(a->mutex);
+    if (a->mutex)
+        pa_mutex_lock(a->mutex);
     pa_asyncq_post(a->asyncq, i);
-    pa_mutex_unlock(a->mutex);
+    if (a->mutex)
+        pa_mutex_unlock(a->mutex);
 }
 
 int pa_asyncmsgq_send(pa_asyncmsgq *a, pa_msgobject *object, int code, const void *userdata, int64_t offset, const pa_memchunk *chunk) {
@@ -161,9 +166,11 @@ int pa_asyncmsgq_send(pa_asyncmsgq *a, pa_msgobject *object, int code, const voi
         i.semaphore = pa_semaphore_new(0);
 
     /* This mutex makes the queue multiple-writer safe. This lock is only used on the writing side */
-    pa_mutex_lock(a->mutex);
+    if (a->mutex)
+        pa_mutex_lock(a->mutex);
     pa_assert_se(pa_asyncq_push(a->asyncq, &i, true) == 0);
-    pa_mutex_unlock(a->mutex);
+    if (a->mutex)
+        pa_mutex_unlock(a->mutex);
 
     pa_semaphore_wait(i.semaphore);
 
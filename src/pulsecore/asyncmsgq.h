@@ -30,9 +30,15 @@
  * contrast to pa_asyncq this one is multiple-writer safe, though
  * still not multiple-reader safe. This queue is intended to be used
  * for controlling real-time threads from normal-priority
- * threads. Multiple-writer-safety is accomplished by using a mutex on
- * the writer side. This queue is thus not useful for communication
- * between several real-time threads.
+ * threads.
+ *
+ * If size is 0 the queue is based on pa_asyncq_new_mp(): it grows as
+ * needed, writers never block and don't take a lock, and the reader
+ * gets all messages posted since it last woke up in one batch.
+ * Otherwise a fixed size queue is used and multiple-writer-safety is
+ * accomplished by using a mutex on the writer side, which makes such
+ * a queue not useful for communication between several real-time
+ * threads.
  *
  * The queue takes messages consisting of:
  *    "Object" for which this messages is intended (may be NULL)
@@ -64,6 +64,13 @@ struct pa_asyncq {
     PA_LLIST_HEAD(struct localq, localq);
     struct localq *last_localq;
     bool waiting_for_post;
+
+    /* For queues from pa_asyncq_new_mp(): the writers push onto the
+     * inbox stack, the reader takes the whole stack at once and then
+     * pops from the batch in FIFO order. */
+    bool mp;
+    pa_atomic_ptr_t inbox;
+    struct localq *batch;
 };
 
 PA_STATIC_FLIST_DECLARE(localq, 0, pa_xfree);
@@ -104,15 +111,27 @@ pa_asyncq *pa_asyncq_new(unsigned size) {
     return l;
 }
 
+pa_asyncq *pa_asyncq_new_mp(void) {
+    pa_asyncq *l;
+
+    if (!(l = pa_asyncq_new(1)))
+        return NULL;
+
+    l->mp = true;
+
+    return l;
+}
+
 void pa_asyncq_free(pa_asyncq *l, pa_free_cb_t free_cb) {
     struct localq *q;
     pa_assert(l);
 
-    if (free_cb) {
+    if (free_cb || l->mp) {
         void *p;
 
         while ((p = pa_asyncq_pop(l, 0)))
-            free_cb(p);
+            if (free_cb)
+                free_cb(p);
     }
 
     while ((q = l->localq)) {
@@ -130,6 +149,61 @@ void pa_asyncq_free(pa_asyncq *l, pa_free_cb_t free_cb) {
     pa_xfree(l);
 }
 
+static void mp_push(pa_asyncq *l, void *p) {
+    struct localq *q;
+    struct localq *head;
+
+    pa_assert(p);
+
+    if (!(q = pa_flist_pop(PA_STATIC_FLIST_GET(localq))))
+        q = pa_xnew(struct localq, 1);
+
+    q->data = p;
+
+    do {
+        _Y;
+        head = pa_atomic_ptr_load(&l->inbox);
+        q->next = head;
+    } while (!pa_atomic_ptr_cmpxchg(&l->inbox, head, q));
+
+    /* Only the writer that finds the inbox empty has to wake up the
+     * reader, which will then take everything pushed so far at once */
+    if (!head)
+        pa_fdsem_post(l->write_fdsem);
+}
+
+static void* mp_pop(pa_asyncq *l) {
+    struct localq *q;
+    void *ret;
+
+    if (!l->batch) {
+        struct localq *stack;
+
+        do {
+            _Y;
+            stack = pa_atomic_ptr_load(&l->inbox);
+        } while (stack && !pa_atomic_ptr_cmpxchg(&l->inbox, stack, NULL));
+
+        /* The stack is newest first, turn it around */
+        while ((q = stack)) {
+            stack = q->next;
+            q->next = l->batch;
+            l->batch = q;
+        }
+    }
+
+    if (!(q = l->batch))
+        return NULL;
+
+    l->batch = q->next;
+    ret = q->data;
+
+    if (pa_flist_push(PA_STATIC_FLIST_GET(localq), q) < 0)
+        pa_xfree(q);
+
+    return ret;
+}
+
 static int push(pa_asyncq*l, void *p, bool wait_op) {
     unsigned idx;
     pa_atomic_ptr_t *cells;
@@ -186,6 +260,11 @@ static bool flush_postq(pa_asyncq *l, bool wait_op) {
 int pa_asyncq_push(pa_asyncq*l, void *p, bool wait_op) {
     pa_assert(l);
 
+    if (l->mp) {
+        mp_push(l, p);
+        return 0;
+    }
+
     if (!flush_postq(l, wait_op))
         return -1;
 
@@ -198,6 +277,11 @@ void pa_asyncq_post(pa_asyncq*l, void *p) {
     pa_assert(l);
     pa_assert(p);
 
+    if (l->mp) {
+        mp_push(l, p);
+        return;
+    }
+
     if (flush_postq(l, false))
         if (pa_asyncq_push(l, p, false) >= 0)
             return;
@@ -227,6 +311,17 @@ void* pa_asyncq_pop(pa_asyncq*l, bool wait_op) {
 
     pa_assert(l);
 
+    if (l->mp) {
+        while (!(ret = mp_pop(l))) {
+            if (!wait_op)
+                return NULL;
+
+            pa_fdsem_wait(l->write_fdsem);
+        }
+
+        return ret;
+    }
+
     cells = PA_ASYNCQ_CELLS(l);
 
     _Y;
@@ -269,6 +364,16 @@ int pa_asyncq_read_before_poll(pa_asyncq *l) {
 
     pa_assert(l);
 
+    if (l->mp) {
+        for (;;) {
+            if (l->batch || pa_atomic_ptr_load(&l->inbox))
+                return -1;
+
+            if (pa_fdsem_before_poll(l->write_fdsem) >= 0)
+                return 0;
+        }
+    }
+
     cells = PA_ASYNCQ_CELLS(l);
 
     _Y;
@@ -41,6 +41,13 @@
 typedef struct pa_asyncq pa_asyncq;
 
 pa_asyncq* pa_asyncq_new(unsigned size);
+
+/* Create a queue that is multiple-writer safe without a mutex and
+ * that grows as needed instead of having a fixed size, so pushing
+ * never fails or blocks and posting never has to queue locally. The
+ * reader takes everything pushed since its last wakeup in one go.
+ * Still not multiple-reader safe. */
+pa_asyncq* pa_asyncq_new_mp(void);
 void pa_asyncq_free(pa_asyncq* q, pa_free_cb_t free_cb);
 
 void* pa_asyncq_pop(pa_asyncq *q, bool wait);
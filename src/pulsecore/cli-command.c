@@ -57,6 +57,7 @@
 #include <pulsecore/core-error.h>
 #include <pulsecore/modinfo.h>
 #include <pulsecore/dynarray.h>
+#include <pulsecore/flist.h>
 
 #include "cli-command.h"
 
@@ -401,6 +402,41 @@ static int pa_cli_command_stat(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool
                          (unsigned) pa_atomic_load(&mstat->n_allocated_by_type[k]),
                          (unsigned) pa_atomic_load(&mstat->n_accumulated_by_type[k]));
 
+    for (k = 0; k < PA_MEMPOOL_SIZE_CLASSES; k++) {
+        size_t size = pa_mempool_class_size(c->mempool, k);
+        unsigned per_slot = (unsigned) (pa_mempool_class_size(c->mempool, PA_MEMPOOL_SIZE_CLASSES - 1) / size);
+
+        pa_strbuf_printf(buf,
+                         "Memory pool blocks of size %s: %u allocated/%u available.\n",
+                         pa_bytes_snprint(bytes, sizeof(bytes), (unsigned) size),
+                         (unsigned) pa_atomic_load(&mstat->n_allocated_by_class[k]),
+                         (unsigned) pa_atomic_load(&mstat->n_slots_by_class[k]) * per_slot);
+    }
+
+    pa_strbuf_printf(buf, "Memory pool segments: %u.\n",
+                     (unsigned) pa_atomic_load(&mstat->n_segments));
+
+    pa_strbuf_printf(buf, "Memory blocks that fell back to non-shared memory: %u.\n",
+                     (unsigned) pa_atomic_load(&mstat->n_shm_fallbacks));
+
+    for (k = 0; k < pa_flist_n_registered(); k++) {
+        const pa_flist_stat *fstat;
+        pa_flist *l;
+
+        if (!(l = pa_flist_get_registered(k)))
+            continue;
+
+        fstat = pa_flist_get_stat(l);
+        pa_strbuf_printf(buf,
+                         "Free list %s: %u thread cache hits/%u shared/%u empty/%u full, %u contended.\n",
+                         pa_flist_get_name(l),
+                         (unsigned) pa_atomic_load(&fstat->n_hits),
+                         (unsigned) pa_atomic_load(&fstat->n_shared),
+                         (unsigned) pa_atomic_load(&fstat->n_misses),
+                         (unsigned) pa_atomic_load(&fstat->n_full),
+                         (unsigned) pa_atomic_load(&fstat->n_contended));
+    }
+
     return 0;
 }
 
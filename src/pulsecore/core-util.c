@@ -3338,6 +3338,127 @@ unsigned pa_ncpus(void) {
     return ncpus <= 0 ? 1 : (unsigned) ncpus;
 }
 
+void pa_cpu_set_clear(pa_cpu_set *s) {
+    pa_assert(s);
+
+    pa_zero(*s);
+}
+
+void pa_cpu_set_add(pa_cpu_set *s, unsigned cpu) {
+    pa_assert(s);
+    pa_assert(cpu < PA_CPU_SET_MAX);
+
+    s->bits[cpu / 32] |= 1U << (cpu % 32);
+}
+
+bool pa_cpu_set_contains(const pa_cpu_set *s, unsigned cpu) {
+    pa_assert(s);
+
+    if (cpu >= PA_CPU_SET_MAX)
+        return false;
+
+    return !!(s->bits[cpu / 32] & (1U << (cpu % 32)));
+}
+
+unsigned pa_cpu_set_count(const pa_cpu_set *s) {
+    unsigned k, n = 0;
+
+    pa_assert(s);
+
+    for (k = 0; k < PA_ELEMENTSOF(s->bits); k++) {
+        uint32_t v;
+
+        for (v = s->bits[k]; v; v &= v - 1)
+            n++;
+    }
+
+    return n;
+}
+
+int pa_cpu_set_nth(const pa_cpu_set *s, unsigned n) {
+    unsigned count, cpu;
+
+    pa_assert(s);
+
+    if ((count = pa_cpu_set_count(s)) == 0)
+        return -1;
+
+    n %= count;
+
+    for (cpu = 0; cpu < PA_CPU_SET_MAX; cpu++)
+        if (pa_cpu_set_contains(s, cpu) && n-- == 0)
+            return (int) cpu;
+
+    pa_assert_not_reached();
+}
+
+int pa_cpu_set_parse(pa_cpu_set *s, const char *list) {
+    const char *state = NULL;
+    char *range;
+
+    pa_assert(s);
+    pa_assert(list);
+
+    pa_cpu_set_clear(s);
+
+    while ((range = pa_split(list, ",", &state))) {
+        uint32_t first, last;
+        char *dash;
+        int r;
+
+        if ((dash = strchr(range, '-'))) {
+            *dash = 0;
+            r = pa_atou(pa_strip(range), &first) < 0 || pa_atou(pa_strip(dash + 1), &last) < 0 ? -1 : 0;
+        } else {
+            r = pa_atou(pa_strip(range), &first);
+            last = first;
+        }
+
+        pa_xfree(range);
+
+        if (r < 0 || first > last || last >= PA_CPU_SET_MAX)
+            return -1;
+
+        for (; first <= last; first++)
+            pa_cpu_set_add(s, first);
+    }
+
+    return pa_cpu_set_count(s) > 0 ? 0 : -1;
+}
+
+char *pa_cpu_set_to_string(const pa_cpu_set *s) {
+    pa_strbuf *buf;
+    unsigned cpu = 0;
+
+    pa_assert(s);
+
+    buf = pa_strbuf_new();
+
+    while (cpu < PA_CPU_SET_MAX) {
+        unsigned last;
+
+        if (!pa_cpu_set_contains(s, cpu)) {
+            cpu++;
+            continue;
+        }
+
+        for (last = cpu; pa_cpu_set_contains(s, last + 1); last++)
+            ;
+
+        if (!pa_strbuf_isempty(buf))
+            pa_strbuf_puts(buf, ",");
+
+        if (last > cpu)
+            pa_strbuf_printf(buf, "%u-%u", cpu, last);
+        else
+            pa_strbuf_printf(buf, "%u", cpu);
+
+        cpu = last + 1;
+    }
+
+    return pa_strbuf_to_string_free(buf);
+}
+
 char *pa_replace(const char*s, const char*a, const char *b) {
     pa_strbuf *sb;
     size_t an;
@@ -259,6 +259,30 @@ void pa_reduce(unsigned *num, unsigned *den);
 
 unsigned pa_ncpus(void);
 
+/* A set of CPUs, for thread affinity */
+#define PA_CPU_SET_MAX 1024
+
+typedef struct pa_cpu_set {
+    uint32_t bits[PA_CPU_SET_MAX / 32];
+} pa_cpu_set;
+
+void pa_cpu_set_clear(pa_cpu_set *s);
+void pa_cpu_set_add(pa_cpu_set *s, unsigned cpu);
+bool pa_cpu_set_contains(const pa_cpu_set *s, unsigned cpu);
+unsigned pa_cpu_set_count(const pa_cpu_set *s);
+
+/* Returns the n-th CPU of the set, counting around, or -1 if the set
+ * is empty */
+int pa_cpu_set_nth(const pa_cpu_set *s, unsigned n);
+
+/* Parses a list of CPUs and CPU ranges like "0-3,6". Returns negative
+ * if the list is invalid or empty. */
+int pa_cpu_set_parse(pa_cpu_set *s, const char *list);
+
+/* Formats the set the way pa_cpu_set_parse() reads it. The caller has
+ * to free the returned string. */
+char *pa_cpu_set_to_string(const pa_cpu_set *s);
+
 /* Replaces all occurrences of `a' in `s' with `b'. The caller has to free the
  * returned string. All parameters must be non-NULL and additionally `a' must
  * not be a zero-length string.
@@ -22,6 +22,7 @@
 #include <config.h>
 #endif
 
+#include <errno.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <signal.h>
@@ -31,6 +32,7 @@
 #include <pulse/xmalloc.h>
 
 #include <pulsecore/module.h>
+#include <pulsecore/core-error.h>
 #include <pulsecore/core-rtclock.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/message-handler.h>
@@ -41,6 +43,7 @@
 #include <pulsecore/macro.h>
 #include <pulsecore/strbuf.h>
 #include <pulsecore/namereg.h>
+#include <pulsecore/thread-mq.h>
 
 #include "core.h"
 
@@ -57,6 +60,10 @@ static int core_process_msg(pa_msgobject *o, int code, void *userdata, int64_t o
             pa_module_unload(userdata, true);
             return 0;
 
+        case PA_CORE_MESSAGE_GROW_MEMPOOL:
+            pa_mempool_grow(c->mempool);
+            return 0;
+
         default:
             return -1;
     }
@@ -64,6 +71,18 @@ static int core_process_msg(pa_msgobject *o, int code, void *userdata, int64_t o
 
 static void core_free(pa_object *o);
 
+/* Called from whichever thread allocates from the mempool. IO threads
+ * leave mapping the next segment to the main thread. */
+static void mempool_grow_cb(pa_mempool *p, void *userdata) {
+    pa_core *c = userdata;
+    pa_thread_mq *q;
+
+    if ((q = pa_thread_mq_get()))
+        pa_asyncmsgq_post(q->outq, PA_MSGOBJECT(c), PA_CORE_MESSAGE_GROW_MEMPOOL, NULL, 0, NULL, NULL);
+    else
+        pa_mempool_grow(p);
+}
+
 /* Returns a list of handlers. */
 static char *message_handler_list(pa_core *c) {
     pa_json_encoder *encoder;
@@ -175,7 +194,9 @@ pa_core* pa_core_new(pa_mainloop_api *m, bool shared, bool enable_memfd, size_t
 
     c->mempool = pool;
     c->shm_size = shm_size;
+    pa_mempool_set_grow_callback(pool, mempool_grow_cb, c);
     pa_silence_cache_init(&c->silence_cache);
+    c->resampler_cache = pa_resampler_cache_new();
 
     c->exit_event = NULL;
     c->scache_auto_unload_event = NULL;
@@ -270,6 +291,7 @@ static void core_free(pa_object *o) {
     pa_xfree(c->policy_default_sink);
 
     pa_silence_cache_done(&c->silence_cache);
+    pa_resampler_cache_free(c->resampler_cache);
     pa_mempool_unref(c->mempool);
 
     for (j = 0; j < PA_CORE_HOOK_MAX; j++)
@@ -610,6 +632,119 @@ static void exit_callback(pa_mainloop_api *m, pa_time_event *e, const struct tim
     pa_core_exit(c, true, 0);
 }
 
+int pa_core_set_cpu_affinity(pa_core *c, const char *main_thread_cpus, const char *io_thread_cpus) {
+    pa_cpu_set all, main_cpus, io_cpus;
+    char *t;
+
+    pa_assert(c);
+
+    if (!main_thread_cpus && !io_thread_cpus)
+        return 0;
+
+    if (pa_thread_get_affinity(NULL, &all) < 0) {
+        pa_log_warn("Thread affinity is not supported: %s", pa_cstrerror(errno));
+        return -1;
+    }
+
+    pa_cpu_set_clear(&main_cpus);
+    pa_cpu_set_clear(&io_cpus);
+
+    if (main_thread_cpus) {
+        if (pa_streq(main_thread_cpus, "auto")) {
+            if (pa_cpu_set_count(&all) >= 2)
+                pa_cpu_set_add(&main_cpus, (unsigned) pa_cpu_set_nth(&all, 0));
+        } else if (pa_cpu_set_parse(&main_cpus, main_thread_cpus) < 0) {
+            pa_log("Invalid main thread CPU list '%s'.", main_thread_cpus);
+            return -1;
+        }
+    }
+
+    if (io_thread_cpus) {
+        if (pa_streq(io_thread_cpus, "auto")) {
+            pa_cpu_set exclude;
+            unsigned cpu;
+
+            /* Keep away from the main thread, unless that leaves nothing.
+             * If it isn't pinned, leave it the first CPU without pinning
+             * it there. */
+            exclude = main_cpus;
+            if (!main_thread_cpus && pa_cpu_set_count(&all) >= 2)
+                pa_cpu_set_add(&exclude, (unsigned) pa_cpu_set_nth(&all, 0));
+
+            for (cpu = 0; cpu < PA_CPU_SET_MAX; cpu++)
+                if (pa_cpu_set_contains(&all, cpu) && !pa_cpu_set_contains(&exclude, cpu))
+                    pa_cpu_set_add(&io_cpus, cpu);
+
+            if (pa_cpu_set_count(&io_cpus) == 0)
+                io_cpus = all;
+        } else if (pa_cpu_set_parse(&io_cpus, io_thread_cpus) < 0) {
+            pa_log("Invalid IO thread CPU list '%s'.", io_thread_cpus);
+            return -1;
+        }
+    }
+
+    if (pa_cpu_set_count(&main_cpus) > 0) {
+        /* Other threads would inherit the affinity of the main thread */
+        pa_thread_set_default_affinity(&all);
+
+        if (pa_thread_set_affinity(NULL, &main_cpus) < 0) {
+            pa_log_warn("Failed to pin the main thread: %s", pa_cstrerror(errno));
+            pa_thread_set_default_affinity(NULL);
+            return -1;
+        }
+
+        t = pa_cpu_set_to_string(&main_cpus);
+        pa_log_info("Main thread runs on CPUs %s.", t);
+        pa_xfree(t);
+    }
+
+    if (pa_cpu_set_count(&io_cpus) > 0) {
+        t = pa_cpu_set_to_string(&io_cpus);
+        pa_log_info("Device IO threads are spread over CPUs %s.", t);
+        pa_xfree(t);
+    }
+
+    c->io_thread_cpus = io_cpus;
+    c->n_io_threads_placed = 0;
+
+    return 0;
+}
+
+void pa_core_place_io_thread(pa_core *c, pa_thread *t, const pa_cpu_set *cpus, pa_proplist *p) {
+    pa_cpu_set s;
+    char *l;
+
+    pa_assert(c);
+    pa_assert(t);
+
+    if (cpus && pa_cpu_set_count(cpus) > 0)
+        s = *cpus;
+    else {
+        int cpu;
+
+        if ((cpu = pa_cpu_set_nth(&c->io_thread_cpus, c->n_io_threads_placed)) < 0)
+            return;
+
+        c->n_io_threads_placed++;
+
+        pa_cpu_set_clear(&s);
+        pa_cpu_set_add(&s, (unsigned) cpu);
+    }
+
+    l = pa_cpu_set_to_string(&s);
+
+    if (pa_thread_set_affinity(t, &s) < 0)
+        pa_log_warn("Failed to pin thread %s to CPUs %s: %s", pa_strnull(pa_thread_get_name(t)), l, pa_cstrerror(errno));
+    else {
+        pa_log_debug("Pinned thread %s to CPUs %s.", pa_strnull(pa_thread_get_name(t)), l);
+
+        if (p)
+            pa_proplist_sets(p, PA_CORE_PROP_IO_THREAD_CPUS, l);
+    }
+
+    pa_xfree(l);
+}
+
 void pa_core_check_idle(pa_core *c) {
     pa_assert(c);
 
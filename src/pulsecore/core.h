@@ -48,6 +48,8 @@ typedef enum pa_suspend_cause {
 #include <pulsecore/llist.h>
 #include <pulsecore/hook-list.h>
 #include <pulsecore/asyncmsgq.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/thread.h>
 #include <pulsecore/sample-util.h>
 #include <pulsecore/sink.h>
 #include <pulsecore/source.h>
@@ -216,6 +218,9 @@ struct pa_core {
 
     pa_silence_cache silence_cache;
 
+    /* Filter tables shared between the resamplers of all streams */
+    pa_resampler_cache *resampler_cache;
+
     pa_time_event *exit_event;
     pa_time_event *scache_auto_unload_event;
 
@@ -228,6 +233,7 @@ struct pa_core {
     bool running_as_daemon:1;
     bool realtime_scheduling:1;
     bool avoid_resampling:1;
+    bool wide_mixing:1;
     bool disable_remixing:1;
     bool remixing_use_all_sink_channels:1;
     bool remixing_produce_lfe:1;
@@ -240,6 +246,11 @@ struct pa_core {
     pa_server_type_t server_type;
     pa_cpu_info cpu_info;
 
+    /* CPUs the IO threads of devices are spread over one by one, empty
+     * if they aren't pinned */
+    pa_cpu_set io_thread_cpus;
+    unsigned n_io_threads_placed;
+
     /* hooks */
     pa_hook hooks[PA_CORE_HOOK_MAX];
 };
@@ -249,6 +260,7 @@ PA_DECLARE_PUBLIC_CLASS(pa_core);
 
 enum {
     PA_CORE_MESSAGE_UNLOAD_MODULE,
+    PA_CORE_MESSAGE_GROW_MEMPOOL,
     PA_CORE_MESSAGE_MAX
 };
 
@@ -291,6 +303,24 @@ static const size_t PA_SUSPEND_CAUSE_TO_STRING_BUF_SIZE =
  * provided buffer. The same buffer is the return value of this function. */
 const char *pa_suspend_cause_to_string(pa_suspend_cause_t cause, char buf[PA_SUSPEND_CAUSE_TO_STRING_BUF_SIZE]);
 
+/* Pins the main thread and sets the CPUs for device IO threads. Each
+ * list is either NULL, for no pinning, "auto" or a list of CPUs as
+ * parsed by pa_cpu_set_parse(). "auto" puts the main thread on the
+ * first CPU of the process, and spreads the IO threads over the CPUs
+ * other than the main thread's, or other than the first one if the
+ * main thread is not pinned. */
+int pa_core_set_cpu_affinity(pa_core *c, const char *main_thread_cpus, const char *io_thread_cpus);
+
+/* The property that reports the CPUs the IO thread of a device is
+ * pinned to */
+#define PA_CORE_PROP_IO_THREAD_CPUS "device.io_thread.cpus"
+
+/* Pins the IO thread of a device to the given CPUs, usually parsed
+ * from the cpu_affinity module argument. If cpus is NULL or empty the
+ * thread gets the next of the IO thread CPUs of the core, if there are
+ * any. The placement is recorded in the proplist, if given. */
+void pa_core_place_io_thread(pa_core *c, pa_thread *t, const pa_cpu_set *cpus, pa_proplist *p);
+
 void pa_core_move_streams_to_newly_available_preferred_sink(pa_core *c, pa_sink *s);
 
 void pa_core_move_streams_to_newly_available_preferred_source(pa_core *c, pa_source *s);
@@ -32,10 +32,23 @@
 
 #include "cpu-x86.h"
 
+#if (defined(__i386__) || defined(__amd64__)) && defined(HAVE_CPUID_H)
+/* Read the extended control register 0, which tells us which register
+ * states the OS saves and restores on context switches. */
+static uint64_t get_xcr0(void) {
+    uint32_t eax, edx;
+
+    __asm__ __volatile__ (".byte 0x0f, 0x01, 0xd0" : "=a" (eax), "=d" (edx) : "c" (0));
+
+    return ((uint64_t) edx << 32) | eax;
+}
+#endif
+
 void pa_cpu_get_x86_flags(pa_cpu_x86_flag_t *flags) {
 #if (defined(__i386__) || defined(__amd64__)) && defined(HAVE_CPUID_H)
     uint32_t eax, ebx, ecx, edx;
     uint32_t level;
+    bool os_avx = false, os_avx512 = false;
 
     *flags = 0;
 
@@ -70,6 +83,36 @@ void pa_cpu_get_x86_flags(pa_cpu_x86_flag_t *flags) {
 
         if (ecx & (1<<20))
           *flags |= PA_CPU_X86_SSE4_2;
+
+        /* AVX is only usable if the OS has enabled XSAVE and preserves
+         * the SSE and AVX register state */
+        if (ecx & (1<<27)) {
+            uint64_t xcr0 = get_xcr0();
+
+            os_avx = (xcr0 & 0x6) == 0x6;
+
+            /* AVX-512 additionally needs the opmask and upper ZMM state */
+            os_avx512 = (xcr0 & 0xE6) == 0xE6;
+        }
+
+        if (os_avx && (ecx & (1<<28)))
+          *flags |= PA_CPU_X86_AVX;
+
+        if (os_avx && (ecx & (1<<12)))
+          *flags |= PA_CPU_X86_FMA;
+    }
+
+    if (level >= 7) {
+        __cpuid_count(0x00000007, 0, eax, ebx, ecx, edx);
+
+        if (os_avx && (ebx & (1<<5)))
+          *flags |= PA_CPU_X86_AVX2;
+
+        if (os_avx512 && (ebx & (1<<16)))
+          *flags |= PA_CPU_X86_AVX512F;
+
+        if (os_avx512 && (ebx & (1<<16)) && (ebx & (1<<30)))
+          *flags |= PA_CPU_X86_AVX512BW;
     }
 
     /* get extended level */
@@ -94,7 +137,7 @@ void pa_cpu_get_x86_flags(pa_cpu_x86_flag_t *flags) {
     }
 
 finish:
-    pa_log_info("CPU flags: %s%s%s%s%s%s%s%s%s%s%s",
+    pa_log_info("CPU flags: %s%s%s%s%s%s%s%s%s%s%s%s%s%s%s%s",
     (*flags & PA_CPU_X86_CMOV) ? "CMOV " : "",
     (*flags & PA_CPU_X86_MMX) ? "MMX " : "",
     (*flags & PA_CPU_X86_SSE) ? "SSE " : "",
@@ -103,6 +146,11 @@ finish:
     (*flags & PA_CPU_X86_SSSE3) ? "SSSE3 " : "",
     (*flags & PA_CPU_X86_SSE4_1) ? "SSE4_1 " : "",
     (*flags & PA_CPU_X86_SSE4_2) ? "SSE4_2 " : "",
+    (*flags & PA_CPU_X86_AVX) ? "AVX " : "",
+    (*flags & PA_CPU_X86_AVX2) ? "AVX2 " : "",
+    (*flags & PA_CPU_X86_FMA) ? "FMA " : "",
+    (*flags & PA_CPU_X86_AVX512F) ? "AVX512F " : "",
+    (*flags & PA_CPU_X86_AVX512BW) ? "AVX512BW " : "",
     (*flags & PA_CPU_X86_MMXEXT) ? "MMXEXT " : "",
     (*flags & PA_CPU_X86_3DNOW) ? "3DNOW " : "",
     (*flags & PA_CPU_X86_3DNOWEXT) ? "3DNOWEXT " : "");
@@ -124,8 +172,35 @@ bool pa_cpu_init_x86(pa_cpu_x86_flag_t *flags) {
 #ifdef HAVE_SSE
     if (*flags & (PA_CPU_X86_SSE | PA_CPU_X86_SSE2)) {
         pa_volume_func_init_sse(*flags);
-        pa_remap_func_init_sse(*flags);
         pa_convert_func_init_sse(*flags);
+        pa_polyphase_func_init_sse(*flags);
+    }
+#endif
+
+#ifdef HAVE_SSE2
+    if (*flags & PA_CPU_X86_SSE2) {
+        pa_remap_func_init_sse(*flags);
+        pa_convert_func_init_sse2(*flags);
+        pa_mix_func_init_sse(*flags);
+    }
+#endif
+
+    /* Each of the following tiers only replaces the functions it has a
+     * faster version of, and the narrower ones stay in place as fallback */
+#ifdef HAVE_AVX2
+    if (*flags & PA_CPU_X86_AVX2) {
+        pa_volume_func_init_avx2(*flags);
+        pa_remap_func_init_avx2(*flags);
+        pa_convert_func_init_avx2(*flags);
+        pa_mix_func_init_avx2(*flags);
+        pa_polyphase_func_init_avx2(*flags);
+    }
+#endif
+
+#ifdef HAVE_AVX512
+    if (*flags & (PA_CPU_X86_AVX512F | PA_CPU_X86_AVX512BW)) {
+        pa_volume_func_init_avx512(*flags);
+        pa_convert_func_init_avx512(*flags);
     }
 #endif
 
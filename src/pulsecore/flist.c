@@ -25,6 +25,8 @@
 #include <config.h>
 #endif
 
+#include <string.h>
+
 #include <pulse/xmalloc.h>
 
 #include <pulsecore/atomic.h>
@@ -32,11 +34,17 @@
 #include <pulsecore/macro.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/macro.h>
+#include <pulsecore/thread.h>
 
 #include "flist.h"
 
 #define FLIST_SIZE 256
 
+/* How many free lists can have a per-thread cache, and how many
+ * entries each thread keeps for each of them */
+#define FLIST_THREAD_CACHE_LISTS 32
+#define FLIST_THREAD_CACHE_SIZE 32
+
 /* Atomic table indices contain
    sign bit = if set, indicates empty/NULL value
    tag bits (to avoid the ABA problem)
@@ -64,21 +72,58 @@ struct pa_flist {
     pa_atomic_t stored;
     /* Stack that contains empty list elements */
     pa_atomic_t empty;
+
+    /* Index into the per-thread caches, or -1 if there is none */
+    int cache_idx;
+    pa_free_cb_t free_cb;
+
+    pa_flist_stat stat;
+
     pa_flist_elem table[];
 };
 
+struct flist_thread_cache {
+    struct {
+        unsigned n_items;
+        /* Not yet added to pa_flist_stat, to keep the fast path free
+         * of shared writes */
+        unsigned n_hits;
+        void *items[FLIST_THREAD_CACHE_SIZE];
+    } lists[FLIST_THREAD_CACHE_LISTS];
+};
+
+static void thread_cache_free(void *userdata);
+
+PA_STATIC_TLS_DECLARE(flist_thread_cache, thread_cache_free);
+
+/* The free lists with a per-thread cache, by cache index */
+static pa_atomic_ptr_t registry[FLIST_THREAD_CACHE_LISTS];
+static pa_atomic_t n_registered = PA_ATOMIC_INIT(0);
+
+/* Only the lists with a thread cache are registered for statistics, so
+ * the others are kept free of the shared counter writes */
+static inline void stat_inc(pa_flist *l, pa_atomic_t *counter) {
+    if (l->cache_idx >= 0)
+        pa_atomic_inc(counter);
+}
+
 /* Lock free pop from linked list stack */
 static pa_flist_elem *stack_pop(pa_flist *flist, pa_atomic_t *list) {
     pa_flist_elem *popped;
     int idx;
     pa_assert(list);
 
-    do {
+    for (;;) {
         idx = pa_atomic_load(list);
         if (idx < 0)
             return NULL;
         popped = &flist->table[idx & flist->index_mask];
-    } while (!pa_atomic_cmpxchg(list, idx, pa_atomic_load(&popped->next)));
+
+        if (pa_atomic_cmpxchg(list, idx, pa_atomic_load(&popped->next)))
+            break;
+
+        stat_inc(flist, &flist->stat.n_contended);
+    }
 
     return popped;
 }
@@ -93,10 +138,93 @@ static void stack_push(pa_flist *flist, pa_atomic_t *list, pa_flist_elem *new_el
     pa_assert(newindex >= 0 && newindex < (int) flist->size);
     newindex |= (tag << flist->tag_shift) & flist->tag_mask;
 
-    do {
+    for (;;) {
         next = pa_atomic_load(list);
         pa_atomic_store(&new_elem->next, next);
-    } while (!pa_atomic_cmpxchg(list, next, newindex));
+
+        if (pa_atomic_cmpxchg(list, next, newindex))
+            break;
+
+        stat_inc(flist, &flist->stat.n_contended);
+    }
+}
+
+static int shared_push(pa_flist *l, void *p) {
+    pa_flist_elem *elem;
+
+    elem = stack_pop(l, &l->empty);
+    if (elem == NULL) {
+        if (pa_log_ratelimit(PA_LOG_DEBUG))
+            pa_log_debug("%s flist is full (don't worry)", l->name);
+        stat_inc(l, &l->stat.n_full);
+        return -1;
+    }
+    pa_atomic_ptr_store(&elem->ptr, p);
+    stack_push(l, &l->stored, elem);
+
+    return 0;
+}
+
+static void* shared_pop(pa_flist *l) {
+    pa_flist_elem *elem;
+    void *ptr;
+
+    elem = stack_pop(l, &l->stored);
+    if (elem == NULL)
+        return NULL;
+
+    ptr = pa_atomic_ptr_load(&elem->ptr);
+
+    stack_push(l, &l->empty, elem);
+
+    return ptr;
+}
+
+static struct flist_thread_cache *thread_cache_get(pa_flist *l, bool create) {
+    struct flist_thread_cache *cache;
+
+    if (l->cache_idx < 0)
+        return NULL;
+
+    if (!(cache = PA_STATIC_TLS_GET(flist_thread_cache)) && create) {
+        cache = pa_xnew0(struct flist_thread_cache, 1);
+        PA_STATIC_TLS_SET(flist_thread_cache, cache);
+    }
+
+    return cache;
+}
+
+/* Give the n oldest cached entries back to the shared list */
+static void thread_cache_spill(struct flist_thread_cache *cache, pa_flist *l, unsigned n) {
+    unsigned i, k = (unsigned) l->cache_idx;
+
+    pa_assert(n <= cache->lists[k].n_items);
+
+    for (i = 0; i < n; i++)
+        if (shared_push(l, cache->lists[k].items[i]) < 0 && l->free_cb)
+            l->free_cb(cache->lists[k].items[i]);
+
+    memmove(cache->lists[k].items, cache->lists[k].items + n, (cache->lists[k].n_items - n) * sizeof(void*));
+    cache->lists[k].n_items -= n;
+
+    pa_atomic_add(&l->stat.n_hits, (int) cache->lists[k].n_hits);
+    cache->lists[k].n_hits = 0;
+}
+
+static void thread_cache_free(void *userdata) {
+    struct flist_thread_cache *cache = userdata;
+    unsigned k;
+
+    for (k = 0; k < FLIST_THREAD_CACHE_LISTS; k++) {
+        pa_flist *l;
+
+        if (!(l = pa_atomic_ptr_load(&registry[k])))
+            continue;
+
+        thread_cache_spill(cache, l, cache->lists[k].n_items);
+    }
+
+    pa_xfree(cache);
 }
 
 pa_flist *pa_flist_new_with_name(unsigned size, const char *name) {
@@ -111,6 +239,7 @@ pa_flist *pa_flist_new_with_name(unsigned size, const char *name) {
 
     l->name = pa_xstrdup(name);
     l->size = size;
+    l->cache_idx = -1;
 
     while (1 << l->tag_shift < (int) size)
         l->tag_shift++;
@@ -129,10 +258,44 @@ pa_flist *pa_flist_new(unsigned size) {
     return pa_flist_new_with_name(size, "unknown");
 }
 
+pa_flist *pa_flist_new_with_thread_cache(unsigned size, const char *name, pa_free_cb_t free_cb) {
+    pa_flist *l;
+    int idx;
+
+    l = pa_flist_new_with_name(size, name);
+    l->free_cb = free_cb;
+
+    if ((idx = pa_atomic_inc(&n_registered)) < FLIST_THREAD_CACHE_LISTS) {
+        l->cache_idx = idx;
+        pa_atomic_ptr_store(&registry[idx], l);
+    } else
+        pa_log_debug("%s flist gets no thread cache", name);
+
+    return l;
+}
+
 void pa_flist_free(pa_flist *l, pa_free_cb_t free_cb) {
+    struct flist_thread_cache *cache;
+
     pa_assert(l);
     pa_assert(l->name);
 
+    if (l->cache_idx >= 0) {
+        pa_atomic_ptr_store(&registry[l->cache_idx], NULL);
+
+        /* Entries cached by other threads are lost, which is only an
+         * issue for valgrind runs */
+        if ((cache = thread_cache_get(l, false))) {
+            unsigned i;
+
+            for (i = 0; i < cache->lists[l->cache_idx].n_items; i++)
+                if (free_cb)
+                    free_cb(cache->lists[l->cache_idx].items[i]);
+
+            cache->lists[l->cache_idx].n_items = 0;
+        }
+    }
+
     if (free_cb) {
         pa_flist_elem *elem;
         while((elem = stack_pop(l, &l->stored)))
@@ -144,34 +307,72 @@ void pa_flist_free(pa_flist *l, pa_free_cb_t free_cb) {
 }
 
 int pa_flist_push(pa_flist *l, void *p) {
-    pa_flist_elem *elem;
+    struct flist_thread_cache *cache;
     pa_assert(l);
     pa_assert(p);
 
-    elem = stack_pop(l, &l->empty);
-    if (elem == NULL) {
-        if (pa_log_ratelimit(PA_LOG_DEBUG))
-            pa_log_debug("%s flist is full (don't worry)", l->name);
-        return -1;
+    if ((cache = thread_cache_get(l, true))) {
+        unsigned k = (unsigned) l->cache_idx;
+
+        if (cache->lists[k].n_items >= FLIST_THREAD_CACHE_SIZE)
+            thread_cache_spill(cache, l, FLIST_THREAD_CACHE_SIZE / 2);
+
+        cache->lists[k].items[cache->lists[k].n_items++] = p;
+        return 0;
     }
-    pa_atomic_ptr_store(&elem->ptr, p);
-    stack_push(l, &l->stored, elem);
 
-    return 0;
+    return shared_push(l, p);
 }
 
 void* pa_flist_pop(pa_flist *l) {
-    pa_flist_elem *elem;
+    struct flist_thread_cache *cache;
     void *ptr;
     pa_assert(l);
 
-    elem = stack_pop(l, &l->stored);
-    if (elem == NULL)
+    if ((cache = thread_cache_get(l, true))) {
+        unsigned k = (unsigned) l->cache_idx;
+
+        if (cache->lists[k].n_items > 0) {
+            cache->lists[k].n_hits++;
+            return cache->lists[k].items[--cache->lists[k].n_items];
+        }
+
+        /* Refill half of the cache, we are about to take one */
+        pa_atomic_inc(&l->stat.n_shared);
+        pa_atomic_add(&l->stat.n_hits, (int) cache->lists[k].n_hits);
+        cache->lists[k].n_hits = 0;
+
+        while (cache->lists[k].n_items < FLIST_THREAD_CACHE_SIZE / 2 && (ptr = shared_pop(l)))
+            cache->lists[k].items[cache->lists[k].n_items++] = ptr;
+
+        if (cache->lists[k].n_items > 0)
+            return cache->lists[k].items[--cache->lists[k].n_items];
+
+        pa_atomic_inc(&l->stat.n_misses);
         return NULL;
+    }
 
-    ptr = pa_atomic_ptr_load(&elem->ptr);
+    return shared_pop(l);
+}
 
-    stack_push(l, &l->empty, elem);
+const pa_flist_stat* pa_flist_get_stat(pa_flist *l) {
+    pa_assert(l);
 
-    return ptr;
+    return &l->stat;
+}
+
+const char *pa_flist_get_name(pa_flist *l) {
+    pa_assert(l);
+
+    return l->name;
+}
+
+unsigned pa_flist_n_registered(void) {
+    return PA_MIN((unsigned) pa_atomic_load(&n_registered), FLIST_THREAD_CACHE_LISTS);
+}
+
+pa_flist *pa_flist_get_registered(unsigned idx) {
+    pa_assert(idx < FLIST_THREAD_CACHE_LISTS);
+
+    return pa_atomic_ptr_load(&registry[idx]);
 }
@@ -25,21 +25,47 @@
 
 #include <pulsecore/once.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/atomic.h>
 
 /* A multiple-reader multipler-write lock-free free list implementation */
 
 typedef struct pa_flist pa_flist;
 
+/* Please note that updates to this structure are not locked,
+ * i.e. n_hits might be updated from another thread while
+ * n_shared isn't yet. The counters are only maintained for lists
+ * with a thread cache. */
+typedef struct pa_flist_stat {
+    pa_atomic_t n_hits;      /* pops served from a thread cache, added up lazily */
+    pa_atomic_t n_shared;    /* pops that went to the shared list */
+    pa_atomic_t n_misses;    /* pops that found the list empty */
+    pa_atomic_t n_full;      /* pushes that found the list full */
+    pa_atomic_t n_contended; /* retries because another thread got in between */
+} pa_flist_stat;
+
 pa_flist * pa_flist_new(unsigned size);
 /* Name string is copied and added to flist structure. The original is
  * responsibility of the caller. The name is only used for debug printing. */
 pa_flist * pa_flist_new_with_name(unsigned size, const char *name);
+/* Put a small per-thread cache in front of the shared list, which
+ * overflows into it and refills from it in batches. Entries are
+ * handed to free_cb if the shared list is full when a thread
+ * exits. Such lists are registered globally for statistics. */
+pa_flist * pa_flist_new_with_thread_cache(unsigned size, const char *name, pa_free_cb_t free_cb);
 void pa_flist_free(pa_flist *l, pa_free_cb_t free_cb);
 
 /* Please note that this routine might fail! */
 int pa_flist_push(pa_flist*l, void *p);
 void* pa_flist_pop(pa_flist*l);
 
+const pa_flist_stat* pa_flist_get_stat(pa_flist *l);
+const char *pa_flist_get_name(pa_flist *l);
+
+/* Iterate through the lists with a thread cache. Returns NULL for
+ * lists that have been freed already. */
+unsigned pa_flist_n_registered(void);
+pa_flist *pa_flist_get_registered(unsigned idx);
+
 /* Please note that the destructor stuff is not really necessary, we do
  * this just to make valgrind output more useful. */
 
@@ -50,7 +76,8 @@ void* pa_flist_pop(pa_flist*l);
     } name##_flist = { NULL, PA_ONCE_INIT };                            \
     static void name##_flist_init(void) {                               \
         name##_flist.flist =                                            \
-            pa_flist_new_with_name(size, __FILE__ ": " #name);          \
+            pa_flist_new_with_thread_cache(size, __FILE__ ": " #name,   \
+                                           (free_cb));                  \
     }                                                                   \
     static inline pa_flist* name##_flist_get(void) {                    \
         pa_run_once(&name##_flist.once, name##_flist_init);             \
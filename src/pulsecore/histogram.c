@@ -0,0 +1,111 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulsecore/macro.h>
+
+#include "histogram.h"
+
+void pa_histogram_reset(pa_histogram *h) {
+    pa_assert(h);
+
+    memset(h, 0, sizeof(*h));
+}
+
+static unsigned bucket_for(pa_usec_t usec) {
+    unsigned n = 0;
+
+    while (usec > 0 && n < PA_HISTOGRAM_BUCKETS - 1) {
+        usec >>= 1;
+        n++;
+    }
+
+    return n;
+}
+
+static pa_usec_t bucket_limit(unsigned n) {
+    if (n == 0)
+        return 0;
+
+    return (pa_usec_t) 1 << n;
+}
+
+void pa_histogram_add(pa_histogram *h, pa_usec_t usec) {
+    pa_assert(h);
+
+    h->buckets[bucket_for(usec)]++;
+    h->count++;
+
+    if (usec > h->max)
+        h->max = usec;
+}
+
+pa_usec_t pa_histogram_percentile(const pa_histogram *h, double fraction) {
+    uint64_t needed, sum = 0;
+    unsigned n;
+
+    pa_assert(h);
+    pa_assert(fraction >= 0 && fraction <= 1);
+
+    if (h->count == 0)
+        return 0;
+
+    needed = (uint64_t) (fraction * (double) h->count + 0.5);
+    if (needed < 1)
+        needed = 1;
+
+    for (n = 0; n < PA_HISTOGRAM_BUCKETS - 1; n++) {
+        sum += h->buckets[n];
+
+        if (sum >= needed)
+            return PA_MIN(bucket_limit(n), h->max);
+    }
+
+    /* The last bucket has no upper bound of its own */
+    return h->max;
+}
+
+void pa_histogram_to_json(const pa_histogram *h, pa_json_encoder *encoder, const char *name) {
+    unsigned n, last = 0;
+
+    pa_assert(h);
+    pa_assert(encoder);
+    pa_assert(name);
+
+    for (n = 0; n < PA_HISTOGRAM_BUCKETS; n++)
+        if (h->buckets[n] > 0)
+            last = n;
+
+    pa_json_encoder_begin_member_object(encoder, name);
+    pa_json_encoder_add_member_int(encoder, "count", (int64_t) h->count);
+    pa_json_encoder_add_member_int(encoder, "max", (int64_t) h->max);
+    pa_json_encoder_add_member_int(encoder, "median", (int64_t) pa_histogram_percentile(h, 0.5));
+    pa_json_encoder_add_member_int(encoder, "p99", (int64_t) pa_histogram_percentile(h, 0.99));
+
+    /* Trailing empty buckets are left out */
+    pa_json_encoder_begin_member_array(encoder, "buckets");
+    for (n = 0; n <= last && h->count > 0; n++)
+        pa_json_encoder_add_element_int(encoder, (int64_t) h->buckets[n]);
+    pa_json_encoder_end_array(encoder);
+
+    pa_json_encoder_end_object(encoder);
+}
@@ -0,0 +1,51 @@
+#ifndef foohistogramhfoo
+#define foohistogramhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <inttypes.h>
+
+#include <pulse/sample.h>
+
+#include <pulsecore/json.h>
+
+/* A histogram of time spans with power of two buckets: bucket 0 counts
+ * spans of 0us, bucket n spans of at least 2^(n-1)us and less than
+ * 2^n us. The last bucket also takes everything that is longer. It is
+ * a plain struct without allocations, so that it can be filled from IO
+ * threads and copied around in messages. */
+
+#define PA_HISTOGRAM_BUCKETS 24
+
+typedef struct pa_histogram {
+    uint64_t count;
+    pa_usec_t max;
+    uint64_t buckets[PA_HISTOGRAM_BUCKETS];
+} pa_histogram;
+
+void pa_histogram_reset(pa_histogram *h);
+void pa_histogram_add(pa_histogram *h, pa_usec_t usec);
+
+/* The smallest upper bound of a bucket that covers at least the given
+ * fraction of all spans, 0 if the histogram is empty. */
+pa_usec_t pa_histogram_percentile(const pa_histogram *h, double fraction);
+
+/* Adds the histogram as an object member with the given name. */
+void pa_histogram_to_json(const pa_histogram *h, pa_json_encoder *encoder, const char *name);
+
+#endif
@@ -0,0 +1,456 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/rtclock.h>
+#include <pulse/util.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/llist.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/msgobject.h>
+#include <pulsecore/poll.h>
+#include <pulsecore/refcnt.h>
+#include <pulsecore/shared.h>
+#include <pulsecore/thread.h>
+
+#include "io-thread-pool.h"
+
+/* How often a pool thread whose rtpoll failed checks for messages */
+#define FAILED_POLL_MSEC 10
+
+typedef struct pool_thread pool_thread;
+
+struct pa_io_thread_pool_client {
+    pool_thread *thread;
+    pa_module *module;
+    pa_thread_mq *thread_mq;
+
+    pa_io_thread_pool_process_cb_t process_cb;
+    void *userdata;
+
+    bool started;
+
+    /* Only accessed from the pool thread */
+    pa_rtpoll_item *read_item, *write_item;
+    pa_usec_t deadline;
+    bool process_needed;
+
+    PA_LLIST_FIELDS(pa_io_thread_pool_client);
+};
+
+struct pool_thread {
+    pa_msgobject parent;
+
+    pa_io_thread_pool *pool;
+    pa_thread *thread;
+    pa_thread_mq thread_mq;
+    pa_rtpoll *rtpoll;
+
+    /* Only accessed from the main thread */
+    unsigned n_clients;
+
+    /* Only accessed from the pool thread */
+    PA_LLIST_HEAD(pa_io_thread_pool_client, clients);
+};
+
+PA_DEFINE_PRIVATE_CLASS(pool_thread, pa_msgobject);
+#define POOL_THREAD(o) (pool_thread_cast(o))
+
+enum {
+    POOL_THREAD_MESSAGE_ATTACH,
+    POOL_THREAD_MESSAGE_DETACH
+};
+
+struct pa_io_thread_pool {
+    PA_REFCNT_DECLARE;
+
+    pa_core *core;
+
+    pool_thread **threads;
+    unsigned n_threads, max_threads;
+};
+
+/* Called from the pool thread */
+static int client_read_before(pa_rtpoll_item *i) {
+    pa_io_thread_pool_client *c = pa_rtpoll_item_get_work_userdata(i);
+
+    if (pa_asyncmsgq_read_before_poll(c->thread_mq->inq) < 0)
+        return 1; /* 1 means immediate restart of the loop */
+
+    return 0;
+}
+
+/* Called from the pool thread */
+static void client_read_after(pa_rtpoll_item *i) {
+    pa_io_thread_pool_client *c = pa_rtpoll_item_get_work_userdata(i);
+
+    pa_asyncmsgq_read_after_poll(c->thread_mq->inq);
+}
+
+/* Called from the pool thread. Like the asyncmsgq read item of
+ * pa_rtpoll, but lets the client know about the message. */
+static int client_read_work(pa_rtpoll_item *i) {
+    pa_io_thread_pool_client *c = pa_rtpoll_item_get_work_userdata(i);
+    pa_msgobject *object;
+    int code;
+    void *data;
+    pa_memchunk chunk;
+    int64_t offset;
+    int ret;
+
+    if (pa_asyncmsgq_get(c->thread_mq->inq, &object, &code, &data, &offset, &chunk, 0) < 0)
+        return 0;
+
+    ret = pa_asyncmsgq_dispatch(object, code, data, offset, &chunk);
+    pa_asyncmsgq_done(c->thread_mq->inq, ret);
+
+    c->process_needed = true;
+    return 1;
+}
+
+/* Called from the pool thread */
+static void client_attach(pool_thread *t, pa_io_thread_pool_client *c) {
+    struct pollfd *pollfd;
+
+    c->read_item = pa_rtpoll_item_new(t->rtpoll, PA_RTPOLL_EARLY, 1);
+    pollfd = pa_rtpoll_item_get_pollfd(c->read_item, NULL);
+    pollfd->fd = pa_asyncmsgq_read_fd(c->thread_mq->inq);
+    pollfd->events = POLLIN;
+
+    pa_rtpoll_item_set_before_callback(c->read_item, client_read_before, c);
+    pa_rtpoll_item_set_after_callback(c->read_item, client_read_after, c);
+    pa_rtpoll_item_set_work_callback(c->read_item, client_read_work, c);
+
+    c->write_item = pa_rtpoll_item_new_asyncmsgq_write(t->rtpoll, PA_RTPOLL_LATE, c->thread_mq->outq);
+
+    c->deadline = 0;
+    c->process_needed = true;
+
+    PA_LLIST_PREPEND(pa_io_thread_pool_client, t->clients, c);
+}
+
+/* Called from the pool thread */
+static void client_detach(pool_thread *t, pa_io_thread_pool_client *c) {
+    PA_LLIST_REMOVE(pa_io_thread_pool_client, t->clients, c);
+
+    pa_rtpoll_item_free(c->read_item);
+    pa_rtpoll_item_free(c->write_item);
+    c->read_item = c->write_item = NULL;
+}
+
+/* Called from the pool thread */
+static int pool_thread_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
+    pool_thread *t = POOL_THREAD(o);
+
+    switch (code) {
+        case POOL_THREAD_MESSAGE_ATTACH:
+            client_attach(t, data);
+            return 0;
+
+        case POOL_THREAD_MESSAGE_DETACH:
+            client_detach(t, data);
+            return 0;
+    }
+
+    return 0;
+}
+
+/* Called from the pool thread after pa_rtpoll_run() failed. Like
+ * pa_asyncmsgq_wait_for(PA_MESSAGE_SHUTDOWN), but there are several
+ * queues to serve: the clients are not processed anymore, but their
+ * messages and the attach and detach requests are still dispatched until
+ * their modules are unloaded and the thread is shut down. */
+static void wait_for_shutdown(pool_thread *t) {
+    for (;;) {
+        pa_io_thread_pool_client *c;
+        pa_msgobject *object;
+        int code;
+        void *data;
+        pa_memchunk chunk;
+        int64_t offset;
+        bool dispatched = false;
+
+        while (pa_asyncmsgq_get(t->thread_mq.inq, &object, &code, &data, &offset, &chunk, false) >= 0) {
+            int ret;
+
+            ret = pa_asyncmsgq_dispatch(object, code, data, offset, &chunk);
+            pa_asyncmsgq_done(t->thread_mq.inq, ret);
+
+            if (code == PA_MESSAGE_SHUTDOWN)
+                return;
+
+            /* Clients that are assigned to this thread meanwhile won't be
+             * served either */
+            if (object == PA_MSGOBJECT(t) && code == POOL_THREAD_MESSAGE_ATTACH) {
+                c = data;
+                pa_asyncmsgq_post(t->thread_mq.outq, PA_MSGOBJECT(t->pool->core), PA_CORE_MESSAGE_UNLOAD_MODULE, c->module, 0, NULL, NULL);
+            }
+
+            dispatched = true;
+        }
+
+        PA_LLIST_FOREACH(c, t->clients)
+            while (pa_asyncmsgq_process_one(c->thread_mq->inq) > 0)
+                dispatched = true;
+
+        /* Back off rather than spin at realtime priority */
+        if (!dispatched)
+            pa_msleep(FAILED_POLL_MSEC);
+    }
+}
+
+static void thread_func(void *userdata) {
+    pool_thread *t = userdata;
+    pa_core *core;
+
+    pa_assert(t);
+
+    core = t->pool->core;
+
+    pa_log_debug("Thread starting up");
+
+    if (core->realtime_scheduling)
+        pa_thread_make_realtime(core->realtime_priority);
+
+    pa_thread_mq_install(&t->thread_mq);
+    pa_mempool_enable_thread_cache(core->mempool);
+
+    for (;;) {
+        pa_io_thread_pool_client *c;
+        pa_usec_t now, next = 0;
+        int ret;
+
+        now = pa_rtclock_now();
+
+        PA_LLIST_FOREACH(c, t->clients) {
+
+            if (c->process_needed || (c->deadline > 0 && c->deadline <= now)) {
+                c->process_needed = false;
+                c->deadline = c->process_cb(c->userdata);
+            }
+
+            if (c->deadline > 0 && (next == 0 || c->deadline < next))
+                next = c->deadline;
+        }
+
+        if (next > 0)
+            pa_rtpoll_set_timer_absolute(t->rtpoll, next);
+        else
+            pa_rtpoll_set_timer_disabled(t->rtpoll);
+
+        if ((ret = pa_rtpoll_run(t->rtpoll)) < 0) {
+
+            /* Stop serving the clients and have their modules unloaded */
+            PA_LLIST_FOREACH(c, t->clients)
+                pa_asyncmsgq_post(t->thread_mq.outq, PA_MSGOBJECT(core), PA_CORE_MESSAGE_UNLOAD_MODULE, c->module, 0, NULL, NULL);
+
+            wait_for_shutdown(t);
+            break;
+        }
+
+        if (ret == 0)
+            break;
+    }
+
+    pa_log_debug("Thread shutting down");
+}
+
+static void pool_thread_free(pool_thread *t) {
+    pa_assert(t);
+    pa_assert(!t->clients);
+
+    if (t->thread) {
+        pa_asyncmsgq_send(t->thread_mq.inq, NULL, PA_MESSAGE_SHUTDOWN, NULL, 0, NULL);
+        pa_thread_free(t->thread);
+    }
+
+    pa_thread_mq_done(&t->thread_mq);
+
+    if (t->rtpoll)
+        pa_rtpoll_free(t->rtpoll);
+
+    pool_thread_unref(t);
+}
+
+static pool_thread* pool_thread_new(pa_io_thread_pool *p) {
+    pool_thread *t;
+    char *name;
+
+    t = pa_msgobject_new(pool_thread);
+    t->parent.process_msg = pool_thread_process_msg;
+    t->pool = p;
+    t->thread = NULL;
+    t->rtpoll = pa_rtpoll_new();
+    t->n_clients = 0;
+    PA_LLIST_HEAD_INIT(pa_io_thread_pool_client, t->clients);
+
+    if (pa_thread_mq_init(&t->thread_mq, p->core->mainloop, t->rtpoll) < 0) {
+        pa_log("pa_thread_mq_init() failed.");
+        goto fail;
+    }
+
+    name = pa_sprintf_malloc("io-pool-%u", p->n_threads);
+    t->thread = pa_thread_new(name, thread_func, t);
+    pa_xfree(name);
+
+    if (!t->thread) {
+        pa_log("Failed to create thread.");
+        goto fail;
+    }
+
+    /* Spread like the IO threads of other devices */
+    pa_core_place_io_thread(p->core, t->thread, NULL, NULL);
+
+    return t;
+
+fail:
+    pool_thread_free(t);
+    return NULL;
+}
+
+static pa_io_thread_pool* io_thread_pool_new(pa_core *c) {
+    pa_io_thread_pool *p;
+
+    pa_assert(c);
+
+    p = pa_xnew0(pa_io_thread_pool, 1);
+    PA_REFCNT_INIT(p);
+    p->core = c;
+    p->max_threads = PA_MAX(pa_ncpus(), 1U);
+    p->threads = pa_xnew0(pool_thread*, p->max_threads);
+
+    pa_assert_se(pa_shared_set(c, "io-thread-pool", p) >= 0);
+
+    return p;
+}
+
+pa_io_thread_pool* pa_io_thread_pool_get(pa_core *c) {
+    pa_io_thread_pool *p;
+
+    if ((p = pa_shared_get(c, "io-thread-pool")))
+        return pa_io_thread_pool_ref(p);
+
+    return io_thread_pool_new(c);
+}
+
+pa_io_thread_pool* pa_io_thread_pool_ref(pa_io_thread_pool *p) {
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) >= 1);
+
+    PA_REFCNT_INC(p);
+
+    return p;
+}
+
+void pa_io_thread_pool_unref(pa_io_thread_pool *p) {
+    unsigned k;
+
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) >= 1);
+
+    if (PA_REFCNT_DEC(p) > 0)
+        return;
+
+    for (k = 0; k < p->n_threads; k++)
+        pool_thread_free(p->threads[k]);
+
+    pa_xfree(p->threads);
+
+    pa_assert_se(pa_shared_remove(p->core, "io-thread-pool") >= 0);
+
+    pa_xfree(p);
+}
+
+/* Picks the thread with the fewest clients, and only starts another one
+ * if every thread has got some already */
+static pool_thread* pick_thread(pa_io_thread_pool *p) {
+    pool_thread *t = NULL;
+    unsigned k;
+
+    for (k = 0; k < p->n_threads; k++)
+        if (!t || p->threads[k]->n_clients < t->n_clients)
+            t = p->threads[k];
+
+    if ((!t || t->n_clients > 0) && p->n_threads < p->max_threads) {
+        pool_thread *n;
+
+        if ((n = pool_thread_new(p))) {
+            p->threads[p->n_threads++] = n;
+            t = n;
+        }
+    }
+
+    return t;
+}
+
+pa_io_thread_pool_client* pa_io_thread_pool_client_new(pa_io_thread_pool *p, pa_module *m, pa_thread_mq *q, pa_io_thread_pool_process_cb_t process_cb, void *userdata) {
+    pa_io_thread_pool_client *c;
+    pool_thread *t;
+
+    pa_assert(p);
+    pa_assert(m);
+    pa_assert(q);
+    pa_assert(process_cb);
+    pa_assert_ctl_context();
+
+    if (!(t = pick_thread(p)))
+        return NULL;
+
+    c = pa_xnew0(pa_io_thread_pool_client, 1);
+    c->thread = t;
+    c->module = m;
+    c->thread_mq = q;
+    c->process_cb = process_cb;
+    c->userdata = userdata;
+
+    t->n_clients++;
+
+    return c;
+}
+
+void pa_io_thread_pool_client_free(pa_io_thread_pool_client *c) {
+    pa_assert(c);
+    pa_assert_ctl_context();
+
+    if (c->started)
+        pa_assert_se(pa_asyncmsgq_send(c->thread->thread_mq.inq, PA_MSGOBJECT(c->thread), POOL_THREAD_MESSAGE_DETACH, c, 0, NULL) == 0);
+
+    c->thread->n_clients--;
+
+    pa_xfree(c);
+}
+
+pa_rtpoll* pa_io_thread_pool_client_get_rtpoll(pa_io_thread_pool_client *c) {
+    pa_assert(c);
+
+    return c->thread->rtpoll;
+}
+
+void pa_io_thread_pool_client_start(pa_io_thread_pool_client *c) {
+    pa_assert(c);
+    pa_assert(!c->started);
+    pa_assert_ctl_context();
+
+    pa_assert_se(pa_asyncmsgq_send(c->thread->thread_mq.inq, PA_MSGOBJECT(c->thread), POOL_THREAD_MESSAGE_ATTACH, c, 0, NULL) == 0);
+    c->started = true;
+}
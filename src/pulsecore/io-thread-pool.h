@@ -0,0 +1,65 @@
+#ifndef foopulseiothreadpoolhfoo
+#define foopulseiothreadpoolhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <pulse/sample.h>
+
+#include <pulsecore/core.h>
+#include <pulsecore/module.h>
+#include <pulsecore/rtpoll.h>
+#include <pulsecore/thread-mq.h>
+
+/* A small set of IO threads, at most one per CPU, shared by timer
+ * driven devices like the null sink that would otherwise sit in a
+ * thread of their own most of the time.
+ *
+ * A client keeps its own pa_thread_mq, so messages are still sent to
+ * the asyncmsgq of its sink or source. They are dispatched by the pool
+ * thread the client was assigned to, which also calls the process
+ * callback of the client after every message and whenever the deadline
+ * returned by the previous call has passed. */
+
+typedef struct pa_io_thread_pool pa_io_thread_pool;
+typedef struct pa_io_thread_pool_client pa_io_thread_pool_client;
+
+/* Called from the pool thread. Returns the next deadline, or 0 if there
+ * is nothing to do until the next message arrives. */
+typedef pa_usec_t (*pa_io_thread_pool_process_cb_t)(void *userdata);
+
+pa_io_thread_pool* pa_io_thread_pool_get(pa_core *c);
+pa_io_thread_pool* pa_io_thread_pool_ref(pa_io_thread_pool *p);
+void pa_io_thread_pool_unref(pa_io_thread_pool *p);
+
+/* Assigns a new client to one of the pool threads. The thread mq must
+ * have been initialized without an rtpoll, its thread side is attached
+ * to the rtpoll of the pool thread by pa_io_thread_pool_client_start(). */
+pa_io_thread_pool_client* pa_io_thread_pool_client_new(pa_io_thread_pool *p, pa_module *m, pa_thread_mq *q, pa_io_thread_pool_process_cb_t process_cb, void *userdata);
+
+/* Detaches the client from its thread, if started, and frees it. */
+void pa_io_thread_pool_client_free(pa_io_thread_pool_client *c);
+
+/* The rtpoll of the thread the client runs in, for pa_sink_set_rtpoll()
+ * and pa_source_set_rtpoll() */
+pa_rtpoll* pa_io_thread_pool_client_get_rtpoll(pa_io_thread_pool_client *c);
+
+/* Starts dispatching the messages of the client and calling its
+ * process callback. */
+void pa_io_thread_pool_client_start(pa_io_thread_pool_client *c);
+
+#endif
@@ -240,6 +240,62 @@ ssize_t pa_iochannel_write(pa_iochannel*io, const void*data, size_t l) {
     return r;
 }
 
+#ifdef HAVE_SYS_UIO_H
+ssize_t pa_iochannel_writev(pa_iochannel*io, const struct iovec *iov, int iovcnt) {
+    ssize_t r;
+    size_t l = 0;
+    int i;
+
+    pa_assert(io);
+    pa_assert(iov);
+    pa_assert(iovcnt > 0);
+    pa_assert(io->ofd >= 0);
+
+    for (i = 0; i < iovcnt; i++)
+        l += iov[i].iov_len;
+
+    pa_assert(l);
+
+    /* Like pa_write(), prefer sendmsg() on sockets to avoid SIGPIPE */
+    for (;;) {
+        if (io->ofd_type == 0) {
+            struct msghdr mh;
+
+            pa_zero(mh);
+            mh.msg_iov = (struct iovec*) iov;
+            mh.msg_iovlen = iovcnt;
+
+            if ((r = sendmsg(io->ofd, &mh, MSG_NOSIGNAL)) < 0 && errno == ENOTSOCK) {
+                io->ofd_type = 1;
+                continue;
+            }
+        } else
+            r = writev(io->ofd, iov, iovcnt);
+
+        if (r < 0 && errno == EINTR)
+            continue;
+
+        break;
+    }
+
+    if ((size_t) r == l)
+        return r;
+
+    if (r < 0) {
+        if (errno == EAGAIN)
+            r = 0;
+        else
+            return r;
+    }
+
+    /* Partial write - let's get a notification when we can write more */
+    io->writable = io->hungup = false;
+    enable_events(io);
+
+    return r;
+}
+#endif
+
 ssize_t pa_iochannel_read(pa_iochannel*io, void*data, size_t l) {
     ssize_t r;
 
@@ -207,6 +207,12 @@ size_t pa_mcalign_csize(pa_mcalign *m, size_t l) {
     return (l/m->base)*m->base;
 }
 
+bool pa_mcalign_is_empty(pa_mcalign *m) {
+    pa_assert(m);
+
+    return !m->leftover.memblock && !m->current.memblock;
+}
+
 void pa_mcalign_flush(pa_mcalign *m) {
     pa_memchunk chunk;
     pa_assert(m);
@@ -75,6 +75,10 @@ int pa_mcalign_pop(pa_mcalign *m, pa_memchunk *c);
 /* If we pass l bytes in now, how many bytes would we get out? */
 size_t pa_mcalign_csize(pa_mcalign *m, size_t l);
 
+/* Returns true if no partial frame is stored in the aligner, so that
+ * an aligned memchunk would be passed through unchanged */
+bool pa_mcalign_is_empty(pa_mcalign *m);
+
 /* Flush what's still stored in the aligner */
 void pa_mcalign_flush(pa_mcalign *m);
 
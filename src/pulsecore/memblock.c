@@ -47,6 +47,7 @@
 #include <pulsecore/flist.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/memtrap.h>
+#include <pulsecore/thread.h>
 
 #include "memblock.h"
 
@@ -57,6 +58,24 @@
 #define PA_MEMPOOL_SLOTS_MAX 1024
 #define PA_MEMPOOL_SLOT_SIZE (64*1024)
 
+/* memfd-backed pools start out with a single segment of the requested
+ * size and grow by further segments of the same size when they run
+ * full. The address space for all of them is reserved up front, which
+ * we only do where address space is plentiful. */
+#define PA_MEMPOOL_SEGMENTS_MAX 4
+
+/* The largest size class uses whole slots */
+#define PA_MEMPOOL_TOP_CLASS (PA_MEMPOOL_SIZE_CLASSES - 1)
+
+/* Free slots a thread cache holds per size class, limited by the total
+ * size per class */
+#define PA_MEMPOOL_THREAD_CACHE_SLOTS 16
+#define PA_MEMPOOL_THREAD_CACHE_SIZE (256*1024)
+
+/* Allocations and frees a thread cache counts by itself before it adds
+ * the counts to the pool statistics */
+#define PA_MEMPOOL_THREAD_CACHE_STAT_OPS 64
+
 #define PA_MEMEXPORT_SLOTS_MAX 128
 
 #define PA_MEMIMPORT_SLOTS_MAX 160
@@ -184,15 +203,35 @@ struct pa_mempool {
     pa_semaphore *semaphore;
     pa_mutex *mutex;
 
+    /* The first segment. Grown segments are mapped right behind it,
+     * so the slots of all segments can be addressed relative to
+     * memory.ptr. */
     pa_shm memory;
+    pa_shm grown[PA_MEMPOOL_SEGMENTS_MAX - 1];
+
+    void *reserved;
+    size_t reserved_size;
 
     bool global;
 
+    /* Set by pa_mempool_lock() */
+    bool locked;
+    bool huge_pages;
+
     size_t block_size;
     unsigned n_blocks;
+    unsigned segment_blocks;
     bool is_remote_writable;
 
     pa_atomic_t n_init;
+    pa_atomic_t n_segments;
+
+    /* Set by pa_mempool_set_grow_callback(). With it, allocations never
+     * map segments themselves, but ask for the next one once the last
+     * segment is three quarters used, and fail over when it is full. */
+    pa_mempool_grow_cb_t grow_cb;
+    void *grow_userdata;
+    pa_atomic_t grow_requested;
 
     PA_LLIST_HEAD(pa_memimport, imports);
     PA_LLIST_HEAD(pa_memexport, exports);
@@ -200,13 +239,45 @@ struct pa_mempool {
     /* A list of free slots that may be reused */
     pa_flist *free_slots;
 
+    /* The size class each slot has been split up for. Slots of the
+     * smaller size classes are never merged again. */
+    uint8_t *slot_classes;
+
+    /* Free blocks of the smaller size classes. Each free block stores the
+     * offset of the next one plus 1 in its first bytes, 0 ends the list. */
+    pa_mutex *class_mutex;
+    uint32_t free_class_slots[PA_MEMPOOL_TOP_CLASS];
+
     pa_mempool_stat stat;
 };
 
+struct mempool_thread_cache {
+    pa_mempool *pool;
+
+    unsigned n_slots[PA_MEMPOOL_SIZE_CLASSES];
+    struct mempool_slot *slots[PA_MEMPOOL_SIZE_CLASSES][PA_MEMPOOL_THREAD_CACHE_SLOTS];
+
+    /* Changes to the pool statistics by the blocks allocated and freed
+     * through this cache, not yet added to them */
+    struct {
+        int n_allocated;
+        int n_accumulated;
+        int allocated_size;
+        int accumulated_size;
+        int n_allocated_by_type[PA_MEMBLOCK_TYPE_MAX];
+        int n_accumulated_by_type[PA_MEMBLOCK_TYPE_MAX];
+        int n_allocated_by_class[PA_MEMPOOL_SIZE_CLASSES];
+        unsigned n_ops;
+    } stat;
+};
+
 static void segment_detach(pa_memimport_segment *seg);
+static void thread_cache_free(void *userdata);
 
 PA_STATIC_FLIST_DECLARE(unused_memblocks, 0, pa_xfree);
 
+PA_STATIC_TLS_DECLARE(mempool_thread_cache, thread_cache_free);
+
 /* No lock necessary */
 static void stat_add(pa_memblock*b) {
     pa_assert(b);
@@ -227,14 +298,13 @@ static void stat_add(pa_memblock*b) {
     pa_atomic_inc(&b->pool->stat.n_accumulated_by_type[b->type]);
 }
 
-/* No lock necessary */
+/* No lock necessary. The block may have been allocated through a thread
+ * cache which did not add it to the statistics yet, so they may well
+ * drop below zero for a while. */
 static void stat_remove(pa_memblock *b) {
     pa_assert(b);
     pa_assert(b->pool);
 
-    pa_assert(pa_atomic_load(&b->pool->stat.n_allocated) > 0);
-    pa_assert(pa_atomic_load(&b->pool->stat.allocated_size) >= (int) b->length);
-
     pa_atomic_dec(&b->pool->stat.n_allocated);
     pa_atomic_sub(&b->pool->stat.allocated_size, (int) b->length);
 
@@ -258,8 +328,12 @@ pa_memblock *pa_memblock_new(pa_mempool *p, size_t length) {
     pa_assert(p);
     pa_assert(length);
 
-    if (!(b = pa_memblock_new_pool(p, length)))
+    if (!(b = pa_memblock_new_pool(p, length))) {
+        if (pa_mempool_is_shared(p))
+            pa_atomic_inc(&p->stat.n_shm_fallbacks);
+
         b = memblock_new_appended(p, length);
+    }
 
     return b;
 }
@@ -292,28 +366,346 @@ static pa_memblock *memblock_new_appended(pa_mempool *p, size_t length) {
 }
 
 /* No lock necessary */
-static struct mempool_slot* mempool_allocate_slot(pa_mempool *p) {
-    struct mempool_slot *slot;
+static inline size_t class_size(pa_mempool *p, unsigned c) {
+    return p->block_size >> (PA_MEMPOOL_TOP_CLASS - c);
+}
+
+/* No lock necessary. Returns the smallest size class with blocks of
+ * the given size, or PA_MEMPOOL_SIZE_CLASSES if there is none. */
+static unsigned size_to_class(pa_mempool *p, size_t size) {
+    unsigned c;
+
+    for (c = 0; c < PA_MEMPOOL_SIZE_CLASSES; c++)
+        if (class_size(p, c) >= size)
+            break;
+
+    return c;
+}
+
+/* No lock necessary */
+static unsigned thread_cache_max(pa_mempool *p, unsigned c) {
+    size_t n = PA_MEMPOOL_THREAD_CACHE_SIZE / class_size(p, c);
+
+    return (unsigned) PA_MAX(PA_MIN(n, (size_t) PA_MEMPOOL_THREAD_CACHE_SLOTS), (size_t) 2);
+}
+
+/* No lock necessary */
+static unsigned mempool_slot_idx(pa_mempool *p, void *ptr) {
     pa_assert(p);
 
-    if (!(slot = pa_flist_pop(p->free_slots))) {
-        int idx;
+    pa_assert((uint8_t*) ptr >= (uint8_t*) p->memory.ptr);
+    pa_assert((uint8_t*) ptr < (uint8_t*) p->memory.ptr + p->block_size * p->n_blocks);
+
+    return (unsigned) ((size_t) ((uint8_t*) ptr - (uint8_t*) p->memory.ptr) / p->block_size);
+}
+
+/* No lock necessary */
+static pa_shm *mempool_segment(pa_mempool *p, unsigned k) {
+    pa_assert(k < PA_MEMPOOL_SEGMENTS_MAX);
 
-        /* The free list was empty, we have to allocate a new entry */
+    return k == 0 ? &p->memory : &p->grown[k - 1];
+}
 
-        if ((unsigned) (idx = pa_atomic_inc(&p->n_init)) >= p->n_blocks)
-            pa_atomic_dec(&p->n_init);
-        else
-            slot = (struct mempool_slot*) ((uint8_t*) p->memory.ptr + (p->block_size * (size_t) idx));
+/* No lock necessary */
+static pa_shm *mempool_segment_by_ptr(pa_mempool *p, const void *ptr) {
+    return mempool_segment(p, mempool_slot_idx(p, (void*) ptr) / p->segment_blocks);
+}
 
-        if (!slot) {
-            if (pa_log_ratelimit(PA_LOG_DEBUG))
-                pa_log_debug("Pool full");
-            pa_atomic_inc(&p->stat.n_pool_full);
-            return NULL;
+/* Self-locked. Maps another segment, unless somebody else did so since
+ * the caller saw n segments. */
+static int mempool_grow(pa_mempool *p, unsigned n) {
+    char t[PA_BYTES_SNPRINT_MAX];
+    size_t size;
+    int r = 0;
+
+    if (!p->reserved)
+        return -1;
+
+    size = p->block_size * p->segment_blocks;
+
+    pa_mutex_lock(p->mutex);
+
+    if ((unsigned) pa_atomic_load(&p->n_segments) != n)
+        goto finish;
+
+    if (n >= p->n_blocks / p->segment_blocks ||
+        pa_shm_create_rw_at(mempool_segment(p, n), p->memory.type, size, 0700, (uint8_t*) p->reserved + size * n) < 0) {
+        r = -1;
+        goto finish;
+    }
+
+    if (p->locked) {
+        bool huge_pages;
+
+        if (pa_shm_lock(mempool_segment(p, n), &huge_pages) >= 0) {
+            pa_atomic_add(&p->stat.locked_size, (int) size);
+
+            /* The pool only counts as huge page backed if all of it is */
+            p->huge_pages = p->huge_pages && huge_pages;
+        } else
+            pa_log_warn("Failed to lock grown memory pool segment into memory.");
+    }
+
+    /* Per-client pools keep the fd until it is taken over for the
+     * registration with the peer, as for the first segment */
+    pa_atomic_store(&p->n_segments, (int) n + 1);
+    pa_atomic_inc(&p->stat.n_segments);
+
+    pa_log_debug("Memory pool grown by a segment of %s, now %u segments",
+                 pa_bytes_snprint(t, sizeof(t), (unsigned) size), n + 1);
+
+finish:
+    pa_mutex_unlock(p->mutex);
+    return r;
+}
+
+/* No lock necessary. Asks the grow callback once for the segment
+ * behind the n mapped ones. */
+static void mempool_request_grow(pa_mempool *p, unsigned n) {
+    if (!p->reserved || n >= p->n_blocks / p->segment_blocks)
+        return;
+
+    if (pa_atomic_cmpxchg(&p->grow_requested, 0, 1))
+        p->grow_cb(p, p->grow_userdata);
+}
+
+/* No lock necessary */
+static struct mempool_slot* mempool_pop_top_slot(pa_mempool *p) {
+    struct mempool_slot *slot;
+    unsigned n;
+    int idx;
+
+    if ((slot = pa_flist_pop(p->free_slots)))
+        return slot;
+
+    /* The free list was empty, we have to allocate a new entry. Slots
+     * are only handed out once the segment they live in is mapped. */
+
+    for (;;) {
+        n = (unsigned) pa_atomic_load(&p->n_segments);
+
+        idx = pa_atomic_load(&p->n_init);
+
+        if ((unsigned) idx >= n * p->segment_blocks) {
+            if (p->grow_cb) {
+                mempool_request_grow(p, n);
+
+                /* Unless the callback mapped it right away, fail over */
+                if ((unsigned) pa_atomic_load(&p->n_segments) == n)
+                    return NULL;
+
+                continue;
+            }
+
+            /* Locking a segment faults all of it in, which is nothing
+             * for the allocating thread to wait for */
+            if (p->locked || mempool_grow(p, n) < 0)
+                return NULL;
+
+            continue;
+        }
+
+        if (pa_atomic_cmpxchg(&p->n_init, idx, idx + 1))
+            break;
+    }
+
+    if (p->grow_cb && (unsigned) idx + 1 >= n * p->segment_blocks - p->segment_blocks / 4)
+        mempool_request_grow(p, n);
+
+    pa_atomic_inc(&p->stat.n_slots_by_class[PA_MEMPOOL_TOP_CLASS]);
+
+    return (struct mempool_slot*) ((uint8_t*) p->memory.ptr + (p->block_size * (size_t) idx));
+}
+
+/* No lock necessary, locks by its own for the smaller size classes.
+ * Takes up to n free blocks of the size class, splitting up a slot if
+ * there are none. */
+static unsigned mempool_pop_slots(pa_mempool *p, unsigned c, struct mempool_slot **slots, unsigned n) {
+    struct mempool_slot *top = NULL;
+    unsigned k = 0;
+    size_t size, o;
+
+    if (c == PA_MEMPOOL_TOP_CLASS) {
+        for (; k < n; k++)
+            if (!(slots[k] = mempool_pop_top_slot(p)))
+                break;
+
+        return k;
+    }
+
+    size = class_size(p, c);
+
+    pa_mutex_lock(p->class_mutex);
+
+    if (!p->free_class_slots[c]) {
+        pa_mutex_unlock(p->class_mutex);
+
+        if (!(top = mempool_pop_top_slot(p)))
+            return 0;
+
+        p->slot_classes[mempool_slot_idx(p, top)] = (uint8_t) c;
+        pa_atomic_dec(&p->stat.n_slots_by_class[PA_MEMPOOL_TOP_CLASS]);
+        pa_atomic_inc(&p->stat.n_slots_by_class[c]);
+
+        slots[k++] = top;
+
+        pa_mutex_lock(p->class_mutex);
+
+        /* The first block of the slot is ours, the others are free */
+        for (o = p->block_size - size; o > 0; o -= size) {
+            uint32_t *next = (uint32_t*) ((uint8_t*) top + o);
+
+            *next = p->free_class_slots[c];
+            p->free_class_slots[c] = (uint32_t) ((uint8_t*) next - (uint8_t*) p->memory.ptr) + 1;
         }
     }
 
+    for (; k < n && p->free_class_slots[c]; k++) {
+        slots[k] = (struct mempool_slot*) ((uint8_t*) p->memory.ptr + p->free_class_slots[c] - 1);
+        p->free_class_slots[c] = *(uint32_t*) slots[k];
+    }
+
+    pa_mutex_unlock(p->class_mutex);
+
+    return k;
+}
+
+/* No lock necessary, locks by its own for the smaller size classes */
+static void mempool_push_slots(pa_mempool *p, unsigned c, struct mempool_slot **slots, unsigned n) {
+    unsigned k;
+
+    if (c == PA_MEMPOOL_TOP_CLASS) {
+        /* The free list dimensions should easily allow all slots
+         * to fit in, hence try harder if pushing this slot into
+         * the free list fails */
+        for (k = 0; k < n; k++)
+            while (pa_flist_push(p->free_slots, slots[k]) < 0)
+                ;
+
+        return;
+    }
+
+    pa_mutex_lock(p->class_mutex);
+
+    for (k = 0; k < n; k++) {
+        *(uint32_t*) slots[k] = p->free_class_slots[c];
+        p->free_class_slots[c] = (uint32_t) ((uint8_t*) slots[k] - (uint8_t*) p->memory.ptr) + 1;
+    }
+
+    pa_mutex_unlock(p->class_mutex);
+}
+
+/* No lock necessary */
+static inline struct mempool_thread_cache *thread_cache_get(pa_mempool *p) {
+    struct mempool_thread_cache *cache = PA_STATIC_TLS_GET(mempool_thread_cache);
+
+    return cache && cache->pool == p ? cache : NULL;
+}
+
+static inline void stat_fold(pa_atomic_t *a, int *delta) {
+    if (*delta != 0) {
+        pa_atomic_add(a, *delta);
+        *delta = 0;
+    }
+}
+
+/* No lock necessary. Adds what the cache counted to the pool statistics. */
+static void thread_cache_fold_stat(struct mempool_thread_cache *cache) {
+    pa_mempool_stat *stat = &cache->pool->stat;
+    unsigned k;
+
+    stat_fold(&stat->n_allocated, &cache->stat.n_allocated);
+    stat_fold(&stat->n_accumulated, &cache->stat.n_accumulated);
+    stat_fold(&stat->allocated_size, &cache->stat.allocated_size);
+    stat_fold(&stat->accumulated_size, &cache->stat.accumulated_size);
+
+    for (k = 0; k < PA_MEMBLOCK_TYPE_MAX; k++) {
+        stat_fold(&stat->n_allocated_by_type[k], &cache->stat.n_allocated_by_type[k]);
+        stat_fold(&stat->n_accumulated_by_type[k], &cache->stat.n_accumulated_by_type[k]);
+    }
+
+    for (k = 0; k < PA_MEMPOOL_SIZE_CLASSES; k++)
+        stat_fold(&stat->n_allocated_by_class[k], &cache->stat.n_allocated_by_class[k]);
+
+    cache->stat.n_ops = 0;
+}
+
+/* No lock necessary. Counts a pool block of size class c like
+ * stat_add() does, but in the cache. */
+static void thread_cache_stat_add(struct mempool_thread_cache *cache, pa_memblock *b, unsigned c) {
+    cache->stat.n_allocated++;
+    cache->stat.allocated_size += (int) b->length;
+    cache->stat.n_accumulated++;
+    cache->stat.accumulated_size += (int) b->length;
+    cache->stat.n_allocated_by_type[b->type]++;
+    cache->stat.n_accumulated_by_type[b->type]++;
+    cache->stat.n_allocated_by_class[c]++;
+
+    if (++cache->stat.n_ops >= PA_MEMPOOL_THREAD_CACHE_STAT_OPS)
+        thread_cache_fold_stat(cache);
+}
+
+/* No lock necessary. The counterpart of stat_remove(). */
+static void thread_cache_stat_remove(struct mempool_thread_cache *cache, pa_memblock *b, unsigned c) {
+    cache->stat.n_allocated--;
+    cache->stat.allocated_size -= (int) b->length;
+    cache->stat.n_allocated_by_type[b->type]--;
+    cache->stat.n_allocated_by_class[c]--;
+
+    if (++cache->stat.n_ops >= PA_MEMPOOL_THREAD_CACHE_STAT_OPS)
+        thread_cache_fold_stat(cache);
+}
+
+/* No lock necessary */
+static void thread_cache_flush(struct mempool_thread_cache *cache) {
+    unsigned c;
+
+    pa_assert(cache->pool);
+
+    thread_cache_fold_stat(cache);
+
+    for (c = 0; c < PA_MEMPOOL_SIZE_CLASSES; c++) {
+        mempool_push_slots(cache->pool, c, cache->slots[c], cache->n_slots[c]);
+        cache->n_slots[c] = 0;
+    }
+
+    pa_mempool_unref(cache->pool);
+    cache->pool = NULL;
+}
+
+static void thread_cache_free(void *userdata) {
+    struct mempool_thread_cache *cache = userdata;
+
+    if (cache->pool)
+        thread_cache_flush(cache);
+
+    pa_xfree(cache);
+}
+
+/* No lock necessary */
+static struct mempool_slot* mempool_allocate_slot(pa_mempool *p, unsigned c) {
+    struct mempool_thread_cache *cache;
+    struct mempool_slot *slot = NULL;
+    pa_assert(p);
+    pa_assert(c < PA_MEMPOOL_SIZE_CLASSES);
+
+    if ((cache = thread_cache_get(p))) {
+        if (cache->n_slots[c] == 0)
+            cache->n_slots[c] = mempool_pop_slots(p, c, cache->slots[c], thread_cache_max(p, c) / 2);
+
+        if (cache->n_slots[c] > 0)
+            slot = cache->slots[c][--cache->n_slots[c]];
+
+    } else if (mempool_pop_slots(p, c, &slot, 1) == 0)
+        slot = NULL;
+
+    if (!slot) {
+        if (pa_log_ratelimit(PA_LOG_DEBUG))
+            pa_log_debug("Pool full");
+        pa_atomic_inc(&p->stat.n_pool_full);
+        return NULL;
+    }
+
 /* #ifdef HAVE_VALGRIND_MEMCHECK_H */
 /*     if (PA_UNLIKELY(pa_in_valgrind())) { */
 /*         VALGRIND_MALLOCLIKE_BLOCK(slot, p->block_size, 0, 0); */
@@ -323,29 +715,46 @@ static struct mempool_slot* mempool_allocate_slot(pa_mempool *p) {
     return slot;
 }
 
-/* No lock necessary, totally redundant anyway */
-static inline void* mempool_slot_data(struct mempool_slot *slot) {
-    return slot;
-}
-
 /* No lock necessary */
-static unsigned mempool_slot_idx(pa_mempool *p, void *ptr) {
-    pa_assert(p);
+static void mempool_free_slot(pa_mempool *p, unsigned c, struct mempool_slot *slot) {
+    struct mempool_thread_cache *cache;
 
-    pa_assert((uint8_t*) ptr >= (uint8_t*) p->memory.ptr);
-    pa_assert((uint8_t*) ptr < (uint8_t*) p->memory.ptr + p->memory.size);
+    if ((cache = thread_cache_get(p))) {
+        unsigned max = thread_cache_max(p, c);
 
-    return (unsigned) ((size_t) ((uint8_t*) ptr - (uint8_t*) p->memory.ptr) / p->block_size);
+        if (cache->n_slots[c] >= max) {
+            /* Give the older half back to the pool */
+            mempool_push_slots(p, c, cache->slots[c], max / 2);
+            memmove(cache->slots[c], cache->slots[c] + max / 2, (cache->n_slots[c] - max / 2) * sizeof(struct mempool_slot*));
+            cache->n_slots[c] -= max / 2;
+        }
+
+        cache->slots[c][cache->n_slots[c]++] = slot;
+        return;
+    }
+
+    mempool_push_slots(p, c, &slot, 1);
+}
+
+/* No lock necessary, totally redundant anyway */
+static inline void* mempool_slot_data(struct mempool_slot *slot) {
+    return slot;
 }
 
 /* No lock necessary */
-static struct mempool_slot* mempool_slot_by_ptr(pa_mempool *p, void *ptr) {
+static struct mempool_slot* mempool_slot_by_ptr(pa_mempool *p, void *ptr, unsigned *size_class) {
     unsigned idx;
+    size_t offset;
 
     if ((idx = mempool_slot_idx(p, ptr)) == (unsigned) -1)
         return NULL;
 
-    return (struct mempool_slot*) ((uint8_t*) p->memory.ptr + (idx * p->block_size));
+    *size_class = p->slot_classes[idx];
+
+    offset = (size_t) ((uint8_t*) ptr - (uint8_t*) p->memory.ptr);
+    offset -= offset % class_size(p, *size_class);
+
+    return (struct mempool_slot*) ((uint8_t*) p->memory.ptr + offset);
 }
 
 /* No lock necessary */
@@ -364,7 +773,9 @@ void pa_mempool_set_is_remote_writable(pa_mempool *p, bool writable) {
 /* No lock necessary */
 pa_memblock *pa_memblock_new_pool(pa_mempool *p, size_t length) {
     pa_memblock *b = NULL;
+    struct mempool_thread_cache *cache;
     struct mempool_slot *slot;
+    unsigned c;
     static int mempool_disable = 0;
 
     pa_assert(p);
@@ -382,9 +793,9 @@ pa_memblock *pa_memblock_new_pool(pa_mempool *p, size_t length) {
     if (length == (size_t) -1)
         length = pa_mempool_block_size_max(p);
 
-    if (p->block_size >= PA_ALIGN(sizeof(pa_memblock)) + length) {
+    if ((c = size_to_class(p, PA_ALIGN(sizeof(pa_memblock)) + length)) < PA_MEMPOOL_SIZE_CLASSES) {
 
-        if (!(slot = mempool_allocate_slot(p)))
+        if (!(slot = mempool_allocate_slot(p, c)))
             return NULL;
 
         b = mempool_slot_data(slot);
@@ -393,7 +804,9 @@ pa_memblock *pa_memblock_new_pool(pa_mempool *p, size_t length) {
 
     } else if (p->block_size >= length) {
 
-        if (!(slot = mempool_allocate_slot(p)))
+        c = PA_MEMPOOL_TOP_CLASS;
+
+        if (!(slot = mempool_allocate_slot(p, c)))
             return NULL;
 
         if (!(b = pa_flist_pop(PA_STATIC_FLIST_GET(unused_memblocks))))
@@ -416,7 +829,13 @@ pa_memblock *pa_memblock_new_pool(pa_mempool *p, size_t length) {
     pa_atomic_store(&b->n_acquired, 0);
     pa_atomic_store(&b->please_signal, 0);
 
-    stat_add(b);
+    if ((cache = thread_cache_get(p)))
+        thread_cache_stat_add(cache, b, c);
+    else {
+        stat_add(b);
+        pa_atomic_inc(&p->stat.n_allocated_by_class[c]);
+    }
+
     return b;
 }
 
@@ -591,7 +1010,10 @@ static void memblock_free(pa_memblock *b) {
     pa_assert(pa_atomic_load(&b->n_acquired) == 0);
 
     pool = b->pool;
-    stat_remove(b);
+
+    /* Pool blocks are accounted for below, possibly by the thread cache */
+    if (b->type != PA_MEMBLOCK_POOL && b->type != PA_MEMBLOCK_POOL_EXTERNAL)
+        stat_remove(b);
 
     switch (b->type) {
         case PA_MEMBLOCK_USER :
@@ -642,10 +1064,12 @@ static void memblock_free(pa_memblock *b) {
 
         case PA_MEMBLOCK_POOL_EXTERNAL:
         case PA_MEMBLOCK_POOL: {
+            struct mempool_thread_cache *cache;
             struct mempool_slot *slot;
+            unsigned c;
             bool call_free;
 
-            pa_assert_se(slot = mempool_slot_by_ptr(b->pool, pa_atomic_ptr_load(&b->data)));
+            pa_assert_se(slot = mempool_slot_by_ptr(b->pool, pa_atomic_ptr_load(&b->data), &c));
 
             call_free = b->type == PA_MEMBLOCK_POOL_EXTERNAL;
 
@@ -655,11 +1079,14 @@ static void memblock_free(pa_memblock *b) {
 /*             } */
 /* #endif */
 
-            /* The free list dimensions should easily allow all slots
-             * to fit in, hence try harder if pushing this slot into
-             * the free list fails */
-            while (pa_flist_push(b->pool->free_slots, slot) < 0)
-                ;
+            if ((cache = thread_cache_get(b->pool)))
+                thread_cache_stat_remove(cache, b, c);
+            else {
+                stat_remove(b);
+                pa_atomic_dec(&b->pool->stat.n_allocated_by_class[c]);
+            }
+
+            mempool_free_slot(b->pool, c, slot);
 
             if (call_free)
                 if (pa_flist_push(PA_STATIC_FLIST_GET(unused_memblocks), b) < 0)
@@ -713,8 +1140,9 @@ static void memblock_make_local(pa_memblock *b) {
 
     if (b->length <= b->pool->block_size) {
         struct mempool_slot *slot;
+        unsigned c = size_to_class(b->pool, b->length);
 
-        if ((slot = mempool_allocate_slot(b->pool))) {
+        if ((slot = mempool_allocate_slot(b->pool, c))) {
             void *new_data;
             /* We can move it into a local pool, perfect! */
 
@@ -725,6 +1153,7 @@ static void memblock_make_local(pa_memblock *b) {
             b->type = PA_MEMBLOCK_POOL_EXTERNAL;
             b->read_only = false;
 
+            pa_atomic_inc(&b->pool->stat.n_allocated_by_class[c]);
             goto finish;
         }
     }
@@ -838,26 +1267,54 @@ pa_mempool *pa_mempool_new(pa_mem_type_t type, size_t size, bool per_client) {
         p->block_size = page_size;
 
     if (size <= 0)
-        p->n_blocks = PA_MEMPOOL_SLOTS_MAX;
+        p->segment_blocks = PA_MEMPOOL_SLOTS_MAX;
     else {
-        p->n_blocks = (unsigned) (size / p->block_size);
+        p->segment_blocks = (unsigned) (size / p->block_size);
+
+        if (p->segment_blocks < 2)
+            p->segment_blocks = 2;
+    }
 
-        if (p->n_blocks < 2)
-            p->n_blocks = 2;
+    p->n_blocks = p->segment_blocks;
+
+    if (type == PA_MEM_TYPE_SHARED_MEMFD) {
+        unsigned n_segments = sizeof(void*) >= 8 ? PA_MEMPOOL_SEGMENTS_MAX : 1;
+
+        /* Free blocks of the smaller size classes are linked by 32 bit
+         * offsets into the pool */
+        while (n_segments > 1 && (uint64_t) p->segment_blocks * p->block_size * n_segments > UINT32_MAX)
+            n_segments--;
+
+        if (n_segments > 1) {
+            p->reserved_size = p->segment_blocks * p->block_size * n_segments;
+
+            if ((p->reserved = pa_shm_reserve(p->reserved_size)))
+                p->n_blocks = p->segment_blocks * n_segments;
+        }
     }
 
-    if (pa_shm_create_rw(&p->memory, type, p->n_blocks * p->block_size, 0700) < 0) {
+    if ((p->reserved ?
+         pa_shm_create_rw_at(&p->memory, type, p->segment_blocks * p->block_size, 0700, p->reserved) :
+         pa_shm_create_rw(&p->memory, type, p->segment_blocks * p->block_size, 0700)) < 0) {
+        if (p->reserved)
+            pa_shm_unreserve(p->reserved, p->reserved_size);
         pa_xfree(p);
         return NULL;
     }
 
     pa_log_debug("Using %s memory pool with %u slots of size %s each, total size is %s, maximum usable slot size is %lu",
                  pa_mem_type_to_string(type),
-                 p->n_blocks,
+                 p->segment_blocks,
                  pa_bytes_snprint(t1, sizeof(t1), (unsigned) p->block_size),
-                 pa_bytes_snprint(t2, sizeof(t2), (unsigned) (p->n_blocks * p->block_size)),
+                 pa_bytes_snprint(t2, sizeof(t2), (unsigned) (p->segment_blocks * p->block_size)),
                  (unsigned long) pa_mempool_block_size_max(p));
 
+    if (p->reserved)
+        pa_log_debug("Memory pool may grow up to %u segments", p->n_blocks / p->segment_blocks);
+
+    pa_atomic_store(&p->n_segments, 1);
+    pa_atomic_store(&p->stat.n_segments, 1);
+
     p->global = !per_client;
 
     pa_atomic_store(&p->n_init, 0);
@@ -870,10 +1327,16 @@ pa_mempool *pa_mempool_new(pa_mem_type_t type, size_t size, bool per_client) {
 
     p->free_slots = pa_flist_new(p->n_blocks);
 
+    p->slot_classes = pa_xnew(uint8_t, p->n_blocks);
+    memset(p->slot_classes, PA_MEMPOOL_TOP_CLASS, p->n_blocks);
+    p->class_mutex = pa_mutex_new(false, false);
+
     return p;
 }
 
 static void mempool_free(pa_mempool *p) {
+    unsigned k;
+
     pa_assert(p);
 
     pa_mutex_lock(p->mutex);
@@ -932,18 +1395,31 @@ static void mempool_free(pa_mempool *p) {
 /*         PA_DEBUG_TRAP; */
     }
 
-    pa_shm_free(&p->memory);
+    for (k = (unsigned) pa_atomic_load(&p->n_segments); k > 0; k--)
+        pa_shm_free(mempool_segment(p, k - 1));
+
+    if (p->reserved)
+        pa_shm_unreserve(p->reserved, p->reserved_size);
 
     pa_mutex_free(p->mutex);
+    pa_mutex_free(p->class_mutex);
     pa_semaphore_free(p->semaphore);
 
+    pa_xfree(p->slot_classes);
     pa_xfree(p);
 }
 
 /* No lock necessary */
 const pa_mempool_stat* pa_mempool_get_stat(pa_mempool *p) {
+    struct mempool_thread_cache *cache;
+
     pa_assert(p);
 
+    /* The thread caches of other threads add their counts after a while,
+     * or when they are flushed */
+    if ((cache = thread_cache_get(p)))
+        thread_cache_fold_stat(cache);
+
     return &p->stat;
 }
 
@@ -955,12 +1431,59 @@ size_t pa_mempool_block_size_max(pa_mempool *p) {
 }
 
 /* No lock necessary */
+size_t pa_mempool_class_size(pa_mempool *p, unsigned size_class) {
+    pa_assert(p);
+    pa_assert(size_class < PA_MEMPOOL_SIZE_CLASSES);
+
+    return class_size(p, size_class);
+}
+
+void pa_mempool_enable_thread_cache(pa_mempool *p) {
+    struct mempool_thread_cache *cache;
+
+    pa_assert(p);
+
+    if ((cache = PA_STATIC_TLS_GET(mempool_thread_cache))) {
+        if (cache->pool == p)
+            return;
+
+        if (cache->pool)
+            thread_cache_flush(cache);
+    } else {
+        cache = pa_xnew0(struct mempool_thread_cache, 1);
+        PA_STATIC_TLS_SET(mempool_thread_cache, cache);
+    }
+
+    cache->pool = pa_mempool_ref(p);
+}
+
+void pa_mempool_disable_thread_cache(void) {
+    struct mempool_thread_cache *cache;
+
+    if (!(cache = PA_STATIC_TLS_GET(mempool_thread_cache)))
+        return;
+
+    PA_STATIC_TLS_SET(mempool_thread_cache, NULL);
+    thread_cache_free(cache);
+}
+
+/* No lock necessary
+ *
+ * Segments the pool has grown by stay mapped, since the other end of
+ * each connection they have been registered with keeps its mapping
+ * until the connection goes away. Their unused memory is returned to
+ * the system here just like the first segment's, so an idle grown
+ * segment does not keep any memory committed. */
 void pa_mempool_vacuum(pa_mempool *p) {
     struct mempool_slot *slot;
     pa_flist *list;
 
     pa_assert(p);
 
+    /* Locked pools are meant to stay resident */
+    if (p->locked)
+        return;
+
     list = pa_flist_new(p->n_blocks);
 
     while ((slot = pa_flist_pop(p->free_slots)))
@@ -968,7 +1491,9 @@ void pa_mempool_vacuum(pa_mempool *p) {
             ;
 
     while ((slot = pa_flist_pop(list))) {
-        pa_shm_punch(&p->memory, (size_t) ((uint8_t*) slot - (uint8_t*) p->memory.ptr), p->block_size);
+        pa_shm *segment = mempool_segment_by_ptr(p, slot);
+
+        pa_shm_punch(segment, (size_t) ((uint8_t*) slot - (uint8_t*) segment->ptr), p->block_size);
 
         while (pa_flist_push(p->free_slots, slot))
             ;
@@ -977,6 +1502,87 @@ void pa_mempool_vacuum(pa_mempool *p) {
     pa_flist_free(list, NULL);
 }
 
+/* Self-locked
+ *
+ * Makes sure the IO threads never take a page fault on pool memory:
+ * advises huge pages for it, faults all of it in and locks it, as well
+ * as any segment the pool grows by later on. Locked pools only grow by
+ * pa_mempool_grow(), never from allocations. Use this right after
+ * creating the pool. */
+int pa_mempool_lock(pa_mempool *p) {
+    char t[PA_BYTES_SNPRINT_MAX];
+    unsigned k, n;
+    bool huge_pages = true;
+
+    pa_assert(p);
+
+    pa_mutex_lock(p->mutex);
+
+    n = (unsigned) pa_atomic_load(&p->n_segments);
+
+    for (k = 0; k < n; k++) {
+        bool h;
+
+        if (pa_shm_lock(mempool_segment(p, k), &h) < 0) {
+            while (k > 0)
+                pa_shm_unlock(mempool_segment(p, --k));
+
+            pa_mutex_unlock(p->mutex);
+            return -1;
+        }
+
+        huge_pages = huge_pages && h;
+    }
+
+    p->locked = true;
+    p->huge_pages = huge_pages;
+    pa_atomic_store(&p->stat.locked_size, (int) (p->block_size * p->segment_blocks * n));
+
+    pa_mutex_unlock(p->mutex);
+
+    pa_log_info("Locked %s of memory pool into memory%s.",
+                pa_bytes_snprint(t, sizeof(t), (unsigned) pa_atomic_load(&p->stat.locked_size)),
+                huge_pages ? ", backed by huge pages" : "");
+
+    return 0;
+}
+
+/* No lock necessary */
+void pa_mempool_set_grow_callback(pa_mempool *p, pa_mempool_grow_cb_t cb, void *userdata) {
+    pa_assert(p);
+
+    p->grow_cb = cb;
+    p->grow_userdata = userdata;
+}
+
+/* Self-locked. Maps the next segment of a growable pool. Only call
+ * this from threads that may block, mapping and locking the segment
+ * takes a while. */
+int pa_mempool_grow(pa_mempool *p) {
+    pa_assert(p);
+
+    if (mempool_grow(p, (unsigned) pa_atomic_load(&p->n_segments)) < 0)
+        return -1;
+
+    /* A segment that could not be mapped is not asked for again */
+    pa_atomic_store(&p->grow_requested, 0);
+    return 0;
+}
+
+/* No lock necessary */
+bool pa_mempool_is_locked(pa_mempool *p) {
+    pa_assert(p);
+
+    return p->locked;
+}
+
+/* No lock necessary */
+bool pa_mempool_uses_huge_pages(pa_mempool *p) {
+    pa_assert(p);
+
+    return p->huge_pages;
+}
+
 /* No lock necessary */
 bool pa_mempool_is_shared(pa_mempool *p) {
     pa_assert(p);
@@ -1083,6 +1689,43 @@ int pa_mempool_get_memfd_fd(pa_mempool *p) {
     return memfd_fd;
 }
 
+/* Self-locked
+ *
+ * Looks up a segment the pool has grown by. For per-client mempools the
+ * caller takes ownership of the returned fd as with
+ * pa_mempool_take_memfd_fd(), for global mempools it stays open. Returns
+ * -1 if the SHM ID does not belong to a grown segment or the fd has
+ * been taken already. */
+int pa_mempool_get_segment_memfd_fd(pa_mempool *p, uint32_t shm_id) {
+    int memfd_fd = -1;
+    unsigned k, n;
+
+    pa_assert(p);
+    pa_assert(pa_mempool_is_memfd_backed(p));
+
+    pa_mutex_lock(p->mutex);
+
+    n = (unsigned) pa_atomic_load(&p->n_segments);
+
+    for (k = 1; k < n; k++) {
+        pa_shm *segment = mempool_segment(p, k);
+
+        if (segment->id != shm_id)
+            continue;
+
+        memfd_fd = segment->fd;
+
+        if (pa_mempool_is_per_client(p))
+            segment->fd = -1;
+
+        break;
+    }
+
+    pa_mutex_unlock(p->mutex);
+
+    return memfd_fd;
+}
+
 /* For receiving blocks from other nodes */
 pa_memimport* pa_memimport_new(pa_mempool *p, pa_memimport_release_cb_t cb, void *userdata) {
     pa_memimport *i;
@@ -1498,7 +2141,7 @@ int pa_memexport_put(pa_memexport *e, pa_memblock *b, pa_mem_type_t *type, uint3
         pa_assert(b->type == PA_MEMBLOCK_POOL || b->type == PA_MEMBLOCK_POOL_EXTERNAL);
         pa_assert(b->pool);
         pa_assert(pa_mempool_is_shared(b->pool));
-        memory = &b->pool->memory;
+        memory = mempool_segment_by_ptr(b->pool, data);
     }
 
     pa_assert(data >= memory->ptr);
@@ -54,13 +54,23 @@ typedef struct pa_memimport_segment pa_memimport_segment;
 typedef struct pa_memimport pa_memimport;
 typedef struct pa_memexport pa_memexport;
 
+/* Pool slots are handed out in size classes of the full slot size
+ * divided by powers of two, i.e. 1 KiB to 64 KiB by default */
+#define PA_MEMPOOL_SIZE_CLASSES 7
+
 typedef void (*pa_memimport_release_cb_t)(pa_memimport *i, uint32_t block_id, void *userdata);
 typedef void (*pa_memexport_revoke_cb_t)(pa_memexport *e, uint32_t block_id, void *userdata);
 
+/* Called from the allocating thread when a growable pool is about to
+ * run full. pa_mempool_grow() should be called soon after, from a
+ * thread that may block. */
+typedef void (*pa_mempool_grow_cb_t)(pa_mempool *p, void *userdata);
+
 /* Please note that updates to this structure are not locked,
  * i.e. n_allocated might be updated at a point in time where
- * n_accumulated is not yet. Take these values with a grain of salt,
- * they are here for purely statistical reasons.*/
+ * n_accumulated is not yet. Blocks allocated and freed through a
+ * thread cache are only counted every so often. Take these values with
+ * a grain of salt, they are here for purely statistical reasons.*/
 struct pa_mempool_stat {
     pa_atomic_t n_allocated;
     pa_atomic_t n_accumulated;
@@ -74,8 +84,23 @@ struct pa_mempool_stat {
     pa_atomic_t n_too_large_for_pool;
     pa_atomic_t n_pool_full;
 
+    /* Blocks of a shared pool that had to be allocated from the heap
+     * instead, and thus cannot be passed by reference */
+    pa_atomic_t n_shm_fallbacks;
+
+    /* Segments of a growable (memfd-backed) pool mapped so far */
+    pa_atomic_t n_segments;
+
+    /* Pool memory locked by pa_mempool_lock() */
+    pa_atomic_t locked_size;
+
     pa_atomic_t n_allocated_by_type[PA_MEMBLOCK_TYPE_MAX];
     pa_atomic_t n_accumulated_by_type[PA_MEMBLOCK_TYPE_MAX];
+
+    /* Pool slots split up for each size class, and blocks allocated
+     * from them */
+    pa_atomic_t n_slots_by_class[PA_MEMPOOL_SIZE_CLASSES];
+    pa_atomic_t n_allocated_by_class[PA_MEMPOOL_SIZE_CLASSES];
 };
 
 /* Allocate a new memory block of type PA_MEMBLOCK_MEMPOOL or PA_MEMBLOCK_APPENDED, depending on the size */
@@ -129,6 +154,11 @@ void pa_mempool_unref(pa_mempool *p);
 pa_mempool* pa_mempool_ref(pa_mempool *p);
 const pa_mempool_stat* pa_mempool_get_stat(pa_mempool *p);
 void pa_mempool_vacuum(pa_mempool *p);
+int pa_mempool_lock(pa_mempool *p);
+bool pa_mempool_is_locked(pa_mempool *p);
+void pa_mempool_set_grow_callback(pa_mempool *p, pa_mempool_grow_cb_t cb, void *userdata);
+int pa_mempool_grow(pa_mempool *p);
+bool pa_mempool_uses_huge_pages(pa_mempool *p);
 int pa_mempool_get_shm_id(pa_mempool *p, uint32_t *id);
 bool pa_mempool_is_shared(pa_mempool *p);
 bool pa_mempool_is_memfd_backed(const pa_mempool *p);
@@ -138,8 +168,20 @@ bool pa_mempool_is_remote_writable(pa_mempool *p);
 void pa_mempool_set_is_remote_writable(pa_mempool *p, bool writable);
 size_t pa_mempool_block_size_max(pa_mempool *p);
 
+/* Returns the size of the blocks of the given size class */
+size_t pa_mempool_class_size(pa_mempool *p, unsigned size_class);
+
+/* Gives the calling thread a private cache of free slots of the pool,
+ * replacing the cache of another pool if there is one. Allocating and
+ * freeing blocks of this pool in the thread then mostly does without
+ * atomic operations on the shared free lists. The cache keeps a
+ * reference to the pool until it is disabled or the thread exits. */
+void pa_mempool_enable_thread_cache(pa_mempool *p);
+void pa_mempool_disable_thread_cache(void);
+
 int pa_mempool_take_memfd_fd(pa_mempool *p);
 int pa_mempool_get_memfd_fd(pa_mempool *p);
+int pa_mempool_get_segment_memfd_fd(pa_mempool *p, uint32_t shm_id);
 
 /* For receiving blocks from other nodes */
 pa_memimport* pa_memimport_new(pa_mempool *p, pa_memimport_release_cb_t cb, void *userdata);
@@ -36,6 +36,9 @@
 
 /* #define MEMBLOCKQ_DEBUG */
 
+/* Initial number of entries of a ring mode queue */
+#define RING_SIZE_MIN (16)
+
 struct list_item {
     struct list_item *next, *prev;
     int64_t index;
@@ -56,6 +59,12 @@ struct pa_memblockq {
     int64_t missing, requested;
     char *name;
     pa_sample_spec sample_spec;
+
+    /* In ring mode the list items live in this array, in order starting
+     * at ring_head, instead of being allocated one by one. The list
+     * pointers are maintained as usual. */
+    struct list_item *ring;
+    unsigned ring_size, ring_head;
 };
 
 pa_memblockq* pa_memblockq_new(
@@ -116,10 +125,104 @@ void pa_memblockq_free(pa_memblockq* bq) {
     if (bq->mcalign)
         pa_mcalign_free(bq->mcalign);
 
+    pa_xfree(bq->ring);
+
     pa_xfree(bq->name);
     pa_xfree(bq);
 }
 
+static struct list_item *ring_item(pa_memblockq *bq, unsigned i) {
+    return &bq->ring[(bq->ring_head + i) & (bq->ring_size - 1)];
+}
+
+/* Returns the first item that ends after idx, like fix_current_read()
+ * but with a binary search */
+static struct list_item *ring_find(pa_memblockq *bq, int64_t idx) {
+    unsigned l = 0, r = bq->n_blocks;
+
+    while (l < r) {
+        unsigned m = l + (r - l) / 2;
+        struct list_item *q = ring_item(bq, m);
+
+        if (q->index + (int64_t) q->chunk.length <= idx)
+            l = m + 1;
+        else
+            r = m;
+    }
+
+    return l < bq->n_blocks ? ring_item(bq, l) : NULL;
+}
+
+/* Moves the items into an array of twice the size, relinking them */
+static void ring_grow(pa_memblockq *bq) {
+    struct list_item *ring;
+    unsigned i;
+
+    ring = pa_xnew(struct list_item, bq->ring_size * 2);
+
+    for (i = 0; i < bq->n_blocks; i++) {
+        struct list_item *q = ring_item(bq, i);
+
+        ring[i].index = q->index;
+        ring[i].chunk = q->chunk;
+        ring[i].prev = i > 0 ? &ring[i - 1] : NULL;
+        ring[i].next = i + 1 < bq->n_blocks ? &ring[i + 1] : NULL;
+
+        if (bq->current_read == q)
+            bq->current_read = &ring[i];
+        if (bq->current_write == q)
+            bq->current_write = &ring[i];
+    }
+
+    bq->blocks = bq->n_blocks > 0 ? &ring[0] : NULL;
+    bq->blocks_tail = bq->n_blocks > 0 ? &ring[bq->n_blocks - 1] : NULL;
+
+    pa_xfree(bq->ring);
+    bq->ring = ring;
+    bq->ring_size *= 2;
+    bq->ring_head = 0;
+}
+
+/* Data is to be written somewhere else than at the end of the queue,
+ * which the ring can't do. Move the items into a list for good. */
+static void ring_to_list(pa_memblockq *bq) {
+    struct list_item *prev = NULL;
+    unsigned i;
+
+#ifdef MEMBLOCKQ_DEBUG
+    pa_log_debug("[%s] Leaving ring mode", bq->name);
+#endif
+
+    for (i = 0; i < bq->n_blocks; i++) {
+        struct list_item *q, *r = ring_item(bq, i);
+
+        if (!(q = pa_flist_pop(PA_STATIC_FLIST_GET(list_items))))
+            q = pa_xnew(struct list_item, 1);
+
+        q->index = r->index;
+        q->chunk = r->chunk;
+        q->next = NULL;
+
+        if ((q->prev = prev))
+            prev->next = q;
+        else
+            bq->blocks = q;
+
+        if (bq->current_read == r)
+            bq->current_read = q;
+        if (bq->current_write == r)
+            bq->current_write = q;
+
+        prev = q;
+    }
+
+    bq->blocks_tail = prev;
+
+    pa_xfree(bq->ring);
+    bq->ring = NULL;
+    bq->ring_size = bq->ring_head = 0;
+}
+
 static void fix_current_read(pa_memblockq *bq) {
     pa_assert(bq);
 
@@ -128,6 +231,26 @@ static void fix_current_read(pa_memblockq *bq) {
         return;
     }
 
+    if (bq->ring) {
+        struct list_item *q = bq->current_read;
+
+        /* Usually the read index is still in the current item or has
+         * moved on to the next one, otherwise it has been rewound or
+         * has skipped a hole */
+        if (q && q->index <= bq->read_index) {
+            if (bq->read_index < q->index + (int64_t) q->chunk.length)
+                return;
+
+            if ((q = q->next) && q->index <= bq->read_index && bq->read_index < q->index + (int64_t) q->chunk.length) {
+                bq->current_read = q;
+                return;
+            }
+        }
+
+        bq->current_read = ring_find(bq, bq->read_index);
+        return;
+    }
+
     if (PA_UNLIKELY(!bq->current_read))
         bq->current_read = bq->blocks;
 
@@ -204,7 +327,11 @@ static void drop_block(pa_memblockq *bq, struct list_item *q) {
 
     pa_memblock_unref(q->chunk.memblock);
 
-    if (pa_flist_push(PA_STATIC_FLIST_GET(list_items), q) < 0)
+    if (bq->ring) {
+        /* Items are only ever dropped from the front of the ring */
+        pa_assert(q == ring_item(bq, 0));
+        bq->ring_head = (bq->ring_head + 1) & (bq->ring_size - 1);
+    } else if (pa_flist_push(PA_STATIC_FLIST_GET(list_items), q) < 0)
         pa_xfree(q);
 
     bq->n_blocks--;
@@ -293,6 +420,13 @@ int pa_memblockq_push(pa_memblockq* bq, const pa_memchunk *uchunk) {
     old = bq->write_index;
     chunk = *uchunk;
 
+    if (bq->ring) {
+        if (bq->blocks_tail && bq->write_index < bq->blocks_tail->index + (int64_t) bq->blocks_tail->chunk.length)
+            ring_to_list(bq);
+        else if (bq->n_blocks == bq->ring_size)
+            ring_grow(bq);
+    }
+
     fix_current_write(bq);
     q = bq->current_write;
 
@@ -412,7 +546,11 @@ int pa_memblockq_push(pa_memblockq* bq, const pa_memchunk *uchunk) {
     } else
         pa_assert(!bq->blocks || (bq->write_index + (int64_t)chunk.length <= bq->blocks->index));
 
-    if (!(n = pa_flist_pop(PA_STATIC_FLIST_GET(list_items))))
+    if (bq->ring) {
+        /* Appended right after the tail */
+        pa_assert(q == bq->blocks_tail);
+        n = ring_item(bq, bq->n_blocks);
+    } else if (!(n = pa_flist_pop(PA_STATIC_FLIST_GET(list_items))))
         n = pa_xnew(struct list_item, 1);
 
     n->chunk = chunk;
@@ -772,6 +910,11 @@ int pa_memblockq_push_align(pa_memblockq* bq, const pa_memchunk *chunk) {
     if (bq->base == 1)
         return pa_memblockq_push(bq, chunk);
 
+    /* Aligned chunks, as received from clients, go into the queue as
+     * they are, without a detour through the aligner */
+    if (chunk->length % bq->base == 0 && pa_mcalign_is_empty(bq->mcalign))
+        return pa_memblockq_push(bq, chunk);
+
     if (!can_push(bq, pa_mcalign_csize(bq->mcalign, chunk->length)))
         return -1;
 
@@ -1006,6 +1149,24 @@ void pa_memblockq_silence(pa_memblockq *bq) {
     pa_assert(bq->n_blocks == 0);
 }
 
+void pa_memblockq_enable_ring(pa_memblockq *bq) {
+    pa_assert(bq);
+    pa_assert(!bq->blocks);
+
+    if (bq->ring)
+        return;
+
+    bq->ring_size = RING_SIZE_MIN;
+    bq->ring_head = 0;
+    bq->ring = pa_xnew(struct list_item, bq->ring_size);
+}
+
+bool pa_memblockq_is_ring(pa_memblockq *bq) {
+    pa_assert(bq);
+
+    return !!bq->ring;
+}
+
 unsigned pa_memblockq_get_nblocks(pa_memblockq *bq) {
     pa_assert(bq);
 
@@ -181,6 +181,16 @@ void pa_memblockq_silence(pa_memblockq *bq);
 /* Check whether we currently are in prebuf state */
 bool pa_memblockq_prebuf_active(pa_memblockq *bq);
 
+/* Keep the queue items in a contiguous ring rather than in a linked
+ * list, so that pushing, peeking, dropping and rewinding need no
+ * allocations and little pointer chasing. Meant for queues that are
+ * only ever appended to; if data is pushed anywhere else the queue
+ * goes back to the list for good. The queue must be empty. */
+void pa_memblockq_enable_ring(pa_memblockq *bq);
+
+/* Check whether the queue is still in ring mode */
+bool pa_memblockq_is_ring(pa_memblockq *bq);
+
 /* Return how many items are currently stored in the queue */
 unsigned pa_memblockq_get_nblocks(pa_memblockq *bq);
 
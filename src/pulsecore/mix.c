@@ -24,6 +24,7 @@
 #endif
 
 #include <math.h>
+#include <string.h>
 
 #include <pulsecore/sample-util.h>
 #include <pulsecore/macro.h>
@@ -35,6 +36,14 @@
 
 #define VOLUME_PADDING 32
 
+/* With more streams than this, pa_mix() sums them in batches into a wide
+ * accumulator instead of using the mixing functions of do_mix_table */
+#define MIX_BATCHED_MIN_STREAMS 32
+/* Streams read together per sample when mixing in batches */
+#define MIX_BATCH_STREAMS 8
+/* Samples mixed at once, small enough to keep the accumulator in cache */
+#define MIX_TILE_SAMPLES 1024
+
 static void calc_linear_integer_volume(int32_t linear[], const pa_cvolume *volume) {
     unsigned channel, nchannels, padding;
 
@@ -608,18 +617,230 @@ static pa_do_mix_func_t do_mix_table[] = {
 void pa_mix_func_init(const pa_cpu_info *cpu_info) {
     if (cpu_info->force_generic_code)
         do_mix_table[PA_SAMPLE_S16NE] = (pa_do_mix_func_t) pa_mix_generic_s16ne;
-    else
+    else if (do_mix_table[PA_SAMPLE_S16NE] == (pa_do_mix_func_t) pa_mix_generic_s16ne)
+        /* Don't replace optimized functions installed by pa_cpu_init_*() */
         do_mix_table[PA_SAMPLE_S16NE] = (pa_do_mix_func_t) pa_mix_s16ne_c;
 }
 
-size_t pa_mix(
+/* Mixing of many streams. The mixing functions above read every stream for
+ * each sample, which gets slow once the number of streams exceeds what the
+ * cache and the prefetcher can follow, and their 32 bit sums may overflow.
+ * Instead, tiles of MIX_TILE_SAMPLES samples are mixed by adding batches of
+ * MIX_BATCH_STREAMS streams at a time to an accumulator of 64 bit integers or
+ * doubles, which is saturated only once when it is stored. This is also used
+ * by pa_mix_wide(). */
+
+typedef union {
+    int64_t i;
+    double f;
+} mix_accumulator;
+
+typedef void (*pa_accumulate_func_t) (mix_accumulator acc[], pa_mix_info streams[], unsigned nstreams, unsigned channels, unsigned n);
+typedef void (*pa_store_func_t) (void *data, const mix_accumulator acc[], unsigned n);
+
+#define READ_U8(p) ((int32_t) *((uint8_t*) (p)) - 0x80)
+#define READ_ALAW(p) st_alaw2linear16(*((uint8_t*) (p)))
+#define READ_ULAW(p) st_ulaw2linear16(*((uint8_t*) (p)))
+#define READ_S16NE(p) (*((int16_t*) (p)))
+#define READ_S16RE(p) PA_INT16_SWAP(*((int16_t*) (p)))
+#define READ_S32NE(p) (*((int32_t*) (p)))
+#define READ_S32RE(p) PA_INT32_SWAP(*((int32_t*) (p)))
+#define READ_S24NE(p) ((int32_t) (PA_READ24NE((uint8_t*) (p)) << 8))
+#define READ_S24RE(p) ((int32_t) (PA_READ24RE((uint8_t*) (p)) << 8))
+#define READ_S24_32NE(p) ((int32_t) (*((uint32_t*) (p)) << 8))
+#define READ_S24_32RE(p) ((int32_t) (PA_UINT32_SWAP(*((uint32_t*) (p))) << 8))
+#define READ_FLOAT32NE(p) (*((float*) (p)))
+#define READ_FLOAT32RE(p) PA_READ_FLOAT32RE(p)
+
+#define DEFINE_ACCUMULATE_INTEGER(name, size, read)                                        \
+static void accumulate_##name(mix_accumulator acc[], pa_mix_info streams[], unsigned nstreams, \
+                              unsigned channels, unsigned n) {                             \
+    unsigned channel = 0, i, k;                                                            \
+                                                                                           \
+    for (i = 0; i < n; i++) {                                                              \
+        int64_t sum = 0;                                                                   \
+                                                                                           \
+        for (k = 0; k < nstreams; k++) {                                                   \
+            pa_mix_info *m = streams + k;                                                  \
+            int32_t cv = m->linear[channel].i;                                             \
+                                                                                           \
+            if (PA_LIKELY(cv > 0))                                                         \
+                sum += ((int64_t) read(m->ptr) * cv) >> 16;                                \
+            m->ptr = (uint8_t*) m->ptr + size;                                             \
+        }                                                                                  \
+                                                                                           \
+        acc[i].i += sum;                                                                   \
+                                                                                           \
+        if (PA_UNLIKELY(++channel >= channels))                                            \
+            channel = 0;                                                                   \
+    }                                                                                      \
+}
+
+#define DEFINE_ACCUMULATE_FLOAT(name, read)                                                \
+static void accumulate_##name(mix_accumulator acc[], pa_mix_info streams[], unsigned nstreams, \
+                              unsigned channels, unsigned n) {                             \
+    unsigned channel = 0, i, k;                                                            \
+                                                                                           \
+    for (i = 0; i < n; i++) {                                                              \
+        double sum = 0;                                                                    \
+                                                                                           \
+        for (k = 0; k < nstreams; k++) {                                                   \
+            pa_mix_info *m = streams + k;                                                  \
+            float cv = m->linear[channel].f;                                               \
+                                                                                           \
+            if (PA_LIKELY(cv > 0))                                                         \
+                sum += read(m->ptr) * cv;                                                  \
+            m->ptr = (uint8_t*) m->ptr + sizeof(float);                                    \
+        }                                                                                  \
+                                                                                           \
+        acc[i].f += sum;                                                                   \
+                                                                                           \
+        if (PA_UNLIKELY(++channel >= channels))                                            \
+            channel = 0;                                                                   \
+    }                                                                                      \
+}
+
+DEFINE_ACCUMULATE_INTEGER(u8, 1, READ_U8)
+DEFINE_ACCUMULATE_INTEGER(alaw, 1, READ_ALAW)
+DEFINE_ACCUMULATE_INTEGER(ulaw, 1, READ_ULAW)
+DEFINE_ACCUMULATE_INTEGER(s16ne, 2, READ_S16NE)
+DEFINE_ACCUMULATE_INTEGER(s16re, 2, READ_S16RE)
+DEFINE_ACCUMULATE_INTEGER(s32ne, 4, READ_S32NE)
+DEFINE_ACCUMULATE_INTEGER(s32re, 4, READ_S32RE)
+DEFINE_ACCUMULATE_INTEGER(s24ne, 3, READ_S24NE)
+DEFINE_ACCUMULATE_INTEGER(s24re, 3, READ_S24RE)
+DEFINE_ACCUMULATE_INTEGER(s24_32ne, 4, READ_S24_32NE)
+DEFINE_ACCUMULATE_INTEGER(s24_32re, 4, READ_S24_32RE)
+DEFINE_ACCUMULATE_FLOAT(float32ne, READ_FLOAT32NE)
+DEFINE_ACCUMULATE_FLOAT(float32re, READ_FLOAT32RE)
+
+static void store_u8(uint8_t *data, const mix_accumulator acc[], unsigned n) {
+    for (; n > 0; n--, acc++)
+        *data++ = (uint8_t) (PA_CLAMP_UNLIKELY(acc->i, -0x80, 0x7F) + 0x80);
+}
+
+static void store_alaw(uint8_t *data, const mix_accumulator acc[], unsigned n) {
+    for (; n > 0; n--, acc++)
+        *data++ = (uint8_t) st_13linear2alaw((int16_t) PA_CLAMP_UNLIKELY(acc->i, -0x8000, 0x7FFF) >> 3);
+}
+
+static void store_ulaw(uint8_t *data, const mix_accumulator acc[], unsigned n) {
+    for (; n > 0; n--, acc++)
+        *data++ = (uint8_t) st_14linear2ulaw((int16_t) PA_CLAMP_UNLIKELY(acc->i, -0x8000, 0x7FFF) >> 2);
+}
+
+static void store_s16ne(int16_t *data, const mix_accumulator acc[], unsigned n) {
+    for (; n > 0; n--, acc++)
+        *data++ = (int16_t) PA_CLAMP_UNLIKELY(acc->i, -0x8000, 0x7FFF);
+}
+
+static void store_s16re(int16_t *data, const mix_accumulator acc[], unsigned n) {
+    for (; n > 0; n--, acc++)
+        *data++ = PA_INT16_SWAP((int16_t) PA_CLAMP_UNLIKELY(acc->i, -0x8000, 0x7FFF));
+}
+
+static void store_s32ne(int32_t *data, const mix_accumulator acc[], unsigned n) {
+    for (; n > 0; n--, acc++)
+        *data++ = (int32_t) PA_CLAMP_UNLIKELY(acc->i, -0x80000000LL, 0x7FFFFFFFLL);
+}
+
+static void store_s32re(int32_t *data, const mix_accumulator acc[], unsigned n) {
+    for (; n > 0; n--, acc++)
+        *data++ = PA_INT32_SWAP((int32_t) PA_CLAMP_UNLIKELY(acc->i, -0x80000000LL, 0x7FFFFFFFLL));
+}
+
+static void store_s24ne(uint8_t *data, const mix_accumulator acc[], unsigned n) {
+    for (; n > 0; n--, acc++, data += 3)
+        PA_WRITE24NE(data, ((uint32_t) PA_CLAMP_UNLIKELY(acc->i, -0x80000000LL, 0x7FFFFFFFLL)) >> 8);
+}
+
+static void store_s24re(uint8_t *data, const mix_accumulator acc[], unsigned n) {
+    for (; n > 0; n--, acc++, data += 3)
+        PA_WRITE24RE(data, ((uint32_t) PA_CLAMP_UNLIKELY(acc->i, -0x80000000LL, 0x7FFFFFFFLL)) >> 8);
+}
+
+static void store_s24_32ne(uint32_t *data, const mix_accumulator acc[], unsigned n) {
+    for (; n > 0; n--, acc++)
+        *data++ = ((uint32_t) (int32_t) PA_CLAMP_UNLIKELY(acc->i, -0x80000000LL, 0x7FFFFFFFLL)) >> 8;
+}
+
+static void store_s24_32re(uint32_t *data, const mix_accumulator acc[], unsigned n) {
+    for (; n > 0; n--, acc++)
+        *data++ = PA_UINT32_SWAP(((uint32_t) (int32_t) PA_CLAMP_UNLIKELY(acc->i, -0x80000000LL, 0x7FFFFFFFLL)) >> 8);
+}
+
+static void store_float32ne(float *data, const mix_accumulator acc[], unsigned n) {
+    for (; n > 0; n--, acc++)
+        *data++ = (float) acc->f;
+}
+
+static void store_float32re(float *data, const mix_accumulator acc[], unsigned n) {
+    for (; n > 0; n--, acc++, data++)
+        PA_WRITE_FLOAT32RE(data, (float) acc->f);
+}
+
+static const pa_accumulate_func_t accumulate_table[] = {
+    [PA_SAMPLE_U8]        = (pa_accumulate_func_t) accumulate_u8,
+    [PA_SAMPLE_ALAW]      = (pa_accumulate_func_t) accumulate_alaw,
+    [PA_SAMPLE_ULAW]      = (pa_accumulate_func_t) accumulate_ulaw,
+    [PA_SAMPLE_S16NE]     = (pa_accumulate_func_t) accumulate_s16ne,
+    [PA_SAMPLE_S16RE]     = (pa_accumulate_func_t) accumulate_s16re,
+    [PA_SAMPLE_FLOAT32NE] = (pa_accumulate_func_t) accumulate_float32ne,
+    [PA_SAMPLE_FLOAT32RE] = (pa_accumulate_func_t) accumulate_float32re,
+    [PA_SAMPLE_S32NE]     = (pa_accumulate_func_t) accumulate_s32ne,
+    [PA_SAMPLE_S32RE]     = (pa_accumulate_func_t) accumulate_s32re,
+    [PA_SAMPLE_S24NE]     = (pa_accumulate_func_t) accumulate_s24ne,
+    [PA_SAMPLE_S24RE]     = (pa_accumulate_func_t) accumulate_s24re,
+    [PA_SAMPLE_S24_32NE]  = (pa_accumulate_func_t) accumulate_s24_32ne,
+    [PA_SAMPLE_S24_32RE]  = (pa_accumulate_func_t) accumulate_s24_32re
+};
+
+static const pa_store_func_t store_table[] = {
+    [PA_SAMPLE_U8]        = (pa_store_func_t) store_u8,
+    [PA_SAMPLE_ALAW]      = (pa_store_func_t) store_alaw,
+    [PA_SAMPLE_ULAW]      = (pa_store_func_t) store_ulaw,
+    [PA_SAMPLE_S16NE]     = (pa_store_func_t) store_s16ne,
+    [PA_SAMPLE_S16RE]     = (pa_store_func_t) store_s16re,
+    [PA_SAMPLE_FLOAT32NE] = (pa_store_func_t) store_float32ne,
+    [PA_SAMPLE_FLOAT32RE] = (pa_store_func_t) store_float32re,
+    [PA_SAMPLE_S32NE]     = (pa_store_func_t) store_s32ne,
+    [PA_SAMPLE_S32RE]     = (pa_store_func_t) store_s32re,
+    [PA_SAMPLE_S24NE]     = (pa_store_func_t) store_s24ne,
+    [PA_SAMPLE_S24RE]     = (pa_store_func_t) store_s24re,
+    [PA_SAMPLE_S24_32NE]  = (pa_store_func_t) store_s24_32ne,
+    [PA_SAMPLE_S24_32RE]  = (pa_store_func_t) store_s24_32re
+};
+
+static void mix_batched(pa_mix_info streams[], unsigned nstreams, const pa_sample_spec *spec, void *data, size_t length) {
+    mix_accumulator acc[MIX_TILE_SAMPLES];
+    size_t sample_size = pa_sample_size(spec);
+    unsigned tile, n, i, k;
+
+    /* Keep tiles frame aligned so that every tile starts with channel 0 */
+    tile = (MIX_TILE_SAMPLES / spec->channels) * spec->channels;
+    n = (unsigned) (length / sample_size);
+
+    for (i = 0; i < n; i += tile) {
+        unsigned t = PA_MIN(tile, n - i);
+
+        memset(acc, 0, t * sizeof(mix_accumulator));
+
+        for (k = 0; k < nstreams; k += MIX_BATCH_STREAMS)
+            accumulate_table[spec->format](acc, streams + k, PA_MIN(MIX_BATCH_STREAMS, nstreams - k), spec->channels, t);
+
+        store_table[spec->format]((uint8_t*) data + i * sample_size, acc, t);
+    }
+}
+
+static size_t mix(
         pa_mix_info streams[],
         unsigned nstreams,
         void *data,
         size_t length,
         const pa_sample_spec *spec,
         const pa_cvolume *volume,
-        bool mute) {
+        bool mute,
+        bool wide) {
 
     pa_cvolume full_volume;
     unsigned k;
@@ -628,7 +849,7 @@ size_t pa_mix(
     pa_assert(data);
     pa_assert(length);
     pa_assert(spec);
-    pa_assert(nstreams > 1);
+    pa_assert(nstreams > 0);
 
     if (!volume)
         volume = pa_cvolume_reset(&full_volume, spec->channels);
@@ -644,7 +865,11 @@ size_t pa_mix(
     }
 
     calc_stream_volumes_table[spec->format](streams, nstreams, volume, spec);
-    do_mix_table[spec->format](streams, nstreams, spec->channels, data, length);
+
+    if (wide || nstreams > MIX_BATCHED_MIN_STREAMS)
+        mix_batched(streams, nstreams, spec, data, length);
+    else
+        do_mix_table[spec->format](streams, nstreams, spec->channels, data, length);
 
     for (k = 0; k < nstreams; k++)
         pa_memblock_release(streams[k].chunk.memblock);
@@ -652,6 +877,30 @@ size_t pa_mix(
     return length;
 }
 
+size_t pa_mix(
+        pa_mix_info streams[],
+        unsigned nstreams,
+        void *data,
+        size_t length,
+        const pa_sample_spec *spec,
+        const pa_cvolume *volume,
+        bool mute) {
+
+    return mix(streams, nstreams, data, length, spec, volume, mute, false);
+}
+
+size_t pa_mix_wide(
+        pa_mix_info streams[],
+        unsigned nstreams,
+        void *data,
+        size_t length,
+        const pa_sample_spec *spec,
+        const pa_cvolume *volume,
+        bool mute) {
+
+    return mix(streams, nstreams, data, length, spec, volume, mute, true);
+}
+
 pa_do_mix_func_t pa_get_mix_func(pa_sample_format_t f) {
     pa_assert(pa_sample_format_valid(f));
 
@@ -49,6 +49,18 @@ size_t pa_mix(
     const pa_cvolume *volume,
     bool mute);
 
+/* Like pa_mix(), but always sums all streams in a 64 bit integer or double
+ * accumulator and saturates only the final result, whatever the number of
+ * streams. */
+size_t pa_mix_wide(
+    pa_mix_info channels[],
+    unsigned nchannels,
+    void *data,
+    size_t length,
+    const pa_sample_spec *spec,
+    const pa_cvolume *volume,
+    bool mute);
+
 typedef void (*pa_do_mix_func_t) (pa_mix_info streams[], unsigned nstreams, unsigned channels, void *data, unsigned length);
 
 pa_do_mix_func_t pa_get_mix_func(pa_sample_format_t f);
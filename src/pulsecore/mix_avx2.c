@@ -0,0 +1,304 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "cpu-x86.h"
+#include "mix.h"
+#include "simd-util.h"
+
+#if defined (__i386__) || defined (__amd64__)
+
+#include <immintrin.h>
+
+/* Samples per AVX2 register for 16 bit and 32 bit samples */
+#define VEC16 16
+#define VEC32 8
+
+/* See mix_sse.c. Must be a multiple of VEC16. */
+#define TILE 512
+
+static pa_do_mix_func_t fallback_s16ne;
+static pa_do_mix_func_t fallback_s32ne;
+static pa_do_mix_func_t fallback_s24_32ne;
+static pa_do_mix_func_t fallback_float32ne;
+
+static bool stream_is_muted(const pa_mix_info *m, unsigned channels) {
+    unsigned c;
+
+    for (c = 0; c < channels; c++)
+        if (m->linear[c].i > 0)
+            return false;
+
+    return true;
+}
+
+static void mix_s16ne_avx2(pa_mix_info streams[], unsigned nstreams, unsigned channels, int16_t *data, unsigned length) {
+    PA_DECLARE_ALIGNED(32, int32_t, acc[TILE]);
+    int16_t lo[PA_CHANNELS_MAX + 2 * VEC16], hi[PA_CHANNELS_MAX + 2 * VEC16];
+    unsigned period = pa_volume_period(channels, VEC16);
+    unsigned n, done, i, j, k;
+
+    n = pa_vector_samples(length / sizeof(int16_t), channels, VEC16);
+
+    for (done = 0; done < n; done += TILE) {
+        unsigned tile = PA_MIN(n - done, (unsigned) TILE);
+
+        memset(acc, 0, tile * sizeof(int32_t));
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            const int16_t *src = (const int16_t *) m->ptr + done;
+            unsigned p = done % period;
+
+            if (stream_is_muted(m, channels))
+                continue;
+
+            for (k = 0; k < period + VEC16; k++) {
+                int32_t cv = m->linear[k % channels].i;
+                lo[k] = (int16_t) (cv & 0xFFFF);
+                hi[k] = (int16_t) (cv >> 16);
+            }
+
+            /* The unpacks work within 128 bit lanes, so the accumulator
+             * holds samples 0-3,8-11 followed by 4-7,12-15. packssdw below
+             * restores the original order. */
+            for (j = 0; j < tile; j += VEC16) {
+                __m256i v = _mm256_loadu_si256((const __m256i *) (src + j));
+                __m256i vlo = _mm256_loadu_si256((const __m256i *) (lo + p));
+                __m256i vhi = _mm256_loadu_si256((const __m256i *) (hi + p));
+                __m256i l, pl, ph, s0, s1;
+
+                l = _mm256_sub_epi16(_mm256_mulhi_epu16(v, vlo), _mm256_and_si256(_mm256_srai_epi16(v, 15), vlo));
+
+                pl = _mm256_mullo_epi16(v, vhi);
+                ph = _mm256_mulhi_epi16(v, vhi);
+
+                s0 = _mm256_add_epi32(_mm256_unpacklo_epi16(pl, ph), _mm256_srai_epi32(_mm256_unpacklo_epi16(l, l), 16));
+                s1 = _mm256_add_epi32(_mm256_unpackhi_epi16(pl, ph), _mm256_srai_epi32(_mm256_unpackhi_epi16(l, l), 16));
+
+                _mm256_store_si256((__m256i *) (acc + j), _mm256_add_epi32(_mm256_load_si256((__m256i *) (acc + j)), s0));
+                _mm256_store_si256((__m256i *) (acc + j + 8), _mm256_add_epi32(_mm256_load_si256((__m256i *) (acc + j + 8)), s1));
+
+                p += VEC16;
+                if (p >= period)
+                    p -= period;
+            }
+        }
+
+        for (j = 0; j < tile; j += VEC16) {
+            __m256i s0 = _mm256_load_si256((__m256i *) (acc + j));
+            __m256i s1 = _mm256_load_si256((__m256i *) (acc + j + 8));
+
+            _mm256_storeu_si256((__m256i *) (data + done + j), _mm256_packs_epi32(s0, s1));
+        }
+    }
+
+    if (n * sizeof(int16_t) < length) {
+        for (i = 0; i < nstreams; i++)
+            streams[i].ptr = (uint8_t *) streams[i].ptr + n * sizeof(int16_t);
+
+        fallback_s16ne(streams, nstreams, channels, data + n, length - n * sizeof(int16_t));
+    }
+}
+
+/* Arithmetic right shift of 64 bit lanes by 16, which AVX2 lacks */
+static inline __m256i sra64_16(__m256i x) {
+    __m256i sign = _mm256_shuffle_epi32(_mm256_srai_epi32(x, 31), _MM_SHUFFLE(3, 3, 1, 1));
+
+    return _mm256_or_si256(_mm256_srli_epi64(x, 16), _mm256_slli_epi64(sign, 48));
+}
+
+/* Adds (v * cv) >> 16 of all streams to a 64 bit accumulator, like the C
+ * implementation does. With shift set, the samples are s24_32 and get moved
+ * to the upper 24 bits first. */
+static void accumulate_s32_avx2(int64_t *acc, pa_mix_info streams[], unsigned nstreams, unsigned channels,
+                                unsigned done, unsigned tile, bool shift) {
+    int32_t vol[PA_CHANNELS_MAX + 2 * VEC32];
+    unsigned period = pa_volume_period(channels, VEC32);
+    unsigned i, j, k;
+
+    for (i = 0; i < nstreams; i++) {
+        pa_mix_info *m = streams + i;
+        const int32_t *src = (const int32_t *) m->ptr + done;
+        unsigned p = done % period;
+
+        if (stream_is_muted(m, channels))
+            continue;
+
+        for (k = 0; k < period + VEC32; k++)
+            vol[k] = PA_MAX(m->linear[k % channels].i, 0);
+
+        for (j = 0; j < tile; j += VEC32) {
+            __m256i v = _mm256_loadu_si256((const __m256i *) (src + j));
+            __m256i cv = _mm256_loadu_si256((const __m256i *) (vol + p));
+            __m256i pe, po, s0, s1;
+
+            if (shift)
+                v = _mm256_slli_epi32(v, 8);
+
+            pe = sra64_16(_mm256_mul_epi32(v, cv));
+            po = sra64_16(_mm256_mul_epi32(_mm256_srli_epi64(v, 32), _mm256_srli_epi64(cv, 32)));
+
+            /* samples 0,1,4,5 and 2,3,6,7, put back in order */
+            s0 = _mm256_unpacklo_epi64(pe, po);
+            s1 = _mm256_unpackhi_epi64(pe, po);
+
+            _mm256_store_si256((__m256i *) (acc + j),
+                               _mm256_add_epi64(_mm256_load_si256((__m256i *) (acc + j)),
+                                                _mm256_permute2x128_si256(s0, s1, 0x20)));
+            _mm256_store_si256((__m256i *) (acc + j + 4),
+                               _mm256_add_epi64(_mm256_load_si256((__m256i *) (acc + j + 4)),
+                                                _mm256_permute2x128_si256(s0, s1, 0x31)));
+
+            p += VEC32;
+            if (p >= period)
+                p -= period;
+        }
+    }
+}
+
+static void mix_s32ne_avx2(pa_mix_info streams[], unsigned nstreams, unsigned channels, int32_t *data, unsigned length) {
+    PA_DECLARE_ALIGNED(32, int64_t, acc[TILE]);
+    unsigned n, done, i, j;
+
+    n = pa_vector_samples(length / sizeof(int32_t), channels, VEC32);
+
+    for (done = 0; done < n; done += TILE) {
+        unsigned tile = PA_MIN(n - done, (unsigned) TILE);
+
+        memset(acc, 0, tile * sizeof(int64_t));
+        accumulate_s32_avx2(acc, streams, nstreams, channels, done, tile, false);
+
+        for (j = 0; j < tile; j++)
+            data[done + j] = (int32_t) PA_CLAMP_UNLIKELY(acc[j], -0x80000000LL, 0x7FFFFFFFLL);
+    }
+
+    if (n * sizeof(int32_t) < length) {
+        for (i = 0; i < nstreams; i++)
+            streams[i].ptr = (uint8_t *) streams[i].ptr + n * sizeof(int32_t);
+
+        fallback_s32ne(streams, nstreams, channels, data + n, length - n * sizeof(int32_t));
+    }
+}
+
+static void mix_s24_32ne_avx2(pa_mix_info streams[], unsigned nstreams, unsigned channels, uint32_t *data, unsigned length) {
+    PA_DECLARE_ALIGNED(32, int64_t, acc[TILE]);
+    unsigned n, done, i, j;
+
+    n = pa_vector_samples(length / sizeof(uint32_t), channels, VEC32);
+
+    for (done = 0; done < n; done += TILE) {
+        unsigned tile = PA_MIN(n - done, (unsigned) TILE);
+
+        memset(acc, 0, tile * sizeof(int64_t));
+        accumulate_s32_avx2(acc, streams, nstreams, channels, done, tile, true);
+
+        for (j = 0; j < tile; j++) {
+            int64_t sum = PA_CLAMP_UNLIKELY(acc[j], -0x80000000LL, 0x7FFFFFFFLL);
+            data[done + j] = ((uint32_t) (int32_t) sum) >> 8;
+        }
+    }
+
+    if (n * sizeof(uint32_t) < length) {
+        for (i = 0; i < nstreams; i++)
+            streams[i].ptr = (uint8_t *) streams[i].ptr + n * sizeof(uint32_t);
+
+        fallback_s24_32ne(streams, nstreams, channels, data + n, length - n * sizeof(uint32_t));
+    }
+}
+
+static void mix_float32ne_avx2(pa_mix_info streams[], unsigned nstreams, unsigned channels, float *data, unsigned length) {
+    PA_DECLARE_ALIGNED(32, float, acc[TILE]);
+    float vol[PA_CHANNELS_MAX + 2 * VEC32];
+    unsigned period = pa_volume_period(channels, VEC32);
+    unsigned n, done, i, j, k;
+
+    n = pa_vector_samples(length / sizeof(float), channels, VEC32);
+
+    for (done = 0; done < n; done += TILE) {
+        unsigned tile = PA_MIN(n - done, (unsigned) TILE);
+
+        memset(acc, 0, tile * sizeof(float));
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            const float *src = (const float *) m->ptr + done;
+            unsigned p = done % period;
+            bool muted = true;
+
+            for (k = 0; k < channels; k++)
+                if (m->linear[k].f > 0)
+                    muted = false;
+
+            if (muted)
+                continue;
+
+            for (k = 0; k < period + VEC32; k++)
+                vol[k] = PA_MAX(m->linear[k % channels].f, 0.0f);
+
+            /* Keep the multiply and add separate (no FMA) so the result is
+             * bit exact with the C version */
+            for (j = 0; j < tile; j += VEC32) {
+                __m256 v = _mm256_loadu_ps(src + j);
+                __m256 cv = _mm256_loadu_ps(vol + p);
+
+                _mm256_store_ps(acc + j, _mm256_add_ps(_mm256_load_ps(acc + j), _mm256_mul_ps(v, cv)));
+
+                p += VEC32;
+                if (p >= period)
+                    p -= period;
+            }
+        }
+
+        memcpy(data + done, acc, tile * sizeof(float));
+    }
+
+    if (n * sizeof(float) < length) {
+        for (i = 0; i < nstreams; i++)
+            streams[i].ptr = (uint8_t *) streams[i].ptr + n * sizeof(float);
+
+        fallback_float32ne(streams, nstreams, channels, data + n, length - n * sizeof(float));
+    }
+}
+
+#endif /* defined (__i386__) || defined (__amd64__) */
+
+void pa_mix_func_init_avx2(pa_cpu_x86_flag_t flags) {
+#if defined (__i386__) || defined (__amd64__)
+    if (flags & PA_CPU_X86_AVX2) {
+        pa_log_info("Initialising AVX2 optimized mixing functions.");
+
+        fallback_s16ne = pa_get_mix_func(PA_SAMPLE_S16NE);
+        fallback_s32ne = pa_get_mix_func(PA_SAMPLE_S32NE);
+        fallback_s24_32ne = pa_get_mix_func(PA_SAMPLE_S24_32NE);
+        fallback_float32ne = pa_get_mix_func(PA_SAMPLE_FLOAT32NE);
+
+        pa_set_mix_func(PA_SAMPLE_S16NE, (pa_do_mix_func_t) mix_s16ne_avx2);
+        pa_set_mix_func(PA_SAMPLE_S32NE, (pa_do_mix_func_t) mix_s32ne_avx2);
+        pa_set_mix_func(PA_SAMPLE_S24_32NE, (pa_do_mix_func_t) mix_s24_32ne_avx2);
+        pa_set_mix_func(PA_SAMPLE_FLOAT32NE, (pa_do_mix_func_t) mix_float32ne_avx2);
+    }
+#endif /* defined (__i386__) || defined (__amd64__) */
+}
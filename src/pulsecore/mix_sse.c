@@ -0,0 +1,198 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "cpu-x86.h"
+#include "mix.h"
+#include "simd-util.h"
+
+#if defined (__i386__) || defined (__amd64__)
+
+#include <emmintrin.h>
+
+/* Samples per SSE2 register for 16 bit and 32 bit samples */
+#define VEC16 8
+#define VEC32 4
+
+/* The output is computed in tiles, so that the accumulator stays in L1 while
+ * all streams are added to it. Must be a multiple of VEC16. */
+#define TILE 512
+
+static pa_do_mix_func_t fallback_s16ne;
+static pa_do_mix_func_t fallback_float32ne;
+
+static bool stream_is_muted(const pa_mix_info *m, unsigned channels) {
+    unsigned c;
+
+    for (c = 0; c < channels; c++)
+        if (m->linear[c].i > 0)
+            return false;
+
+    return true;
+}
+
+static void mix_s16ne_sse2(pa_mix_info streams[], unsigned nstreams, unsigned channels, int16_t *data, unsigned length) {
+    PA_DECLARE_ALIGNED(16, int32_t, acc[TILE]);
+    int16_t lo[PA_CHANNELS_MAX + 2 * VEC16], hi[PA_CHANNELS_MAX + 2 * VEC16];
+    unsigned period = pa_volume_period(channels, VEC16);
+    unsigned n, done, i, j, k;
+
+    n = pa_vector_samples(length / sizeof(int16_t), channels, VEC16);
+
+    for (done = 0; done < n; done += TILE) {
+        unsigned tile = PA_MIN(n - done, (unsigned) TILE);
+
+        memset(acc, 0, tile * sizeof(int32_t));
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            const int16_t *src = (const int16_t *) m->ptr + done;
+            unsigned p = done % period;
+
+            if (stream_is_muted(m, channels))
+                continue;
+
+            /* Split the 16.16 volume so that (v * cv) >> 16 can be computed
+             * exactly as (v * hi) + ((v * lo) >> 16) with 16 bit multiplies */
+            for (k = 0; k < period + VEC16; k++) {
+                int32_t cv = m->linear[k % channels].i;
+                lo[k] = (int16_t) (cv & 0xFFFF);
+                hi[k] = (int16_t) (cv >> 16);
+            }
+
+            for (j = 0; j < tile; j += VEC16) {
+                __m128i v = _mm_loadu_si128((const __m128i *) (src + j));
+                __m128i vlo = _mm_loadu_si128((const __m128i *) (lo + p));
+                __m128i vhi = _mm_loadu_si128((const __m128i *) (hi + p));
+                __m128i l, pl, ph, s0, s1;
+
+                /* (v * lo) >> 16, correcting the unsigned multiply for
+                 * negative samples */
+                l = _mm_sub_epi16(_mm_mulhi_epu16(v, vlo), _mm_and_si128(_mm_srai_epi16(v, 15), vlo));
+
+                /* v * hi, widened to 32 bit */
+                pl = _mm_mullo_epi16(v, vhi);
+                ph = _mm_mulhi_epi16(v, vhi);
+
+                s0 = _mm_add_epi32(_mm_unpacklo_epi16(pl, ph), _mm_srai_epi32(_mm_unpacklo_epi16(l, l), 16));
+                s1 = _mm_add_epi32(_mm_unpackhi_epi16(pl, ph), _mm_srai_epi32(_mm_unpackhi_epi16(l, l), 16));
+
+                _mm_store_si128((__m128i *) (acc + j), _mm_add_epi32(_mm_load_si128((__m128i *) (acc + j)), s0));
+                _mm_store_si128((__m128i *) (acc + j + 4), _mm_add_epi32(_mm_load_si128((__m128i *) (acc + j + 4)), s1));
+
+                p += VEC16;
+                if (p >= period)
+                    p -= period;
+            }
+        }
+
+        /* packssdw saturates exactly like PA_CLAMP_UNLIKELY(sum, -0x8000, 0x7FFF) */
+        for (j = 0; j < tile; j += VEC16) {
+            __m128i s0 = _mm_load_si128((__m128i *) (acc + j));
+            __m128i s1 = _mm_load_si128((__m128i *) (acc + j + 4));
+
+            _mm_storeu_si128((__m128i *) (data + done + j), _mm_packs_epi32(s0, s1));
+        }
+    }
+
+    if (n * sizeof(int16_t) < length) {
+        for (i = 0; i < nstreams; i++)
+            streams[i].ptr = (uint8_t *) streams[i].ptr + n * sizeof(int16_t);
+
+        fallback_s16ne(streams, nstreams, channels, data + n, length - n * sizeof(int16_t));
+    }
+}
+
+static void mix_float32ne_sse2(pa_mix_info streams[], unsigned nstreams, unsigned channels, float *data, unsigned length) {
+    PA_DECLARE_ALIGNED(16, float, acc[TILE]);
+    float vol[PA_CHANNELS_MAX + 2 * VEC32];
+    unsigned period = pa_volume_period(channels, VEC32);
+    unsigned n, done, i, j, k;
+
+    n = pa_vector_samples(length / sizeof(float), channels, VEC32);
+
+    for (done = 0; done < n; done += TILE) {
+        unsigned tile = PA_MIN(n - done, (unsigned) TILE);
+
+        memset(acc, 0, tile * sizeof(float));
+
+        for (i = 0; i < nstreams; i++) {
+            pa_mix_info *m = streams + i;
+            const float *src = (const float *) m->ptr + done;
+            unsigned p = done % period;
+            bool muted = true;
+
+            /* Like the C version, channels with a volume of zero are
+             * skipped rather than multiplied */
+            for (k = 0; k < channels; k++)
+                if (m->linear[k].f > 0)
+                    muted = false;
+
+            if (muted)
+                continue;
+
+            for (k = 0; k < period + VEC32; k++)
+                vol[k] = PA_MAX(m->linear[k % channels].f, 0.0f);
+
+            for (j = 0; j < tile; j += VEC32) {
+                __m128 v = _mm_loadu_ps(src + j);
+                __m128 cv = _mm_loadu_ps(vol + p);
+
+                _mm_store_ps(acc + j, _mm_add_ps(_mm_load_ps(acc + j), _mm_mul_ps(v, cv)));
+
+                p += VEC32;
+                if (p >= period)
+                    p -= period;
+            }
+        }
+
+        memcpy(data + done, acc, tile * sizeof(float));
+    }
+
+    if (n * sizeof(float) < length) {
+        for (i = 0; i < nstreams; i++)
+            streams[i].ptr = (uint8_t *) streams[i].ptr + n * sizeof(float);
+
+        fallback_float32ne(streams, nstreams, channels, data + n, length - n * sizeof(float));
+    }
+}
+
+#endif /* defined (__i386__) || defined (__amd64__) */
+
+void pa_mix_func_init_sse(pa_cpu_x86_flag_t flags) {
+#if defined (__i386__) || defined (__amd64__)
+    if (flags & PA_CPU_X86_SSE2) {
+        pa_log_info("Initialising SSE2 optimized mixing functions.");
+
+        /* SSE2 has no signed 32x32->64 bit multiply, so the 32 bit formats
+         * are left to the C code (or AVX2, see mix_avx2.c) */
+        fallback_s16ne = pa_get_mix_func(PA_SAMPLE_S16NE);
+        fallback_float32ne = pa_get_mix_func(PA_SAMPLE_FLOAT32NE);
+
+        pa_set_mix_func(PA_SAMPLE_S16NE, (pa_do_mix_func_t) mix_s16ne_sse2);
+        pa_set_mix_func(PA_SAMPLE_FLOAT32NE, (pa_do_mix_func_t) mix_float32ne_sse2);
+    }
+#endif /* defined (__i386__) || defined (__amd64__) */
+}
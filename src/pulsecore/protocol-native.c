@@ -599,6 +599,9 @@ static record_stream* record_stream_new(
             NULL);
     pa_xfree(memblockq_name);
 
+    /* Record data is only ever appended */
+    pa_memblockq_enable_ring(s->memblockq);
+
     pa_memblockq_get_attr(s->memblockq, &s->buffer_attr);
     fix_record_buffer_attr_post(s);
 
@@ -1085,6 +1088,10 @@ static playback_stream* playback_stream_new(
     pa_xfree(memblockq_name);
     pa_memblock_unref(silence.memblock);
 
+    /* Clients rarely seek back into queued data, the queue falls back
+     * to the list when they do */
+    pa_memblockq_enable_ring(s->memblockq);
+
     pa_memblockq_get_attr(s->memblockq, &s->buffer_attr);
 
     *missing = (uint32_t) pa_memblockq_pop_missing(s->memblockq);
@@ -2515,11 +2522,12 @@ static void setup_srbchannel(pa_native_connection *c, pa_mem_type_t shm_type) {
     }
     pa_mempool_set_is_remote_writable(c->rw_mempool, true);
 
-    srb = pa_srbchannel_new(c->protocol->core->mainloop, c->rw_mempool);
+    srb = pa_srbchannel_new(c->protocol->core->mainloop, c->rw_mempool, c->options->srbchannel_size);
     if (!srb) {
         pa_log_debug("Failed to create srbchannel");
         goto fail;
     }
+    pa_srbchannel_set_busy_poll(srb, c->options->srbchannel_busy_poll);
     pa_log_debug("Enabling srbchannel...");
     pa_srbchannel_export(srb, &srbt);
 
@@ -2684,6 +2692,11 @@ static void command_auth(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_ta
     pa_log_debug("Negotiated SHM: %s", pa_yes_no(do_shm));
     pa_pstream_enable_shm(c->pstream, do_shm);
 
+    /* Starting with protocol version 36, SHM memblock releases and
+     * revokes may be sent in batches */
+    if (do_shm && c->version >= 36)
+        pa_pstream_enable_batches(c->pstream);
+
     /* Do not declare memfd support for 9.0 client libraries (protocol v31).
      *
      * Although they support memfd transport, such 9.0 clients has an iochannel
@@ -5319,6 +5332,44 @@ void pa_native_protocol_disconnect(pa_native_protocol *p, pa_module *m) {
             native_connection_unlink(c);
 }
 
+static int native_protocol_message_handler(const char *object_path, const char *message, const pa_json_object *parameters, char **response, void *userdata) {
+    pa_native_protocol *p = userdata;
+    pa_native_connection *c;
+    pa_json_encoder *encoder;
+    uint32_t idx;
+
+    pa_assert(p);
+    pa_assert(message);
+    pa_assert(response);
+    pa_assert(pa_safe_streq(object_path, "/native-protocol"));
+
+    if (!pa_streq(message, "get-srbchannel-stats"))
+        return -PA_ERR_NOTIMPLEMENTED;
+
+    encoder = pa_json_encoder_new();
+    pa_json_encoder_begin_element_array(encoder);
+
+    PA_IDXSET_FOREACH(c, p->connections, idx) {
+        pa_srbchannel_stat stat;
+        unsigned n_socket_frames;
+
+        if (!pa_pstream_get_srbchannel_stat(c->pstream, &stat, &n_socket_frames))
+            continue;
+
+        pa_json_encoder_begin_element_object(encoder);
+        pa_json_encoder_add_member_int(encoder, "client", (int64_t) c->client->index);
+        pa_json_encoder_add_member_int(encoder, "full", (int64_t) stat.n_full);
+        pa_json_encoder_add_member_int(encoder, "busy-polled", (int64_t) stat.n_busy_polled);
+        pa_json_encoder_add_member_int(encoder, "socket-frames", (int64_t) n_socket_frames);
+        pa_json_encoder_end_object(encoder);
+    }
+
+    pa_json_encoder_end_array(encoder);
+    *response = pa_json_encoder_to_string_free(encoder);
+
+    return PA_OK;
+}
+
 static pa_native_protocol* native_protocol_new(pa_core *c) {
     pa_native_protocol *p;
     pa_native_hook_t h;
@@ -5339,6 +5390,8 @@ static pa_native_protocol* native_protocol_new(pa_core *c) {
 
     pa_assert_se(pa_shared_set(c, "native-protocol", p) >= 0);
 
+    pa_message_handler_register(c, "/native-protocol", "Native protocol message handler", native_protocol_message_handler, (void *) p);
+
     return p;
 }
 
@@ -5382,6 +5435,7 @@ void pa_native_protocol_unref(pa_native_protocol *p) {
 
     pa_hashmap_free(p->extensions);
 
+    pa_message_handler_unregister(p->core, "/native-protocol");
     pa_assert_se(pa_shared_remove(p->core, "native-protocol") >= 0);
 
     pa_xfree(p);
@@ -5479,6 +5533,7 @@ void pa_native_options_unref(pa_native_options *o) {
 int pa_native_options_parse(pa_native_options *o, pa_core *c, pa_modargs *ma) {
     bool enabled;
     const char *acl;
+    uint32_t busy_poll;
 
     pa_assert(o);
     pa_assert(PA_REFCNT_VALUE(o) >= 1);
@@ -5490,6 +5545,20 @@ int pa_native_options_parse(pa_native_options *o, pa_core *c, pa_modargs *ma) {
         return -1;
     }
 
+    o->srbchannel_size = 0;
+    if (pa_modargs_get_value_u32(ma, "srbchannel-size", &o->srbchannel_size) < 0) {
+        pa_log("srbchannel-size= expects a size in bytes.");
+        return -1;
+    }
+
+    busy_poll = 0;
+    if (pa_modargs_get_value_u32(ma, "srbchannel-busy-poll", &busy_poll) < 0 ||
+        busy_poll > PA_SRBCHANNEL_BUSY_POLL_MAX_USEC) {
+        pa_log("srbchannel-busy-poll= expects a time of at most %u microseconds.", PA_SRBCHANNEL_BUSY_POLL_MAX_USEC);
+        return -1;
+    }
+    o->srbchannel_busy_poll = busy_poll;
+
     if (pa_modargs_get_value_boolean(ma, "auth-anonymous", &o->auth_anonymous) < 0) {
         pa_log("auth-anonymous= expects a boolean argument.");
         return -1;
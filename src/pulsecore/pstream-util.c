@@ -196,3 +196,53 @@ finish:
     return -1;
 #endif
 }
+
+/* Registers a segment a memfd-backed pool has grown by, provided the
+ * pool itself has been registered with the pipe. Blocks of the segment
+ * are passed by reference once the registration has been sent. */
+int pa_pstream_register_memfd_segment(pa_pstream *p, pa_mempool *pool, uint32_t shm_id) {
+#if defined(HAVE_CREDS) && defined(HAVE_MEMFD)
+    pa_cmsg_ancil_data a;
+    pa_tagstruct *t;
+    pa_packet *packet;
+    const uint8_t *data;
+    size_t length;
+    uint32_t pool_shm_id;
+    int memfd_fd, ret;
+
+    pa_assert(p);
+    pa_assert(pool);
+
+    if (!pa_pstream_get_memfd(p) || !pa_mempool_is_memfd_backed(pool))
+        return -1;
+
+    if (pa_mempool_get_shm_id(pool, &pool_shm_id) < 0 || !pa_pstream_is_memfd_registered(p, pool_shm_id))
+        return -1;
+
+    /* Note! For per-client mempools we've taken ownership of the memfd
+     * fd here, it is closed once it has been sent. */
+    if ((memfd_fd = pa_mempool_get_segment_memfd_fd(pool, shm_id)) < 0)
+        return -1;
+
+    t = pa_tagstruct_new();
+    pa_tagstruct_putu32(t, PA_COMMAND_REGISTER_MEMFD_SHMID);
+    pa_tagstruct_putu32(t, (uint32_t) -1); /* tag */
+    pa_tagstruct_putu32(t, shm_id);
+
+    pa_assert_se(data = pa_tagstruct_data(t, &length));
+    pa_assert_se(packet = pa_packet_new_data(data, length));
+    pa_tagstruct_free(t);
+
+    a.nfd = 1;
+    a.fds[0] = memfd_fd;
+    a.creds_valid = false;
+    a.close_fds_on_cleanup = pa_mempool_is_per_client(pool);
+
+    ret = pa_pstream_send_memfd_registration(p, packet, &a, shm_id);
+    pa_packet_unref(packet);
+
+    return ret;
+#else
+    return -1;
+#endif
+}
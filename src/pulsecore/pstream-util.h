@@ -35,5 +35,6 @@ void pa_pstream_send_error(pa_pstream *p, uint32_t tag, uint32_t error);
 void pa_pstream_send_simple_ack(pa_pstream *p, uint32_t tag);
 
 int pa_pstream_register_memfd_mempool(pa_pstream *p, pa_mempool *pool, const char **fail_reason);
+int pa_pstream_register_memfd_segment(pa_pstream *p, pa_mempool *pool, uint32_t shm_id);
 
 #endif
@@ -33,6 +33,7 @@
 #include <pulse/xmalloc.h>
 
 #include <pulsecore/idxset.h>
+#include <pulsecore/hashmap.h>
 #include <pulsecore/socket.h>
 #include <pulsecore/queue.h>
 #include <pulsecore/log.h>
@@ -42,12 +43,15 @@
 #include <pulsecore/macro.h>
 
 #include "pstream.h"
+#include "pstream-util.h"
 
 /* We piggyback information if audio data blocks are stored in SHM on the seek mode */
 #define PA_FLAG_SHMDATA     0x80000000LU
 #define PA_FLAG_SHMDATA_MEMFD_BLOCK         0x20000000LU
 #define PA_FLAG_SHMRELEASE  0x40000000LU
 #define PA_FLAG_SHMREVOKE   0xC0000000LU
+#define PA_FLAG_SHMRELEASE_BATCH 0x50000000LU
+#define PA_FLAG_SHMREVOKE_BATCH  0xD0000000LU
 #define PA_FLAG_SHMMASK     0xFF000000LU
 #define PA_FLAG_SEEKMASK    0x000000FFLU
 #define PA_FLAG_SHMWRITABLE 0x00800000LU
@@ -77,6 +81,10 @@ typedef uint32_t pa_pstream_descriptor[PA_PSTREAM_DESCRIPTOR_MAX];
 
 #define MINIBUF_SIZE (256)
 
+/* Block IDs a batched release or revoke frame can carry, so that it
+ * fits into the minibuf */
+#define BATCH_MAX ((MINIBUF_SIZE - PA_PSTREAM_DESCRIPTOR_SIZE) / sizeof(uint32_t))
+
 /* To allow uploading a single sample in one frame, this value should be the
  * same size (16 MB) as PA_SCACHE_ENTRY_SIZE_MAX from pulsecore/core-scache.h.
  */
@@ -86,6 +94,12 @@ typedef uint32_t pa_pstream_descriptor[PA_PSTREAM_DESCRIPTOR_MAX];
  */
 #define DEFAULT_PSTREAM_MEMBLOCK_ALIGN (256)
 
+/* Queued frames that are gathered into a single writev() call, and the
+ * number of bytes after which no further frames are added. The latter
+ * stays well below the usual socket send buffer sizes. */
+#define GATHER_MAX (16)
+#define GATHER_BYTES_MAX (64*1024)
+
 PA_STATIC_FLIST_DECLARE(items, 0, pa_xfree);
 
 struct item_info {
@@ -93,7 +107,9 @@ struct item_info {
         PA_PSTREAM_ITEM_PACKET,
         PA_PSTREAM_ITEM_MEMBLOCK,
         PA_PSTREAM_ITEM_SHMRELEASE,
-        PA_PSTREAM_ITEM_SHMREVOKE
+        PA_PSTREAM_ITEM_SHMREVOKE,
+        PA_PSTREAM_ITEM_SHMRELEASE_BATCH,
+        PA_PSTREAM_ITEM_SHMREVOKE_BATCH
     } type;
 
     /* packet info */
@@ -113,15 +129,40 @@ struct item_info {
     uint32_t block_id;
 };
 
+struct pstream_write {
+    union {
+        uint8_t minibuf[MINIBUF_SIZE];
+        pa_pstream_descriptor descriptor;
+    };
+    struct item_info* current;
+    void *data;
+    size_t index;
+    int minibuf_validsize;
+    pa_memchunk memchunk;
+};
+
 struct pstream_read {
     pa_pstream_descriptor descriptor;
     pa_memblock *memblock;
     pa_packet *packet;
     uint32_t shm_info[PA_PSTREAM_SHM_MAX];
+    uint32_t block_ids[BATCH_MAX];
     void *data;
     size_t index;
 };
 
+/* Block IDs to be released or revoked with a single frame. A batch
+ * item is queued for the first one, the following ones join it until
+ * it is written. */
+struct pstream_batch {
+    uint32_t block_ids[BATCH_MAX];
+    unsigned n;
+
+    /* Other frames have been queued behind the batch item since, so
+     * block IDs may not join it any more */
+    bool closed;
+};
+
 struct pa_pstream {
     PA_REFCNT_DECLARE;
 
@@ -131,21 +172,20 @@ struct pa_pstream {
     pa_srbchannel *srb, *srbpending;
     bool is_srbpending;
 
+    /* Frames that had to be written to the socket while a srbchannel
+     * was in use, because they carry ancillary data */
+    unsigned n_srb_socket_frames;
+
     pa_queue *send_queue;
 
     bool dead;
 
-    struct {
-        union {
-            uint8_t minibuf[MINIBUF_SIZE];
-            pa_pstream_descriptor descriptor;
-        };
-        struct item_info* current;
-        void *data;
-        size_t index;
-        int minibuf_validsize;
-        pa_memchunk memchunk;
-    } write;
+    struct pstream_write write;
+
+    /* Frames following write.current that have been prepared already,
+     * to be written with the same writev() call */
+    struct pstream_write gather[GATHER_MAX];
+    unsigned n_gather;
 
     struct pstream_read readio, readsrb;
 
@@ -156,10 +196,20 @@ struct pa_pstream {
      * @use_memfd: pipe supports sending SHM memfd block references
      *
      * @registered_memfd_ids: registered memfd pools SHM IDs. Check
-     * pa_pstream_register_memfd_mempool() for more information. */
+     * pa_pstream_register_memfd_mempool() for more information.
+     *
+     * @pending_memfd_ids: SHM IDs of grown memfd pool segments, mapped
+     * to their queued registration packets. They are registered once
+     * the packet has been written. */
     bool use_shm, use_memfd;
     bool non_registered_memfd_id_error_logged;
     pa_idxset *registered_memfd_ids;
+    pa_hashmap *pending_memfd_ids;
+
+    /* @use_batches: the other end understands batched release and
+     * revoke frames (protocol version 36) */
+    bool use_batches;
+    struct pstream_batch release_batch, revoke_batch;
 
     pa_memimport *import;
     pa_memexport *export;
@@ -388,6 +438,57 @@ int pa_pstream_attach_memfd_shmid(pa_pstream *p, unsigned shm_id, int memfd_fd)
     return 0;
 }
 
+bool pa_pstream_is_memfd_registered(pa_pstream *p, unsigned shm_id) {
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+
+    return p->registered_memfd_ids && pa_idxset_get_by_data(p->registered_memfd_ids, PA_UINT32_TO_PTR(shm_id), NULL);
+}
+
+/* Blocks of a segment the sending pool has grown by are referenced
+ * only after its registration packet has been written: the queue might
+ * hold blocks of the segment in front of it already, which have to be
+ * copied still. */
+int pa_pstream_send_memfd_registration(pa_pstream *p, pa_packet *packet, pa_cmsg_ancil_data *ancil_data, unsigned shm_id) {
+#ifdef HAVE_CREDS
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+    pa_assert(packet);
+    pa_assert(ancil_data);
+    pa_assert(ancil_data->nfd == 1);
+
+    if (!p->use_memfd ||
+        pa_idxset_get_by_data(p->registered_memfd_ids, PA_UINT32_TO_PTR(shm_id), NULL) ||
+        pa_hashmap_get(p->pending_memfd_ids, PA_UINT32_TO_PTR(shm_id)) ||
+        pa_memimport_attach_memfd(p->import, shm_id, ancil_data->fds[0], true)) {
+        pa_cmsg_ancil_data_close_fds(ancil_data);
+        return -1;
+    }
+
+    pa_assert_se(pa_hashmap_put(p->pending_memfd_ids, PA_UINT32_TO_PTR(shm_id), packet) == 0);
+    pa_pstream_send_packet(p, packet, ancil_data);
+
+    return 0;
+#else
+    pa_assert_not_reached();
+#endif
+}
+
+static void memfd_registration_sent(pa_pstream *p, pa_packet *packet) {
+    void *state, *shm_id;
+    pa_packet *pending;
+
+    PA_HASHMAP_FOREACH_KV(shm_id, pending, p->pending_memfd_ids, state) {
+        if (pending != packet)
+            continue;
+
+        pa_hashmap_remove(p->pending_memfd_ids, shm_id);
+        pa_assert_se(pa_idxset_put(p->registered_memfd_ids, shm_id, NULL) == 0);
+        pa_log_debug("Registered grown memfd pool segment with ID = %u", PA_PTR_TO_UINT32(shm_id));
+        break;
+    }
+}
+
 static void item_free(void *item) {
     struct item_info *i = item;
     pa_assert(i);
@@ -414,6 +515,8 @@ static void item_free(void *item) {
 }
 
 static void pstream_free(pa_pstream *p) {
+    unsigned i;
+
     pa_assert(p);
 
     pa_pstream_unlink(p);
@@ -426,6 +529,13 @@ static void pstream_free(pa_pstream *p) {
     if (p->write.memchunk.memblock)
         pa_memblock_unref(p->write.memchunk.memblock);
 
+    for (i = 0; i < p->n_gather; i++) {
+        item_free(p->gather[i].current);
+
+        if (p->gather[i].memchunk.memblock)
+            pa_memblock_unref(p->gather[i].memchunk.memblock);
+    }
+
     if (p->readsrb.memblock)
         pa_memblock_unref(p->readsrb.memblock);
 
@@ -441,9 +551,23 @@ static void pstream_free(pa_pstream *p) {
     if (p->registered_memfd_ids)
         pa_idxset_free(p->registered_memfd_ids, NULL);
 
+    if (p->pending_memfd_ids)
+        pa_hashmap_free(p->pending_memfd_ids);
+
     pa_xfree(p);
 }
 
+/* A revoke must not overtake a frame that was queued before it, it
+ * could refer to the revoked block. So the revoke batch is closed once
+ * anything else is queued behind it. Releases only ever refer to blocks
+ * the other end sent, their order does not matter. */
+static void queue_item(pa_pstream *p, struct item_info *item) {
+    if (item->type != PA_PSTREAM_ITEM_SHMREVOKE_BATCH && p->revoke_batch.n > 0)
+        p->revoke_batch.closed = true;
+
+    pa_queue_push(p->send_queue, item);
+}
+
 void pa_pstream_send_packet(pa_pstream*p, pa_packet *packet, pa_cmsg_ancil_data *ancil_data) {
     struct item_info *i;
 
@@ -474,7 +598,7 @@ void pa_pstream_send_packet(pa_pstream*p, pa_packet *packet, pa_cmsg_ancil_data
     }
 #endif
 
-    pa_queue_push(p->send_queue, i);
+    queue_item(p, i);
 
     p->mainloop->defer_enable(p->defer_event, 1);
 }
@@ -521,7 +645,7 @@ void pa_pstream_send_memblock(pa_pstream*p, uint32_t channel, int64_t offset, pa
         i->with_ancil_data = false;
 #endif
 
-        pa_queue_push(p->send_queue, i);
+        queue_item(p, i);
 
         idx += n;
         length -= n;
@@ -530,6 +654,31 @@ void pa_pstream_send_memblock(pa_pstream*p, uint32_t channel, int64_t offset, pa
     p->mainloop->defer_enable(p->defer_event, 1);
 }
 
+/* Returns true if the block ID has been added to a batch that is queued already */
+static bool batch_add(pa_pstream *p, struct pstream_batch *batch, int type, uint32_t block_id) {
+    struct item_info *item;
+
+    if (!p->use_batches || batch->closed || batch->n >= BATCH_MAX)
+        return false;
+
+    batch->block_ids[batch->n++] = block_id;
+
+    if (batch->n > 1)
+        return true;
+
+    if (!(item = pa_flist_pop(PA_STATIC_FLIST_GET(items))))
+        item = pa_xnew(struct item_info, 1);
+    item->type = type;
+#ifdef HAVE_CREDS
+    item->with_ancil_data = false;
+#endif
+
+    queue_item(p, item);
+    p->mainloop->defer_enable(p->defer_event, 1);
+
+    return true;
+}
+
 void pa_pstream_send_release(pa_pstream *p, uint32_t block_id) {
     struct item_info *item;
     pa_assert(p);
@@ -540,6 +689,9 @@ void pa_pstream_send_release(pa_pstream *p, uint32_t block_id) {
 
 /*     pa_log("Releasing block %u", block_id); */
 
+    if (batch_add(p, &p->release_batch, PA_PSTREAM_ITEM_SHMRELEASE_BATCH, block_id))
+        return;
+
     if (!(item = pa_flist_pop(PA_STATIC_FLIST_GET(items))))
         item = pa_xnew(struct item_info, 1);
     item->type = PA_PSTREAM_ITEM_SHMRELEASE;
@@ -548,7 +700,7 @@ void pa_pstream_send_release(pa_pstream *p, uint32_t block_id) {
     item->with_ancil_data = false;
 #endif
 
-    pa_queue_push(p->send_queue, item);
+    queue_item(p, item);
     p->mainloop->defer_enable(p->defer_event, 1);
 }
 
@@ -577,6 +729,9 @@ void pa_pstream_send_revoke(pa_pstream *p, uint32_t block_id) {
         return;
 /*     pa_log("Revoking block %u", block_id); */
 
+    if (batch_add(p, &p->revoke_batch, PA_PSTREAM_ITEM_SHMREVOKE_BATCH, block_id))
+        return;
+
     if (!(item = pa_flist_pop(PA_STATIC_FLIST_GET(items))))
         item = pa_xnew(struct item_info, 1);
     item->type = PA_PSTREAM_ITEM_SHMREVOKE;
@@ -585,7 +740,7 @@ void pa_pstream_send_revoke(pa_pstream *p, uint32_t block_id) {
     item->with_ancil_data = false;
 #endif
 
-    pa_queue_push(p->send_queue, item);
+    queue_item(p, item);
     p->mainloop->defer_enable(p->defer_event, 1);
 }
 
@@ -602,68 +757,92 @@ static void memexport_revoke_cb(pa_memexport *e, uint32_t block_id, void *userda
         pa_pstream_send_revoke(p, block_id);
 }
 
-static void prepare_next_write_item(pa_pstream *p) {
+static void prepare_write_item(pa_pstream *p, struct pstream_write *w, struct item_info *item) {
     pa_assert(p);
-    pa_assert(PA_REFCNT_VALUE(p) > 0);
+    pa_assert(w);
+    pa_assert(item);
+
+    w->current = item;
+    w->index = 0;
+    w->data = NULL;
+    w->minibuf_validsize = 0;
+    pa_memchunk_reset(&w->memchunk);
+
+    w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = 0;
+    w->descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL] = htonl((uint32_t) -1);
+    w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = 0;
+    w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = 0;
+    w->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = 0;
+
+    if (w->current->type == PA_PSTREAM_ITEM_PACKET) {
+        size_t plen;
 
-    p->write.current = pa_queue_pop(p->send_queue);
+        pa_assert(w->current->packet);
 
-    if (!p->write.current)
-        return;
-    p->write.index = 0;
-    p->write.data = NULL;
-    p->write.minibuf_validsize = 0;
-    pa_memchunk_reset(&p->write.memchunk);
+        w->data = (void *) pa_packet_data(w->current->packet, &plen);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl((uint32_t) plen);
 
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = 0;
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL] = htonl((uint32_t) -1);
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = 0;
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = 0;
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = 0;
+        if (plen <= MINIBUF_SIZE - PA_PSTREAM_DESCRIPTOR_SIZE) {
+            memcpy(&w->minibuf[PA_PSTREAM_DESCRIPTOR_SIZE], w->data, plen);
+            w->minibuf_validsize = PA_PSTREAM_DESCRIPTOR_SIZE + plen;
+        }
 
-    if (p->write.current->type == PA_PSTREAM_ITEM_PACKET) {
-        size_t plen;
+    } else if (w->current->type == PA_PSTREAM_ITEM_SHMRELEASE) {
 
-        pa_assert(p->write.current->packet);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMRELEASE);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl(w->current->block_id);
 
-        p->write.data = (void *) pa_packet_data(p->write.current->packet, &plen);
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl((uint32_t) plen);
+    } else if (w->current->type == PA_PSTREAM_ITEM_SHMREVOKE) {
 
-        if (plen <= MINIBUF_SIZE - PA_PSTREAM_DESCRIPTOR_SIZE) {
-            memcpy(&p->write.minibuf[PA_PSTREAM_DESCRIPTOR_SIZE], p->write.data, plen);
-            p->write.minibuf_validsize = PA_PSTREAM_DESCRIPTOR_SIZE + plen;
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMREVOKE);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl(w->current->block_id);
+
+    } else if (w->current->type == PA_PSTREAM_ITEM_SHMRELEASE_BATCH ||
+               w->current->type == PA_PSTREAM_ITEM_SHMREVOKE_BATCH) {
+        struct pstream_batch *batch;
+        uint32_t *block_ids = (uint32_t *) &w->minibuf[PA_PSTREAM_DESCRIPTOR_SIZE];
+        unsigned i;
+
+        if (w->current->type == PA_PSTREAM_ITEM_SHMRELEASE_BATCH) {
+            batch = &p->release_batch;
+            w->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMRELEASE_BATCH);
+        } else {
+            batch = &p->revoke_batch;
+            w->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMREVOKE_BATCH);
         }
 
-    } else if (p->write.current->type == PA_PSTREAM_ITEM_SHMRELEASE) {
+        pa_assert(batch->n > 0);
 
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMRELEASE);
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl(p->write.current->block_id);
+        for (i = 0; i < batch->n; i++)
+            block_ids[i] = htonl(batch->block_ids[i]);
 
-    } else if (p->write.current->type == PA_PSTREAM_ITEM_SHMREVOKE) {
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl((uint32_t) (batch->n * sizeof(uint32_t)));
+        w->minibuf_validsize = PA_PSTREAM_DESCRIPTOR_SIZE + batch->n * sizeof(uint32_t);
 
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMREVOKE);
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl(p->write.current->block_id);
+        /* Further block IDs go into the next batch */
+        batch->n = 0;
+        batch->closed = false;
 
     } else {
         uint32_t flags;
         bool send_payload = true;
 
-        pa_assert(p->write.current->type == PA_PSTREAM_ITEM_MEMBLOCK);
-        pa_assert(p->write.current->chunk.memblock);
+        pa_assert(w->current->type == PA_PSTREAM_ITEM_MEMBLOCK);
+        pa_assert(w->current->chunk.memblock);
 
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL] = htonl(p->write.current->channel);
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl((uint32_t) (((uint64_t) p->write.current->offset) >> 32));
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = htonl((uint32_t) ((uint64_t) p->write.current->offset));
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL] = htonl(w->current->channel);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl((uint32_t) (((uint64_t) w->current->offset) >> 32));
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = htonl((uint32_t) ((uint64_t) w->current->offset));
 
-        flags = (uint32_t) (p->write.current->seek_mode & PA_FLAG_SEEKMASK);
+        flags = (uint32_t) (w->current->seek_mode & PA_FLAG_SEEKMASK);
 
         if (p->use_shm) {
             pa_mem_type_t type;
             uint32_t block_id, shm_id;
             size_t offset, length;
-            uint32_t *shm_info = (uint32_t *) &p->write.minibuf[PA_PSTREAM_DESCRIPTOR_SIZE];
+            uint32_t *shm_info = (uint32_t *) &w->minibuf[PA_PSTREAM_DESCRIPTOR_SIZE];
             size_t shm_size = sizeof(uint32_t) * PA_PSTREAM_SHM_MAX;
-            pa_mempool *current_pool = pa_memblock_get_pool(p->write.current->chunk.memblock);
+            pa_mempool *current_pool = pa_memblock_get_pool(w->current->chunk.memblock);
             pa_memexport *current_export;
 
             if (p->mempool == current_pool)
@@ -672,7 +851,7 @@ static void prepare_next_write_item(pa_pstream *p) {
                 pa_assert_se(current_export = pa_memexport_new(current_pool, memexport_revoke_cb, p));
 
             if (pa_memexport_put(current_export,
-                                 p->write.current->chunk.memblock,
+                                 w->current->chunk.memblock,
                                  &type,
                                  &block_id,
                                  &shm_id,
@@ -686,6 +865,10 @@ static void prepare_next_write_item(pa_pstream *p) {
                     if (pa_idxset_get_by_data(p->registered_memfd_ids, PA_UINT32_TO_PTR(shm_id), NULL)) {
                         flags |= PA_FLAG_SHMDATA_MEMFD_BLOCK;
                         send_payload = false;
+                    } else if (pa_hashmap_get(p->pending_memfd_ids, PA_UINT32_TO_PTR(shm_id)) ||
+                               pa_pstream_register_memfd_segment(p, current_pool, shm_id) >= 0) {
+                        /* A segment the pool has grown by, copied until
+                         * its registration has been sent */
                     } else {
                         if (!p->non_registered_memfd_id_error_logged) {
                             pa_log("Cannot send block reference with non-registered memfd ID = %u", shm_id);
@@ -705,11 +888,11 @@ static void prepare_next_write_item(pa_pstream *p) {
 
                     shm_info[PA_PSTREAM_SHM_BLOCKID] = htonl(block_id);
                     shm_info[PA_PSTREAM_SHM_SHMID] = htonl(shm_id);
-                    shm_info[PA_PSTREAM_SHM_INDEX] = htonl((uint32_t) (offset + p->write.current->chunk.index));
-                    shm_info[PA_PSTREAM_SHM_LENGTH] = htonl((uint32_t) p->write.current->chunk.length);
+                    shm_info[PA_PSTREAM_SHM_INDEX] = htonl((uint32_t) (offset + w->current->chunk.index));
+                    shm_info[PA_PSTREAM_SHM_LENGTH] = htonl((uint32_t) w->current->chunk.length);
 
-                    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl(shm_size);
-                    p->write.minibuf_validsize = PA_PSTREAM_DESCRIPTOR_SIZE + shm_size;
+                    w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl(shm_size);
+                    w->minibuf_validsize = PA_PSTREAM_DESCRIPTOR_SIZE + shm_size;
                 }
             }
 /*             else */
@@ -722,13 +905,31 @@ static void prepare_next_write_item(pa_pstream *p) {
         }
 
         if (send_payload) {
-            p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl((uint32_t) p->write.current->chunk.length);
-            p->write.memchunk = p->write.current->chunk;
-            pa_memblock_ref(p->write.memchunk.memblock);
+            w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl((uint32_t) w->current->chunk.length);
+            w->memchunk = w->current->chunk;
+            pa_memblock_ref(w->memchunk.memblock);
         }
 
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(flags);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(flags);
     }
+}
+
+static void prepare_next_write_item(pa_pstream *p) {
+    struct item_info *item;
+
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+
+    if (p->n_gather > 0) {
+        /* Frames that have been prepared for a writev() call come first */
+        p->write = p->gather[0];
+        p->n_gather--;
+        memmove(p->gather, p->gather + 1, p->n_gather * sizeof(struct pstream_write));
+    } else if ((item = pa_queue_pop(p->send_queue)))
+        prepare_write_item(p, &p->write, item);
+
+    if (!p->write.current)
+        return;
 
 #ifdef HAVE_CREDS
     if ((p->send_ancil_data_now = p->write.current->with_ancil_data))
@@ -740,8 +941,15 @@ static void check_srbpending(pa_pstream *p) {
     if (!p->is_srbpending)
         return;
 
-    if (p->srb)
+    if (p->srb) {
+        const pa_srbchannel_stat *stat = pa_srbchannel_get_stat(p->srb);
+
+        pa_log_debug("srbchannel statistics: full %u times, %u signals busy polled, %u frames via socket",
+                     stat->n_full, stat->n_busy_polled, p->n_srb_socket_frames);
+
         pa_srbchannel_free(p->srb);
+        p->n_srb_socket_frames = 0;
+    }
 
     p->srb = p->srbpending;
     p->is_srbpending = false;
@@ -750,6 +958,146 @@ static void check_srbpending(pa_pstream *p) {
         pa_srbchannel_set_callback(p->srb, srb_callback, p);
 }
 
+static size_t write_frame_size(struct pstream_write *w) {
+    return PA_PSTREAM_DESCRIPTOR_SIZE + ntohl(w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]);
+}
+
+static void write_item_done(pa_pstream *p) {
+    pa_assert(p->write.current);
+
+    if (p->write.current->type == PA_PSTREAM_ITEM_PACKET && p->pending_memfd_ids &&
+        !pa_hashmap_isempty(p->pending_memfd_ids))
+        memfd_registration_sent(p, p->write.current->packet);
+
+    item_free(p->write.current);
+    p->write.current = NULL;
+
+    if (p->write.memchunk.memblock)
+        pa_memblock_unref(p->write.memchunk.memblock);
+
+    pa_memchunk_reset(&p->write.memchunk);
+}
+
+#ifdef HAVE_SYS_UIO_H
+/* Adds the parts of the frame that have not been written yet to the
+ * iovec. Returns the number of entries used, at most 2. */
+static int write_frame_iov(struct pstream_write *w, struct iovec *iov, pa_memblock **acquired) {
+    size_t length = ntohl(w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]);
+    size_t index = w->index;
+    int n = 0;
+
+    if (w->minibuf_validsize > 0) {
+        iov[0].iov_base = w->minibuf + index;
+        iov[0].iov_len = w->minibuf_validsize - index;
+        return 1;
+    }
+
+    if (index < PA_PSTREAM_DESCRIPTOR_SIZE) {
+        iov[n].iov_base = (uint8_t*) w->descriptor + index;
+        iov[n].iov_len = PA_PSTREAM_DESCRIPTOR_SIZE - index;
+        n++;
+        index = PA_PSTREAM_DESCRIPTOR_SIZE;
+    }
+
+    if (length > 0) {
+        void *d;
+
+        pa_assert(w->data || w->memchunk.memblock);
+
+        if (w->data)
+            d = w->data;
+        else {
+            d = pa_memblock_acquire_chunk(&w->memchunk);
+            *acquired = w->memchunk.memblock;
+        }
+
+        iov[n].iov_base = (uint8_t*) d + index - PA_PSTREAM_DESCRIPTOR_SIZE;
+        iov[n].iov_len = length - (index - PA_PSTREAM_DESCRIPTOR_SIZE);
+        n++;
+    }
+
+    return n;
+}
+
+/* Writes the current frame together with the frames queued after it
+ * with a single writev(), which saves a system call and a wakeup of
+ * the other end per frame when audio data is not passed via SHM. Frames
+ * carrying ancillary data are left to do_write(). */
+static int do_writev(pa_pstream *p) {
+    struct iovec iov[2 * (GATHER_MAX + 1)];
+    pa_memblock *acquired[GATHER_MAX + 1];
+    size_t l, left;
+    ssize_t r;
+    unsigned i;
+    int n;
+    bool done = false;
+
+    pa_assert(p->write.current);
+
+    l = write_frame_size(&p->write) - p->write.index;
+
+    for (i = 0; i < p->n_gather; i++)
+        l += write_frame_size(&p->gather[i]);
+
+    while (p->n_gather < GATHER_MAX && l < GATHER_BYTES_MAX) {
+        struct item_info *item;
+
+        if (!(item = pa_queue_peek(p->send_queue)))
+            break;
+
+#ifdef HAVE_CREDS
+        if (item->with_ancil_data)
+            break;
+#endif
+
+        pa_assert_se(pa_queue_pop(p->send_queue) == item);
+        prepare_write_item(p, &p->gather[p->n_gather], item);
+        l += write_frame_size(&p->gather[p->n_gather]);
+        p->n_gather++;
+    }
+
+    acquired[0] = NULL;
+    n = write_frame_iov(&p->write, iov, &acquired[0]);
+
+    for (i = 0; i < p->n_gather; i++) {
+        acquired[i + 1] = NULL;
+        n += write_frame_iov(&p->gather[i], iov + n, &acquired[i + 1]);
+    }
+
+    r = pa_iochannel_writev(p->io, iov, n);
+
+    for (i = 0; i <= p->n_gather; i++)
+        if (acquired[i])
+            pa_memblock_release(acquired[i]);
+
+    if (r < 0)
+        return -1;
+
+    left = (size_t) r;
+
+    while (p->write.current) {
+        size_t k = write_frame_size(&p->write) - p->write.index;
+
+        if (left < k) {
+            p->write.index += left;
+            break;
+        }
+
+        left -= k;
+        write_item_done(p);
+        done = true;
+
+        if (p->n_gather > 0)
+            prepare_next_write_item(p);
+    }
+
+    if (done && p->drain_callback && !pa_pstream_is_pending(p))
+        p->drain_callback(p, p->drain_callback_userdata);
+
+    return (size_t) r == l ? 1 : 0;
+}
+#endif
+
 static int do_write(pa_pstream *p) {
     void *d;
     size_t l;
@@ -768,6 +1116,15 @@ static int do_write(pa_pstream *p) {
         return 0;
     }
 
+#ifdef HAVE_SYS_UIO_H
+    if (!p->srb
+#ifdef HAVE_CREDS
+        && !p->send_ancil_data_now
+#endif
+        )
+        return do_writev(p);
+#endif
+
     if (p->write.minibuf_validsize > 0) {
         d = p->write.minibuf + p->write.index;
         l = p->write.minibuf_validsize - p->write.index;
@@ -803,6 +1160,9 @@ static int do_write(pa_pstream *p) {
 
         pa_cmsg_ancil_data_close_fds(p->write_ancil_data);
         p->send_ancil_data_now = false;
+
+        if (p->srb)
+            p->n_srb_socket_frames++;
     } else
 #endif
     if (p->srb)
@@ -815,15 +1175,8 @@ static int do_write(pa_pstream *p) {
 
     p->write.index += (size_t) r;
 
-    if (p->write.index >= PA_PSTREAM_DESCRIPTOR_SIZE + ntohl(p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH])) {
-        pa_assert(p->write.current);
-        item_free(p->write.current);
-        p->write.current = NULL;
-
-        if (p->write.memchunk.memblock)
-            pa_memblock_unref(p->write.memchunk.memblock);
-
-        pa_memchunk_reset(&p->write.memchunk);
+    if (p->write.index >= write_frame_size(&p->write)) {
+        write_item_done(p);
 
         if (p->drain_callback && !pa_pstream_is_pending(p))
             p->drain_callback(p, p->drain_callback_userdata);
@@ -961,6 +1314,21 @@ static int do_read(pa_pstream *p, struct pstream_read *re) {
             pa_memimport_process_revoke(p->import, ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI]));
 
             goto frame_done;
+
+        } else if (flags == PA_FLAG_SHMRELEASE_BATCH || flags == PA_FLAG_SHMREVOKE_BATCH) {
+
+            /* This is a frame releasing or revoking several SHM memblocks,
+             * their IDs are the payload */
+
+            length = ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]);
+
+            if (length == 0 || length > sizeof(re->block_ids) || length % sizeof(uint32_t) != 0) {
+                pa_log_warn("Received batch frame with invalid frame length.");
+                return -1;
+            }
+
+            re->data = re->block_ids;
+            return 0;
         }
 
         length = ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]);
@@ -1035,6 +1403,21 @@ static int do_read(pa_pstream *p, struct pstream_read *re) {
 #endif
 
             pa_packet_unref(re->packet);
+
+        } else if (re->data == re->block_ids) {
+            uint32_t flags = ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS]);
+            unsigned i, n = ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]) / sizeof(uint32_t);
+
+            for (i = 0; i < n; i++) {
+                if (flags == PA_FLAG_SHMRELEASE_BATCH) {
+                    pa_assert(p->export);
+                    pa_memexport_process_release(p->export, ntohl(re->block_ids[i]));
+                } else {
+                    pa_assert(p->import);
+                    pa_memimport_process_revoke(p->import, ntohl(re->block_ids[i]));
+                }
+            }
+
         } else {
             pa_memblock *b = NULL;
             uint32_t flags = ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS]);
@@ -1177,7 +1560,7 @@ bool pa_pstream_is_pending(pa_pstream *p) {
     if (p->dead)
         b = false;
     else
-        b = p->write.current || !pa_queue_isempty(p->send_queue);
+        b = p->write.current || p->n_gather > 0 || !pa_queue_isempty(p->send_queue);
 
     return b;
 }
@@ -1264,6 +1647,7 @@ void pa_pstream_enable_memfd(pa_pstream *p) {
 
     if (!p->registered_memfd_ids) {
         p->registered_memfd_ids = pa_idxset_new(NULL, NULL);
+        p->pending_memfd_ids = pa_hashmap_new(NULL, NULL);
     }
 }
 
@@ -1281,6 +1665,13 @@ bool pa_pstream_get_memfd(pa_pstream *p) {
     return p->use_memfd;
 }
 
+void pa_pstream_enable_batches(pa_pstream *p) {
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+
+    p->use_batches = true;
+}
+
 void pa_pstream_set_srbchannel(pa_pstream *p, pa_srbchannel *srb) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0 || srb == NULL);
@@ -1300,3 +1691,18 @@ void pa_pstream_set_srbchannel(pa_pstream *p, pa_srbchannel *srb) {
     else
         do_write(p);
 }
+
+bool pa_pstream_get_srbchannel_stat(pa_pstream *p, pa_srbchannel_stat *stat, unsigned *n_socket_frames) {
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+    pa_assert(stat);
+    pa_assert(n_socket_frames);
+
+    if (!p->srb)
+        return false;
+
+    *stat = *pa_srbchannel_get_stat(p->srb);
+    *n_socket_frames = p->n_srb_socket_frames;
+
+    return true;
+}
@@ -49,6 +49,8 @@ void pa_pstream_unref(pa_pstream*p);
 void pa_pstream_unlink(pa_pstream *p);
 
 int pa_pstream_attach_memfd_shmid(pa_pstream *p, unsigned shm_id, int memfd_fd);
+bool pa_pstream_is_memfd_registered(pa_pstream *p, unsigned shm_id);
+int pa_pstream_send_memfd_registration(pa_pstream *p, pa_packet *packet, pa_cmsg_ancil_data *ancil_data, unsigned shm_id);
 
 void pa_pstream_send_packet(pa_pstream*p, pa_packet *packet, pa_cmsg_ancil_data *ancil_data);
 void pa_pstream_send_memblock(pa_pstream*p, uint32_t channel, int64_t offset, pa_seek_mode_t seek, const pa_memchunk *chunk, size_t align);
@@ -69,8 +71,18 @@ void pa_pstream_enable_memfd(pa_pstream *p);
 bool pa_pstream_get_shm(pa_pstream *p);
 bool pa_pstream_get_memfd(pa_pstream *p);
 
+/* Enables coalescing the release and revoke frames for SHM memblocks
+ * of a mainloop iteration into single frames. Both ends need to
+ * support protocol version 36 for this. */
+void pa_pstream_enable_batches(pa_pstream *p);
+
 /* Enables shared ringbuffer channel. Note that the srbchannel is now owned by the pstream.
    Setting srb to NULL will free any existing srbchannel. */
 void pa_pstream_set_srbchannel(pa_pstream *p, pa_srbchannel *srb);
 
+/* Returns false if no srbchannel is active. Otherwise fills in the
+ * srbchannel statistics and the number of frames that were written to
+ * the socket nevertheless. */
+bool pa_pstream_get_srbchannel_stat(pa_pstream *p, pa_srbchannel_stat *stat, unsigned *n_socket_frames);
+
 #endif
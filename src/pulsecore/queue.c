@@ -115,6 +115,12 @@ void* pa_queue_pop(pa_queue *q) {
     return p;
 }
 
+void* pa_queue_peek(pa_queue *q) {
+    pa_assert(q);
+
+    return q->front ? q->front->data : NULL;
+}
+
 int pa_queue_isempty(pa_queue *q) {
     pa_assert(q);
 
@@ -0,0 +1,134 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/sample.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "cpu-x86.h"
+#include "remap.h"
+
+#if defined (__i386__) || defined (__amd64__)
+
+#include <immintrin.h>
+
+/* Used for the remappings not handled here */
+static pa_init_remap_func_t init_remap_fallback;
+
+static void remap_mono_to_stereo_s16ne_avx2(pa_remap_t *m, int16_t *dst, const int16_t *src, unsigned n) {
+    unsigned i;
+
+    for (i = n >> 4; i; i--) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) src);
+        __m256i lo = _mm256_unpacklo_epi16(v, v);
+        __m256i hi = _mm256_unpackhi_epi16(v, v);
+
+        /* The unpacks work per 128 bit lane */
+        _mm256_storeu_si256((__m256i *) dst, _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i *) (dst + 16), _mm256_permute2x128_si256(lo, hi, 0x31));
+        src += 16;
+        dst += 32;
+    }
+    for (i = n & 15; i; i--) {
+        dst[0] = dst[1] = src[0];
+        src++;
+        dst += 2;
+    }
+}
+
+/* Works for both S32NE and FLOAT32NE */
+static void remap_mono_to_stereo_any32ne_avx2(pa_remap_t *m, int32_t *dst, const int32_t *src, unsigned n) {
+    unsigned i;
+
+    for (i = n >> 3; i; i--) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) src);
+        __m256i lo = _mm256_unpacklo_epi32(v, v);
+        __m256i hi = _mm256_unpackhi_epi32(v, v);
+
+        _mm256_storeu_si256((__m256i *) dst, _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i *) (dst + 8), _mm256_permute2x128_si256(lo, hi, 0x31));
+        src += 8;
+        dst += 16;
+    }
+    for (i = n & 7; i; i--) {
+        dst[0] = dst[1] = src[0];
+        src++;
+        dst += 2;
+    }
+}
+
+static void remap_stereo_to_mono_float32ne_avx2(pa_remap_t *m, float *dst, const float *src, unsigned n) {
+    const __m256 half = _mm256_set1_ps(0.5f);
+    unsigned i;
+
+    for (i = n >> 3; i; i--) {
+        /* haddps gives frames 0 1 4 5 | 2 3 6 7 */
+        __m256 s = _mm256_hadd_ps(_mm256_loadu_ps(src), _mm256_loadu_ps(src + 8));
+
+        s = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(s), 0xD8));
+        _mm256_storeu_ps(dst, _mm256_mul_ps(s, half));
+        src += 16;
+        dst += 8;
+    }
+    for (i = n & 7; i; i--) {
+        dst[0] = (src[0] + src[1])*0.5f;
+        src += 2;
+        dst += 1;
+    }
+}
+
+/* set the function that will execute the remapping based on the matrices */
+static void init_remap_avx2(pa_remap_t *m) {
+    unsigned n_oc, n_ic;
+
+    n_oc = m->o_ss.channels;
+    n_ic = m->i_ss.channels;
+
+    /* find some common channel remappings, leave the rest to the previously
+     * installed init function */
+    if (n_ic == 1 && n_oc == 2 &&
+            m->map_table_i[0][0] == 0x10000 && m->map_table_i[1][0] == 0x10000) {
+
+        pa_log_info("Using AVX2 mono to stereo remapping");
+        pa_set_remap_func(m, (pa_do_remap_func_t) remap_mono_to_stereo_s16ne_avx2,
+            (pa_do_remap_func_t) remap_mono_to_stereo_any32ne_avx2,
+            (pa_do_remap_func_t) remap_mono_to_stereo_any32ne_avx2);
+    } else if (n_ic == 2 && n_oc == 1 && m->format == PA_SAMPLE_FLOAT32NE &&
+            m->map_table_i[0][0] == 0x8000 && m->map_table_i[0][1] == 0x8000) {
+
+        pa_log_info("Using AVX2 stereo to mono remapping");
+        m->do_remap = (pa_do_remap_func_t) remap_stereo_to_mono_float32ne_avx2;
+    } else
+        init_remap_fallback(m);
+}
+#endif /* defined (__i386__) || defined (__amd64__) */
+
+void pa_remap_func_init_avx2(pa_cpu_x86_flag_t flags) {
+#if defined (__i386__) || defined (__amd64__)
+
+    if (flags & PA_CPU_X86_AVX2) {
+        pa_log_info("Initialising AVX2 optimized remappers.");
+        init_remap_fallback = pa_get_init_remap_func();
+        pa_set_init_remap_func((pa_init_remap_func_t) init_remap_avx2);
+    }
+
+#endif /* defined (__i386__) || defined (__amd64__) */
+}
@@ -24,6 +24,7 @@
 
 #include <pulse/sample.h>
 #include <pulse/volume.h>
+#include <pulse/xmalloc.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
 
@@ -99,6 +100,9 @@
                 "4:                             \n\t"
 
 #if defined (__i386__) || defined (__amd64__)
+
+#include <emmintrin.h>
+
 static void remap_mono_to_stereo_s16ne_sse2(pa_remap_t *m, int16_t *dst, const int16_t *src, unsigned n) {
     pa_reg_x86 temp, temp2;
 
@@ -122,9 +126,225 @@ static void remap_mono_to_stereo_any32ne_sse2(pa_remap_t *m, float *dst, const f
     );
 }
 
+/* Generic matrix remapping for up to 8 output channels. For each frame, the
+ * output vector is the sum over the input channels of the input sample
+ * times the column of the matrix for that input channel. Input channels that
+ * do not contribute to any output, like LFE in the usual downmixes, are left
+ * out. With 1, 2 or 4 output channels, the vectors hold several frames. The
+ * results match remap_channels_matrix_*_c() exactly. */
+typedef struct remap_matrix {
+    /* Input channels with a non-zero column */
+    unsigned n_active;
+    unsigned active[PA_CHANNELS_MAX];
+
+    /* Frames per vector */
+    unsigned frames;
+
+    /* Columns for one frame, padded with zeros */
+    float f[PA_CHANNELS_MAX][8];
+    /* Columns repeated for all frames of a vector */
+    float f_frames[PA_CHANNELS_MAX][4];
+
+    /* For s16, coefficients below 1.0 go to lo, lanes with 1.0 are set in
+     * full */
+    int16_t lo[PA_CHANNELS_MAX][8];
+    int16_t full[PA_CHANNELS_MAX][8];
+    int16_t lo_frames[PA_CHANNELS_MAX][8];
+    int16_t full_frames[PA_CHANNELS_MAX][8];
+} remap_matrix;
+
+/* Stores the first n lanes of v, the rest of the vector may only be written
+ * when more frames follow */
+static inline void store_ps_partial(float *dst, __m128 v, unsigned n, bool more) {
+    if (more || n >= 4)
+        _mm_storeu_ps(dst, v);
+    else {
+        float t[4];
+        unsigned i;
+
+        _mm_storeu_ps(t, v);
+        for (i = 0; i < n; i++)
+            dst[i] = t[i];
+    }
+}
+
+static void remap_matrix_float32ne_sse2(pa_remap_t *m, float *dst, const float *src, unsigned n) {
+    const remap_matrix *t = m->state;
+    unsigned n_ic = m->i_ss.channels, n_oc = m->o_ss.channels;
+    unsigned k;
+
+    if (t->frames == 4) {
+        for (; n >= 4; n -= 4, src += 4 * n_ic, dst += 4) {
+            __m128 acc = _mm_setzero_ps();
+
+            for (k = 0; k < t->n_active; k++) {
+                const float *s = src + t->active[k];
+                __m128 v = _mm_setr_ps(s[0], s[n_ic], s[2 * n_ic], s[3 * n_ic]);
+
+                acc = _mm_add_ps(acc, _mm_mul_ps(v, _mm_loadu_ps(t->f_frames[k])));
+            }
+
+            _mm_storeu_ps(dst, acc);
+        }
+    } else if (t->frames == 2) {
+        for (; n >= 2; n -= 2, src += 2 * n_ic, dst += 4) {
+            __m128 acc = _mm_setzero_ps();
+
+            for (k = 0; k < t->n_active; k++) {
+                const float *s = src + t->active[k];
+                __m128 v = _mm_movelh_ps(_mm_set1_ps(s[0]), _mm_set1_ps(s[n_ic]));
+
+                acc = _mm_add_ps(acc, _mm_mul_ps(v, _mm_loadu_ps(t->f_frames[k])));
+            }
+
+            _mm_storeu_ps(dst, acc);
+        }
+    }
+
+    /* One frame per iteration, for the remaining frames or when the output
+     * does not fit several frames per vector */
+    for (; n > 0; n--, src += n_ic, dst += n_oc) {
+        __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+
+        for (k = 0; k < t->n_active; k++) {
+            __m128 v = _mm_set1_ps(src[t->active[k]]);
+
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(v, _mm_loadu_ps(t->f[k])));
+            if (n_oc > 4)
+                acc1 = _mm_add_ps(acc1, _mm_mul_ps(v, _mm_loadu_ps(t->f[k] + 4)));
+        }
+
+        store_ps_partial(dst, acc0, n_oc, n > 1);
+        if (n_oc > 4)
+            store_ps_partial(dst + 4, acc1, n_oc - 4, n > 1);
+    }
+}
+
+/* (v * vol) >> 16 for 16.16 coefficients below 1.0, correcting the unsigned
+ * multiply for negative samples, plus v where the coefficient is 1.0 */
+static inline __m128i volume_s16_sse2(__m128i v, __m128i lo, __m128i full) {
+    __m128i l = _mm_sub_epi16(_mm_mulhi_epu16(v, lo), _mm_and_si128(_mm_srai_epi16(v, 15), lo));
+
+    return _mm_add_epi16(l, _mm_and_si128(v, full));
+}
+
+static void remap_matrix_s16ne_sse2(pa_remap_t *m, int16_t *dst, const int16_t *src, unsigned n) {
+    const remap_matrix *t = m->state;
+    unsigned n_ic = m->i_ss.channels, n_oc = m->o_ss.channels;
+    unsigned k;
+
+    if (t->frames > 1) {
+        unsigned frames = t->frames;
+
+        for (; n >= frames; n -= frames, src += frames * n_ic, dst += 8) {
+            __m128i acc = _mm_setzero_si128();
+
+            for (k = 0; k < t->n_active; k++) {
+                const int16_t *s = src + t->active[k];
+                __m128i v;
+
+                if (frames == 8)
+                    v = _mm_setr_epi16(s[0], s[n_ic], s[2 * n_ic], s[3 * n_ic],
+                                       s[4 * n_ic], s[5 * n_ic], s[6 * n_ic], s[7 * n_ic]);
+                else if (frames == 4)
+                    v = _mm_setr_epi16(s[0], s[0], s[n_ic], s[n_ic],
+                                       s[2 * n_ic], s[2 * n_ic], s[3 * n_ic], s[3 * n_ic]);
+                else
+                    v = _mm_unpacklo_epi64(_mm_set1_epi16(s[0]), _mm_set1_epi16(s[n_ic]));
+
+                /* The samples of each output channel wrap around like in the
+                 * C version */
+                acc = _mm_add_epi16(acc, volume_s16_sse2(v,
+                    _mm_loadu_si128((const __m128i *) t->lo_frames[k]),
+                    _mm_loadu_si128((const __m128i *) t->full_frames[k])));
+            }
+
+            _mm_storeu_si128((__m128i *) dst, acc);
+        }
+    }
+
+    for (; n > 0; n--, src += n_ic, dst += n_oc) {
+        __m128i acc = _mm_setzero_si128();
+
+        for (k = 0; k < t->n_active; k++) {
+            __m128i v = _mm_set1_epi16(src[t->active[k]]);
+
+            acc = _mm_add_epi16(acc, volume_s16_sse2(v,
+                _mm_loadu_si128((const __m128i *) t->lo[k]),
+                _mm_loadu_si128((const __m128i *) t->full[k])));
+        }
+
+        if (n > 1 || n_oc == 8)
+            _mm_storeu_si128((__m128i *) dst, acc);
+        else {
+            int16_t r[8];
+            unsigned i;
+
+            _mm_storeu_si128((__m128i *) r, acc);
+            for (i = 0; i < n_oc; i++)
+                dst[i] = r[i];
+        }
+    }
+}
+
+static remap_matrix *setup_remap_matrix(pa_remap_t *m) {
+    unsigned n_ic = m->i_ss.channels, n_oc = m->o_ss.channels;
+    unsigned lanes = m->format == PA_SAMPLE_FLOAT32NE ? 4 : 8;
+    remap_matrix *t;
+    unsigned ic, oc, j;
+
+    t = pa_xnew0(remap_matrix, 1);
+    t->frames = (lanes % n_oc == 0) ? lanes / n_oc : 1;
+
+    for (ic = 0; ic < n_ic; ic++) {
+        unsigned k = t->n_active;
+        bool used = false;
+
+        for (oc = 0; oc < n_oc; oc++) {
+            if (m->format == PA_SAMPLE_FLOAT32NE) {
+                float vol = m->map_table_f[oc][ic];
+
+                /* Like in the C version, coefficients above 1.0 count as 1.0
+                 * and negative ones are ignored */
+                if (vol > 0.0f) {
+                    t->f[k][oc] = PA_MIN(vol, 1.0f);
+                    used = true;
+                }
+            } else {
+                int32_t vol = m->map_table_i[oc][ic];
+
+                if (vol >= 0x10000)
+                    t->full[k][oc] = -1;
+                else if (vol > 0)
+                    t->lo[k][oc] = (int16_t) vol;
+
+                if (vol > 0)
+                    used = true;
+            }
+        }
+
+        if (!used)
+            continue;
+
+        for (j = 0; j < lanes; j++) {
+            if (m->format == PA_SAMPLE_FLOAT32NE)
+                t->f_frames[k][j] = t->f[k][j % n_oc];
+            else {
+                t->lo_frames[k][j] = t->lo[k][j % n_oc];
+                t->full_frames[k][j] = t->full[k][j % n_oc];
+            }
+        }
+
+        t->active[t->n_active++] = ic;
+    }
+
+    return t;
+}
+
 /* set the function that will execute the remapping based on the matrices */
 static void init_remap_sse2(pa_remap_t *m) {
     unsigned n_oc, n_ic;
+    int8_t arrange[PA_CHANNELS_MAX];
 
     n_oc = m->o_ss.channels;
     n_ic = m->i_ss.channels;
@@ -137,6 +357,18 @@ static void init_remap_sse2(pa_remap_t *m) {
         pa_set_remap_func(m, (pa_do_remap_func_t) remap_mono_to_stereo_s16ne_sse2,
             (pa_do_remap_func_t) remap_mono_to_stereo_any32ne_sse2,
             (pa_do_remap_func_t) remap_mono_to_stereo_any32ne_sse2);
+    } else if ((m->format == PA_SAMPLE_FLOAT32NE || m->format == PA_SAMPLE_S16NE) &&
+            n_oc <= 8 && (n_ic > 2 || n_oc > 2) && !pa_setup_remap_arrange(m, arrange)) {
+
+        /* Mono and stereo remappings and pure rearrangements are left to the
+         * special cases of the C version */
+        pa_log_info("Using SSE2 matrix remapping");
+        pa_set_remap_func(m, (pa_do_remap_func_t) remap_matrix_s16ne_sse2,
+            (pa_do_remap_func_t) NULL,
+            (pa_do_remap_func_t) remap_matrix_float32ne_sse2);
+
+        /* setup state */
+        m->state = setup_remap_matrix(m);
     }
 }
 #endif /* defined (__i386__) || defined (__amd64__) */
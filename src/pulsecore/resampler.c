@@ -30,12 +30,45 @@
 #include <pulsecore/macro.h>
 #include <pulsecore/strbuf.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/llist.h>
+#include <pulsecore/mutex.h>
 
 #include "resampler.h"
 
 /* Number of samples of extra space we allow the resamplers to return */
 #define EXTRA_FRAMES 128
 
+/* Number of filter tables the cache keeps after their last user is gone */
+#define MAX_UNUSED_TABLES 8
+
+typedef struct cache_key {
+    pa_resample_method_t method;
+    pa_sample_format_t format;
+    uint32_t in_rate, out_rate;
+} cache_key;
+
+typedef struct cache_entry cache_entry;
+
+struct cache_entry {
+    cache_key key;
+    unsigned ref;
+    void *table;
+    pa_resampler_table_free_cb_t free_cb;
+
+    PA_LLIST_FIELDS(cache_entry);
+};
+
+struct pa_resampler_cache {
+    pa_mutex *mutex;
+    pa_hashmap *entries; /* cache_key -> cache_entry */
+    pa_hashmap *tables;  /* table -> cache_entry */
+
+    /* Entries without references, most recently used first */
+    PA_LLIST_HEAD(cache_entry, unused);
+    unsigned n_unused;
+};
+
 struct ffmpeg_data { /* data specific to ffmpeg */
     struct AVResampleContext *state;
 };
@@ -120,6 +153,9 @@ static int (* const init_table[])(pa_resampler *r) = {
     [PA_RESAMPLER_SOXR_HQ]                 = NULL,
     [PA_RESAMPLER_SOXR_VHQ]                = NULL,
 #endif
+    [PA_RESAMPLER_POLYPHASE_LQ]            = pa_resampler_polyphase_init,
+    [PA_RESAMPLER_POLYPHASE_MQ]            = pa_resampler_polyphase_init,
+    [PA_RESAMPLER_POLYPHASE_HQ]            = pa_resampler_polyphase_init,
 };
 
 static void calculate_gcd(pa_resampler *r) {
@@ -341,6 +377,7 @@ static pa_sample_format_t choose_work_format(
 
 pa_resampler* pa_resampler_new(
         pa_mempool *pool,
+        pa_resampler_cache *cache,
         const pa_sample_spec *a,
         const pa_channel_map *am,
         const pa_sample_spec *b,
@@ -365,6 +402,11 @@ pa_resampler* pa_resampler_new(
     r = pa_xnew0(pa_resampler, 1);
     r->mempool = pool;
     r->method = method;
+
+    if (!cache)
+        cache = r->own_cache = pa_resampler_cache_new();
+    r->cache = cache;
+
     r->flags = flags;
     r->in_frames = 0;
     r->out_frames = 0;
@@ -461,6 +503,8 @@ pa_resampler* pa_resampler_new(
 fail:
     if (r->lfe_filter)
       pa_lfe_filter_free(r->lfe_filter);
+    if (r->own_cache)
+        pa_resampler_cache_free(r->own_cache);
     pa_xfree(r);
 
     return NULL;
@@ -488,6 +532,9 @@ void pa_resampler_free(pa_resampler *r) {
 
     free_remap(&r->remap);
 
+    if (r->own_cache)
+        pa_resampler_cache_free(r->own_cache);
+
     pa_xfree(r);
 }
 
@@ -809,7 +856,10 @@ static const char * const resample_methods[] = {
     "peaks",
     "soxr-mq",
     "soxr-hq",
-    "soxr-vhq"
+    "soxr-vhq",
+    "polyphase-lq",
+    "polyphase-mq",
+    "polyphase-hq"
 };
 
 const char *pa_resample_method_to_string(pa_resample_method_t m) {
@@ -1681,6 +1731,158 @@ size_t pa_resampler_get_max_history(pa_resampler *r) {
     return (uint64_t) PA_RESAMPLER_MAX_DELAY_USEC * r->i_ss.rate * 3 / PA_USEC_PER_SEC / 2;
 }
 
+/*** shared filter tables ***/
+
+static unsigned cache_key_hash_func(const void *p) {
+    const cache_key *k = p;
+
+    return (unsigned) k->method * 31 + (unsigned) k->format * 7 + k->in_rate * 65537 + k->out_rate;
+}
+
+static int cache_key_compare_func(const void *a, const void *b) {
+    const cache_key *x = a, *y = b;
+
+    if (x->method != y->method)
+        return x->method < y->method ? -1 : 1;
+    if (x->format != y->format)
+        return x->format < y->format ? -1 : 1;
+    if (x->in_rate != y->in_rate)
+        return x->in_rate < y->in_rate ? -1 : 1;
+    if (x->out_rate != y->out_rate)
+        return x->out_rate < y->out_rate ? -1 : 1;
+
+    return 0;
+}
+
+static void cache_entry_free(cache_entry *e) {
+    e->free_cb(e->table);
+    pa_xfree(e);
+}
+
+pa_resampler_cache *pa_resampler_cache_new(void) {
+    pa_resampler_cache *c;
+
+    c = pa_xnew0(pa_resampler_cache, 1);
+    c->mutex = pa_mutex_new(false, false);
+    c->entries = pa_hashmap_new_full(cache_key_hash_func, cache_key_compare_func, NULL, (pa_free_cb_t) cache_entry_free);
+    c->tables = pa_hashmap_new(NULL, NULL);
+    PA_LLIST_HEAD_INIT(cache_entry, c->unused);
+
+    return c;
+}
+
+void pa_resampler_cache_free(pa_resampler_cache *c) {
+    pa_assert(c);
+
+    /* Only unused tables may be left */
+    pa_assert(pa_hashmap_size(c->entries) == c->n_unused);
+
+    pa_hashmap_free(c->tables);
+    pa_hashmap_free(c->entries);
+    pa_mutex_free(c->mutex);
+    pa_xfree(c);
+}
+
+/* Must be called with the mutex held */
+static cache_entry *cache_lookup(pa_resampler_cache *c, const cache_key *key) {
+    cache_entry *e;
+
+    if (!(e = pa_hashmap_get(c->entries, key)))
+        return NULL;
+
+    if (e->ref++ == 0) {
+        PA_LLIST_REMOVE(cache_entry, c->unused, e);
+        c->n_unused--;
+    }
+
+    return e;
+}
+
+const void *pa_resampler_table_ref(pa_resampler *r, uint32_t in_rate, uint32_t out_rate,
+                                   pa_resampler_table_new_cb_t new_cb, pa_resampler_table_free_cb_t free_cb, void *userdata) {
+    pa_resampler_cache *c;
+    cache_key key;
+    cache_entry *e;
+    void *table;
+
+    pa_assert(r);
+    pa_assert(new_cb);
+    pa_assert(free_cb);
+
+    c = r->cache;
+
+    pa_zero(key);
+    key.method = r->method;
+    key.format = r->work_format;
+    key.in_rate = in_rate;
+    key.out_rate = out_rate;
+
+    pa_mutex_lock(c->mutex);
+    e = cache_lookup(c, &key);
+    pa_mutex_unlock(c->mutex);
+
+    if (e)
+        return e->table;
+
+    /* Computing a table may take a while, don't block other threads
+     * meanwhile. If another thread was faster, its table is used. */
+    table = new_cb(userdata);
+
+    pa_mutex_lock(c->mutex);
+
+    if ((e = cache_lookup(c, &key)))
+        free_cb(table);
+    else {
+        e = pa_xnew0(cache_entry, 1);
+        e->key = key;
+        e->ref = 1;
+        e->table = table;
+        e->free_cb = free_cb;
+
+        pa_assert_se(pa_hashmap_put(c->entries, &e->key, e) >= 0);
+        pa_assert_se(pa_hashmap_put(c->tables, e->table, e) >= 0);
+    }
+
+    pa_mutex_unlock(c->mutex);
+
+    return e->table;
+}
+
+void pa_resampler_table_unref(pa_resampler *r, const void *table) {
+    pa_resampler_cache *c;
+    cache_entry *e;
+
+    pa_assert(r);
+    pa_assert(table);
+
+    c = r->cache;
+
+    pa_mutex_lock(c->mutex);
+
+    pa_assert_se(e = pa_hashmap_get(c->tables, table));
+    pa_assert(e->ref >= 1);
+
+    if (--e->ref == 0) {
+        PA_LLIST_PREPEND(cache_entry, c->unused, e);
+        c->n_unused++;
+
+        if (c->n_unused > MAX_UNUSED_TABLES) {
+            cache_entry *last;
+
+            for (last = c->unused; last->next; last = last->next)
+                ;
+
+            PA_LLIST_REMOVE(cache_entry, c->unused, last);
+            c->n_unused--;
+
+            pa_hashmap_remove(c->tables, last->table);
+            pa_hashmap_remove_and_free(c->entries, &last->key);
+        }
+    }
+
+    pa_mutex_unlock(c->mutex);
+}
+
 /*** copy (noop) implementation ***/
 
 static int copy_init(pa_resampler *r) {
@@ -30,6 +30,7 @@
 
 typedef struct pa_resampler pa_resampler;
 typedef struct pa_resampler_impl pa_resampler_impl;
+typedef struct pa_resampler_cache pa_resampler_cache;
 
 struct pa_resampler_impl {
     void (*free)(pa_resampler *r);
@@ -61,6 +62,9 @@ typedef enum pa_resample_method {
     PA_RESAMPLER_SOXR_MQ,
     PA_RESAMPLER_SOXR_HQ,
     PA_RESAMPLER_SOXR_VHQ,
+    PA_RESAMPLER_POLYPHASE_LQ,
+    PA_RESAMPLER_POLYPHASE_MQ,
+    PA_RESAMPLER_POLYPHASE_HQ,
     PA_RESAMPLER_MAX
 } pa_resample_method_t;
 
@@ -88,6 +92,10 @@ struct pa_resampler {
     size_t i_fz, o_fz, w_fz, w_sz;
     pa_mempool *mempool;
 
+    /* Shared filter tables, either the one passed in or a private one */
+    pa_resampler_cache *cache;
+    pa_resampler_cache *own_cache;
+
     pa_memchunk to_work_format_buf;
     pa_memchunk remap_buf;
     pa_memchunk resample_buf;
@@ -126,6 +134,7 @@ struct pa_resampler {
 
 pa_resampler* pa_resampler_new(
         pa_mempool *pool,
+        pa_resampler_cache *cache,
         const pa_sample_spec *a,
         const pa_channel_map *am,
         const pa_sample_spec *b,
@@ -192,6 +201,21 @@ const pa_sample_spec* pa_resampler_input_sample_spec(pa_resampler *r);
 const pa_channel_map* pa_resampler_output_channel_map(pa_resampler *r);
 const pa_sample_spec* pa_resampler_output_sample_spec(pa_resampler *r);
 
+/* A cache of read-only filter tables that can be shared between the
+ * resamplers of a core. Tables are looked up by method, work format and the
+ * pair of rates passed by the implementation. The cache is thread-safe. */
+pa_resampler_cache *pa_resampler_cache_new(void);
+void pa_resampler_cache_free(pa_resampler_cache *c);
+
+typedef void *(*pa_resampler_table_new_cb_t)(void *userdata);
+typedef void (*pa_resampler_table_free_cb_t)(void *table);
+
+/* Returns a reference to the table for the given rates, calling new_cb to
+ * create it if it is not cached yet. For use by the implementations. */
+const void *pa_resampler_table_ref(pa_resampler *r, uint32_t in_rate, uint32_t out_rate,
+                                   pa_resampler_table_new_cb_t new_cb, pa_resampler_table_free_cb_t free_cb, void *userdata);
+void pa_resampler_table_unref(pa_resampler *r, const void *table);
+
 /* Implementation specific init functions */
 int pa_resampler_ffmpeg_init(pa_resampler *r);
 int pa_resampler_libsamplerate_init(pa_resampler *r);
@@ -199,6 +223,13 @@ int pa_resampler_peaks_init(pa_resampler *r);
 int pa_resampler_speex_init(pa_resampler *r);
 int pa_resampler_trivial_init(pa_resampler*r);
 int pa_resampler_soxr_init(pa_resampler *r);
+int pa_resampler_polyphase_init(pa_resampler *r);
+
+/* Dot product of n floats, used by the polyphase resampler for each output
+ * sample. n is always a multiple of 8. */
+typedef float (*pa_polyphase_dot_func_t)(const float *x, const float *h, unsigned n);
+
+void pa_set_polyphase_dot_func(pa_polyphase_dot_func_t func);
 
 /* Resampler-specific quirks */
 bool pa_speex_is_fixed_point(void);
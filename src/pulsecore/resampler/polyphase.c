@@ -0,0 +1,417 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <string.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/resampler.h>
+
+/* A windowed sinc FIR resampler. The filter is split into phases, one per
+ * fractional input position an output sample can fall on. If the reduced
+ * output rate is small, there is one phase for each of these positions
+ * ("exact" bank). Otherwise, and for variable rate resamplers, the bank has
+ * a fixed number of phases and the coefficients are linearly interpolated
+ * between the two closest ones ("interpolated" bank). Interpolated banks
+ * only depend on the rate ratio through the cutoff when downsampling, which
+ * makes small rate changes cheap.
+ *
+ * Banks are read-only once computed and shared through the resampler cache.
+ * Exact banks are looked up by the reduced rate ratio, interpolated ones by
+ * the rounded downsampling ratio and an output rate of 0. */
+
+/* Exact banks are used up to this many phases and coefficients */
+#define MAX_EXACT_PHASES 512
+#define MAX_EXACT_COEFFS (64 * 1024)
+
+/* Number of filter banks a resampler keeps referenced for rate changes */
+#define MAX_CACHED_BANKS 4
+
+/* Filter lengths are padded to this, for the vectorized dot products */
+#define TAPS_ALIGN 8
+
+/* The downsampling ratio is rounded up to this step when designing the
+ * filter, so that small rate changes can reuse a bank */
+#define RATIO_STEPS 64
+
+struct polyphase_quality {
+    unsigned taps;        /* filter length without downsampling */
+    double cutoff;        /* relative to the lower of the Nyquist frequencies */
+    double beta;          /* Kaiser window shape */
+    unsigned oversample;  /* phases of interpolated banks */
+};
+
+static const struct polyphase_quality qualities[] = {
+    [PA_RESAMPLER_POLYPHASE_LQ - PA_RESAMPLER_POLYPHASE_LQ] = { 16, 0.85, 5.0, 64 },
+    [PA_RESAMPLER_POLYPHASE_MQ - PA_RESAMPLER_POLYPHASE_LQ] = { 32, 0.91, 7.0, 128 },
+    [PA_RESAMPLER_POLYPHASE_HQ - PA_RESAMPLER_POLYPHASE_LQ] = { 64, 0.95, 9.0, 256 },
+};
+
+typedef struct polyphase_bank {
+    bool interpolate;
+    unsigned n_phases;
+    unsigned taps;
+    double cutoff;
+    double beta;
+
+    /* n_phases filters of taps coefficients each */
+    float *coeffs;
+} polyphase_bank;
+
+struct polyphase_data {
+    const struct polyphase_quality *quality;
+
+    /* Most recently used first, the first one is in use */
+    const polyphase_bank *banks[MAX_CACHED_BANKS];
+    unsigned n_banks;
+
+    /* Each output frame advances the input position by num / den */
+    unsigned num, den;
+
+    /* Input position of the next output frame, relative to the start of
+     * the next input chunk. The fractional part is in units of 1 / den. */
+    int pos;
+    unsigned phase;
+
+    /* Non-interleaved input, per channel the last history frames followed
+     * by the current input */
+    float *buf;
+    unsigned buf_frames;
+    unsigned history;
+};
+
+static float dot_c(const float *x, const float *h, unsigned n) {
+    float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    unsigned i;
+
+    for (i = 0; i < n; i += 4) {
+        s0 += x[i] * h[i];
+        s1 += x[i + 1] * h[i + 1];
+        s2 += x[i + 2] * h[i + 2];
+        s3 += x[i + 3] * h[i + 3];
+    }
+
+    return (s0 + s1) + (s2 + s3);
+}
+
+static pa_polyphase_dot_func_t dot_func = dot_c;
+
+void pa_set_polyphase_dot_func(pa_polyphase_dot_func_t func) {
+    pa_assert(func);
+
+    dot_func = func;
+}
+
+static double bessel_i0(double x) {
+    double sum = 1, term = 1;
+    unsigned k;
+
+    for (k = 1; term > sum * 1e-12; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+
+    return sum;
+}
+
+/* Computes the coefficients of a bank with the parameters of the template */
+static void *bank_new(void *userdata) {
+    const polyphase_bank *t = userdata;
+    polyphase_bank *b;
+    double i0_beta;
+    unsigned p, k, taps = t->taps;
+
+    pa_log_debug("Computing %s polyphase filter bank: %u phases, %u taps, cutoff %0.3f",
+                 t->interpolate ? "interpolated" : "exact", t->n_phases, t->taps, t->cutoff);
+
+    b = pa_xnewdup(polyphase_bank, t, 1);
+    b->coeffs = pa_xnew(float, b->n_phases * taps);
+
+    i0_beta = bessel_i0(b->beta);
+
+    for (p = 0; p < b->n_phases; p++) {
+        /* Interpolated banks have one more phase than oversample, so the
+         * last one is at a fraction of 1 */
+        double frac = b->interpolate ? (double) p / (b->n_phases - 1) : (double) p / b->n_phases;
+        float *h = b->coeffs + p * taps;
+        double sum = 0;
+
+        for (k = 0; k < taps; k++) {
+            double x = (double) k - (taps / 2 - 1) - frac;
+            double u = x / (taps / 2);
+            double v = 0;
+
+            if (fabs(u) < 1) {
+                v = bessel_i0(b->beta * sqrt(1 - u * u)) / i0_beta;
+                if (fabs(x) > 1e-9)
+                    v *= sin(M_PI * b->cutoff * x) / (M_PI * x);
+                else
+                    v *= b->cutoff;
+            }
+
+            h[k] = (float) v;
+            sum += v;
+        }
+
+        /* Unity gain at DC for every phase */
+        for (k = 0; k < taps; k++)
+            h[k] = (float) (h[k] / sum);
+    }
+
+    return b;
+}
+
+static void bank_free(void *table) {
+    polyphase_bank *b = table;
+
+    pa_xfree(b->coeffs);
+    pa_xfree(b);
+}
+
+static void set_ratio(pa_resampler *r, struct polyphase_data *d) {
+    d->num = r->i_ss.rate / r->gcd;
+    d->den = r->o_ss.rate / r->gcd;
+}
+
+/* Makes sure that the buffer can take the history and in_frames of input */
+static void fit_buffer(pa_resampler *r, struct polyphase_data *d, unsigned history, unsigned in_frames) {
+    unsigned c;
+
+    pa_assert(history >= d->history);
+
+    if (history + in_frames > d->buf_frames || history != d->history) {
+        unsigned buf_frames = PA_MAX(d->buf_frames, history + in_frames);
+        float *buf = pa_xnew0(float, buf_frames * r->work_channels);
+
+        /* Older history is silence when the filter got longer */
+        if (d->buf)
+            for (c = 0; c < r->work_channels; c++)
+                memcpy(buf + c * buf_frames + history - d->history, d->buf + c * d->buf_frames, d->history * sizeof(float));
+
+        pa_xfree(d->buf);
+        d->buf = buf;
+        d->buf_frames = buf_frames;
+        d->history = history;
+    }
+}
+
+/* Selects the filter bank for the current rates, reusing a cached one if
+ * possible */
+static void select_bank(pa_resampler *r, struct polyphase_data *d) {
+    const struct polyphase_quality *q = d->quality;
+    const polyphase_bank *b;
+    polyphase_bank t;
+    double ratio = 1;
+    unsigned i;
+
+    if (r->i_ss.rate > r->o_ss.rate)
+        ratio = ceil((double) r->i_ss.rate / r->o_ss.rate * RATIO_STEPS) / RATIO_STEPS;
+
+    pa_zero(t);
+    t.taps = PA_ROUND_UP((unsigned) ceil(q->taps * ratio), TAPS_ALIGN);
+    t.cutoff = q->cutoff / ratio;
+    t.beta = q->beta;
+
+    t.interpolate = (r->flags & PA_RESAMPLER_VARIABLE_RATE) ||
+        d->den > MAX_EXACT_PHASES || d->den * t.taps > MAX_EXACT_COEFFS;
+    t.n_phases = t.interpolate ? q->oversample + 1 : d->den;
+
+    for (i = 0; i < d->n_banks; i++) {
+        b = d->banks[i];
+
+        if (b->interpolate == t.interpolate && b->n_phases == t.n_phases && b->taps == t.taps && b->cutoff == t.cutoff)
+            break;
+    }
+
+    if (i == d->n_banks) {
+        if (t.interpolate)
+            b = pa_resampler_table_ref(r, (uint32_t) (ratio * RATIO_STEPS), 0, bank_new, bank_free, &t);
+        else
+            b = pa_resampler_table_ref(r, d->num, d->den, bank_new, bank_free, &t);
+
+        if (d->n_banks == MAX_CACHED_BANKS)
+            pa_resampler_table_unref(r, d->banks[--d->n_banks]);
+
+        i = d->n_banks++;
+    }
+
+    memmove(d->banks + 1, d->banks, i * sizeof(d->banks[0]));
+    d->banks[0] = b;
+
+    /* Keep enough history for a window that starts half a filter before
+     * the current input chunk */
+    if (b->taps - 1 > d->history)
+        fit_buffer(r, d, b->taps - 1, 0);
+}
+
+static unsigned polyphase_resample(pa_resampler *r, const pa_memchunk *input, unsigned in_n_frames, pa_memchunk *output, unsigned *out_n_frames) {
+    struct polyphase_data *d;
+    const polyphase_bank *b;
+    unsigned c, i, o, channels, half, advance, step;
+    float *src, *dst;
+
+    pa_assert(r);
+    pa_assert(input);
+    pa_assert(output);
+    pa_assert(out_n_frames);
+
+    d = r->impl.data;
+    b = d->banks[0];
+    channels = r->work_channels;
+    half = b->taps / 2;
+    advance = d->num / d->den;
+    step = d->num % d->den;
+
+    fit_buffer(r, d, d->history, in_n_frames);
+
+    /* Split up the channels behind the history */
+    src = pa_memblock_acquire_chunk(input);
+    for (c = 0; c < channels; c++) {
+        float *x = d->buf + c * d->buf_frames + d->history;
+
+        for (i = 0; i < in_n_frames; i++)
+            x[i] = src[i * channels + c];
+    }
+    pa_memblock_release(input->memblock);
+
+    dst = pa_memblock_acquire_chunk(output);
+
+    /* The window of an output frame covers the input frames from
+     * pos - half + 1 to pos + half */
+    for (o = 0; d->pos + (int) half < (int) in_n_frames; o++) {
+        const float *x = d->buf + (d->history + d->pos - half + 1);
+
+        pa_assert_fp(o < *out_n_frames);
+
+        if (!b->interpolate) {
+            const float *h = b->coeffs + d->phase * b->taps;
+
+            for (c = 0; c < channels; c++)
+                dst[c] = dot_func(x + c * d->buf_frames, h, b->taps);
+        } else {
+            uint64_t t = (uint64_t) d->phase * (b->n_phases - 1);
+            const float *h0 = b->coeffs + (t / d->den) * b->taps;
+            const float *h1 = h0 + b->taps;
+            float f = (float) (t % d->den) / d->den;
+
+            for (c = 0; c < channels; c++) {
+                float y0 = dot_func(x + c * d->buf_frames, h0, b->taps);
+                float y1 = dot_func(x + c * d->buf_frames, h1, b->taps);
+
+                dst[c] = y0 + f * (y1 - y0);
+            }
+        }
+
+        dst += channels;
+
+        d->pos += advance;
+        d->phase += step;
+        if (d->phase >= d->den) {
+            d->phase -= d->den;
+            d->pos++;
+        }
+    }
+
+    pa_memblock_release(output->memblock);
+
+    /* Keep the end of the input as history for the next chunk */
+    for (c = 0; c < channels; c++) {
+        float *x = d->buf + c * d->buf_frames;
+
+        memmove(x, x + in_n_frames, d->history * sizeof(float));
+    }
+
+    d->pos -= in_n_frames;
+    *out_n_frames = o;
+
+    return 0;
+}
+
+static void polyphase_update_rates(pa_resampler *r) {
+    struct polyphase_data *d;
+    unsigned den;
+
+    pa_assert(r);
+
+    d = r->impl.data;
+    den = d->den;
+
+    set_ratio(r, d);
+    d->phase = (unsigned) ((uint64_t) d->phase * d->den / den);
+
+    select_bank(r, d);
+}
+
+static void polyphase_reset(pa_resampler *r) {
+    struct polyphase_data *d;
+
+    pa_assert(r);
+
+    d = r->impl.data;
+
+    /* The first output frame is aligned with the first input frame */
+    d->pos = 0;
+    d->phase = 0;
+
+    if (d->buf)
+        memset(d->buf, 0, d->buf_frames * r->work_channels * sizeof(float));
+}
+
+static void polyphase_free(pa_resampler *r) {
+    struct polyphase_data *d;
+    unsigned i;
+
+    pa_assert(r);
+
+    if (!(d = r->impl.data))
+        return;
+
+    for (i = 0; i < d->n_banks; i++)
+        pa_resampler_table_unref(r, d->banks[i]);
+
+    pa_xfree(d->buf);
+    pa_xfree(d);
+}
+
+int pa_resampler_polyphase_init(pa_resampler *r) {
+    struct polyphase_data *d;
+
+    pa_assert(r);
+    pa_assert(r->method >= PA_RESAMPLER_POLYPHASE_LQ && r->method <= PA_RESAMPLER_POLYPHASE_HQ);
+    pa_assert(r->work_format == PA_SAMPLE_FLOAT32NE);
+
+    d = pa_xnew0(struct polyphase_data, 1);
+    d->quality = &qualities[r->method - PA_RESAMPLER_POLYPHASE_LQ];
+
+    set_ratio(r, d);
+    select_bank(r, d);
+
+    r->impl.free = polyphase_free;
+    r->impl.update_rates = polyphase_update_rates;
+    r->impl.reset = polyphase_reset;
+    r->impl.resample = polyphase_resample;
+    r->impl.data = d;
+
+    return 0;
+}
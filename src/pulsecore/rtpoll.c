@@ -24,8 +24,16 @@
 
 #include <sys/types.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_TIMERFD_H)
+#define USE_EPOLL
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
 
 #include <pulse/xmalloc.h>
 #include <pulse/timeval.h>
@@ -44,6 +52,22 @@
 
 /* #define DEBUG_TIMING */
 
+#ifdef USE_EPOLL
+/* epoll data of the timerfd, all other registrations carry their
+ * index into the pollfd array */
+#define TIMER_INDEX ((uint32_t) -1)
+
+struct rtpoll_registration {
+    /* fd and events as last registered, fd is -1 if not registered */
+    int fd;
+    short events;
+
+    /* The fd registered with epoll: fd itself, a duplicate of it if
+     * another entry already watches fd, or -1 */
+    int registered_fd;
+};
+#endif
+
 struct pa_rtpoll {
     struct pollfd *pollfd, *pollfd2;
     unsigned n_pollfd_alloc, n_pollfd_used;
@@ -57,6 +81,20 @@ struct pa_rtpoll {
     bool quit:1;
     bool timer_elapsed:1;
 
+#ifdef USE_EPOLL
+    /* If this is not -1, the pollfds stay registered with epoll and
+     * are only updated when they changed since the last run, and the
+     * timer is an absolute timerfd */
+    int epoll_fd, timer_fd;
+    struct rtpoll_registration *registered;
+    unsigned n_registered;
+    struct epoll_event *epoll_events;
+    unsigned max_epoll_events;
+
+    struct timeval timer_armed_elapse;
+    bool timer_armed:1;
+#endif
+
 #ifdef DEBUG_TIMING
     pa_usec_t timestamp;
     pa_usec_t slept, awake;
@@ -86,6 +124,220 @@ struct pa_rtpoll_item {
 
 PA_STATIC_FLIST_DECLARE(items, 0, pa_xfree);
 
+#ifdef USE_EPOLL
+static void epoll_init(pa_rtpoll *p) {
+    struct epoll_event ev;
+
+    if ((p->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+        goto fail;
+
+    if ((p->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC|TFD_NONBLOCK)) < 0)
+        goto fail;
+
+    pa_zero(ev);
+    ev.events = EPOLLIN;
+    ev.data.u32 = TIMER_INDEX;
+
+    if (epoll_ctl(p->epoll_fd, EPOLL_CTL_ADD, p->timer_fd, &ev) < 0)
+        goto fail;
+
+    p->max_epoll_events = 1;
+    p->epoll_events = pa_xnew(struct epoll_event, p->max_epoll_events);
+    return;
+
+fail:
+    pa_log_debug("Not using epoll for the real-time poll loop: %s", pa_cstrerror(errno));
+
+    if (p->timer_fd >= 0)
+        pa_close(p->timer_fd);
+    if (p->epoll_fd >= 0)
+        pa_close(p->epoll_fd);
+
+    p->epoll_fd = p->timer_fd = -1;
+}
+
+static int epoll_register(pa_rtpoll *p, unsigned k) {
+    struct rtpoll_registration *r = &p->registered[k];
+    struct epoll_event ev;
+    int fd = p->pollfd[k].fd;
+
+    pa_assert(r->fd < 0);
+    pa_assert(fd >= 0);
+
+    pa_zero(ev);
+    ev.events = (uint16_t) p->pollfd[k].events;
+    ev.data.u32 = k;
+
+    if (epoll_ctl(p->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        if (errno != EEXIST)
+            return -1;
+
+        /* epoll can't watch the same fd twice, but duplicates are fine */
+        if ((fd = fcntl(p->pollfd[k].fd, F_DUPFD_CLOEXEC, 0)) < 0)
+            return -1;
+
+        if (epoll_ctl(p->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            pa_close(fd);
+            return -1;
+        }
+    }
+
+    r->fd = p->pollfd[k].fd;
+    r->events = p->pollfd[k].events;
+    r->registered_fd = fd;
+    return 0;
+}
+
+static void epoll_unregister(pa_rtpoll *p, struct rtpoll_registration *r) {
+    if (r->fd < 0)
+        return;
+
+    /* Fails harmlessly if the fd has been closed already, closing
+     * removes it from the epoll set anyway */
+    epoll_ctl(p->epoll_fd, EPOLL_CTL_DEL, r->registered_fd, NULL);
+
+    if (r->registered_fd != r->fd)
+        pa_close(r->registered_fd);
+
+    r->fd = r->registered_fd = -1;
+    r->events = 0;
+}
+
+static void epoll_unregister_all(pa_rtpoll *p) {
+    unsigned k;
+
+    for (k = 0; k < p->n_registered; k++)
+        epoll_unregister(p, &p->registered[k]);
+
+    p->n_registered = 0;
+}
+
+/* Go back to ppoll(), for fds epoll doesn't support like regular files */
+static void epoll_disable(pa_rtpoll *p) {
+    pa_log_debug("Falling back to poll() for the real-time poll loop: %s", pa_cstrerror(errno));
+
+    epoll_unregister_all(p);
+
+    pa_close(p->timer_fd);
+    pa_close(p->epoll_fd);
+    p->epoll_fd = p->timer_fd = -1;
+}
+
+/* Bring the epoll set and the timerfd in line with the pollfd array
+ * and the timer. Only entries that changed since the last run cost a
+ * system call, so does the timer. */
+static int epoll_sync(pa_rtpoll *p) {
+    struct epoll_event ev;
+    unsigned k;
+
+    pa_assert(p->n_registered == 0 || p->n_registered == p->n_pollfd_used);
+
+    if (p->n_registered < p->n_pollfd_used) {
+        p->registered = pa_xrealloc(p->registered, sizeof(struct rtpoll_registration) * p->n_pollfd_used);
+
+        for (k = 0; k < p->n_pollfd_used; k++) {
+            p->registered[k].fd = p->registered[k].registered_fd = -1;
+            p->registered[k].events = 0;
+        }
+
+        p->n_registered = p->n_pollfd_used;
+    }
+
+    if (p->max_epoll_events < p->n_pollfd_used + 1) {
+        p->max_epoll_events = p->n_pollfd_used + 1;
+        p->epoll_events = pa_xrealloc(p->epoll_events, sizeof(struct epoll_event) * p->max_epoll_events);
+    }
+
+    for (k = 0; k < p->n_pollfd_used; k++) {
+        struct pollfd *f = &p->pollfd[k];
+        struct rtpoll_registration *r = &p->registered[k];
+
+        if (f->fd == r->fd && f->events == r->events)
+            continue;
+
+        if (f->fd >= 0 && f->fd == r->fd) {
+            pa_zero(ev);
+            ev.events = (uint16_t) f->events;
+            ev.data.u32 = k;
+
+            if (epoll_ctl(p->epoll_fd, EPOLL_CTL_MOD, r->registered_fd, &ev) < 0)
+                return -1;
+
+            r->events = f->events;
+            continue;
+        }
+
+        epoll_unregister(p, r);
+
+        if (f->fd >= 0 && epoll_register(p, k) < 0)
+            return -1;
+    }
+
+    if (p->timer_enabled) {
+        if (!p->timer_armed || pa_timeval_cmp(&p->timer_armed_elapse, &p->next_elapse) != 0) {
+            struct itimerspec its;
+
+            pa_zero(its);
+            its.it_value.tv_sec = p->next_elapse.tv_sec;
+            its.it_value.tv_nsec = p->next_elapse.tv_usec * 1000;
+
+            /* An all zero value would disarm the timer */
+            if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0)
+                its.it_value.tv_nsec = 1;
+
+            if (timerfd_settime(p->timer_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+                return -1;
+
+            p->timer_armed_elapse = p->next_elapse;
+            p->timer_armed = true;
+        }
+    } else if (p->timer_armed) {
+        struct itimerspec its;
+
+        pa_zero(its);
+
+        if (timerfd_settime(p->timer_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+            return -1;
+
+        p->timer_armed = false;
+    }
+
+    return 0;
+}
+
+static int epoll_sleep(pa_rtpoll *p) {
+    unsigned k;
+    int r, n = 0;
+
+    if ((r = epoll_wait(p->epoll_fd, p->epoll_events, (int) p->max_epoll_events, p->quit ? 0 : -1)) < 0)
+        return r;
+
+    for (k = 0; k < p->n_pollfd_used; k++)
+        p->pollfd[k].revents = 0;
+
+    for (k = 0; k < (unsigned) r; k++) {
+        uint32_t idx = p->epoll_events[k].data.u32;
+
+        if (idx == TIMER_INDEX) {
+            /* Makes the next epoll_sync() rearm or disarm the timer,
+             * which also clears its expiration */
+            pa_zero(p->timer_armed_elapse);
+            continue;
+        }
+
+        pa_assert(idx < p->n_pollfd_used);
+        p->pollfd[idx].revents = (short) p->epoll_events[k].events;
+        n++;
+    }
+
+    /* Like with ppoll(), the timer only counts as elapsed if no fd
+     * woke us up */
+    p->timer_elapsed = n == 0;
+
+    return n;
+}
+#endif
+
 pa_rtpoll *pa_rtpoll_new(void) {
     pa_rtpoll *p;
 
@@ -95,6 +347,13 @@ pa_rtpoll *pa_rtpoll_new(void) {
     p->pollfd = pa_xnew(struct pollfd, p->n_pollfd_alloc);
     p->pollfd2 = pa_xnew(struct pollfd, p->n_pollfd_alloc);
 
+#ifdef USE_EPOLL
+    p->epoll_fd = p->timer_fd = -1;
+
+    if (!getenv("PULSE_NO_EPOLL"))
+        epoll_init(p);
+#endif
+
 #ifdef DEBUG_TIMING
     p->timestamp = pa_rtclock_now();
 #endif
@@ -112,6 +371,12 @@ static void rtpoll_rebuild(pa_rtpoll *p) {
 
     p->rebuild_needed = false;
 
+#ifdef USE_EPOLL
+    /* The registrations refer to pollfd indexes, which change now */
+    if (p->epoll_fd >= 0)
+        epoll_unregister_all(p);
+#endif
+
     if (p->n_pollfd_used > p->n_pollfd_alloc) {
         /* Hmm, we have to allocate some more space */
         p->n_pollfd_alloc = p->n_pollfd_used * 2;
@@ -170,6 +435,17 @@ void pa_rtpoll_free(pa_rtpoll *p) {
     while (p->items)
         rtpoll_item_destroy(p->items);
 
+#ifdef USE_EPOLL
+    if (p->epoll_fd >= 0) {
+        epoll_unregister_all(p);
+        pa_close(p->timer_fd);
+        pa_close(p->epoll_fd);
+    }
+
+    pa_xfree(p->registered);
+    pa_xfree(p->epoll_events);
+#endif
+
     pa_xfree(p->pollfd);
     pa_xfree(p->pollfd2);
 
@@ -203,6 +479,31 @@ static void reset_all_revents(pa_rtpoll *p) {
     }
 }
 
+static inline bool use_epoll(pa_rtpoll *p) {
+#ifdef USE_EPOLL
+    return p->epoll_fd >= 0;
+#else
+    return false;
+#endif
+}
+
+static int poll_sleep(pa_rtpoll *p, const struct timeval *timeout) {
+    int r;
+
+#ifdef HAVE_PPOLL
+    struct timespec ts;
+    ts.tv_sec = timeout->tv_sec;
+    ts.tv_nsec = timeout->tv_usec * 1000;
+    r = ppoll(p->pollfd, p->n_pollfd_used, (p->quit || p->timer_enabled) ? &ts : NULL, NULL);
+#else
+    r = pa_poll(p->pollfd, p->n_pollfd_used, (p->quit || p->timer_enabled) ? (int) ((timeout->tv_sec*1000) + (timeout->tv_usec / 1000)) : -1);
+#endif
+
+    p->timer_elapsed = r == 0;
+
+    return r;
+}
+
 int pa_rtpoll_run(pa_rtpoll *p) {
     pa_rtpoll_item *i;
     int r = 0;
@@ -282,10 +583,15 @@ int pa_rtpoll_run(pa_rtpoll *p) {
     if (p->rebuild_needed)
         rtpoll_rebuild(p);
 
+#ifdef USE_EPOLL
+    if (p->epoll_fd >= 0 && epoll_sync(p) < 0)
+        epoll_disable(p);
+#endif
+
     pa_zero(timeout);
 
-    /* Calculate timeout */
-    if (!p->quit && p->timer_enabled) {
+    /* Calculate timeout, unless the timerfd takes care of that */
+    if (!p->quit && p->timer_enabled && !use_epoll(p)) {
         struct timeval now;
         pa_rtclock_get(&now);
 
@@ -308,18 +614,12 @@ int pa_rtpoll_run(pa_rtpoll *p) {
 #endif
 
     /* OK, now let's sleep */
-#ifdef HAVE_PPOLL
-    {
-        struct timespec ts;
-        ts.tv_sec = timeout.tv_sec;
-        ts.tv_nsec = timeout.tv_usec * 1000;
-        r = ppoll(p->pollfd, p->n_pollfd_used, (p->quit || p->timer_enabled) ? &ts : NULL, NULL);
-    }
-#else
-    r = pa_poll(p->pollfd, p->n_pollfd_used, (p->quit || p->timer_enabled) ? (int) ((timeout.tv_sec*1000) + (timeout.tv_usec / 1000)) : -1);
+#ifdef USE_EPOLL
+    if (p->epoll_fd >= 0)
+        r = epoll_sleep(p);
+    else
 #endif
-
-    p->timer_elapsed = r == 0;
+        r = poll_sleep(p, &timeout);
 
 #ifdef DEBUG_TIMING
     {
@@ -39,7 +39,13 @@
  * 3) It allows arbitrary functions to be run before entering the
  * actual poll() and after it.
  *
- * Only a single interval timer is supported. */
+ * Only a single interval timer is supported.
+ *
+ * Where available, the fds stay registered with epoll between runs
+ * and the timer is a timerfd. Changes to the pollfd data are picked up
+ * before every sleep, but an fd that is closed and reopened under the
+ * same number without a change in between goes unnoticed, so replace
+ * the item in that case. */
 
 typedef struct pa_rtpoll pa_rtpoll;
 typedef struct pa_rtpoll_item pa_rtpoll_item;
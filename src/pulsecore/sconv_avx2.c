@@ -0,0 +1,322 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <string.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "cpu-x86.h"
+#include "sconv.h"
+
+#if defined (__i386__) || defined (__amd64__)
+
+#include <immintrin.h>
+
+static void pa_sconv_s16le_from_f32ne_avx2(unsigned n, const float *a, int16_t *b) {
+    const __m256 scale = _mm256_set1_ps((float) 0x8000);
+    const __m256 min = _mm256_set1_ps(-0x8000);
+    const __m256 max = _mm256_set1_ps(0x7FFF);
+    unsigned i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        __m256 f0 = _mm256_mul_ps(_mm256_loadu_ps(a + i), scale);
+        __m256 f1 = _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), scale);
+        __m256i s;
+
+        /* Clamp before converting, cvtps2dq turns overflows into 0x80000000 */
+        f0 = _mm256_min_ps(_mm256_max_ps(f0, min), max);
+        f1 = _mm256_min_ps(_mm256_max_ps(f1, min), max);
+
+        /* cvtps2dq rounds to nearest even like lrintf(), and packssdw packs
+         * per 128 bit lane, so the 64 bit quarters need reordering */
+        s = _mm256_packs_epi32(_mm256_cvtps_epi32(f0), _mm256_cvtps_epi32(f1));
+        _mm256_storeu_si256((__m256i *) (b + i), _mm256_permute4x64_epi64(s, 0xD8));
+    }
+
+    for (; i < n; i++)
+        b[i] = (int16_t) PA_CLAMP_UNLIKELY(lrintf(a[i] * (1 << 15)), -0x8000, 0x7FFF);
+}
+
+static void pa_sconv_s16le_to_f32ne_avx2(unsigned n, const int16_t *a, float *b) {
+    const __m256 scale = _mm256_set1_ps(1.0f / (1 << 15));
+    unsigned i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m256i s = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) (a + i)));
+
+        _mm256_storeu_ps(b + i, _mm256_mul_ps(_mm256_cvtepi32_ps(s), scale));
+    }
+
+    for (; i < n; i++)
+        b[i] = a[i] * (1.0f / (1 << 15));
+}
+
+/* Samples per vector */
+#define N 8
+
+static inline __m256i bswap16_avx2(__m256i x) {
+    const __m256i mask = _mm256_setr_epi8(
+            1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+            1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+
+    return _mm256_shuffle_epi8(x, mask);
+}
+
+static inline __m256i bswap32_avx2(__m256i x) {
+    const __m256i mask = _mm256_setr_epi8(
+            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+    return _mm256_shuffle_epi8(x, mask);
+}
+
+/* Full scale 32 bit samples to float, like s * (1.0f / (1U << 31)) */
+static inline __m256 s32_to_float_avx2(__m256i s) {
+    return _mm256_mul_ps(_mm256_cvtepi32_ps(s), _mm256_set1_ps(1.0f / (1U << 31)));
+}
+
+/* Float to full scale 32 bit samples, like clamping llrintf(f * (1U << 31)).
+ * Overflows come out of cvtps2dq as 0x80000000, the positive ones are
+ * flipped to 0x7FFFFFFF. */
+static inline __m256i float_to_s32_avx2(__m256 f) {
+    __m256 v = _mm256_mul_ps(f, _mm256_set1_ps((float) (1U << 31)));
+    __m256i ovf = _mm256_castps_si256(_mm256_cmp_ps(v, _mm256_set1_ps((float) (1U << 31)), _CMP_GE_OQ));
+
+    return _mm256_xor_si256(_mm256_cvtps_epi32(v), ovf);
+}
+
+/* Packed 24 bit samples: the upper 128 bit lane is loaded from 8 bytes in,
+ * so that no byte past the 8 samples is touched. The shuffle masks put each
+ * sample into the top 3 bytes (LE) or byte swapped into the top 3 bytes (BE)
+ * of a 32 bit lane. */
+static inline __m256i load_s24_avx2(const uint8_t *p, const __m256i mask) {
+    __m256i t = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) p)),
+                                        _mm_loadu_si128((const __m128i *) (p + 8)), 1);
+
+    return _mm256_shuffle_epi8(t, mask);
+}
+
+/* The reverse of load_s24_avx2(), 12 bytes per 128 bit lane are written */
+static inline void store_s24_avx2(uint8_t *p, __m256i s, const __m256i mask) {
+    __m256i t = _mm256_shuffle_epi8(s, mask);
+    __m128i hi = _mm256_extracti128_si256(t, 1);
+    int32_t last;
+
+    _mm_storeu_si128((__m128i *) p, _mm256_castsi256_si128(t));
+    _mm_storel_epi64((__m128i *) (p + 12), hi);
+    last = _mm_extract_epi32(hi, 2);
+    memcpy(p + 20, &last, sizeof(last));
+}
+
+/* Loaders return 8 samples as float in [-1, 1], storers take them back */
+
+static inline __m256 load_float32ne_avx2(const uint8_t *p) {
+    return _mm256_loadu_ps((const float *) p);
+}
+
+static inline __m256 load_float32re_avx2(const uint8_t *p) {
+    return _mm256_castsi256_ps(bswap32_avx2(_mm256_loadu_si256((const __m256i *) p)));
+}
+
+static inline __m256 load_s16le_avx2(const uint8_t *p) {
+    __m256i s = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) p));
+
+    return _mm256_mul_ps(_mm256_cvtepi32_ps(s), _mm256_set1_ps(1.0f / (1 << 15)));
+}
+
+static inline __m256 load_s16be_avx2(const uint8_t *p) {
+    const __m128i mask = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    __m256i s = _mm256_cvtepi16_epi32(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) p), mask));
+
+    return _mm256_mul_ps(_mm256_cvtepi32_ps(s), _mm256_set1_ps(1.0f / (1 << 15)));
+}
+
+static inline __m256 load_s32le_avx2(const uint8_t *p) {
+    return s32_to_float_avx2(_mm256_loadu_si256((const __m256i *) p));
+}
+
+static inline __m256 load_s32be_avx2(const uint8_t *p) {
+    return s32_to_float_avx2(bswap32_avx2(_mm256_loadu_si256((const __m256i *) p)));
+}
+
+static inline __m256 load_s24le_avx2(const uint8_t *p) {
+    const __m256i mask = _mm256_setr_epi8(
+            -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+            -1, 4, 5, 6, -1, 7, 8, 9, -1, 10, 11, 12, -1, 13, 14, 15);
+
+    return s32_to_float_avx2(load_s24_avx2(p, mask));
+}
+
+static inline __m256 load_s24be_avx2(const uint8_t *p) {
+    const __m256i mask = _mm256_setr_epi8(
+            -1, 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9,
+            -1, 6, 5, 4, -1, 9, 8, 7, -1, 12, 11, 10, -1, 15, 14, 13);
+
+    return s32_to_float_avx2(load_s24_avx2(p, mask));
+}
+
+static inline __m256 load_s24_32le_avx2(const uint8_t *p) {
+    return s32_to_float_avx2(_mm256_slli_epi32(_mm256_loadu_si256((const __m256i *) p), 8));
+}
+
+static inline __m256 load_s24_32be_avx2(const uint8_t *p) {
+    return s32_to_float_avx2(_mm256_slli_epi32(bswap32_avx2(_mm256_loadu_si256((const __m256i *) p)), 8));
+}
+
+static inline void store_float32ne_avx2(uint8_t *p, __m256 f) {
+    _mm256_storeu_ps((float *) p, f);
+}
+
+static inline void store_float32re_avx2(uint8_t *p, __m256 f) {
+    _mm256_storeu_si256((__m256i *) p, bswap32_avx2(_mm256_castps_si256(f)));
+}
+
+/* s16 is rounded from f * (1 << 15) like lrintf(), clamped before the
+ * conversion as in pa_sconv_s16le_from_f32ne_avx2() */
+static inline __m128i float_to_s16_avx2(__m256 f) {
+    __m256 v = _mm256_mul_ps(f, _mm256_set1_ps((float) (1 << 15)));
+    __m256i s;
+
+    v = _mm256_min_ps(_mm256_max_ps(v, _mm256_set1_ps(-0x8000)), _mm256_set1_ps(0x7FFF));
+    s = _mm256_cvtps_epi32(v);
+
+    return _mm_packs_epi32(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1));
+}
+
+static inline void store_s16le_avx2(uint8_t *p, __m256 f) {
+    _mm_storeu_si128((__m128i *) p, float_to_s16_avx2(f));
+}
+
+static inline void store_s16be_avx2(uint8_t *p, __m256 f) {
+    const __m128i mask = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+
+    _mm_storeu_si128((__m128i *) p, _mm_shuffle_epi8(float_to_s16_avx2(f), mask));
+}
+
+static inline void store_s32le_avx2(uint8_t *p, __m256 f) {
+    _mm256_storeu_si256((__m256i *) p, float_to_s32_avx2(f));
+}
+
+static inline void store_s32be_avx2(uint8_t *p, __m256 f) {
+    _mm256_storeu_si256((__m256i *) p, bswap32_avx2(float_to_s32_avx2(f)));
+}
+
+/* 24 bit samples are the top bits of the rounded 32 bit value, the same
+ * way the generic code derives them */
+static inline void store_s24le_avx2(uint8_t *p, __m256 f) {
+    const __m256i mask = _mm256_setr_epi8(
+            1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, -1, -1, -1, -1,
+            1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, -1, -1, -1, -1);
+
+    store_s24_avx2(p, float_to_s32_avx2(f), mask);
+}
+
+static inline void store_s24be_avx2(uint8_t *p, __m256 f) {
+    const __m256i mask = _mm256_setr_epi8(
+            3, 2, 1, 7, 6, 5, 11, 10, 9, 15, 14, 13, -1, -1, -1, -1,
+            3, 2, 1, 7, 6, 5, 11, 10, 9, 15, 14, 13, -1, -1, -1, -1);
+
+    store_s24_avx2(p, float_to_s32_avx2(f), mask);
+}
+
+static inline void store_s24_32le_avx2(uint8_t *p, __m256 f) {
+    _mm256_storeu_si256((__m256i *) p, _mm256_srli_epi32(float_to_s32_avx2(f), 8));
+}
+
+static inline void store_s24_32be_avx2(uint8_t *p, __m256 f) {
+    _mm256_storeu_si256((__m256i *) p, bswap32_avx2(_mm256_srli_epi32(float_to_s32_avx2(f), 8)));
+}
+
+/* The remainder that does not fill a vector goes through a zero padded
+ * bounce buffer, so it is converted exactly like the rest */
+#define DEFINE_CONVERT(from, from_size, to, to_size)                           \
+static void pa_sconv_##from##_to_##to##_avx2(unsigned n, const uint8_t *a, uint8_t *b) { \
+    unsigned i;                                                                \
+                                                                               \
+    for (i = 0; i + N <= n; i += N)                                            \
+        store_##to##_avx2(b + i * (to_size), load_##from##_avx2(a + i * (from_size))); \
+                                                                               \
+    if (i < n) {                                                               \
+        uint8_t in[N * 4] = { 0 }, out[N * 4];                                 \
+                                                                               \
+        memcpy(in, a + i * (from_size), (n - i) * (from_size));                \
+        store_##to##_avx2(out, load_##from##_avx2(in));                        \
+        memcpy(b + i * (to_size), out, (n - i) * (to_size));                   \
+    }                                                                          \
+}
+
+DEFINE_CONVERT(s16be, 2, float32ne, 4)
+DEFINE_CONVERT(s24le, 3, float32ne, 4)
+DEFINE_CONVERT(s24be, 3, float32ne, 4)
+DEFINE_CONVERT(s24_32le, 4, float32ne, 4)
+DEFINE_CONVERT(s24_32be, 4, float32ne, 4)
+DEFINE_CONVERT(s32le, 4, float32ne, 4)
+DEFINE_CONVERT(s32be, 4, float32ne, 4)
+DEFINE_CONVERT(float32re, 4, float32ne, 4)
+
+DEFINE_CONVERT(float32ne, 4, s16be, 2)
+DEFINE_CONVERT(float32ne, 4, s24le, 3)
+DEFINE_CONVERT(float32ne, 4, s24be, 3)
+DEFINE_CONVERT(float32ne, 4, s24_32le, 4)
+DEFINE_CONVERT(float32ne, 4, s24_32be, 4)
+DEFINE_CONVERT(float32ne, 4, s32le, 4)
+DEFINE_CONVERT(float32ne, 4, s32be, 4)
+
+DEFINE_CONVERT(float32re, 4, s16le, 2)
+DEFINE_CONVERT(s16le, 2, float32re, 4)
+
+#endif /* defined (__i386__) || defined (__amd64__) */
+
+void pa_convert_func_init_avx2(pa_cpu_x86_flag_t flags) {
+#if defined (__i386__) || defined (__amd64__)
+    if (flags & PA_CPU_X86_AVX2) {
+        pa_log_info("Initialising AVX2 optimized conversions.");
+
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_S16LE, (pa_convert_func_t) pa_sconv_s16le_from_f32ne_avx2);
+        pa_set_convert_to_s16ne_function(PA_SAMPLE_FLOAT32LE, (pa_convert_func_t) pa_sconv_s16le_from_f32ne_avx2);
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_S16LE, (pa_convert_func_t) pa_sconv_s16le_to_f32ne_avx2);
+        pa_set_convert_from_s16ne_function(PA_SAMPLE_FLOAT32LE, (pa_convert_func_t) pa_sconv_s16le_to_f32ne_avx2);
+
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_S16BE, (pa_convert_func_t) pa_sconv_s16be_to_float32ne_avx2);
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_S24LE, (pa_convert_func_t) pa_sconv_s24le_to_float32ne_avx2);
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_S24BE, (pa_convert_func_t) pa_sconv_s24be_to_float32ne_avx2);
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_S24_32LE, (pa_convert_func_t) pa_sconv_s24_32le_to_float32ne_avx2);
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_S24_32BE, (pa_convert_func_t) pa_sconv_s24_32be_to_float32ne_avx2);
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_S32LE, (pa_convert_func_t) pa_sconv_s32le_to_float32ne_avx2);
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_S32BE, (pa_convert_func_t) pa_sconv_s32be_to_float32ne_avx2);
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_FLOAT32RE, (pa_convert_func_t) pa_sconv_float32re_to_float32ne_avx2);
+
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_S16BE, (pa_convert_func_t) pa_sconv_float32ne_to_s16be_avx2);
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_S24LE, (pa_convert_func_t) pa_sconv_float32ne_to_s24le_avx2);
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_S24BE, (pa_convert_func_t) pa_sconv_float32ne_to_s24be_avx2);
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_S24_32LE, (pa_convert_func_t) pa_sconv_float32ne_to_s24_32le_avx2);
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_S24_32BE, (pa_convert_func_t) pa_sconv_float32ne_to_s24_32be_avx2);
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_S32LE, (pa_convert_func_t) pa_sconv_float32ne_to_s32le_avx2);
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_S32BE, (pa_convert_func_t) pa_sconv_float32ne_to_s32be_avx2);
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_FLOAT32RE, (pa_convert_func_t) pa_sconv_float32re_to_float32ne_avx2);
+
+        pa_set_convert_to_s16ne_function(PA_SAMPLE_FLOAT32RE, (pa_convert_func_t) pa_sconv_float32re_to_s16le_avx2);
+        pa_set_convert_from_s16ne_function(PA_SAMPLE_FLOAT32RE, (pa_convert_func_t) pa_sconv_s16le_to_float32re_avx2);
+    }
+#endif /* defined (__i386__) || defined (__amd64__) */
+}
@@ -0,0 +1,64 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "cpu-x86.h"
+#include "sconv.h"
+
+#if defined (__i386__) || defined (__amd64__)
+
+#include <immintrin.h>
+
+static void pa_sconv_s16le_from_f32ne_avx512(unsigned n, const float *a, int16_t *b) {
+    const __m512 scale = _mm512_set1_ps((float) 0x8000);
+    const __m512 min = _mm512_set1_ps(-0x8000);
+    const __m512 max = _mm512_set1_ps(0x7FFF);
+    unsigned i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        __m512 f = _mm512_mul_ps(_mm512_loadu_ps(a + i), scale);
+
+        /* Clamp before converting, cvtps2dq turns overflows into 0x80000000.
+         * The conversion rounds to nearest even like lrintf(). */
+        f = _mm512_min_ps(_mm512_max_ps(f, min), max);
+        _mm256_storeu_si256((__m256i *) (b + i), _mm512_cvtsepi32_epi16(_mm512_cvtps_epi32(f)));
+    }
+
+    for (; i < n; i++)
+        b[i] = (int16_t) PA_CLAMP_UNLIKELY(lrintf(a[i] * (1 << 15)), -0x8000, 0x7FFF);
+}
+
+#endif /* defined (__i386__) || defined (__amd64__) */
+
+void pa_convert_func_init_avx512(pa_cpu_x86_flag_t flags) {
+#if defined (__i386__) || defined (__amd64__)
+    if (flags & PA_CPU_X86_AVX512F) {
+        pa_log_info("Initialising AVX-512 optimized conversions.");
+
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_S16LE, (pa_convert_func_t) pa_sconv_s16le_from_f32ne_avx512);
+        pa_set_convert_to_s16ne_function(PA_SAMPLE_FLOAT32LE, (pa_convert_func_t) pa_sconv_s16le_from_f32ne_avx512);
+    }
+#endif /* defined (__i386__) || defined (__amd64__) */
+}
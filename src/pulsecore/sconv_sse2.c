@@ -0,0 +1,264 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "cpu-x86.h"
+#include "sconv.h"
+
+#if defined (__i386__) || defined (__amd64__)
+
+#include <emmintrin.h>
+
+/* Samples per vector */
+#define N 4
+
+static inline __m128i bswap16_sse2(__m128i x) {
+    return _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+}
+
+static inline __m128i bswap32_sse2(__m128i x) {
+    x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+    x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+    return bswap16_sse2(x);
+}
+
+/* Full scale 32 bit samples to float, like s * (1.0f / (1U << 31)) */
+static inline __m128 s32_to_float_sse2(__m128i s) {
+    return _mm_mul_ps(_mm_cvtepi32_ps(s), _mm_set1_ps(1.0f / (1U << 31)));
+}
+
+/* Float to full scale 32 bit samples, like clamping llrintf(f * (1U << 31)).
+ * cvtps2dq rounds to nearest even and turns every overflow into 0x80000000,
+ * which is right for negative overflows, positive ones are flipped to
+ * 0x7FFFFFFF. */
+static inline __m128i float_to_s32_sse2(__m128 f) {
+    __m128 v = _mm_mul_ps(f, _mm_set1_ps((float) (1U << 31)));
+    __m128i ovf = _mm_castps_si128(_mm_cmpge_ps(v, _mm_set1_ps((float) (1U << 31))));
+
+    return _mm_xor_si128(_mm_cvtps_epi32(v), ovf);
+}
+
+/* Loads 4 packed 24 bit samples (12 bytes) into the low 3 bytes of each
+ * 32 bit lane */
+static inline __m128i load_s24_raw_sse2(const uint8_t *p) {
+    int32_t last;
+    __m128i t, q;
+
+    memcpy(&last, p + 8, sizeof(last));
+    t = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *) p), _mm_cvtsi32_si128(last));
+
+    /* Two samples in the low 48 bits of each 64 bit lane */
+    q = _mm_unpacklo_epi64(t, _mm_srli_si128(t, 6));
+
+    return _mm_or_si128(_mm_and_si128(q, _mm_set_epi32(0, 0xFFFFFF, 0, 0xFFFFFF)),
+                        _mm_and_si128(_mm_slli_epi64(q, 8), _mm_set_epi32(0xFFFFFF, 0, 0xFFFFFF, 0)));
+}
+
+/* The reverse of load_s24_raw_sse2(), the top byte of each lane is dropped */
+static inline void store_s24_raw_sse2(uint8_t *p, __m128i x) {
+    int32_t last;
+    __m128i q;
+
+    q = _mm_or_si128(_mm_and_si128(x, _mm_set_epi32(0, 0xFFFFFF, 0, 0xFFFFFF)),
+                     _mm_srli_epi64(_mm_and_si128(x, _mm_set_epi32(0xFFFFFF, 0, 0xFFFFFF, 0)), 8));
+    q = _mm_or_si128(_mm_move_epi64(q), _mm_slli_si128(_mm_srli_si128(q, 8), 6));
+
+    _mm_storel_epi64((__m128i *) p, q);
+    last = _mm_cvtsi128_si32(_mm_srli_si128(q, 8));
+    memcpy(p + 8, &last, sizeof(last));
+}
+
+/* Loaders return 4 samples as float in [-1, 1], storers take them back */
+
+static inline __m128 load_float32ne_sse2(const uint8_t *p) {
+    return _mm_loadu_ps((const float *) p);
+}
+
+static inline __m128 load_float32re_sse2(const uint8_t *p) {
+    return _mm_castsi128_ps(bswap32_sse2(_mm_loadu_si128((const __m128i *) p)));
+}
+
+static inline __m128 load_s16le_sse2(const uint8_t *p) {
+    __m128i s = _mm_loadl_epi64((const __m128i *) p);
+
+    return s32_to_float_sse2(_mm_unpacklo_epi16(_mm_setzero_si128(), s));
+}
+
+static inline __m128 load_s16be_sse2(const uint8_t *p) {
+    __m128i s = bswap16_sse2(_mm_loadl_epi64((const __m128i *) p));
+
+    return s32_to_float_sse2(_mm_unpacklo_epi16(_mm_setzero_si128(), s));
+}
+
+static inline __m128 load_s32le_sse2(const uint8_t *p) {
+    return s32_to_float_sse2(_mm_loadu_si128((const __m128i *) p));
+}
+
+static inline __m128 load_s32be_sse2(const uint8_t *p) {
+    return s32_to_float_sse2(bswap32_sse2(_mm_loadu_si128((const __m128i *) p)));
+}
+
+static inline __m128 load_s24le_sse2(const uint8_t *p) {
+    return s32_to_float_sse2(_mm_slli_epi32(load_s24_raw_sse2(p), 8));
+}
+
+static inline __m128 load_s24be_sse2(const uint8_t *p) {
+    return s32_to_float_sse2(bswap32_sse2(load_s24_raw_sse2(p)));
+}
+
+static inline __m128 load_s24_32le_sse2(const uint8_t *p) {
+    return s32_to_float_sse2(_mm_slli_epi32(_mm_loadu_si128((const __m128i *) p), 8));
+}
+
+static inline __m128 load_s24_32be_sse2(const uint8_t *p) {
+    return s32_to_float_sse2(_mm_slli_epi32(bswap32_sse2(_mm_loadu_si128((const __m128i *) p)), 8));
+}
+
+static inline void store_float32ne_sse2(uint8_t *p, __m128 f) {
+    _mm_storeu_ps((float *) p, f);
+}
+
+static inline void store_float32re_sse2(uint8_t *p, __m128 f) {
+    _mm_storeu_si128((__m128i *) p, bswap32_sse2(_mm_castps_si128(f)));
+}
+
+/* s16 is rounded from f * (1 << 15) like lrintf(), clamping before the
+ * conversion also takes care of values that do not fit 32 bit */
+static inline __m128i float_to_s16_sse2(__m128 f) {
+    __m128 v = _mm_mul_ps(f, _mm_set1_ps((float) (1 << 15)));
+    __m128i s;
+
+    v = _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-0x8000)), _mm_set1_ps(0x7FFF));
+    s = _mm_cvtps_epi32(v);
+
+    return _mm_packs_epi32(s, s);
+}
+
+static inline void store_s16le_sse2(uint8_t *p, __m128 f) {
+    _mm_storel_epi64((__m128i *) p, float_to_s16_sse2(f));
+}
+
+static inline void store_s16be_sse2(uint8_t *p, __m128 f) {
+    _mm_storel_epi64((__m128i *) p, bswap16_sse2(float_to_s16_sse2(f)));
+}
+
+static inline void store_s32le_sse2(uint8_t *p, __m128 f) {
+    _mm_storeu_si128((__m128i *) p, float_to_s32_sse2(f));
+}
+
+static inline void store_s32be_sse2(uint8_t *p, __m128 f) {
+    _mm_storeu_si128((__m128i *) p, bswap32_sse2(float_to_s32_sse2(f)));
+}
+
+/* 24 bit samples are the top bits of the rounded 32 bit value, the same
+ * way the generic code derives them */
+static inline void store_s24le_sse2(uint8_t *p, __m128 f) {
+    store_s24_raw_sse2(p, _mm_srli_epi32(float_to_s32_sse2(f), 8));
+}
+
+static inline void store_s24be_sse2(uint8_t *p, __m128 f) {
+    store_s24_raw_sse2(p, bswap32_sse2(float_to_s32_sse2(f)));
+}
+
+static inline void store_s24_32le_sse2(uint8_t *p, __m128 f) {
+    _mm_storeu_si128((__m128i *) p, _mm_srli_epi32(float_to_s32_sse2(f), 8));
+}
+
+static inline void store_s24_32be_sse2(uint8_t *p, __m128 f) {
+    _mm_storeu_si128((__m128i *) p, bswap32_sse2(_mm_srli_epi32(float_to_s32_sse2(f), 8)));
+}
+
+/* The remainder that does not fill a vector goes through a zero padded
+ * bounce buffer, so it is converted exactly like the rest */
+#define DEFINE_CONVERT(from, from_size, to, to_size)                           \
+static void pa_sconv_##from##_to_##to##_sse2(unsigned n, const uint8_t *a, uint8_t *b) { \
+    unsigned i;                                                                \
+                                                                               \
+    for (i = 0; i + N <= n; i += N)                                            \
+        store_##to##_sse2(b + i * (to_size), load_##from##_sse2(a + i * (from_size))); \
+                                                                               \
+    if (i < n) {                                                               \
+        uint8_t in[N * 4] = { 0 }, out[N * 4];                                 \
+                                                                               \
+        memcpy(in, a + i * (from_size), (n - i) * (from_size));                \
+        store_##to##_sse2(out, load_##from##_sse2(in));                        \
+        memcpy(b + i * (to_size), out, (n - i) * (to_size));                   \
+    }                                                                          \
+}
+
+DEFINE_CONVERT(s16le, 2, float32ne, 4)
+DEFINE_CONVERT(s16be, 2, float32ne, 4)
+DEFINE_CONVERT(s24le, 3, float32ne, 4)
+DEFINE_CONVERT(s24be, 3, float32ne, 4)
+DEFINE_CONVERT(s24_32le, 4, float32ne, 4)
+DEFINE_CONVERT(s24_32be, 4, float32ne, 4)
+DEFINE_CONVERT(s32le, 4, float32ne, 4)
+DEFINE_CONVERT(s32be, 4, float32ne, 4)
+DEFINE_CONVERT(float32re, 4, float32ne, 4)
+
+DEFINE_CONVERT(float32ne, 4, s16be, 2)
+DEFINE_CONVERT(float32ne, 4, s24le, 3)
+DEFINE_CONVERT(float32ne, 4, s24be, 3)
+DEFINE_CONVERT(float32ne, 4, s24_32le, 4)
+DEFINE_CONVERT(float32ne, 4, s24_32be, 4)
+DEFINE_CONVERT(float32ne, 4, s32le, 4)
+DEFINE_CONVERT(float32ne, 4, s32be, 4)
+
+DEFINE_CONVERT(float32re, 4, s16le, 2)
+DEFINE_CONVERT(s16le, 2, float32re, 4)
+
+#endif /* defined (__i386__) || defined (__amd64__) */
+
+void pa_convert_func_init_sse2(pa_cpu_x86_flag_t flags) {
+#if defined (__i386__) || defined (__amd64__)
+    if (flags & PA_CPU_X86_SSE2) {
+        pa_log_info("Initialising SSE2 optimized sample format conversions.");
+
+        /* float -> s16le stays with pa_convert_func_init_sse() */
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_S16LE, (pa_convert_func_t) pa_sconv_s16le_to_float32ne_sse2);
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_S16BE, (pa_convert_func_t) pa_sconv_s16be_to_float32ne_sse2);
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_S24LE, (pa_convert_func_t) pa_sconv_s24le_to_float32ne_sse2);
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_S24BE, (pa_convert_func_t) pa_sconv_s24be_to_float32ne_sse2);
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_S24_32LE, (pa_convert_func_t) pa_sconv_s24_32le_to_float32ne_sse2);
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_S24_32BE, (pa_convert_func_t) pa_sconv_s24_32be_to_float32ne_sse2);
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_S32LE, (pa_convert_func_t) pa_sconv_s32le_to_float32ne_sse2);
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_S32BE, (pa_convert_func_t) pa_sconv_s32be_to_float32ne_sse2);
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_FLOAT32RE, (pa_convert_func_t) pa_sconv_float32re_to_float32ne_sse2);
+
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_S16BE, (pa_convert_func_t) pa_sconv_float32ne_to_s16be_sse2);
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_S24LE, (pa_convert_func_t) pa_sconv_float32ne_to_s24le_sse2);
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_S24BE, (pa_convert_func_t) pa_sconv_float32ne_to_s24be_sse2);
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_S24_32LE, (pa_convert_func_t) pa_sconv_float32ne_to_s24_32le_sse2);
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_S24_32BE, (pa_convert_func_t) pa_sconv_float32ne_to_s24_32be_sse2);
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_S32LE, (pa_convert_func_t) pa_sconv_float32ne_to_s32le_sse2);
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_S32BE, (pa_convert_func_t) pa_sconv_float32ne_to_s32be_sse2);
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_FLOAT32RE, (pa_convert_func_t) pa_sconv_float32re_to_float32ne_sse2);
+
+        pa_set_convert_to_s16ne_function(PA_SAMPLE_FLOAT32RE, (pa_convert_func_t) pa_sconv_float32re_to_s16le_sse2);
+        pa_set_convert_from_s16ne_function(PA_SAMPLE_FLOAT32LE, (pa_convert_func_t) pa_sconv_s16le_to_float32ne_sse2);
+        pa_set_convert_from_s16ne_function(PA_SAMPLE_FLOAT32RE, (pa_convert_func_t) pa_sconv_s16le_to_float32re_sse2);
+    }
+#endif /* defined (__i386__) || defined (__amd64__) */
+}
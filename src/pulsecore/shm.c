@@ -118,6 +118,7 @@ static int privatemem_create(pa_shm *m, size_t size) {
     m->id = 0;
     m->size = size;
     m->do_unlink = false;
+    m->fixed = false;
     m->fd = -1;
 
 #ifdef MAP_ANONYMOUS
@@ -141,7 +142,7 @@ static int privatemem_create(pa_shm *m, size_t size) {
     return 0;
 }
 
-static int sharedmem_create(pa_shm *m, pa_mem_type_t type, size_t size, mode_t mode) {
+static int sharedmem_create(pa_shm *m, pa_mem_type_t type, size_t size, mode_t mode, void *at) {
 #if defined(HAVE_SHM_OPEN) || defined(HAVE_MEMFD)
     char fn[32];
     int fd = -1;
@@ -183,6 +184,7 @@ static int sharedmem_create(pa_shm *m, pa_mem_type_t type, size_t size, mode_t m
     m->type = type;
     m->size = size + shm_marker_size(type);
     m->do_unlink = do_unlink;
+    m->fixed = !!at;
 
     if (ftruncate(fd, (off_t) m->size) < 0) {
         pa_log("ftruncate() failed: %s", pa_cstrerror(errno));
@@ -193,7 +195,7 @@ static int sharedmem_create(pa_shm *m, pa_mem_type_t type, size_t size, mode_t m
 #define MAP_NORESERVE 0
 #endif
 
-    if ((m->ptr = mmap(NULL, PA_PAGE_ALIGN(m->size), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_NORESERVE, fd, (off_t) 0)) == MAP_FAILED) {
+    if ((m->ptr = mmap(at, PA_PAGE_ALIGN(m->size), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_NORESERVE|(at ? MAP_FIXED : 0), fd, (off_t) 0)) == MAP_FAILED) {
         pa_log("mmap() failed: %s", pa_cstrerror(errno));
         goto fail;
     }
@@ -245,7 +247,51 @@ int pa_shm_create_rw(pa_shm *m, pa_mem_type_t type, size_t size, mode_t mode) {
     if (type == PA_MEM_TYPE_PRIVATE)
         return privatemem_create(m, size);
 
-    return sharedmem_create(m, type, size, mode);
+    return sharedmem_create(m, type, size, mode, NULL);
+}
+
+int pa_shm_create_rw_at(pa_shm *m, pa_mem_type_t type, size_t size, mode_t mode, void *at) {
+    pa_assert(m);
+    pa_assert(size > 0);
+    pa_assert(size <= MAX_SHM_SIZE);
+    pa_assert(!(mode & ~0777));
+    pa_assert(mode >= 0600);
+    pa_assert(at);
+    pa_assert(at == PA_PAGE_ALIGN_PTR(at));
+    pa_assert(pa_mem_type_is_shared(type));
+
+    size = PA_PAGE_ALIGN(size);
+
+    return sharedmem_create(m, type, size, mode, at);
+}
+
+void *pa_shm_reserve(size_t size) {
+#if defined(MAP_ANONYMOUS) && (defined(HAVE_SHM_OPEN) || defined(HAVE_MEMFD))
+    void *ptr;
+
+    pa_assert(size > 0);
+
+    if ((ptr = mmap(NULL, PA_PAGE_ALIGN(size), PROT_NONE, MAP_ANONYMOUS|MAP_PRIVATE|MAP_NORESERVE, -1, (off_t) 0)) == MAP_FAILED) {
+        pa_log("mmap() failed: %s", pa_cstrerror(errno));
+        return NULL;
+    }
+
+    return ptr;
+#else
+    return NULL;
+#endif
+}
+
+void pa_shm_unreserve(void *ptr, size_t size) {
+    pa_assert(ptr);
+    pa_assert(size > 0);
+
+#if defined(MAP_ANONYMOUS) && (defined(HAVE_SHM_OPEN) || defined(HAVE_MEMFD))
+    if (munmap(ptr, PA_PAGE_ALIGN(size)) < 0)
+        pa_log("munmap() failed: %s", pa_cstrerror(errno));
+#else
+    pa_assert_not_reached();
+#endif
 }
 
 static void privatemem_free(pa_shm *m) {
@@ -278,7 +324,12 @@ void pa_shm_free(pa_shm *m) {
     }
 
 #if defined(HAVE_SHM_OPEN) || defined(HAVE_MEMFD)
-    if (munmap(m->ptr, PA_PAGE_ALIGN(m->size)) < 0)
+    if (m->fixed) {
+        /* Hand the range back to the reservation it was mapped into,
+         * instead of leaving a hole anybody else could map into. */
+        if (mmap(m->ptr, PA_PAGE_ALIGN(m->size), PROT_NONE, MAP_ANONYMOUS|MAP_PRIVATE|MAP_NORESERVE|MAP_FIXED, -1, (off_t) 0) == MAP_FAILED)
+            pa_log("mmap() failed: %s", pa_cstrerror(errno));
+    } else if (munmap(m->ptr, PA_PAGE_ALIGN(m->size)) < 0)
         pa_log("munmap() failed: %s", pa_cstrerror(errno));
 
 #ifdef HAVE_SHM_OPEN
@@ -304,6 +355,94 @@ finish:
     pa_zero(*m);
 }
 
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+/* Whether huge pages back any of the mapping at ptr. The kernel may
+ * well ignore the advice, so this asks it what it actually did. */
+static bool mapping_has_huge_pages(const void *ptr) {
+    FILE *f;
+    char line[1024];
+    bool in_mapping = false, huge_pages = false;
+
+    if (!(f = pa_fopen_cloexec("/proc/self/smaps", "r")))
+        return false;
+
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long start, end, kb;
+
+        /* Each mapping starts with its address range, followed by its
+         * fields */
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+            if (in_mapping)
+                break;
+
+            in_mapping = (unsigned long) ptr >= start && (unsigned long) ptr < end;
+            continue;
+        }
+
+        if (!in_mapping)
+            continue;
+
+        if ((sscanf(line, "AnonHugePages: %lu kB", &kb) == 1 ||
+             sscanf(line, "ShmemPmdMapped: %lu kB", &kb) == 1 ||
+             sscanf(line, "FilePmdMapped: %lu kB", &kb) == 1) && kb > 0) {
+            huge_pages = true;
+            break;
+        }
+    }
+
+    fclose(f);
+    return huge_pages;
+}
+#endif
+
+int pa_shm_lock(pa_shm *m, bool *huge_pages) {
+    pa_assert(m);
+    pa_assert(m->ptr);
+    pa_assert(m->size > 0);
+    pa_assert(huge_pages);
+
+    *huge_pages = false;
+
+#ifdef HAVE_SYS_MMAN_H
+    /* This needs to happen before the memory is faulted in. Shared
+     * memory only gets huge pages if the kernel has been configured to
+     * allow that on advice, see shmem_enabled. */
+#ifdef MADV_HUGEPAGE
+    madvise(m->ptr, PA_PAGE_ALIGN(m->size), MADV_HUGEPAGE);
+#endif
+
+    /* mlock() faults everything in as well, but only for reading. Write
+     * faulting it up front saves the IO threads the write faults on the
+     * zero pages of private memory. */
+#ifdef MADV_POPULATE_WRITE
+    madvise(m->ptr, PA_PAGE_ALIGN(m->size), MADV_POPULATE_WRITE);
+#endif
+
+    if (mlock(m->ptr, PA_PAGE_ALIGN(m->size)) < 0) {
+        pa_log_warn("mlock() failed: %s", pa_cstrerror(errno));
+        return -1;
+    }
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    *huge_pages = mapping_has_huge_pages(m->ptr);
+#endif
+
+    return 0;
+#else
+    pa_log_warn("Memory locking requested but not supported on platform.");
+    return -1;
+#endif
+}
+
+void pa_shm_unlock(pa_shm *m) {
+    pa_assert(m);
+    pa_assert(m->ptr);
+
+#ifdef HAVE_SYS_MMAN_H
+    munlock(m->ptr, PA_PAGE_ALIGN(m->size));
+#endif
+}
+
 void pa_shm_punch(pa_shm *m, size_t offset, size_t size) {
     void *ptr;
     size_t o;
@@ -412,6 +551,7 @@ static int shm_attach(pa_shm *m, pa_mem_type_t type, unsigned id, int memfd_fd,
     m->id = id;
     m->size = (size_t) st.st_size;
     m->do_unlink = false;
+    m->fixed = false;
     m->fd = -1;
 
     return 0;
@@ -34,6 +34,10 @@ typedef struct pa_shm {
     /* Only for type = PA_MEM_TYPE_SHARED_POSIX */
     bool do_unlink:1;
 
+    /* Only for the shared types: mapped into a range reserved with
+     * pa_shm_reserve(), which the memory is returned to when freed */
+    bool fixed:1;
+
     /* Only for type = PA_MEM_TYPE_SHARED_MEMFD
      *
      * To avoid fd leaks, we keep this fd open only until we pass it
@@ -50,12 +54,24 @@ typedef struct pa_shm {
 } pa_shm;
 
 int pa_shm_create_rw(pa_shm *m, pa_mem_type_t type, size_t size, mode_t mode);
+/* Like pa_shm_create_rw(), but maps the shared memory at the given page
+ * aligned address, which must lie in a range reserved by pa_shm_reserve() */
+int pa_shm_create_rw_at(pa_shm *m, pa_mem_type_t type, size_t size, mode_t mode, void *at);
 int pa_shm_attach(pa_shm *m, pa_mem_type_t type, unsigned id, int memfd_fd, bool writable);
 
 void pa_shm_punch(pa_shm *m, size_t offset, size_t size);
 
+/* Faults the memory in and locks it, advising huge pages before.
+ * *huge_pages tells whether huge pages actually back the memory. */
+int pa_shm_lock(pa_shm *m, bool *huge_pages);
+void pa_shm_unlock(pa_shm *m);
+
 void pa_shm_free(pa_shm *m);
 
+/* Reserves inaccessible address space for pa_shm_create_rw_at() */
+void *pa_shm_reserve(size_t size);
+void pa_shm_unreserve(void *ptr, size_t size);
+
 int pa_shm_cleanup(void);
 
 #endif
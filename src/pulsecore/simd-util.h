@@ -0,0 +1,62 @@
+#ifndef foosimdutilhfoo
+#define foosimdutilhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <inttypes.h>
+
+/* Helpers shared by the vectorized mixing and volume functions. vec is the
+ * number of samples per vector register. */
+
+/* Number of samples that can be handled with full vectors while ending on a
+ * frame boundary, so that the C fallback can pick up the rest. */
+static inline unsigned pa_vector_samples(unsigned n, unsigned channels, unsigned vec) {
+    unsigned block = channels;
+
+    while (block % vec)
+        block += channels;
+
+    return n - n % block;
+}
+
+/* The volume of the sample at position p of a period is found at vol[p]. The
+ * period is a multiple of the channel count that is at least one vector long,
+ * and the table is padded by one vector so that unaligned loads at any
+ * position of the period stay within the table. */
+static inline unsigned pa_volume_period(unsigned channels, unsigned vec) {
+    return channels * ((vec + channels - 1) / channels);
+}
+
+/* Splits the 16.16 volumes into tables of their low and high halves, laid
+ * out as described for pa_volume_period(). Returns the period. */
+static inline unsigned pa_split_volumes(const int32_t *volumes, unsigned channels, unsigned vec, int16_t *lo, int16_t *hi) {
+    unsigned period = pa_volume_period(channels, vec);
+    unsigned k, c;
+
+    for (k = 0, c = 0; k < period + vec; k++) {
+        lo[k] = (int16_t) (volumes[c] & 0xFFFF);
+        hi[k] = (int16_t) (volumes[c] >> 16);
+
+        if (++c >= channels)
+            c = 0;
+    }
+
+    return period;
+}
+
+#endif
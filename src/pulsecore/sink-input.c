@@ -531,6 +531,7 @@ int pa_sink_input_new(
         if (!pa_sink_input_new_data_is_passthrough(data)) /* no resampler for passthrough content */
             if (!(resampler = pa_resampler_new(
                           core->mempool,
+                          core->resampler_cache,
                           &data->sample_spec, &data->channel_map,
                           &data->sink->sample_spec, &data->sink->channel_map,
                           core->lfe_crossover_freq,
@@ -2589,6 +2590,7 @@ int pa_sink_input_update_resampler(pa_sink_input *i, bool flush_history) {
          !pa_channel_map_equal(&i->channel_map, &i->sink->channel_map))) {
 
         new_resampler = pa_resampler_new(i->core->mempool,
+                                     i->core->resampler_cache,
                                      &i->sample_spec, &i->channel_map,
                                      &i->sink->sample_spec, &i->sink->channel_map,
                                      i->core->lfe_crossover_freq,
@@ -47,10 +47,11 @@
 #include <pulsecore/macro.h>
 #include <pulsecore/play-memblockq.h>
 #include <pulsecore/flist.h>
+#include <pulsecore/message-handler.h>
 
 #include "sink.h"
 
-#define MAX_MIX_CHANNELS 32
+#define MIX_INFO_INITIAL 32
 #define MIX_BUFFER_LENGTH (pa_page_size())
 #define ABSOLUTE_MIN_LATENCY (500)
 #define ABSOLUTE_MAX_LATENCY (10*PA_USEC_PER_SEC)
@@ -75,6 +76,11 @@ static void sink_free(pa_object *s);
 static void pa_sink_volume_change_push(pa_sink *s);
 static void pa_sink_volume_change_flush(pa_sink *s);
 static void pa_sink_volume_change_rewind(pa_sink *s, size_t nbytes);
+static int sink_message_handler(const char *object_path, const char *message, const pa_json_object *parameters, char **response, void *userdata);
+
+static char* make_message_handler_path(const char *name) {
+    return pa_sprintf_malloc("/sink/%s", name);
+}
 
 pa_sink_new_data* pa_sink_new_data_init(pa_sink_new_data *data) {
     pa_assert(data);
@@ -121,6 +127,13 @@ void pa_sink_new_data_set_avoid_resampling(pa_sink_new_data *data, bool avoid_re
     data->avoid_resampling = avoid_resampling;
 }
 
+void pa_sink_new_data_set_wide_mixing(pa_sink_new_data *data, bool wide_mixing) {
+    pa_assert(data);
+
+    data->wide_mixing_is_set = true;
+    data->wide_mixing = wide_mixing;
+}
+
 void pa_sink_new_data_set_volume(pa_sink_new_data *data, const pa_cvolume *volume) {
     pa_assert(data);
 
@@ -284,6 +297,11 @@ pa_sink* pa_sink_new(
     else
         s->avoid_resampling = s->core->avoid_resampling;
 
+    if (data->wide_mixing_is_set)
+        s->wide_mixing = data->wide_mixing;
+    else
+        s->wide_mixing = s->core->wide_mixing;
+
     s->inputs = pa_idxset_new(NULL, NULL);
     s->n_corked = 0;
     s->input_to_master = NULL;
@@ -335,6 +353,8 @@ pa_sink* pa_sink_new(
     s->thread_info.rtpoll = NULL;
     s->thread_info.inputs = pa_hashmap_new_full(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func, NULL,
                                                 (pa_free_cb_t) pa_sink_input_unref);
+    s->thread_info.mix_info = pa_xnew(pa_mix_info, MIX_INFO_INITIAL);
+    s->thread_info.n_mix_info = MIX_INFO_INITIAL;
     s->thread_info.soft_volume =  s->soft_volume;
     s->thread_info.soft_muted = s->muted;
     s->thread_info.state = s->state;
@@ -355,6 +375,9 @@ pa_sink* pa_sink_new(
     s->thread_info.volume_change_safety_margin = core->deferred_volume_safety_margin_usec;
     s->thread_info.volume_change_extra_delay = core->deferred_volume_extra_delay_usec;
     s->thread_info.port_latency_offset = s->port_latency_offset;
+    pa_histogram_reset(&s->thread_info.timing_stats.wakeup_lateness);
+    pa_histogram_reset(&s->thread_info.timing_stats.render_time);
+    pa_histogram_reset(&s->thread_info.timing_stats.slack);
 
     /* FIXME: This should probably be moved to pa_sink_put() */
     pa_assert_se(pa_idxset_put(core->sinks, s, &s->index) >= 0);
@@ -649,6 +672,9 @@ void pa_sink_enable_decibel_volume(pa_sink *s, bool enable) {
 
 /* Called from main context */
 void pa_sink_put(pa_sink* s) {
+    const char *tmp;
+    char *object_path, *description;
+
     pa_sink_assert_ref(s);
     pa_assert_ctl_context();
 
@@ -733,6 +759,14 @@ void pa_sink_put(pa_sink* s) {
 
     pa_source_put(s->monitor_source);
 
+    object_path = make_message_handler_path(s->name);
+    if (!(tmp = pa_proplist_gets(s->proplist, PA_PROP_DEVICE_DESCRIPTION)))
+        tmp = s->name;
+    description = pa_sprintf_malloc("Message handler for sink \"%s\"", tmp);
+    pa_message_handler_register(s->core, object_path, description, sink_message_handler, (void *) s);
+    pa_xfree(object_path);
+    pa_xfree(description);
+
     pa_subscription_post(s->core, PA_SUBSCRIPTION_EVENT_SINK | PA_SUBSCRIPTION_EVENT_NEW, s->index);
     pa_hook_fire(&s->core->hooks[PA_CORE_HOOK_SINK_PUT], s);
 
@@ -765,9 +799,16 @@ void pa_sink_unlink(pa_sink* s) {
 
     linked = PA_SINK_IS_LINKED(s->state);
 
-    if (linked)
+    if (linked) {
+        char *object_path;
+
         pa_hook_fire(&s->core->hooks[PA_CORE_HOOK_SINK_UNLINK], s);
 
+        object_path = make_message_handler_path(s->name);
+        pa_message_handler_unregister(s->core, object_path);
+        pa_xfree(object_path);
+    }
+
     if (s->state != PA_SINK_UNLINKED)
         pa_namereg_unregister(s->core, s->name);
     pa_idxset_remove_by_data(s->core->sinks, s, NULL);
@@ -827,6 +868,7 @@ static void sink_free(pa_object *o) {
 
     pa_idxset_free(s->inputs, NULL);
     pa_hashmap_free(s->thread_info.inputs);
+    pa_xfree(s->thread_info.mix_info);
 
     if (s->silence.memblock)
         pa_memblock_unref(s->silence.memblock);
@@ -1098,8 +1140,30 @@ void pa_sink_process_rewind(pa_sink *s, size_t nbytes) {
     }
 }
 
+/* Called from IO thread context. Makes sure there is a pa_mix_info entry
+ * for every input. The array only grows, so this allocates only when the
+ * number of inputs exceeds everything seen before. */
+static pa_mix_info *get_mix_info(pa_sink *s) {
+    unsigned n_inputs;
+
+    n_inputs = pa_hashmap_size(s->thread_info.inputs);
+
+    if (n_inputs > s->thread_info.n_mix_info) {
+        unsigned n = s->thread_info.n_mix_info;
+
+        while (n < n_inputs)
+            n *= 2;
+
+        pa_xfree(s->thread_info.mix_info);
+        s->thread_info.mix_info = pa_xnew(pa_mix_info, n);
+        s->thread_info.n_mix_info = n;
+    }
+
+    return s->thread_info.mix_info;
+}
+
 /* Called from IO thread context */
-static unsigned fill_mix_info(pa_sink *s, size_t *length, pa_mix_info *info, unsigned maxinfo) {
+static unsigned fill_mix_info(pa_sink *s, size_t *length, pa_mix_info *info) {
     pa_sink_input *i;
     unsigned n = 0;
     void *state = NULL;
@@ -1109,15 +1173,18 @@ static unsigned fill_mix_info(pa_sink *s, size_t *length, pa_mix_info *info, uns
     pa_sink_assert_io_context(s);
     pa_assert(info);
 
-    while ((i = pa_hashmap_iterate(s->thread_info.inputs, &state, NULL)) && maxinfo > 0) {
+    while ((i = pa_hashmap_iterate(s->thread_info.inputs, &state, NULL))) {
         pa_sink_input_assert_ref(i);
+        pa_assert(n < s->thread_info.n_mix_info);
 
         pa_sink_input_peek(i, *length, &info->chunk, &info->volume);
 
         if (mixlength == 0 || info->chunk.length < mixlength)
             mixlength = info->chunk.length;
 
-        if (pa_memblock_is_silence(info->chunk.memblock)) {
+        /* Neither silence nor muted inputs contribute anything, so leave
+         * their memory alone */
+        if (pa_memblock_is_silence(info->chunk.memblock) || pa_cvolume_is_muted(&info->volume)) {
             pa_memblock_unref(info->chunk.memblock);
             continue;
         }
@@ -1129,7 +1196,6 @@ static unsigned fill_mix_info(pa_sink *s, size_t *length, pa_mix_info *info, uns
 
         info++;
         n++;
-        maxinfo--;
     }
 
     if (mixlength > 0)
@@ -1138,6 +1204,27 @@ static unsigned fill_mix_info(pa_sink *s, size_t *length, pa_mix_info *info, uns
     return n;
 }
 
+/* Called from IO thread context. Writes length bytes of a single input
+ * with the volume applied into target, so that copying the data and
+ * adjusting the volume is done in one pass over the memory. */
+static void mix_single(pa_sink *s, pa_mix_info *info, pa_memchunk *target, size_t length, const pa_cvolume *volume) {
+    void *ptr;
+
+    pa_assert(info->chunk.length >= length);
+
+    ptr = pa_memblock_acquire(target->memblock);
+    target->length = pa_mix(info, 1, (uint8_t*) ptr + target->index, length, &s->sample_spec, volume, false);
+    pa_memblock_release(target->memblock);
+}
+
+/* Called from IO thread context */
+static size_t mix_inputs(pa_sink *s, pa_mix_info *info, unsigned n, void *data, size_t length) {
+    if (s->wide_mixing)
+        return pa_mix_wide(info, n, data, length, &s->sample_spec, &s->thread_info.soft_volume, s->thread_info.soft_muted);
+
+    return pa_mix(info, n, data, length, &s->sample_spec, &s->thread_info.soft_volume, s->thread_info.soft_muted);
+}
+
 /* Called from IO thread context */
 static void inputs_drop(pa_sink *s, pa_mix_info *info, unsigned n, pa_memchunk *result) {
     pa_sink_input *i;
@@ -1182,14 +1269,20 @@ static void inputs_drop(pa_sink *s, pa_mix_info *info, unsigned n, pa_memchunk *
                 pa_source_output *o;
                 pa_memchunk c;
 
-                if (m && m->chunk.memblock) {
+                if (m && m->chunk.memblock && pa_cvolume_is_norm(&m->volume)) {
                     c = m->chunk;
                     pa_memblock_ref(c.memblock);
                     pa_assert(result->length <= c.length);
                     c.length = result->length;
+                } else if (m && m->chunk.memblock) {
+                    pa_cvolume unity;
+
+                    /* pa_mix() applies the stream volume by itself */
+                    pa_cvolume_reset(&unity, s->sample_spec.channels);
 
-                    pa_memchunk_make_writable(&c, 0);
-                    pa_volume_memchunk(&c, &s->sample_spec, &m->volume);
+                    c.memblock = pa_memblock_new(s->core->mempool, result->length);
+                    c.index = 0;
+                    mix_single(s, m, &c, result->length, &unity);
                 } else {
                     c = s->silence;
                     pa_memblock_ref(c.memblock);
@@ -1238,7 +1331,7 @@ static void inputs_drop(pa_sink *s, pa_mix_info *info, unsigned n, pa_memchunk *
 
 /* Called from IO thread context */
 void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
-    pa_mix_info info[MAX_MIX_CHANNELS];
+    pa_mix_info *info;
     unsigned n;
     size_t block_size_max;
 
@@ -1269,7 +1362,8 @@ void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
 
     pa_assert(length > 0);
 
-    n = fill_mix_info(s, &length, info, MAX_MIX_CHANNELS);
+    info = get_mix_info(s);
+    n = fill_mix_info(s, &length, info);
 
     if (n == 0) {
 
@@ -1282,35 +1376,38 @@ void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
     } else if (n == 1) {
         pa_cvolume volume;
 
-        *result = info[0].chunk;
-        pa_memblock_ref(result->memblock);
-
-        if (result->length > length)
-            result->length = length;
-
         pa_sw_cvolume_multiply(&volume, &s->thread_info.soft_volume, &info[0].volume);
 
         if (s->thread_info.soft_muted || pa_cvolume_is_muted(&volume)) {
-            pa_memblock_unref(result->memblock);
             pa_silence_memchunk_get(&s->core->silence_cache,
                                     s->core->mempool,
                                     result,
                                     &s->sample_spec,
-                                    result->length);
-        } else if (!pa_cvolume_is_norm(&volume)) {
-            pa_memchunk_make_writable(result, 0);
-            pa_volume_memchunk(result, &s->sample_spec, &volume);
+                                    PA_MIN(info[0].chunk.length, length));
+        } else if (pa_cvolume_is_norm(&volume)) {
+            *result = info[0].chunk;
+            pa_memblock_ref(result->memblock);
+
+            if (result->length > length)
+                result->length = length;
+        } else {
+            /* The input still holds a reference to its block, so changing
+             * the volume in place would need a copy first anyway. pa_mix()
+             * multiplies the soft volume with the stream volume itself. */
+            result->memblock = pa_memblock_new(s->core->mempool, length);
+            result->index = 0;
+            mix_single(s, &info[0], result, length, &s->thread_info.soft_volume);
         }
     } else {
         void *ptr;
+
+        /* The inputs are already in the sink format, their resamplers
+         * convert them before they are queued for rewinding. Mixing them
+         * applies their volumes and the soft volume in the same pass. */
         result->memblock = pa_memblock_new(s->core->mempool, length);
 
         ptr = pa_memblock_acquire(result->memblock);
-        result->length = pa_mix(info, n,
-                                ptr, length,
-                                &s->sample_spec,
-                                &s->thread_info.soft_volume,
-                                s->thread_info.soft_muted);
+        result->length = mix_inputs(s, info, n, ptr, length);
         pa_memblock_release(result->memblock);
 
         result->index = 0;
@@ -1323,7 +1420,7 @@ void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
 
 /* Called from IO thread context */
 void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
-    pa_mix_info info[MAX_MIX_CHANNELS];
+    pa_mix_info *info;
     unsigned n;
     size_t length, block_size_max;
 
@@ -1352,7 +1449,8 @@ void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
 
     pa_assert(length > 0);
 
-    n = fill_mix_info(s, &length, info, MAX_MIX_CHANNELS);
+    info = get_mix_info(s);
+    n = fill_mix_info(s, &length, info);
 
     if (n == 0) {
         if (target->length > length)
@@ -1369,7 +1467,7 @@ void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
 
         if (s->thread_info.soft_muted || pa_cvolume_is_muted(&volume))
             pa_silence_memchunk(target, &s->sample_spec);
-        else {
+        else if (pa_cvolume_is_norm(&volume)) {
             pa_memchunk vchunk;
 
             vchunk = info[0].chunk;
@@ -1378,25 +1476,17 @@ void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
             if (vchunk.length > length)
                 vchunk.length = length;
 
-            if (!pa_cvolume_is_norm(&volume)) {
-                pa_memchunk_make_writable(&vchunk, 0);
-                pa_volume_memchunk(&vchunk, &s->sample_spec, &volume);
-            }
-
             pa_memchunk_memcpy(target, &vchunk);
             pa_memblock_unref(vchunk.memblock);
-        }
+        } else
+            mix_single(s, &info[0], target, target->length, &s->thread_info.soft_volume);
 
     } else {
         void *ptr;
 
         ptr = pa_memblock_acquire(target->memblock);
 
-        target->length = pa_mix(info, n,
-                                (uint8_t*) ptr + target->index, length,
-                                &s->sample_spec,
-                                &s->thread_info.soft_volume,
-                                s->thread_info.soft_muted);
+        target->length = mix_inputs(s, info, n, (uint8_t*) ptr + target->index, length);
 
         pa_memblock_release(target->memblock);
     }
@@ -3041,6 +3131,16 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
             s->thread_info.port_latency_offset = offset;
             return 0;
 
+        case PA_SINK_MESSAGE_GET_TIMING_STATS:
+            *((pa_sink_timing_stats*) userdata) = s->thread_info.timing_stats;
+            return 0;
+
+        case PA_SINK_MESSAGE_RESET_TIMING_STATS:
+            pa_histogram_reset(&s->thread_info.timing_stats.wakeup_lateness);
+            pa_histogram_reset(&s->thread_info.timing_stats.render_time);
+            pa_histogram_reset(&s->thread_info.timing_stats.slack);
+            return 0;
+
         case PA_SINK_MESSAGE_GET_LATENCY:
         case PA_SINK_MESSAGE_MAX:
             ;
@@ -3049,6 +3149,68 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
     return -1;
 }
 
+/* Called from IO thread */
+void pa_sink_record_timing(pa_sink *s, pa_usec_t wakeup_lateness, pa_usec_t render_time, pa_usec_t slack) {
+    pa_sink_assert_ref(s);
+    pa_sink_assert_io_context(s);
+
+    if (wakeup_lateness != (pa_usec_t) -1)
+        pa_histogram_add(&s->thread_info.timing_stats.wakeup_lateness, wakeup_lateness);
+
+    if (render_time != (pa_usec_t) -1)
+        pa_histogram_add(&s->thread_info.timing_stats.render_time, render_time);
+
+    if (slack != (pa_usec_t) -1)
+        pa_histogram_add(&s->thread_info.timing_stats.slack, slack);
+}
+
+/* Called from main thread */
+static int sink_message_handler(const char *object_path, const char *message, const pa_json_object *parameters, char **response, void *userdata) {
+    pa_sink *s = userdata;
+    char *message_handler_path;
+
+    pa_assert(s);
+    pa_assert(message);
+    pa_assert(response);
+
+    message_handler_path = make_message_handler_path(s->name);
+
+    if (!object_path || !pa_streq(object_path, message_handler_path)) {
+        pa_xfree(message_handler_path);
+        return -PA_ERR_NOENTITY;
+    }
+
+    pa_xfree(message_handler_path);
+
+    if (pa_streq(message, "get-timing-stats")) {
+        pa_sink_timing_stats stats;
+        pa_json_encoder *encoder;
+
+        if (pa_asyncmsgq_send(s->asyncmsgq, PA_MSGOBJECT(s), PA_SINK_MESSAGE_GET_TIMING_STATS, &stats, 0, NULL) < 0)
+            return -PA_ERR_NOTSUPPORTED;
+
+        encoder = pa_json_encoder_new();
+
+        pa_json_encoder_begin_element_object(encoder);
+        pa_histogram_to_json(&stats.wakeup_lateness, encoder, "wakeup-lateness");
+        pa_histogram_to_json(&stats.render_time, encoder, "render-time");
+        pa_histogram_to_json(&stats.slack, encoder, "slack");
+        pa_json_encoder_end_object(encoder);
+
+        *response = pa_json_encoder_to_string_free(encoder);
+
+        return PA_OK;
+    } else if (pa_streq(message, "reset-timing-stats")) {
+
+        if (pa_asyncmsgq_send(s->asyncmsgq, PA_MSGOBJECT(s), PA_SINK_MESSAGE_RESET_TIMING_STATS, NULL, 0, NULL) < 0)
+            return -PA_ERR_NOTSUPPORTED;
+
+        return PA_OK;
+    }
+
+    return -PA_ERR_NOTIMPLEMENTED;
+}
+
 /* Called from main thread */
 int pa_sink_suspend_all(pa_core *c, bool suspend, pa_suspend_cause_t cause) {
     pa_sink *sink;
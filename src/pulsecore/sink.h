@@ -31,8 +31,10 @@
 #include <pulse/volume.h>
 
 #include <pulsecore/core.h>
+#include <pulsecore/histogram.h>
 #include <pulsecore/idxset.h>
 #include <pulsecore/memchunk.h>
+#include <pulsecore/mix.h>
 #include <pulsecore/source.h>
 #include <pulsecore/module.h>
 #include <pulsecore/asyncmsgq.h>
@@ -56,6 +58,18 @@ typedef void(*pa_sink_cb_t)(pa_sink *s);
 
 typedef int (*pa_sink_get_mute_cb_t)(pa_sink *s, bool *mute);
 
+/* How punctual the IO thread of a timer scheduled sink is, recorded by
+ * the sink implementation with pa_sink_record_timing() */
+typedef struct pa_sink_timing_stats {
+    /* How much later than planned the thread woke up */
+    pa_histogram wakeup_lateness;
+    /* How long rendering and writing to the device took */
+    pa_histogram render_time;
+    /* How much time was left before the device would have run out of
+     * data when the write finished */
+    pa_histogram slack;
+} pa_sink_timing_stats;
+
 struct pa_sink {
     pa_msgobject parent;
 
@@ -84,6 +98,8 @@ struct pa_sink {
     uint32_t default_sample_rate;
     uint32_t alternate_sample_rate;
     bool avoid_resampling:1;
+    /* Sum all inputs in a wide accumulator, see pa_mix_wide() */
+    bool wide_mixing:1;
 
     pa_idxset *inputs;
     unsigned n_corked;
@@ -276,6 +292,10 @@ struct pa_sink {
         pa_sink_state_t state;
         pa_hashmap *inputs;
 
+        /* Scratch space for mixing the inputs, grows with their number */
+        pa_mix_info *mix_info;
+        unsigned n_mix_info;
+
         pa_rtpoll *rtpoll;
 
         pa_cvolume soft_volume;
@@ -329,6 +349,8 @@ struct pa_sink {
         uint32_t volume_change_safety_margin;
         /* Usec delay added to all volume change events, may be negative. */
         int32_t volume_change_extra_delay;
+
+        pa_sink_timing_stats timing_stats;
     } thread_info;
 
     void *userdata;
@@ -363,6 +385,8 @@ typedef enum pa_sink_message {
     PA_SINK_MESSAGE_UPDATE_VOLUME_AND_MUTE,
     PA_SINK_MESSAGE_SET_PORT_LATENCY_OFFSET,
     PA_SINK_MESSAGE_GET_LAST_REWIND,
+    PA_SINK_MESSAGE_GET_TIMING_STATS,
+    PA_SINK_MESSAGE_RESET_TIMING_STATS,
     PA_SINK_MESSAGE_MAX
 } pa_sink_message_t;
 
@@ -383,6 +407,7 @@ typedef struct pa_sink_new_data {
     pa_channel_map channel_map;
     uint32_t alternate_sample_rate;
     bool avoid_resampling:1;
+    bool wide_mixing:1;
     pa_cvolume volume;
     bool muted:1;
 
@@ -390,6 +415,7 @@ typedef struct pa_sink_new_data {
     bool channel_map_is_set:1;
     bool alternate_sample_rate_is_set:1;
     bool avoid_resampling_is_set:1;
+    bool wide_mixing_is_set:1;
     bool volume_is_set:1;
     bool muted_is_set:1;
 
@@ -406,6 +432,7 @@ void pa_sink_new_data_set_sample_spec(pa_sink_new_data *data, const pa_sample_sp
 void pa_sink_new_data_set_channel_map(pa_sink_new_data *data, const pa_channel_map *map);
 void pa_sink_new_data_set_alternate_sample_rate(pa_sink_new_data *data, const uint32_t alternate_sample_rate);
 void pa_sink_new_data_set_avoid_resampling(pa_sink_new_data *data, bool avoid_resampling);
+void pa_sink_new_data_set_wide_mixing(pa_sink_new_data *data, bool wide_mixing);
 void pa_sink_new_data_set_volume(pa_sink_new_data *data, const pa_cvolume *volume);
 void pa_sink_new_data_set_muted(pa_sink_new_data *data, bool mute);
 void pa_sink_new_data_set_port(pa_sink_new_data *data, const char *port);
@@ -538,6 +565,10 @@ void pa_sink_process_rewind(pa_sink *s, size_t nbytes);
 
 int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offset, pa_memchunk *chunk);
 
+/* Records one wakeup of a timer scheduled sink. Pass (pa_usec_t) -1 for
+ * values the sink cannot measure. */
+void pa_sink_record_timing(pa_sink *s, pa_usec_t wakeup_lateness, pa_usec_t render_time, pa_usec_t slack);
+
 void pa_sink_attach_within_thread(pa_sink *s);
 void pa_sink_detach_within_thread(pa_sink *s);
 
@@ -417,6 +417,7 @@ int pa_source_output_new(
         if (!pa_source_output_new_data_is_passthrough(data)) /* no resampler for passthrough content */
             if (!(resampler = pa_resampler_new(
                         core->mempool,
+                        core->resampler_cache,
                         &data->source->sample_spec, &data->source->channel_map,
                         &data->sample_spec, &data->channel_map,
                         core->lfe_crossover_freq,
@@ -1831,6 +1832,7 @@ int pa_source_output_update_resampler(pa_source_output *o) {
          !pa_channel_map_equal(&o->channel_map, &o->source->channel_map))) {
 
         new_resampler = pa_resampler_new(o->core->mempool,
+                                     o->core->resampler_cache,
                                      &o->source->sample_spec, &o->source->channel_map,
                                      &o->sample_spec, &o->channel_map,
                                      o->core->lfe_crossover_freq,
@@ -24,10 +24,20 @@
 #include "srbchannel.h"
 
 #include <pulsecore/atomic.h>
+#include <pulse/rtclock.h>
 #include <pulse/xmalloc.h>
 
 /* #define DEBUG_SRBCHANNEL */
 
+/* Smallest ringbuffer capacity a srbchannel is created with */
+#define CAPACITY_MIN (1024)
+
+/* Busy polling is given up after this many unsuccessful attempts in a
+ * row. It is resumed when the other side signals within this many
+ * polling intervals after we went to sleep. */
+#define BUSY_POLL_MISSES_MAX (4)
+#define BUSY_POLL_RESUME_FACTOR (4)
+
 /* This ringbuffer might be useful in other contexts too, but
  * right now it's only used inside the srbchannel, so let's keep it here
  * for the time being. */
@@ -86,6 +96,11 @@ struct pa_srbchannel {
     pa_io_event *read_event;
     pa_defer_event *defer_event;
     pa_mainloop_api *mainloop;
+
+    pa_usec_t busy_poll_usec, sleep_time;
+    unsigned busy_poll_misses;
+
+    pa_srbchannel_stat stat;
 };
 
 /* We always listen to sem_read, and always signal on sem_write.
@@ -111,6 +126,7 @@ size_t pa_srbchannel_write(pa_srbchannel *sr, const void *data, size_t l) {
 #ifdef DEBUG_SRBCHANNEL
             pa_log("srbchannel output buffer full");
 #endif
+            sr->stat.n_full++;
             break;
         }
 
@@ -124,7 +140,9 @@ size_t pa_srbchannel_write(pa_srbchannel *sr, const void *data, size_t l) {
     pa_log("Wrote %d bytes to srbchannel, signalling fdsem", (int) written);
 #endif
 
-    pa_fdsem_post(sr->sem_write);
+    if (written > 0)
+        pa_fdsem_post(sr->sem_write);
+
     return written;
 }
 
@@ -175,11 +193,35 @@ struct srbheader {
     int readbuf_offset;
     int writebuf_offset;
 
+    /* Only valid if the other side has protocol version >= 37 */
+    uint32_t busy_poll_usec;
+
     /* TODO: Maybe a marker here to make sure we talk to a server with equally sized struct */
 };
 
-static void srbchannel_rwloop(pa_srbchannel* sr) {
+/* Returns true if the other side signalled while we were polling */
+static bool srbchannel_busy_poll(pa_srbchannel *sr) {
+    pa_usec_t until;
+
+    if (sr->busy_poll_usec == 0 || sr->busy_poll_misses >= BUSY_POLL_MISSES_MAX)
+        return false;
+
+    until = pa_rtclock_now() + sr->busy_poll_usec;
+
     do {
+        if (pa_fdsem_try(sr->sem_read)) {
+            sr->busy_poll_misses = 0;
+            sr->stat.n_busy_polled++;
+            return true;
+        }
+    } while (pa_rtclock_now() < until);
+
+    sr->busy_poll_misses++;
+    return false;
+}
+
+static void srbchannel_rwloop(pa_srbchannel* sr) {
+    for (;;) {
 #ifdef DEBUG_SRBCHANNEL
         int q;
         pa_ringbuffer_peek(&sr->rb_read, &q);
@@ -200,13 +242,27 @@ static void srbchannel_rwloop(pa_srbchannel* sr) {
         pa_log("In rw loop from srbchannel, after callback, count = %d", q);
 #endif
 
-    } while (pa_fdsem_before_poll(sr->sem_read) < 0);
+        if (srbchannel_busy_poll(sr))
+            continue;
+
+        if (pa_fdsem_before_poll(sr->sem_read) >= 0)
+            break;
+    }
+
+    if (sr->busy_poll_usec > 0)
+        sr->sleep_time = pa_rtclock_now();
 }
 
 static void semread_cb(pa_mainloop_api *m, pa_io_event *e, int fd, pa_io_event_flags_t events, void *userdata) {
     pa_srbchannel* sr = userdata;
 
     pa_fdsem_after_poll(sr->sem_read);
+
+    /* The other side is busy again, so polling would have paid off */
+    if (sr->busy_poll_misses > 0 &&
+        pa_rtclock_now() - sr->sleep_time < sr->busy_poll_usec * BUSY_POLL_RESUME_FACTOR)
+        sr->busy_poll_misses = 0;
+
     srbchannel_rwloop(sr);
 }
 
@@ -221,14 +277,24 @@ static void defer_cb(pa_mainloop_api *m, pa_defer_event *e, void *userdata) {
     srbchannel_rwloop(sr);
 }
 
-pa_srbchannel* pa_srbchannel_new(pa_mainloop_api *m, pa_mempool *p) {
+pa_srbchannel* pa_srbchannel_new(pa_mainloop_api *m, pa_mempool *p, size_t capacity_hint) {
     int capacity;
     int readfd;
     struct srbheader *srh;
+    size_t length = (size_t) -1;
 
     pa_srbchannel* sr = pa_xmalloc0(sizeof(pa_srbchannel));
     sr->mainloop = m;
-    sr->memblock = pa_memblock_new_pool(p, -1);
+
+    if (capacity_hint > 0) {
+        capacity_hint = PA_MAX(PA_ALIGN(capacity_hint), (size_t) CAPACITY_MIN);
+        length = PA_ALIGN(sizeof(*srh)) + 2 * capacity_hint;
+
+        if (length > pa_mempool_block_size_max(p))
+            length = (size_t) -1;
+    }
+
+    sr->memblock = pa_memblock_new_pool(p, length);
     if (!sr->memblock)
         goto fail;
 
@@ -291,6 +357,7 @@ pa_srbchannel* pa_srbchannel_new_from_template(pa_mainloop_api *m, pa_srbchannel
 {
     int temp;
     struct srbheader *srh;
+    size_t length;
     pa_srbchannel* sr = pa_xmalloc0(sizeof(pa_srbchannel));
 
     sr->mainloop = m;
@@ -298,6 +365,20 @@ pa_srbchannel* pa_srbchannel_new_from_template(pa_mainloop_api *m, pa_srbchannel
     pa_memblock_ref(sr->memblock);
     srh = pa_memblock_acquire(sr->memblock);
 
+    /* The ringbuffer layout is chosen by the other side, make sure it
+     * fits into the block */
+    length = pa_memblock_get_length(sr->memblock);
+    if (length < sizeof(*srh) || srh->capacity <= 0 ||
+        srh->readbuf_offset < 0 || srh->writebuf_offset < 0 ||
+        (size_t) srh->readbuf_offset + (size_t) srh->capacity > length ||
+        (size_t) srh->writebuf_offset + (size_t) srh->capacity > length) {
+        pa_log_warn("Invalid srbchannel ringbuffer layout");
+        goto fail;
+    }
+
+    if (t->with_busy_poll)
+        pa_srbchannel_set_busy_poll(sr, srh->busy_poll_usec);
+
     sr->rb_read.capacity = sr->rb_write.capacity = srh->capacity;
     sr->rb_read.count = &srh->read_count;
     sr->rb_write.count = &srh->write_count;
@@ -332,9 +413,36 @@ fail:
 }
 
 void pa_srbchannel_export(pa_srbchannel *sr, pa_srbchannel_template *t) {
+    struct srbheader *srh;
+
+    /* The block stays acquired for the lifetime of the channel */
+    srh = pa_memblock_acquire(sr->memblock);
+    srh->busy_poll_usec = (uint32_t) sr->busy_poll_usec;
+    pa_memblock_release(sr->memblock);
+
     t->memblock = sr->memblock;
     t->readfd = pa_fdsem_get(sr->sem_read);
     t->writefd = pa_fdsem_get(sr->sem_write);
+    t->with_busy_poll = true;
+}
+
+size_t pa_srbchannel_get_capacity(pa_srbchannel *sr) {
+    pa_assert(sr);
+
+    return (size_t) sr->rb_write.capacity;
+}
+
+void pa_srbchannel_set_busy_poll(pa_srbchannel *sr, pa_usec_t usec) {
+    pa_assert(sr);
+
+    sr->busy_poll_usec = PA_MIN(usec, (pa_usec_t) PA_SRBCHANNEL_BUSY_POLL_MAX_USEC);
+    sr->busy_poll_misses = 0;
+}
+
+const pa_srbchannel_stat *pa_srbchannel_get_stat(pa_srbchannel *sr) {
+    pa_assert(sr);
+
+    return &sr->stat;
 }
 
 void pa_srbchannel_set_callback(pa_srbchannel *sr, pa_srbchannel_cb_t callback, void *userdata) {
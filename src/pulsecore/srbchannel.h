@@ -21,6 +21,7 @@
 ***/
 
 #include <pulse/mainloop-api.h>
+#include <pulse/sample.h>
 #include <pulsecore/fdsem.h>
 #include <pulsecore/memblock.h>
 
@@ -32,9 +33,20 @@ typedef struct pa_srbchannel pa_srbchannel;
 typedef struct pa_srbchannel_template {
     int readfd, writefd;
     pa_memblock *memblock;
+    /* The shm block header carries the busy polling setting of the
+     * creating side (protocol version >= 37) */
+    bool with_busy_poll;
 } pa_srbchannel_template;
 
-pa_srbchannel* pa_srbchannel_new(pa_mainloop_api *m, pa_mempool *p);
+typedef struct pa_srbchannel_stat {
+    unsigned n_full;        /* Writes that found the ringbuffer full */
+    unsigned n_busy_polled; /* Signals picked up by busy polling, without sleeping */
+} pa_srbchannel_stat;
+
+/* Creates a srbchannel with ringbuffers of the given capacity in each
+ * direction, or as large as a block of the pool allows if 0. The other
+ * side takes the capacity over from the shm block. */
+pa_srbchannel* pa_srbchannel_new(pa_mainloop_api *m, pa_mempool *p, size_t capacity);
 /* Note: this creates a srbchannel with swapped read and write. */
 pa_srbchannel* pa_srbchannel_new_from_template(pa_mainloop_api *m, pa_srbchannel_template *t);
 
@@ -42,6 +54,20 @@ void pa_srbchannel_free(pa_srbchannel *sr);
 
 void pa_srbchannel_export(pa_srbchannel *sr, pa_srbchannel_template *t);
 
+size_t pa_srbchannel_get_capacity(pa_srbchannel *sr);
+
+/* Before going to sleep, wait up to usec for the other side to signal,
+ * so that neither side needs the pa_fdsem system calls while both are
+ * busy. Polling stops being attempted after some unsuccessful tries,
+ * until the other side is found to be busy again. 0 disables it. */
+void pa_srbchannel_set_busy_poll(pa_srbchannel *sr, pa_usec_t usec);
+
+/* Upper limit for the busy polling time, also applied to the value a
+ * client reads from the ringbuffer header */
+#define PA_SRBCHANNEL_BUSY_POLL_MAX_USEC 500
+
+const pa_srbchannel_stat *pa_srbchannel_get_stat(pa_srbchannel *sr);
+
 size_t pa_srbchannel_write(pa_srbchannel *sr, const void *data, size_t l);
 size_t pa_srbchannel_read(pa_srbchannel *sr, void *data, size_t l);
 
@@ -0,0 +1,122 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "cpu-x86.h"
+
+#include "sample-util.h"
+#include "simd-util.h"
+
+#if defined (__i386__) || defined (__amd64__)
+
+#include <immintrin.h>
+
+/* Samples per AVX2 register for 16 bit samples */
+#define VEC16 16
+
+static pa_do_volume_func_t fallback_s16ne;
+static pa_do_volume_func_t fallback_s16re;
+
+/* Computes (v * (hi << 16 | lo)) >> 16 with 16 bit multiplies and saturates
+ * the result like PA_CLAMP_UNLIKELY(t, -0x8000, 0x7FFF) */
+static inline __m256i volume_s16_avx2(__m256i v, __m256i lo, __m256i hi) {
+    __m256i l, pl, ph, s0, s1;
+
+    /* (v * lo) >> 16, correcting the unsigned multiply for negative samples */
+    l = _mm256_sub_epi16(_mm256_mulhi_epu16(v, lo), _mm256_and_si256(_mm256_srai_epi16(v, 15), lo));
+
+    /* v * hi, widened to 32 bit */
+    pl = _mm256_mullo_epi16(v, hi);
+    ph = _mm256_mulhi_epi16(v, hi);
+
+    /* The unpacks work per 128 bit lane, and packssdw restores that order */
+    s0 = _mm256_add_epi32(_mm256_unpacklo_epi16(pl, ph), _mm256_srai_epi32(_mm256_unpacklo_epi16(l, l), 16));
+    s1 = _mm256_add_epi32(_mm256_unpackhi_epi16(pl, ph), _mm256_srai_epi32(_mm256_unpackhi_epi16(l, l), 16));
+
+    return _mm256_packs_epi32(s0, s1);
+}
+
+static void pa_volume_s16ne_avx2(int16_t *samples, const int32_t *volumes, unsigned channels, unsigned length) {
+    int16_t lo[PA_CHANNELS_MAX + 2 * VEC16], hi[PA_CHANNELS_MAX + 2 * VEC16];
+    unsigned period, n, i, p = 0;
+
+    period = pa_split_volumes(volumes, channels, VEC16, lo, hi);
+    n = pa_vector_samples(length / sizeof(int16_t), channels, VEC16);
+
+    for (i = 0; i < n; i += VEC16) {
+        __m256i v = _mm256_loadu_si256((__m256i *) (samples + i));
+        __m256i vlo = _mm256_loadu_si256((const __m256i *) (lo + p));
+        __m256i vhi = _mm256_loadu_si256((const __m256i *) (hi + p));
+
+        _mm256_storeu_si256((__m256i *) (samples + i), volume_s16_avx2(v, vlo, vhi));
+
+        p += VEC16;
+        if (p >= period)
+            p -= period;
+    }
+
+    if (n * sizeof(int16_t) < length)
+        fallback_s16ne(samples + n, volumes, channels, length - n * sizeof(int16_t));
+}
+
+static void pa_volume_s16re_avx2(int16_t *samples, const int32_t *volumes, unsigned channels, unsigned length) {
+    int16_t lo[PA_CHANNELS_MAX + 2 * VEC16], hi[PA_CHANNELS_MAX + 2 * VEC16];
+    const __m256i swap = _mm256_setr_epi8(
+        1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+        1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    unsigned period, n, i, p = 0;
+
+    period = pa_split_volumes(volumes, channels, VEC16, lo, hi);
+    n = pa_vector_samples(length / sizeof(int16_t), channels, VEC16);
+
+    for (i = 0; i < n; i += VEC16) {
+        __m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256((__m256i *) (samples + i)), swap);
+        __m256i vlo = _mm256_loadu_si256((const __m256i *) (lo + p));
+        __m256i vhi = _mm256_loadu_si256((const __m256i *) (hi + p));
+
+        _mm256_storeu_si256((__m256i *) (samples + i), _mm256_shuffle_epi8(volume_s16_avx2(v, vlo, vhi), swap));
+
+        p += VEC16;
+        if (p >= period)
+            p -= period;
+    }
+
+    if (n * sizeof(int16_t) < length)
+        fallback_s16re(samples + n, volumes, channels, length - n * sizeof(int16_t));
+}
+
+#endif /* defined (__i386__) || defined (__amd64__) */
+
+void pa_volume_func_init_avx2(pa_cpu_x86_flag_t flags) {
+#if defined (__i386__) || defined (__amd64__)
+    if (flags & PA_CPU_X86_AVX2) {
+        pa_log_info("Initialising AVX2 optimized volume functions.");
+
+        fallback_s16ne = pa_get_volume_func(PA_SAMPLE_S16NE);
+        fallback_s16re = pa_get_volume_func(PA_SAMPLE_S16RE);
+
+        pa_set_volume_func(PA_SAMPLE_S16NE, (pa_do_volume_func_t) pa_volume_s16ne_avx2);
+        pa_set_volume_func(PA_SAMPLE_S16RE, (pa_do_volume_func_t) pa_volume_s16re_avx2);
+    }
+#endif /* defined (__i386__) || defined (__amd64__) */
+}
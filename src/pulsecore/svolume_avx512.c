@@ -0,0 +1,120 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "cpu-x86.h"
+
+#include "sample-util.h"
+#include "simd-util.h"
+
+#if defined (__i386__) || defined (__amd64__)
+
+#include <immintrin.h>
+
+/* Samples per AVX-512 register for 16 bit samples */
+#define VEC16 32
+
+static pa_do_volume_func_t fallback_s16ne;
+static pa_do_volume_func_t fallback_s16re;
+
+/* Computes (v * (hi << 16 | lo)) >> 16 with 16 bit multiplies and saturates
+ * the result like PA_CLAMP_UNLIKELY(t, -0x8000, 0x7FFF) */
+static inline __m512i volume_s16_avx512(__m512i v, __m512i lo, __m512i hi) {
+    __m512i l, pl, ph, s0, s1;
+
+    /* (v * lo) >> 16, correcting the unsigned multiply for negative samples */
+    l = _mm512_sub_epi16(_mm512_mulhi_epu16(v, lo), _mm512_and_si512(_mm512_srai_epi16(v, 15), lo));
+
+    /* v * hi, widened to 32 bit */
+    pl = _mm512_mullo_epi16(v, hi);
+    ph = _mm512_mulhi_epi16(v, hi);
+
+    /* The unpacks work per 128 bit lane, and packssdw restores that order */
+    s0 = _mm512_add_epi32(_mm512_unpacklo_epi16(pl, ph), _mm512_srai_epi32(_mm512_unpacklo_epi16(l, l), 16));
+    s1 = _mm512_add_epi32(_mm512_unpackhi_epi16(pl, ph), _mm512_srai_epi32(_mm512_unpackhi_epi16(l, l), 16));
+
+    return _mm512_packs_epi32(s0, s1);
+}
+
+static void pa_volume_s16ne_avx512(int16_t *samples, const int32_t *volumes, unsigned channels, unsigned length) {
+    int16_t lo[PA_CHANNELS_MAX + 2 * VEC16], hi[PA_CHANNELS_MAX + 2 * VEC16];
+    unsigned period, n, i, p = 0;
+
+    period = pa_split_volumes(volumes, channels, VEC16, lo, hi);
+    n = pa_vector_samples(length / sizeof(int16_t), channels, VEC16);
+
+    for (i = 0; i < n; i += VEC16) {
+        __m512i v = _mm512_loadu_si512((__m512i *) (samples + i));
+        __m512i vlo = _mm512_loadu_si512((const __m512i *) (lo + p));
+        __m512i vhi = _mm512_loadu_si512((const __m512i *) (hi + p));
+
+        _mm512_storeu_si512((__m512i *) (samples + i), volume_s16_avx512(v, vlo, vhi));
+
+        p += VEC16;
+        if (p >= period)
+            p -= period;
+    }
+
+    if (n * sizeof(int16_t) < length)
+        fallback_s16ne(samples + n, volumes, channels, length - n * sizeof(int16_t));
+}
+
+static void pa_volume_s16re_avx512(int16_t *samples, const int32_t *volumes, unsigned channels, unsigned length) {
+    int16_t lo[PA_CHANNELS_MAX + 2 * VEC16], hi[PA_CHANNELS_MAX + 2 * VEC16];
+    const __m512i swap = _mm512_broadcast_i32x4(_mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14));
+    unsigned period, n, i, p = 0;
+
+    period = pa_split_volumes(volumes, channels, VEC16, lo, hi);
+    n = pa_vector_samples(length / sizeof(int16_t), channels, VEC16);
+
+    for (i = 0; i < n; i += VEC16) {
+        __m512i v = _mm512_shuffle_epi8(_mm512_loadu_si512((__m512i *) (samples + i)), swap);
+        __m512i vlo = _mm512_loadu_si512((const __m512i *) (lo + p));
+        __m512i vhi = _mm512_loadu_si512((const __m512i *) (hi + p));
+
+        _mm512_storeu_si512((__m512i *) (samples + i), _mm512_shuffle_epi8(volume_s16_avx512(v, vlo, vhi), swap));
+
+        p += VEC16;
+        if (p >= period)
+            p -= period;
+    }
+
+    if (n * sizeof(int16_t) < length)
+        fallback_s16re(samples + n, volumes, channels, length - n * sizeof(int16_t));
+}
+
+#endif /* defined (__i386__) || defined (__amd64__) */
+
+void pa_volume_func_init_avx512(pa_cpu_x86_flag_t flags) {
+#if defined (__i386__) || defined (__amd64__)
+    if (flags & PA_CPU_X86_AVX512BW) {
+        pa_log_info("Initialising AVX-512 optimized volume functions.");
+
+        fallback_s16ne = pa_get_volume_func(PA_SAMPLE_S16NE);
+        fallback_s16re = pa_get_volume_func(PA_SAMPLE_S16RE);
+
+        pa_set_volume_func(PA_SAMPLE_S16NE, (pa_do_volume_func_t) pa_volume_s16ne_avx512);
+        pa_set_volume_func(PA_SAMPLE_S16RE, (pa_do_volume_func_t) pa_volume_s16re_avx512);
+    }
+#endif /* defined (__i386__) || defined (__amd64__) */
+}
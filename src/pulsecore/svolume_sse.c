@@ -249,6 +249,195 @@ static void pa_volume_s16re_sse2(int16_t *samples, const int32_t *volumes, unsig
     );
 }
 
+/* swap 32 bits */
+#define SWAP_32(s) \
+      " pshuflw $0xb1, "#s", "#s"    \n\t" /* .. | l h | .. */ \
+      " pshufhw $0xb1, "#s", "#s"    \n\t"                     \
+      SWAP_16(s)                           /* .. | swapped | .. */
+
+/* (s * v) >> 16 with 64 bit intermediates and saturation to 32 bits, for
+ * four signed samples and four non-negative 16.16 volumes. The result ends
+ * up in s, v is clobbered. */
+#define VOLUME_32x32(s,v)                  /*  s3  |  s2  |  s1  |  s0  | */              \
+      " movdqa "#s", %%xmm4          \n\t"                                                \
+      " psrad $31, %%xmm4            \n\t" /* sign(s) */                                  \
+      " pand "#v", %%xmm4            \n\t" /* sign(s) & v, corrects unsigned product */   \
+      " movdqa "#s", %%xmm5          \n\t"                                                \
+      " pmuludq "#v", %%xmm5         \n\t" /*    s2 * v2  |    s0 * v0  | */              \
+      " psrlq $32, "#s"              \n\t"                                                \
+      " psrlq $32, "#v"              \n\t"                                                \
+      " pmuludq "#v", "#s"           \n\t" /*    s3 * v3  |    s1 * v1  | */              \
+      " movdqa %%xmm5, %%xmm6        \n\t"                                                \
+      " movdqa "#s", %%xmm7          \n\t"                                                \
+      " psrlq $16, %%xmm5            \n\t" /* low 32 bits of p >> 16 */                   \
+      " psrlq $16, "#s"              \n\t"                                                \
+      " psrlq $32, %%xmm6            \n\t" /* high 32 bits of p */                        \
+      " psrlq $32, %%xmm7            \n\t"                                                \
+      " pshufd $0x08, %%xmm5, %%xmm5 \n\t"                                                \
+      " pshufd $0x08, "#s", "#s"     \n\t"                                                \
+      " punpckldq "#s", %%xmm5       \n\t" /*  r3  |  r2  |  r1  |  r0  | */              \
+      " pshufd $0x08, %%xmm6, %%xmm6 \n\t"                                                \
+      " pshufd $0x08, %%xmm7, %%xmm7 \n\t"                                                \
+      " punpckldq %%xmm7, %%xmm6     \n\t" /*  h3  |  h2  |  h1  |  h0  | */              \
+      " psubd %%xmm4, %%xmm6         \n\t" /* signed high part */                         \
+      " pslld $16, %%xmm4            \n\t"                                                \
+      " psubd %%xmm4, %%xmm5         \n\t" /* r contains the low half of it as well */    \
+      " movdqa %%xmm6, %%xmm7        \n\t"                                                \
+      " psrad $15, %%xmm7            \n\t" /* bits 47..63 of p */                         \
+      " movdqa %%xmm5, "#s"          \n\t"                                                \
+      " psrad $31, "#s"              \n\t" /* bit 47 of p */                              \
+      " pcmpeqd %%xmm7, "#s"         \n\t" /* r fits if all of them are equal */          \
+      " psrad $31, %%xmm6            \n\t"                                                \
+      " pcmpeqd %%xmm7, %%xmm7       \n\t"                                                \
+      " psrld $1, %%xmm7             \n\t" /* 0x7fffffff */                               \
+      " pxor %%xmm7, %%xmm6          \n\t" /* saturated value */                          \
+      " pand "#s", %%xmm5            \n\t"                                                \
+      " pandn %%xmm6, "#s"           \n\t"                                                \
+      " por %%xmm5, "#s"             \n\t"
+
+#define VOLUME_FLOAT32(s,v) \
+      " mulps "#v", "#s"             \n\t"
+
+#define VOLUME_FLOAT32RE(s,v) \
+      SWAP_32(s)                           \
+      " mulps "#v", "#s"             \n\t" \
+      SWAP_32(s)
+
+#define VOLUME_S32(s,v) \
+      VOLUME_32x32(s,v)
+
+#define VOLUME_S24_32(s,v) \
+      " pslld $8, "#s"               \n\t" /* sign extend the 24 bit samples */ \
+      VOLUME_32x32(s,v)                                                        \
+      " psrld $8, "#s"               \n\t"
+
+/* The loop for all formats with 32 bit samples and 32 bit volumes, the
+ * per sample operation is given as macro that leaves its result in s */
+#define VOLUME_32_LOOP(op)                                                                  \
+        " xor %3, %3                    \n\t"                                               \
+        " sar $2, %2                    \n\t" /* length /= sizeof (int32_t) */              \
+                                                                                            \
+        " test $1, %2                   \n\t" /* check for odd samples */                   \
+        " je 2f                         \n\t"                                               \
+                                                                                            \
+        " movd (%q1, %3, 4), %%xmm0     \n\t" /*                             |  v0  | */    \
+        " movd (%0), %%xmm1             \n\t" /*                             |  p0  | */    \
+        op (%%xmm1, %%xmm0)                                                                 \
+        " movd %%xmm1, (%0)             \n\t" /*                             | p0*v0 | */   \
+        " add $4, %0                    \n\t"                                               \
+        MOD_ADD ($1, %5)                                                                    \
+                                                                                            \
+        "2:                             \n\t"                                               \
+        " sar $1, %2                    \n\t" /* prepare for processing 2 samples at a time */ \
+        " test $1, %2                   \n\t"                                               \
+        " je 4f                         \n\t"                                               \
+                                                                                            \
+        "3:                             \n\t" /* do samples in groups of 2 */               \
+        " movq (%q1, %3, 4), %%xmm0     \n\t" /*                      |  v1  |  v0  | */    \
+        " movq (%0), %%xmm1             \n\t" /*                      |  p1  |  p0  | */    \
+        op (%%xmm1, %%xmm0)                                                                 \
+        " movq %%xmm1, (%0)             \n\t" /*                    | p1*v1 | p0*v0 | */    \
+        " add $8, %0                    \n\t"                                               \
+        MOD_ADD ($2, %5)                                                                    \
+                                                                                            \
+        "4:                             \n\t"                                               \
+        " sar $1, %2                    \n\t" /* prepare for processing 4 samples at a time */ \
+        " test $1, %2                   \n\t"                                               \
+        " je 6f                         \n\t"                                               \
+                                                                                            \
+        "5:                             \n\t" /* do samples in groups of 4 */               \
+        " movdqu (%q1, %3, 4), %%xmm0   \n\t" /*        |  v3  |  v2  |  v1  |  v0  | */    \
+        " movdqu (%0), %%xmm1           \n\t" /*        |  p3  |  p2  |  p1  |  p0  | */    \
+        op (%%xmm1, %%xmm0)                                                                 \
+        " movdqu %%xmm1, (%0)           \n\t" /*        | p3*v3 ..           p0*v0 | */     \
+        " add $16, %0                   \n\t"                                               \
+        MOD_ADD ($4, %5)                                                                    \
+                                                                                            \
+        "6:                             \n\t"                                               \
+        " sar $1, %2                    \n\t" /* prepare for processing 8 samples at a time */ \
+        " cmp $0, %2                    \n\t"                                               \
+        " je 8f                         \n\t"                                               \
+                                                                                            \
+        "7:                             \n\t" /* do samples in groups of 8 */               \
+        " movdqu (%q1, %3, 4), %%xmm0   \n\t" /*        |  v3  |  v2  |  v1  |  v0  | */    \
+        " movdqu 16(%q1, %3, 4), %%xmm2 \n\t" /*        |  v7  |  v6  |  v5  |  v4  | */    \
+        " movdqu (%0), %%xmm1           \n\t" /*        |  p3  |  p2  |  p1  |  p0  | */    \
+        " movdqu 16(%0), %%xmm3         \n\t" /*        |  p7  |  p6  |  p5  |  p4  | */    \
+        op (%%xmm1, %%xmm0)                                                                 \
+        op (%%xmm3, %%xmm2)                                                                 \
+        " movdqu %%xmm1, (%0)           \n\t" /*        | p3*v3 ..           p0*v0 | */     \
+        " movdqu %%xmm3, 16(%0)         \n\t" /*        | p7*v7 ..           p4*v4 | */     \
+        " add $32, %0                   \n\t"                                               \
+        MOD_ADD ($8, %5)                                                                    \
+        " dec %2                        \n\t"                                               \
+        " jne 7b                        \n\t"                                               \
+        "8:                             \n\t"
+
+#if defined (__i386__)
+#define VOLUME_32_CHANNELS "m" (channels)
+#else
+#define VOLUME_32_CHANNELS "r" ((pa_reg_x86)channels)
+#endif
+
+static void pa_volume_float32ne_sse2(float *samples, const float *volumes, unsigned channels, unsigned length) {
+    pa_reg_x86 channel, temp;
+
+    /* Channels must be at least 8 and always a multiple of the original number.
+     * This is also the max amount we overread the volume array, which should
+     * have enough padding. */
+    if (channels < 8)
+        channels = channel_overread_table[channels];
+
+    __asm__ __volatile__ (
+        VOLUME_32_LOOP (VOLUME_FLOAT32)
+        : "+r" (samples), "+r" (volumes), "+r" (length), "=&D" (channel), "=&r" (temp)
+        : VOLUME_32_CHANNELS
+        : "cc", "memory", "xmm0", "xmm1", "xmm2", "xmm3"
+    );
+}
+
+static void pa_volume_float32re_sse2(float *samples, const float *volumes, unsigned channels, unsigned length) {
+    pa_reg_x86 channel, temp;
+
+    if (channels < 8)
+        channels = channel_overread_table[channels];
+
+    __asm__ __volatile__ (
+        VOLUME_32_LOOP (VOLUME_FLOAT32RE)
+        : "+r" (samples), "+r" (volumes), "+r" (length), "=&D" (channel), "=&r" (temp)
+        : VOLUME_32_CHANNELS
+        : "cc", "memory", "xmm0", "xmm1", "xmm2", "xmm3", "xmm4"
+    );
+}
+
+static void pa_volume_s32ne_sse2(int32_t *samples, const int32_t *volumes, unsigned channels, unsigned length) {
+    pa_reg_x86 channel, temp;
+
+    if (channels < 8)
+        channels = channel_overread_table[channels];
+
+    __asm__ __volatile__ (
+        VOLUME_32_LOOP (VOLUME_S32)
+        : "+r" (samples), "+r" (volumes), "+r" (length), "=&D" (channel), "=&r" (temp)
+        : VOLUME_32_CHANNELS
+        : "cc", "memory", "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7"
+    );
+}
+
+static void pa_volume_s24_32ne_sse2(uint32_t *samples, const int32_t *volumes, unsigned channels, unsigned length) {
+    pa_reg_x86 channel, temp;
+
+    if (channels < 8)
+        channels = channel_overread_table[channels];
+
+    __asm__ __volatile__ (
+        VOLUME_32_LOOP (VOLUME_S24_32)
+        : "+r" (samples), "+r" (volumes), "+r" (length), "=&D" (channel), "=&r" (temp)
+        : VOLUME_32_CHANNELS
+        : "cc", "memory", "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7"
+    );
+}
+
 #endif /* (!defined(__APPLE__) && !defined(__FreeBSD__) && !defined(__FreeBSD_kernel__) && defined (__i386__)) || defined (__amd64__) */
 
 void pa_volume_func_init_sse(pa_cpu_x86_flag_t flags) {
@@ -258,6 +447,10 @@ void pa_volume_func_init_sse(pa_cpu_x86_flag_t flags) {
 
         pa_set_volume_func(PA_SAMPLE_S16NE, (pa_do_volume_func_t) pa_volume_s16ne_sse2);
         pa_set_volume_func(PA_SAMPLE_S16RE, (pa_do_volume_func_t) pa_volume_s16re_sse2);
+        pa_set_volume_func(PA_SAMPLE_FLOAT32NE, (pa_do_volume_func_t) pa_volume_float32ne_sse2);
+        pa_set_volume_func(PA_SAMPLE_FLOAT32RE, (pa_do_volume_func_t) pa_volume_float32re_sse2);
+        pa_set_volume_func(PA_SAMPLE_S32NE, (pa_do_volume_func_t) pa_volume_s32ne_sse2);
+        pa_set_volume_func(PA_SAMPLE_S24_32NE, (pa_do_volume_func_t) pa_volume_s24_32ne_sse2);
     }
 #endif /* (!defined(__APPLE__) && !defined(__FreeBSD__) && !defined(__FreeBSD_kernel__) && defined (__i386__)) || defined (__amd64__) */
 }
@@ -63,6 +63,21 @@ static void thread_free_cb(void *p) {
 
 PA_STATIC_TLS_DECLARE(current_thread, thread_free_cb);
 
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+static bool default_affinity_set = false;
+static cpu_set_t default_affinity;
+
+static void cpu_set_to_mask(const pa_cpu_set *s, cpu_set_t *mask) {
+    unsigned cpu;
+
+    CPU_ZERO(mask);
+
+    for (cpu = 0; cpu < PA_CPU_SET_MAX && cpu < CPU_SETSIZE; cpu++)
+        if (pa_cpu_set_contains(s, cpu))
+            CPU_SET(cpu, mask);
+}
+#endif
+
 static void* internal_thread_func(void *userdata) {
     pa_thread *t = userdata;
     pa_assert(t);
@@ -86,6 +101,11 @@ static void* internal_thread_func(void *userdata) {
 
 pa_thread* pa_thread_new(const char *name, pa_thread_func_t thread_func, void *userdata) {
     pa_thread *t;
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+    pthread_attr_t attr;
+#endif
+    pthread_attr_t *a = NULL;
+    int r;
 
     pa_assert(thread_func);
 
@@ -94,7 +114,20 @@ pa_thread* pa_thread_new(const char *name, pa_thread_func_t thread_func, void *u
     t->thread_func = thread_func;
     t->userdata = userdata;
 
-    if (pthread_create(&t->id, NULL, internal_thread_func, t) < 0) {
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+    if (default_affinity_set) {
+        pa_assert_se(pthread_attr_init(&attr) == 0);
+        pa_assert_se(pthread_attr_setaffinity_np(&attr, sizeof(default_affinity), &default_affinity) == 0);
+        a = &attr;
+    }
+#endif
+
+    r = pthread_create(&t->id, a, internal_thread_func, t);
+
+    if (a)
+        pthread_attr_destroy(a);
+
+    if (r != 0) {
         pa_xfree(t);
         return NULL;
     }
@@ -211,6 +244,60 @@ const char *pa_thread_get_name(pa_thread *t) {
     return t->name;
 }
 
+int pa_thread_set_affinity(pa_thread *t, const pa_cpu_set *cpus) {
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+    cpu_set_t mask;
+    int r;
+
+    pa_assert(cpus);
+
+    cpu_set_to_mask(cpus, &mask);
+
+    if ((r = pthread_setaffinity_np(t ? t->id : pthread_self(), sizeof(mask), &mask)) != 0) {
+        errno = r;
+        return -1;
+    }
+
+    return 0;
+#else
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+int pa_thread_get_affinity(pa_thread *t, pa_cpu_set *cpus) {
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+    cpu_set_t mask;
+    unsigned cpu;
+    int r;
+
+    pa_assert(cpus);
+
+    if ((r = pthread_getaffinity_np(t ? t->id : pthread_self(), sizeof(mask), &mask)) != 0) {
+        errno = r;
+        return -1;
+    }
+
+    pa_cpu_set_clear(cpus);
+
+    for (cpu = 0; cpu < PA_CPU_SET_MAX && cpu < CPU_SETSIZE; cpu++)
+        if (CPU_ISSET(cpu, &mask))
+            pa_cpu_set_add(cpus, cpu);
+
+    return 0;
+#else
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+void pa_thread_set_default_affinity(const pa_cpu_set *cpus) {
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+    if ((default_affinity_set = !!cpus))
+        cpu_set_to_mask(cpus, &default_affinity);
+#endif
+}
+
 void pa_thread_yield(void) {
 #ifdef HAVE_PTHREAD_YIELD
     pthread_yield();
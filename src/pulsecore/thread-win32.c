@@ -149,6 +149,20 @@ const char *pa_thread_get_name(pa_thread *t) {
     return NULL;
 }
 
+int pa_thread_set_affinity(pa_thread *t, const pa_cpu_set *cpus) {
+    /* Not implemented */
+    return -1;
+}
+
+int pa_thread_get_affinity(pa_thread *t, pa_cpu_set *cpus) {
+    /* Not implemented */
+    return -1;
+}
+
+void pa_thread_set_default_affinity(const pa_cpu_set *cpus) {
+    /* Not implemented */
+}
+
 void pa_thread_yield(void) {
     Sleep(0);
 }
@@ -49,6 +49,17 @@ void pa_thread_set_data(pa_thread *t, void *userdata);
 const char *pa_thread_get_name(pa_thread *t);
 void pa_thread_set_name(pa_thread *t, const char *name);
 
+/* Restrict the thread to the given CPUs, or return the CPUs it may
+ * run on. NULL for t means the calling thread. Both return negative if
+ * thread affinity is not supported. */
+int pa_thread_set_affinity(pa_thread *t, const pa_cpu_set *cpus);
+int pa_thread_get_affinity(pa_thread *t, pa_cpu_set *cpus);
+
+/* Threads created by pa_thread_new() inherit the affinity of their
+ * creator. After this call they start on the given CPUs instead, NULL
+ * goes back to inheriting. */
+void pa_thread_set_default_affinity(const pa_cpu_set *cpus);
+
 typedef struct pa_tls pa_tls;
 
 pa_tls* pa_tls_new(pa_free_cb_t free_cb);
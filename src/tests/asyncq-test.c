@@ -87,6 +87,71 @@ START_TEST (asyncq_test) {
 }
 END_TEST
 
+#define MP_PRODUCERS 4
+#define MP_ITEMS 100000
+
+struct mp_producer {
+    pa_asyncq *q;
+    unsigned id;
+};
+
+static void mp_producer(void *_p) {
+    struct mp_producer *p = _p;
+    unsigned i;
+
+    /* Item values encode the producer and a sequence number, starting at 1 */
+    for (i = 1; i <= MP_ITEMS; i++)
+        fail_unless(pa_asyncq_push(p->q, PA_UINT_TO_PTR(p->id * MP_ITEMS + i), false) == 0);
+}
+
+START_TEST (asyncq_mp_test) {
+    struct mp_producer p[MP_PRODUCERS];
+    pa_thread *t[MP_PRODUCERS];
+    unsigned last[MP_PRODUCERS] = { 0 };
+    unsigned i, n = 0;
+    pa_asyncq *q;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    q = pa_asyncq_new_mp();
+    fail_unless(q != NULL);
+
+    for (i = 0; i < MP_PRODUCERS; i++) {
+        p[i].q = q;
+        p[i].id = i;
+        t[i] = pa_thread_new("producer", mp_producer, &p[i]);
+        fail_unless(t[i] != NULL);
+    }
+
+    /* Every item arrives exactly once, in order per producer */
+    while (n < MP_PRODUCERS * MP_ITEMS) {
+        unsigned v = PA_PTR_TO_UINT(pa_asyncq_pop(q, true));
+
+        fail_unless(v > 0);
+        v--;
+        fail_unless(v / MP_ITEMS < MP_PRODUCERS);
+        fail_unless(v % MP_ITEMS == last[v / MP_ITEMS]);
+        last[v / MP_ITEMS]++;
+        n++;
+    }
+
+    fail_unless(pa_asyncq_pop(q, false) == NULL);
+    fail_unless(pa_asyncq_read_before_poll(q) == 0);
+    pa_asyncq_read_after_poll(q);
+
+    for (i = 0; i < MP_PRODUCERS; i++)
+        pa_thread_free(t[i]);
+
+    /* Never full, so nothing ever needs to be queued locally */
+    for (i = 0; i < 1000; i++)
+        pa_asyncq_post(q, PA_UINT_TO_PTR(i + 1));
+    fail_unless(pa_asyncq_read_before_poll(q) < 0);
+
+    pa_asyncq_free(q, NULL);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -96,6 +161,7 @@ int main(int argc, char *argv[]) {
     s = suite_create("Async Queue");
     tc = tcase_create("asyncq");
     tcase_add_test(tc, asyncq_test);
+    tcase_add_test(tc, asyncq_mp_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -312,6 +312,38 @@ START_TEST (test_unescape) {
 }
 END_TEST
 
+START_TEST (test_cpu_set) {
+    pa_cpu_set set;
+    char *value;
+
+    ck_assert_int_eq(pa_cpu_set_parse(&set, "0-3,6"), 0);
+    ck_assert_int_eq(pa_cpu_set_count(&set), 5);
+    ck_assert(pa_cpu_set_contains(&set, 3));
+    ck_assert(!pa_cpu_set_contains(&set, 4));
+    ck_assert_int_eq(pa_cpu_set_nth(&set, 4), 6);
+    ck_assert_int_eq(pa_cpu_set_nth(&set, 5), 0);
+
+    value = pa_cpu_set_to_string(&set);
+    ck_assert_str_eq(value, "0-3,6");
+    pa_xfree(value);
+
+    ck_assert_int_eq(pa_cpu_set_parse(&set, " 7 , 1-2 "), 0);
+    value = pa_cpu_set_to_string(&set);
+    ck_assert_str_eq(value, "1-2,7");
+    pa_xfree(value);
+
+    ck_assert_int_lt(pa_cpu_set_parse(&set, ""), 0);
+    ck_assert_int_lt(pa_cpu_set_parse(&set, "3-1"), 0);
+    ck_assert_int_lt(pa_cpu_set_parse(&set, "1,,2"), 0);
+    ck_assert_int_lt(pa_cpu_set_parse(&set, "x"), 0);
+    ck_assert_int_lt(pa_cpu_set_parse(&set, "1024"), 0);
+
+    pa_cpu_set_clear(&set);
+    ck_assert_int_eq(pa_cpu_set_count(&set), 0);
+    ck_assert_int_eq(pa_cpu_set_nth(&set, 0), -1);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -340,6 +372,7 @@ int main(int argc, char *argv[]) {
     tcase_add_test_raise_signal(tc, test_replace_fail_4, SIGABRT);
     tcase_add_test(tc, test_escape);
     tcase_add_test(tc, test_unescape);
+    tcase_add_test(tc, test_cpu_set);
 
     sr = srunner_create(s);
     srunner_run_all(sr, CK_NORMAL);
@@ -20,9 +20,11 @@
 #endif
 
 #include <check.h>
+#include <math.h>
 
 #include <pulsecore/cpu.h>
 #include <pulsecore/cpu-arm.h>
+#include <pulsecore/cpu-x86.h>
 #include <pulsecore/random.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/mix.h>
@@ -32,6 +34,8 @@
 #define SAMPLES 1028
 #define TIMES 1000
 #define TIMES2 100
+#define MAX_STREAMS 8
+#define MAX_CHANNELS 6
 
 static void acquire_mix_streams(pa_mix_info streams[], unsigned nstreams) {
     unsigned i;
@@ -145,6 +149,126 @@ static void run_mix_test(
     pa_mempool_unref(pool);
 }
 
+static void run_mix_format_test(
+        pa_do_mix_func_t func,
+        pa_do_mix_func_t orig_func,
+        pa_sample_format_t format,
+        unsigned nstreams,
+        int align,
+        int channels,
+        bool correct,
+        bool perf) {
+
+    PA_DECLARE_ALIGNED(8, uint8_t, in[MAX_STREAMS][SAMPLES * MAX_CHANNELS * 4]) = { { 0 } };
+    PA_DECLARE_ALIGNED(8, uint8_t, out[SAMPLES * MAX_CHANNELS * 4]) = { 0 };
+    PA_DECLARE_ALIGNED(8, uint8_t, out_ref[SAMPLES * MAX_CHANNELS * 4]) = { 0 };
+    size_t ss = pa_sample_size_of_format(format);
+    uint8_t *samples, *samples_ref;
+    int nsamples;
+    pa_mempool *pool;
+    pa_mix_info m[MAX_STREAMS];
+    unsigned k;
+    int i;
+
+    pa_assert(nstreams <= MAX_STREAMS);
+    pa_assert(channels <= MAX_CHANNELS);
+
+    /* Force sample alignment as requested */
+    samples = out + (8 - align) * ss;
+    samples_ref = out_ref + (8 - align) * ss;
+    nsamples = channels * (SAMPLES - (8 - align));
+
+    fail_unless((pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true)) != NULL);
+
+    for (k = 0; k < nstreams; k++) {
+        void *d = in[k] + (8 - align) * ss;
+
+        if (format == PA_SAMPLE_FLOAT32NE) {
+            float *f = d;
+
+            for (i = 0; i < nsamples; i++)
+                f[i] = (float) (rand() - RAND_MAX / 2) / (RAND_MAX / 2);
+        } else
+            pa_random(d, nsamples * ss);
+
+        m[k].chunk.memblock = pa_memblock_new_fixed(pool, d, nsamples * ss, false);
+        m[k].chunk.length = pa_memblock_get_length(m[k].chunk.memblock);
+        m[k].chunk.index = 0;
+
+        m[k].volume.channels = channels;
+        for (i = 0; i < channels; i++) {
+            m[k].volume.values[i] = PA_VOLUME_NORM;
+            if (format == PA_SAMPLE_FLOAT32NE)
+                m[k].linear[i].f = (float) (rand() % 0x18000) / 0x10000;
+            else
+                m[k].linear[i].i = rand() % 0x18000;
+        }
+    }
+
+    if (correct) {
+        acquire_mix_streams(m, nstreams);
+        orig_func(m, nstreams, channels, samples_ref, nsamples * ss);
+        release_mix_streams(m, nstreams);
+
+        acquire_mix_streams(m, nstreams);
+        func(m, nstreams, channels, samples, nsamples * ss);
+        release_mix_streams(m, nstreams);
+
+        for (i = 0; i < nsamples; i++) {
+            bool equal;
+
+            /* The compiler may contract float multiply-adds differently */
+            if (format == PA_SAMPLE_FLOAT32NE)
+                equal = fabsf(((float *) samples)[i] - ((float *) samples_ref)[i]) <= 0.0001f;
+            else
+                equal = memcmp(samples + i * ss, samples_ref + i * ss, ss) == 0;
+
+            if (!equal) {
+                pa_log_debug("Correctness test failed: format=%s, streams=%u, align=%d, channels=%d",
+                    pa_sample_format_to_string(format), nstreams, align, channels);
+                pa_log_debug("%d: %08x != %08x", i, *(uint32_t *) (samples + i * ss) & (ss == 2 ? 0xffff : ~0U),
+                    *(uint32_t *) (samples_ref + i * ss) & (ss == 2 ? 0xffff : ~0U));
+                ck_abort();
+            }
+        }
+    }
+
+    if (perf) {
+        pa_log_debug("Testing %d-channel %s mixing performance of %u streams with %d sample alignment",
+            channels, pa_sample_format_to_string(format), nstreams, align);
+
+        PA_RUNTIME_TEST_RUN_START("func", TIMES, TIMES2) {
+            acquire_mix_streams(m, nstreams);
+            func(m, nstreams, channels, samples, nsamples * ss);
+            release_mix_streams(m, nstreams);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig", TIMES, TIMES2) {
+            acquire_mix_streams(m, nstreams);
+            orig_func(m, nstreams, channels, samples_ref, nsamples * ss);
+            release_mix_streams(m, nstreams);
+        } PA_RUNTIME_TEST_RUN_STOP
+    }
+
+    for (k = 0; k < nstreams; k++)
+        pa_memblock_unref(m[k].chunk.memblock);
+
+    pa_mempool_unref(pool);
+}
+
+static void run_mix_format_tests(pa_do_mix_func_t func, pa_do_mix_func_t orig_func, pa_sample_format_t format) {
+    int channels;
+
+    pa_log_debug("Checking %s mix", pa_sample_format_to_string(format));
+
+    for (channels = 1; channels <= MAX_CHANNELS; channels++)
+        run_mix_format_test(func, orig_func, format, 3, 7, channels, true, false);
+    run_mix_format_test(func, orig_func, format, 2, 5, 2, true, false);
+
+    run_mix_format_test(func, orig_func, format, 2, 7, 2, true, true);
+    run_mix_format_test(func, orig_func, format, MAX_STREAMS, 7, 2, true, true);
+}
+
 START_TEST (mix_special_test) {
     pa_cpu_info cpu_info = { PA_CPU_UNDEFINED, {}, false };
     pa_do_mix_func_t orig_func, special_func;
@@ -168,6 +292,72 @@ START_TEST (mix_special_test) {
 }
 END_TEST
 
+#if defined (__i386__) || defined (__amd64__)
+static void run_mix_x86_tests(void (*init)(pa_cpu_x86_flag_t flags), pa_cpu_x86_flag_t flags) {
+    static const pa_sample_format_t formats[] = {
+        PA_SAMPLE_S16NE, PA_SAMPLE_S32NE, PA_SAMPLE_S24_32NE, PA_SAMPLE_FLOAT32NE
+    };
+    pa_cpu_info cpu_info = { PA_CPU_UNDEFINED, {}, true };
+    pa_do_mix_func_t orig_func[PA_ELEMENTSOF(formats)];
+    unsigned i;
+
+    /* Compare against the generic C code, not what was installed before */
+    pa_mix_func_init(&cpu_info);
+
+    for (i = 0; i < PA_ELEMENTSOF(formats); i++)
+        orig_func[i] = pa_get_mix_func(formats[i]);
+
+    init(flags);
+
+    for (i = 0; i < PA_ELEMENTSOF(formats); i++) {
+        pa_do_mix_func_t func = pa_get_mix_func(formats[i]);
+
+        if (func == orig_func[i])
+            continue;
+
+        run_mix_format_tests(func, orig_func[i], formats[i]);
+
+        if (formats[i] == PA_SAMPLE_S16NE) {
+            run_mix_test(func, orig_func[i], 7, 2, true, true);
+            run_mix_test(func, orig_func[i], 7, 4, true, true);
+            run_mix_test(func, orig_func[i], 7, 1, true, true);
+        }
+
+        pa_set_mix_func(formats[i], orig_func[i]);
+    }
+}
+
+START_TEST (mix_sse2_test) {
+    pa_cpu_x86_flag_t flags = 0;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_SSE2)) {
+        pa_log_info("SSE2 not supported. Skipping");
+        return;
+    }
+
+    pa_log_debug("Checking SSE2 mix");
+    run_mix_x86_tests(pa_mix_func_init_sse, flags);
+}
+END_TEST
+
+START_TEST (mix_avx2_test) {
+    pa_cpu_x86_flag_t flags = 0;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_AVX2)) {
+        pa_log_info("AVX2 not supported. Skipping");
+        return;
+    }
+
+    pa_log_debug("Checking AVX2 mix");
+    run_mix_x86_tests(pa_mix_func_init_avx2, flags);
+}
+END_TEST
+#endif /* defined (__i386__) || defined (__amd64__) */
+
 #if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
 START_TEST (mix_neon_test) {
     pa_do_mix_func_t orig_func, neon_func;
@@ -209,6 +399,14 @@ int main(int argc, char *argv[]) {
 
     tc = tcase_create("mix");
     tcase_add_test(tc, mix_special_test);
+#if defined (__i386__) || defined (__amd64__)
+#ifdef HAVE_SSE2
+    tcase_add_test(tc, mix_sse2_test);
+#endif
+#ifdef HAVE_AVX2
+    tcase_add_test(tc, mix_avx2_test);
+#endif
+#endif
 #if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
     tcase_add_test(tc, mix_neon_test);
 #endif
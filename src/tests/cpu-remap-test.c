@@ -284,6 +284,49 @@ static void remap_init_test_channels(
     remap_test_channels(&remap_func, &remap_orig);
 }
 
+/* 5.1 to stereo or mono downmix, LFE is not used */
+static void setup_remap_downmix(pa_remap_t *m, pa_sample_format_t f, unsigned out_channels) {
+    static const float stereo[2][6] = {
+        { 0.5f, 0.0f, 0.354f, 0.0f, 0.354f, 0.0f },
+        { 0.0f, 0.5f, 0.354f, 0.0f, 0.0f, 0.354f },
+    };
+    static const float mono[6] = { 0.25f, 0.25f, 0.177f, 0.0f, 0.177f, 0.177f };
+    unsigned i, o;
+
+    pa_assert(out_channels == 1 || out_channels == 2);
+
+    m->format = f;
+    m->i_ss.channels = 6;
+    m->o_ss.channels = out_channels;
+
+    for (o = 0; o < out_channels; o++) {
+        for (i = 0; i < 6; i++) {
+            m->map_table_f[o][i] = out_channels == 1 ? mono[i] : stereo[o][i];
+            m->map_table_i[o][i] = (int32_t) (m->map_table_f[o][i] * 0x10000);
+        }
+    }
+}
+
+static void remap_init_test_downmix(
+        pa_init_remap_func_t init_func,
+        pa_init_remap_func_t orig_init_func,
+        pa_sample_format_t f,
+        unsigned out_channels) {
+
+    pa_remap_t remap_orig = {0}, remap_func = {0};
+
+    setup_remap_downmix(&remap_orig, f, out_channels);
+    orig_init_func(&remap_orig);
+
+    setup_remap_downmix(&remap_func, f, out_channels);
+    init_func(&remap_func);
+
+    remap_test_channels(&remap_func, &remap_orig);
+
+    pa_xfree(remap_orig.state);
+    pa_xfree(remap_func.state);
+}
+
 static void remap_init2_test_channels(
         pa_sample_format_t f,
         unsigned in_channels,
@@ -384,7 +427,7 @@ START_TEST (remap_mmx_test) {
 END_TEST
 #endif /* (defined (__i386__) || defined (__amd64__)) && defined (HAVE_MMX) */
 
-#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_SSE)
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_SSE2)
 START_TEST (remap_sse2_test) {
     pa_cpu_x86_flag_t flags = 0;
     pa_init_remap_func_t init_func, orig_init_func;
@@ -408,7 +451,79 @@ START_TEST (remap_sse2_test) {
     remap_init_test_channels(init_func, orig_init_func, PA_SAMPLE_S16NE, 1, 2, false);
 }
 END_TEST
-#endif /* (defined (__i386__) || defined (__amd64__)) && defined (HAVE_SSE) */
+
+START_TEST (remap_sse2_matrix_test) {
+    static const unsigned channels[][2] = {
+        { 6, 2 }, { 6, 1 }, { 8, 2 }, { 4, 4 }, { 2, 6 }, { 3, 5 }, { 6, 8 }, { 8, 3 },
+    };
+    static const pa_sample_format_t formats[] = { PA_SAMPLE_FLOAT32NE, PA_SAMPLE_S16NE };
+    pa_cpu_x86_flag_t flags = 0;
+    pa_init_remap_func_t init_func, orig_init_func;
+    unsigned i, j;
+
+    pa_cpu_get_x86_flags(&flags);
+    if (!(flags & PA_CPU_X86_SSE2)) {
+        pa_log_info("SSE2 not supported. Skipping");
+        return;
+    }
+
+    orig_init_func = pa_get_init_remap_func();
+    pa_remap_func_init_sse(flags);
+    init_func = pa_get_init_remap_func();
+
+    for (j = 0; j < PA_ELEMENTSOF(formats); j++) {
+        for (i = 0; i < PA_ELEMENTSOF(channels); i++) {
+            pa_log_debug("Checking SSE2 matrix remap (%s, %u-channel->%u-channel)",
+                pa_sample_format_to_string(formats[j]), channels[i][0], channels[i][1]);
+            remap_init_test_channels(init_func, orig_init_func, formats[j], channels[i][0], channels[i][1], false);
+        }
+
+        pa_log_debug("Checking SSE2 matrix remap (%s, 5.1->stereo downmix)", pa_sample_format_to_string(formats[j]));
+        remap_init_test_downmix(init_func, orig_init_func, formats[j], 2);
+        pa_log_debug("Checking SSE2 matrix remap (%s, 5.1->mono downmix)", pa_sample_format_to_string(formats[j]));
+        remap_init_test_downmix(init_func, orig_init_func, formats[j], 1);
+    }
+}
+END_TEST
+#endif /* (defined (__i386__) || defined (__amd64__)) && defined (HAVE_SSE2) */
+
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX2)
+START_TEST (remap_avx2_test) {
+    pa_cpu_x86_flag_t flags = 0;
+    pa_init_remap_func_t init_func, orig_init_func;
+    pa_remap_t remap_orig = {0}, remap_func = {0};
+
+    pa_cpu_get_x86_flags(&flags);
+    if (!(flags & PA_CPU_X86_AVX2)) {
+        pa_log_info("AVX2 not supported. Skipping");
+        return;
+    }
+
+    /* The previously installed init function may not handle stereo->mono,
+     * so take the reference from pa_init_remap_func() which falls back to C */
+    setup_remap_channels(&remap_orig, PA_SAMPLE_FLOAT32NE, 2, 1, false);
+    pa_init_remap_func(&remap_orig);
+
+    orig_init_func = pa_get_init_remap_func();
+    pa_remap_func_init_avx2(flags);
+    init_func = pa_get_init_remap_func();
+
+    pa_log_debug("Checking AVX2 remap (float, stereo->mono)");
+    setup_remap_channels(&remap_func, PA_SAMPLE_FLOAT32NE, 2, 1, false);
+    pa_init_remap_func(&remap_func);
+    remap_test_channels(&remap_func, &remap_orig);
+
+    pa_log_debug("Checking AVX2 remap (float, mono->stereo)");
+    remap_init_test_channels(init_func, orig_init_func, PA_SAMPLE_FLOAT32NE, 1, 2, false);
+
+    pa_log_debug("Checking AVX2 remap (s32, mono->stereo)");
+    remap_init_test_channels(init_func, orig_init_func, PA_SAMPLE_S32NE, 1, 2, false);
+
+    pa_log_debug("Checking AVX2 remap (s16, mono->stereo)");
+    remap_init_test_channels(init_func, orig_init_func, PA_SAMPLE_S16NE, 1, 2, false);
+}
+END_TEST
+#endif /* (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX2) */
 
 #if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
 START_TEST (remap_neon_test) {
@@ -518,8 +633,12 @@ int main(int argc, char *argv[]) {
 #if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_MMX)
     tcase_add_test(tc, remap_mmx_test);
 #endif
-#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_SSE)
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_SSE2)
     tcase_add_test(tc, remap_sse2_test);
+    tcase_add_test(tc, remap_sse2_matrix_test);
+#endif
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX2)
+    tcase_add_test(tc, remap_avx2_test);
 #endif
 #if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
     tcase_add_test(tc, remap_neon_test);
@@ -20,9 +20,11 @@
 #endif
 
 #include <check.h>
+#include <string.h>
 
 #include <pulsecore/cpu-arm.h>
 #include <pulsecore/cpu-x86.h>
+#include <pulsecore/endianmacros.h>
 #include <pulsecore/random.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/sconv.h>
@@ -83,8 +85,9 @@ static void run_conv_test_float_to_s16(
     }
 }
 
-/* This test is currently only run under NEON */
-#if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
+/* This test is currently only run under NEON and AVX2 */
+#if (defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)) || \
+    ((defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX2))
 static void run_conv_test_s16_to_float(
         pa_convert_func_t func,
         pa_convert_func_t orig_func,
@@ -132,7 +135,118 @@ static void run_conv_test_s16_to_float(
         } PA_RUNTIME_TEST_RUN_STOP
     }
 }
-#endif /* defined (__arm__) && defined (__linux__) && defined (HAVE_NEON) */
+#endif /* (defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)) || ... */
+
+#if (defined (__i386__) || defined (__amd64__)) && (defined (HAVE_SSE2) || defined (HAVE_AVX2))
+/* Conversions between float32ne and every other linear format, in both
+ * directions. The optimized functions must match the generic ones exactly. */
+static const pa_sample_format_t float_formats[] = {
+    PA_SAMPLE_S16LE, PA_SAMPLE_S16BE,
+    PA_SAMPLE_S24LE, PA_SAMPLE_S24BE,
+    PA_SAMPLE_S24_32LE, PA_SAMPLE_S24_32BE,
+    PA_SAMPLE_S32LE, PA_SAMPLE_S32BE,
+    PA_SAMPLE_FLOAT32RE,
+};
+
+static void run_conv_test_float_formats(
+        pa_sample_format_t format,
+        bool to_float,
+        pa_convert_func_t func,
+        pa_convert_func_t orig_func,
+        int align,
+        bool correct,
+        bool perf) {
+
+    PA_DECLARE_ALIGNED(8, uint8_t, in_buf[SAMPLES * 4]);
+    PA_DECLARE_ALIGNED(8, uint8_t, out_buf[SAMPLES * 4]) = { 0 };
+    PA_DECLARE_ALIGNED(8, uint8_t, out_ref_buf[SAMPLES * 4]) = { 0 };
+    pa_sample_format_t in_format, out_format;
+    size_t in_size, out_size;
+    uint8_t *in, *out, *out_ref;
+    int i, nsamples;
+
+    in_format = to_float ? format : PA_SAMPLE_FLOAT32NE;
+    out_format = to_float ? PA_SAMPLE_FLOAT32NE : format;
+    in_size = pa_sample_size_of_format(in_format);
+    out_size = pa_sample_size_of_format(out_format);
+
+    /* Force sample alignment as requested */
+    in = in_buf + (8 - align) * in_size;
+    out = out_buf + (8 - align) * out_size;
+    out_ref = out_ref_buf + (8 - align) * out_size;
+    nsamples = SAMPLES - (8 - align);
+
+    if (in_format == PA_SAMPLE_FLOAT32NE || in_format == PA_SAMPLE_FLOAT32RE) {
+        for (i = 0; i < nsamples; i++) {
+            /* Some samples clip */
+            float f = 2.1f * (rand()/(float) RAND_MAX - 0.5f);
+
+            if (in_format == PA_SAMPLE_FLOAT32RE)
+                PA_WRITE_FLOAT32RE(in + i * in_size, f);
+            else
+                memcpy(in + i * in_size, &f, sizeof(f));
+        }
+    } else
+        pa_random(in, nsamples * in_size);
+
+    if (correct) {
+        orig_func(nsamples, in, out_ref);
+        func(nsamples, in, out);
+
+        for (i = 0; i < nsamples; i++) {
+            if (memcmp(out + i * out_size, out_ref + i * out_size, out_size)) {
+                uint32_t v = 0, v_ref = 0;
+
+                memcpy(&v, out + i * out_size, out_size);
+                memcpy(&v_ref, out_ref + i * out_size, out_size);
+
+                pa_log_debug("Correctness test failed: %s -> %s, align=%d",
+                             pa_sample_format_to_string(in_format), pa_sample_format_to_string(out_format), align);
+                pa_log_debug("%d: %08x != %08x\n", i, v, v_ref);
+                ck_abort();
+            }
+        }
+    }
+
+    if (perf) {
+        pa_log_debug("Testing sconv performance of %s -> %s with %d sample alignment",
+                     pa_sample_format_to_string(in_format), pa_sample_format_to_string(out_format), align);
+
+        PA_RUNTIME_TEST_RUN_START("func", TIMES, TIMES2) {
+            func(nsamples, in, out);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig", TIMES, TIMES2) {
+            orig_func(nsamples, in, out_ref);
+        } PA_RUNTIME_TEST_RUN_STOP
+    }
+}
+
+static void run_conv_tests_float_formats(void (*init_func)(pa_cpu_x86_flag_t flags), pa_cpu_x86_flag_t flags) {
+    pa_convert_func_t orig_to[PA_ELEMENTSOF(float_formats)], orig_from[PA_ELEMENTSOF(float_formats)];
+    unsigned i;
+    int align;
+
+    for (i = 0; i < PA_ELEMENTSOF(float_formats); i++) {
+        orig_to[i] = pa_get_convert_to_float32ne_function(float_formats[i]);
+        orig_from[i] = pa_get_convert_from_float32ne_function(float_formats[i]);
+    }
+
+    init_func(flags);
+
+    for (i = 0; i < PA_ELEMENTSOF(float_formats); i++) {
+        pa_convert_func_t to = pa_get_convert_to_float32ne_function(float_formats[i]);
+        pa_convert_func_t from = pa_get_convert_from_float32ne_function(float_formats[i]);
+
+        for (align = 0; align < 8; align++) {
+            if (to != orig_to[i])
+                run_conv_test_float_formats(float_formats[i], true, to, orig_to[i], align, true, align == 7);
+            if (from != orig_from[i])
+                run_conv_test_float_formats(float_formats[i], false, from, orig_from[i], align, true, align == 7);
+        }
+    }
+}
+#endif /* (defined (__i386__) || defined (__amd64__)) && (defined (HAVE_SSE2) || defined (HAVE_AVX2)) */
 
 #if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_SSE)
 START_TEST (sconv_sse2_test) {
@@ -190,6 +304,109 @@ START_TEST (sconv_sse_test) {
 END_TEST
 #endif /* (defined (__i386__) || defined (__amd64__)) && defined (HAVE_SSE) */
 
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_SSE2)
+START_TEST (sconv_sse2_formats_test) {
+    pa_cpu_x86_flag_t flags = 0;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_SSE2)) {
+        pa_log_info("SSE2 not supported. Skipping");
+        return;
+    }
+
+    pa_log_debug("Checking SSE2 sconv (float <-> s16/s24/s24-32/s32/float32re)");
+    run_conv_tests_float_formats(pa_convert_func_init_sse2, flags);
+}
+END_TEST
+#endif /* (defined (__i386__) || defined (__amd64__)) && defined (HAVE_SSE2) */
+
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX2)
+START_TEST (sconv_avx2_test) {
+    pa_cpu_x86_flag_t flags = 0;
+    pa_convert_func_t orig_from_func, avx2_from_func;
+    pa_convert_func_t orig_to_func, avx2_to_func;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_AVX2)) {
+        pa_log_info("AVX2 not supported. Skipping");
+        return;
+    }
+
+    orig_from_func = pa_get_convert_from_float32ne_function(PA_SAMPLE_S16LE);
+    orig_to_func = pa_get_convert_to_float32ne_function(PA_SAMPLE_S16LE);
+    pa_convert_func_init_avx2(flags);
+    avx2_from_func = pa_get_convert_from_float32ne_function(PA_SAMPLE_S16LE);
+    avx2_to_func = pa_get_convert_to_float32ne_function(PA_SAMPLE_S16LE);
+
+    pa_log_debug("Checking AVX2 sconv (float -> s16)");
+    run_conv_test_float_to_s16(avx2_from_func, orig_from_func, 0, true, false);
+    run_conv_test_float_to_s16(avx2_from_func, orig_from_func, 1, true, false);
+    run_conv_test_float_to_s16(avx2_from_func, orig_from_func, 2, true, false);
+    run_conv_test_float_to_s16(avx2_from_func, orig_from_func, 3, true, false);
+    run_conv_test_float_to_s16(avx2_from_func, orig_from_func, 4, true, false);
+    run_conv_test_float_to_s16(avx2_from_func, orig_from_func, 5, true, false);
+    run_conv_test_float_to_s16(avx2_from_func, orig_from_func, 6, true, false);
+    run_conv_test_float_to_s16(avx2_from_func, orig_from_func, 7, true, true);
+
+    pa_log_debug("Checking AVX2 sconv (s16 -> float)");
+    run_conv_test_s16_to_float(avx2_to_func, orig_to_func, 0, true, false);
+    run_conv_test_s16_to_float(avx2_to_func, orig_to_func, 1, true, false);
+    run_conv_test_s16_to_float(avx2_to_func, orig_to_func, 2, true, false);
+    run_conv_test_s16_to_float(avx2_to_func, orig_to_func, 3, true, false);
+    run_conv_test_s16_to_float(avx2_to_func, orig_to_func, 4, true, false);
+    run_conv_test_s16_to_float(avx2_to_func, orig_to_func, 5, true, false);
+    run_conv_test_s16_to_float(avx2_to_func, orig_to_func, 6, true, false);
+    run_conv_test_s16_to_float(avx2_to_func, orig_to_func, 7, true, true);
+}
+END_TEST
+
+START_TEST (sconv_avx2_formats_test) {
+    pa_cpu_x86_flag_t flags = 0;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_AVX2)) {
+        pa_log_info("AVX2 not supported. Skipping");
+        return;
+    }
+
+    pa_log_debug("Checking AVX2 sconv (float <-> s16/s24/s24-32/s32/float32re)");
+    run_conv_tests_float_formats(pa_convert_func_init_avx2, flags);
+}
+END_TEST
+#endif /* (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX2) */
+
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX512)
+START_TEST (sconv_avx512_test) {
+    pa_cpu_x86_flag_t flags = 0;
+    pa_convert_func_t orig_func, avx512_func;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_AVX512F)) {
+        pa_log_info("AVX-512F not supported. Skipping");
+        return;
+    }
+
+    orig_func = pa_get_convert_from_float32ne_function(PA_SAMPLE_S16LE);
+    pa_convert_func_init_avx512(flags);
+    avx512_func = pa_get_convert_from_float32ne_function(PA_SAMPLE_S16LE);
+
+    pa_log_debug("Checking AVX-512 sconv (float -> s16)");
+    run_conv_test_float_to_s16(avx512_func, orig_func, 0, true, false);
+    run_conv_test_float_to_s16(avx512_func, orig_func, 1, true, false);
+    run_conv_test_float_to_s16(avx512_func, orig_func, 2, true, false);
+    run_conv_test_float_to_s16(avx512_func, orig_func, 3, true, false);
+    run_conv_test_float_to_s16(avx512_func, orig_func, 4, true, false);
+    run_conv_test_float_to_s16(avx512_func, orig_func, 5, true, false);
+    run_conv_test_float_to_s16(avx512_func, orig_func, 6, true, false);
+    run_conv_test_float_to_s16(avx512_func, orig_func, 7, true, true);
+}
+END_TEST
+#endif /* (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX512) */
+
 #if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
 START_TEST (sconv_neon_test) {
     pa_cpu_arm_flag_t flags = 0;
@@ -248,9 +465,21 @@ int main(int argc, char *argv[]) {
     tcase_add_test(tc, sconv_sse2_test);
     tcase_add_test(tc, sconv_sse_test);
 #endif
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_SSE2)
+    tcase_add_test(tc, sconv_sse2_formats_test);
+#endif
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX2)
+    tcase_add_test(tc, sconv_avx2_test);
+    tcase_add_test(tc, sconv_avx2_formats_test);
+#endif
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX512)
+    tcase_add_test(tc, sconv_avx512_test);
+#endif
 #if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
     tcase_add_test(tc, sconv_neon_test);
 #endif
+    /* Ensure that the runtime tests don't time out */
+    tcase_set_timeout(tc, 120);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -20,12 +20,14 @@
 #endif
 
 #include <check.h>
+#include <math.h>
 
 #include <pulsecore/cpu-arm.h>
 #include <pulsecore/cpu-x86.h>
 #include <pulsecore/cpu-orc.h>
 #include <pulsecore/random.h>
 #include <pulsecore/macro.h>
+#include <pulsecore/endianmacros.h>
 #include <pulsecore/sample-util.h>
 
 #include "runtime-test-util.h"
@@ -99,6 +101,143 @@ static void run_volume_test(
     }
 }
 
+/* For float32ne and float32re (with swap set) */
+static void run_volume_float_test(
+        pa_do_volume_func_t func,
+        pa_do_volume_func_t orig_func,
+        int align,
+        int channels,
+        bool swap,
+        bool correct,
+        bool perf) {
+    fail_unless(align % channels == 0);
+
+    PA_DECLARE_ALIGNED(8, float, s[SAMPLES]) = { 0 };
+    PA_DECLARE_ALIGNED(8, float, s_ref[SAMPLES]) = { 0 };
+    PA_DECLARE_ALIGNED(8, float, s_orig[SAMPLES]) = { 0 };
+    float volumes[channels + PADDING];
+    float *samples, *samples_ref, *samples_orig;
+    int i, padding, nsamples, size;
+
+    /* Force sample alignment as requested */
+    samples = s + (8 - align);
+    samples_ref = s_ref + (8 - align);
+    samples_orig = s_orig + (8 - align);
+    nsamples = SAMPLES - (8 - align);
+    size = nsamples * sizeof(float);
+
+    for (i = 0; i < nsamples; i++) {
+        float v = 2.1f * (rand()/(float) RAND_MAX - 0.5f);
+
+        if (swap)
+            PA_WRITE_FLOAT32RE(samples + i, v);
+        else
+            samples[i] = v;
+    }
+    memcpy(samples_ref, samples, size);
+    memcpy(samples_orig, samples, size);
+
+    for (i = 0; i < channels; i++)
+        volumes[i] = 2.0f * rand()/(float) RAND_MAX;
+    for (padding = 0; padding < PADDING; padding++, i++)
+        volumes[i] = volumes[padding];
+
+    if (correct) {
+        orig_func(samples_ref, volumes, channels, size);
+        func(samples, volumes, channels, size);
+
+        for (i = 0; i < nsamples; i++) {
+            float a = swap ? PA_READ_FLOAT32RE(samples + i) : samples[i];
+            float b = swap ? PA_READ_FLOAT32RE(samples_ref + i) : samples_ref[i];
+
+            if (fabsf(a - b) > 0.0001f) {
+                pa_log_debug("Correctness test failed: align=%d, channels=%d", align, channels);
+                pa_log_debug("%d: %.24f != %.24f (%.24f)", i, a, b, volumes[i % channels]);
+                ck_abort();
+            }
+        }
+    }
+
+    if (perf) {
+        pa_log_debug("Testing svolume %dch performance with %d sample alignment", channels, align);
+
+        PA_RUNTIME_TEST_RUN_START("func", TIMES, TIMES2) {
+            memcpy(samples, samples_orig, size);
+            func(samples, volumes, channels, size);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig", TIMES, TIMES2) {
+            memcpy(samples_ref, samples_orig, size);
+            orig_func(samples_ref, volumes, channels, size);
+        } PA_RUNTIME_TEST_RUN_STOP
+    }
+}
+
+/* For s32ne and s24_32ne */
+static void run_volume_s32_test(
+        pa_do_volume_func_t func,
+        pa_do_volume_func_t orig_func,
+        int align,
+        int channels,
+        bool correct,
+        bool perf) {
+    fail_unless(align % channels == 0);
+
+    PA_DECLARE_ALIGNED(8, int32_t, s[SAMPLES]) = { 0 };
+    PA_DECLARE_ALIGNED(8, int32_t, s_ref[SAMPLES]) = { 0 };
+    PA_DECLARE_ALIGNED(8, int32_t, s_orig[SAMPLES]) = { 0 };
+    int32_t volumes[channels + PADDING];
+    int32_t *samples, *samples_ref, *samples_orig;
+    int i, padding, nsamples, size;
+
+    /* Force sample alignment as requested */
+    samples = s + (8 - align);
+    samples_ref = s_ref + (8 - align);
+    samples_orig = s_orig + (8 - align);
+    nsamples = SAMPLES - (8 - align);
+    size = nsamples * sizeof(int32_t);
+
+    pa_random(samples, size);
+    memcpy(samples_ref, samples, size);
+    memcpy(samples_orig, samples, size);
+
+    /* Volumes up to 4.0, so that saturation is covered as well */
+    for (i = 0; i < channels; i++)
+        volumes[i] = PA_CLAMP_VOLUME((pa_volume_t)(rand() >> 13));
+    for (padding = 0; padding < PADDING; padding++, i++)
+        volumes[i] = volumes[padding];
+
+    if (correct) {
+        orig_func(samples_ref, volumes, channels, size);
+        func(samples, volumes, channels, size);
+
+        for (i = 0; i < nsamples; i++) {
+            if (samples[i] != samples_ref[i]) {
+                pa_log_debug("Correctness test failed: align=%d, channels=%d", align, channels);
+                pa_log_debug("%d: %08x != %08x (%08x * %08x)", i, samples[i], samples_ref[i],
+                        samples_orig[i], volumes[i % channels]);
+                ck_abort();
+            }
+        }
+    }
+
+    if (perf) {
+        pa_log_debug("Testing svolume %dch performance with %d sample alignment", channels, align);
+
+        PA_RUNTIME_TEST_RUN_START("func", TIMES, TIMES2) {
+            memcpy(samples, samples_orig, size);
+            func(samples, volumes, channels, size);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig", TIMES, TIMES2) {
+            memcpy(samples_ref, samples_orig, size);
+            orig_func(samples_ref, volumes, channels, size);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        fail_unless(memcmp(samples_ref, samples, size) == 0);
+    }
+}
+
 #if defined (__i386__) || defined (__amd64__)
 START_TEST (svolume_mmx_test) {
     pa_do_volume_func_t orig_func, mmx_func;
@@ -153,6 +292,132 @@ START_TEST (svolume_sse_test) {
     run_volume_test(sse_func, orig_func, 6, 3, true, true);
 }
 END_TEST
+
+START_TEST (svolume_sse_32bit_test) {
+    pa_do_volume_func_t orig_func[4], sse_func[4];
+    const pa_sample_format_t formats[4] = {
+        PA_SAMPLE_FLOAT32NE, PA_SAMPLE_FLOAT32RE, PA_SAMPLE_S32NE, PA_SAMPLE_S24_32NE
+    };
+    pa_cpu_x86_flag_t flags = 0;
+    int i, j, f;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_SSE2)) {
+        pa_log_info("SSE2 not supported. Skipping");
+        return;
+    }
+
+    for (f = 0; f < 4; f++)
+        orig_func[f] = pa_get_volume_func(formats[f]);
+    pa_volume_func_init_sse(flags);
+    for (f = 0; f < 4; f++)
+        sse_func[f] = pa_get_volume_func(formats[f]);
+
+    for (f = 0; f < 4; f++) {
+        pa_log_debug("Checking SSE2 svolume (%s)", pa_sample_format_to_string(formats[f]));
+
+        for (i = 1; i <= 6; i++) {
+            for (j = 0; j < 7; j += i) {
+                if (f < 2)
+                    run_volume_float_test(sse_func[f], orig_func[f], j, i, f == 1, true, false);
+                else
+                    run_volume_s32_test(sse_func[f], orig_func[f], j, i, true, false);
+            }
+        }
+
+        if (f < 2) {
+            run_volume_float_test(sse_func[f], orig_func[f], 7, 1, f == 1, true, true);
+            run_volume_float_test(sse_func[f], orig_func[f], 6, 2, f == 1, true, true);
+        } else {
+            run_volume_s32_test(sse_func[f], orig_func[f], 7, 1, true, true);
+            run_volume_s32_test(sse_func[f], orig_func[f], 6, 2, true, true);
+        }
+    }
+}
+END_TEST
+
+#ifdef HAVE_AVX2
+START_TEST (svolume_avx2_test) {
+    pa_do_volume_func_t orig_func, orig_re_func, avx2_func, avx2_re_func;
+    pa_cpu_x86_flag_t flags = 0;
+    int i, j;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_AVX2)) {
+        pa_log_info("AVX2 not supported. Skipping");
+        return;
+    }
+
+    orig_func = pa_get_volume_func(PA_SAMPLE_S16NE);
+    orig_re_func = pa_get_volume_func(PA_SAMPLE_S16RE);
+    pa_volume_func_init_avx2(flags);
+    avx2_func = pa_get_volume_func(PA_SAMPLE_S16NE);
+    avx2_re_func = pa_get_volume_func(PA_SAMPLE_S16RE);
+
+    pa_log_debug("Checking AVX2 svolume");
+    for (i = 1; i <= 3; i++) {
+        for (j = 0; j < 7; j += i)
+            run_volume_test(avx2_func, orig_func, j, i, true, j == 0);
+    }
+    run_volume_test(avx2_func, orig_func, 0, 5, true, false);
+    run_volume_test(avx2_func, orig_func, 0, 6, true, false);
+    run_volume_test(avx2_func, orig_func, 7, 1, true, true);
+    run_volume_test(avx2_func, orig_func, 6, 2, true, true);
+    run_volume_test(avx2_func, orig_func, 6, 3, true, true);
+
+    pa_log_debug("Checking AVX2 svolume (byte-swapped)");
+    for (i = 1; i <= 3; i++) {
+        for (j = 0; j < 7; j += i)
+            run_volume_test(avx2_re_func, orig_re_func, j, i, true, j == 0);
+    }
+    run_volume_test(avx2_re_func, orig_re_func, 0, 5, true, false);
+    run_volume_test(avx2_re_func, orig_re_func, 0, 6, true, false);
+}
+END_TEST
+#endif /* HAVE_AVX2 */
+
+#ifdef HAVE_AVX512
+START_TEST (svolume_avx512_test) {
+    pa_do_volume_func_t orig_func, orig_re_func, avx512_func, avx512_re_func;
+    pa_cpu_x86_flag_t flags = 0;
+    int i, j;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_AVX512BW)) {
+        pa_log_info("AVX-512BW not supported. Skipping");
+        return;
+    }
+
+    orig_func = pa_get_volume_func(PA_SAMPLE_S16NE);
+    orig_re_func = pa_get_volume_func(PA_SAMPLE_S16RE);
+    pa_volume_func_init_avx512(flags);
+    avx512_func = pa_get_volume_func(PA_SAMPLE_S16NE);
+    avx512_re_func = pa_get_volume_func(PA_SAMPLE_S16RE);
+
+    pa_log_debug("Checking AVX-512 svolume");
+    for (i = 1; i <= 3; i++) {
+        for (j = 0; j < 7; j += i)
+            run_volume_test(avx512_func, orig_func, j, i, true, j == 0);
+    }
+    run_volume_test(avx512_func, orig_func, 0, 5, true, false);
+    run_volume_test(avx512_func, orig_func, 0, 6, true, false);
+    run_volume_test(avx512_func, orig_func, 7, 1, true, true);
+    run_volume_test(avx512_func, orig_func, 6, 2, true, true);
+    run_volume_test(avx512_func, orig_func, 6, 3, true, true);
+
+    pa_log_debug("Checking AVX-512 svolume (byte-swapped)");
+    for (i = 1; i <= 3; i++) {
+        for (j = 0; j < 7; j += i)
+            run_volume_test(avx512_re_func, orig_re_func, j, i, true, j == 0);
+    }
+    run_volume_test(avx512_re_func, orig_re_func, 0, 5, true, false);
+    run_volume_test(avx512_re_func, orig_re_func, 0, 6, true, false);
+}
+END_TEST
+#endif /* HAVE_AVX512 */
 #endif /* defined (__i386__) || defined (__amd64__) */
 
 #if defined (__arm__) && defined (__linux__)
@@ -229,6 +494,13 @@ int main(int argc, char *argv[]) {
 #if defined (__i386__) || defined (__amd64__)
     tcase_add_test(tc, svolume_mmx_test);
     tcase_add_test(tc, svolume_sse_test);
+    tcase_add_test(tc, svolume_sse_32bit_test);
+#ifdef HAVE_AVX2
+    tcase_add_test(tc, svolume_avx2_test);
+#endif
+#ifdef HAVE_AVX512
+    tcase_add_test(tc, svolume_avx512_test);
+#endif
 #endif
 #if defined (__arm__) && defined (__linux__)
     tcase_add_test(tc, svolume_arm_test);
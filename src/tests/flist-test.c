@@ -25,16 +25,94 @@
 
 #include <pulse/util.h>
 #include <pulse/xmalloc.h>
+#include <pulsecore/atomic.h>
 #include <pulsecore/flist.h>
 #include <pulsecore/thread.h>
 #include <pulsecore/log.h>
 #include <pulsecore/core-util.h>
 
 #define THREADS_MAX 20
+#define N_ITEMS 100
 
 static pa_flist *flist;
 static int quit = 0;
 
+static int items[N_ITEMS];
+static pa_atomic_t n_freed = PA_ATOMIC_INIT(0);
+
+static void item_free(void *p) {
+    pa_atomic_inc(&n_freed);
+}
+
+static void push_items_func(void *data) {
+    unsigned i;
+
+    /* Whatever is still cached goes back when the thread exits */
+    for (i = 0; i < N_ITEMS; i++)
+        pa_assert_se(pa_flist_push(data, &items[i]) == 0);
+}
+
+static void pop_items_func(void *data) {
+    unsigned *n = data;
+
+    while (pa_flist_pop(flist))
+        (*n)++;
+}
+
+static void thread_cache_test(void) {
+    const pa_flist_stat *stat;
+    pa_thread *t;
+    unsigned i, n = 0;
+
+    /* Entries pushed by a thread are popped from its cache again, without
+     * touching the shared list */
+    flist = pa_flist_new_with_thread_cache(0, "test", item_free);
+    stat = pa_flist_get_stat(flist);
+
+    for (i = 0; i < 10; i++)
+        pa_assert_se(pa_flist_push(flist, &items[i]) == 0);
+    for (i = 10; i > 0; i--)
+        pa_assert_se(pa_flist_pop(flist) == &items[i - 1]);
+
+    pa_assert_se(pa_atomic_load(&stat->n_shared) == 0);
+
+    /* The hits are accounted for once the cache runs empty */
+    pa_assert_se(!pa_flist_pop(flist));
+    pa_assert_se(pa_atomic_load(&stat->n_hits) == 10);
+    pa_assert_se(pa_atomic_load(&stat->n_shared) == 1);
+    pa_assert_se(pa_atomic_load(&stat->n_misses) == 1);
+
+    /* One thread fills its cache and spills over into the shared list,
+     * another one refills its cache from there and drains it */
+    pa_assert_se(t = pa_thread_new("push", push_items_func, flist));
+    pa_thread_free(t);
+
+    pa_assert_se(t = pa_thread_new("pop", pop_items_func, &n));
+    pa_thread_free(t);
+
+    pa_assert_se(n == N_ITEMS);
+    pa_assert_se(pa_atomic_load(&stat->n_hits) > 10);
+    pa_assert_se(pa_atomic_load(&n_freed) == 0);
+
+    pa_flist_free(flist, item_free);
+
+    /* Entries that don't fit into the shared list when a thread exits are
+     * freed */
+    flist = pa_flist_new_with_thread_cache(4, "test-small", item_free);
+
+    pa_assert_se(t = pa_thread_new("push", push_items_func, flist));
+    pa_thread_free(t);
+
+    for (n = 0; pa_flist_pop(flist); n++)
+        ;
+
+    pa_assert_se(n == 4);
+    pa_assert_se(pa_atomic_load(&n_freed) == N_ITEMS - 4);
+    pa_assert_se(pa_atomic_load(&pa_flist_get_stat(flist)->n_full) > 0);
+
+    pa_flist_free(flist, item_free);
+}
+
 static void spin(void) {
     int k;
 
@@ -82,6 +160,8 @@ int main(int argc, char* argv[]) {
     pa_thread *threads[THREADS_MAX];
     int i;
 
+    thread_cache_test();
+
     flist = pa_flist_new(0);
 
     for (i = 0; i < THREADS_MAX; i++) {
@@ -95,6 +175,10 @@ int main(int argc, char* argv[]) {
     for (i = 0; i < THREADS_MAX; i++)
         pa_thread_free(threads[i]);
 
+    /* Lists without a thread cache keep no statistics */
+    pa_assert_se(pa_atomic_load(&pa_flist_get_stat(flist)->n_shared) == 0);
+    pa_assert_se(pa_atomic_load(&pa_flist_get_stat(flist)->n_contended) == 0);
+
     pa_flist_free(flist, pa_xfree);
 
     return 0;
@@ -0,0 +1,109 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/histogram.h>
+#include <pulsecore/json.h>
+
+START_TEST (histogram_test) {
+    pa_histogram h;
+    unsigned i;
+
+    pa_histogram_reset(&h);
+    ck_assert_int_eq(h.count, 0);
+    ck_assert_int_eq(pa_histogram_percentile(&h, 0.5), 0);
+
+    pa_histogram_add(&h, 0);
+    pa_histogram_add(&h, 1);
+    pa_histogram_add(&h, 3);
+    pa_histogram_add(&h, 4);
+    ck_assert_int_eq(h.buckets[0], 1);
+    ck_assert_int_eq(h.buckets[1], 1);
+    ck_assert_int_eq(h.buckets[2], 1);
+    ck_assert_int_eq(h.buckets[3], 1);
+    ck_assert_int_eq(h.max, 4);
+
+    /* 96 more spans between 64 and 127us */
+    for (i = 0; i < 96; i++)
+        pa_histogram_add(&h, 100);
+
+    ck_assert_int_eq(h.count, 100);
+    ck_assert_int_eq(pa_histogram_percentile(&h, 0.01), 0);
+    ck_assert_int_eq(pa_histogram_percentile(&h, 0.5), 100);
+    ck_assert_int_eq(pa_histogram_percentile(&h, 1), 100);
+
+    pa_histogram_add(&h, 200);
+    ck_assert_int_eq(pa_histogram_percentile(&h, 0.5), 128);
+    ck_assert_int_eq(pa_histogram_percentile(&h, 1), 200);
+
+    /* Everything that is too long ends up in the last bucket */
+    pa_histogram_add(&h, (pa_usec_t) 1 << 40);
+    ck_assert_int_eq(h.buckets[PA_HISTOGRAM_BUCKETS - 1], 1);
+    ck_assert(pa_histogram_percentile(&h, 1) == (pa_usec_t) 1 << 40);
+}
+END_TEST
+
+START_TEST (histogram_json_test) {
+    pa_histogram h;
+    pa_json_encoder *encoder;
+    char *s;
+
+    pa_histogram_reset(&h);
+
+    encoder = pa_json_encoder_new();
+    pa_json_encoder_begin_element_object(encoder);
+    pa_histogram_to_json(&h, encoder, "empty");
+    pa_histogram_add(&h, 2);
+    pa_histogram_add(&h, 3);
+    pa_histogram_to_json(&h, encoder, "two");
+    pa_json_encoder_end_object(encoder);
+    s = pa_json_encoder_to_string_free(encoder);
+
+    ck_assert_str_eq(s, "{"
+        "\"empty\":{\"count\":0,\"max\":0,\"median\":0,\"p99\":0,\"buckets\":[]},"
+        "\"two\":{\"count\":2,\"max\":3,\"median\":3,\"p99\":3,\"buckets\":[0,0,2]}"
+        "}");
+    pa_xfree(s);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    s = suite_create("Histogram");
+    tc = tcase_create("histogram");
+    tcase_add_test(tc, histogram_test);
+    tcase_add_test(tc, histogram_json_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
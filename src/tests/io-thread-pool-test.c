@@ -0,0 +1,282 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+
+#include <pulse/mainloop.h>
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/util.h>
+
+#include <pulsecore/atomic.h>
+#include <pulsecore/core.h>
+#include <pulsecore/io-thread-pool.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/msgobject.h>
+#include <pulsecore/shared.h>
+#include <pulsecore/thread-mq.h>
+
+#define N_CALLS_MAX 16
+#define PING 41
+
+typedef struct test_client {
+    pa_msgobject parent;
+
+    pa_thread_mq thread_mq;
+    pa_io_thread_pool_client *client;
+    unsigned id;
+
+    /* Deadlines relative to the first call, returned one after the other */
+    pa_usec_t delays[N_CALLS_MAX];
+    unsigned n_delays;
+
+    /* Written by the pool thread */
+    pa_usec_t start, deadline;
+    unsigned next_delay;
+    pa_atomic_t n_calls, n_messages, early;
+} test_client;
+
+PA_DEFINE_PRIVATE_CLASS(test_client, pa_msgobject);
+#define TEST_CLIENT(o) (test_client_cast(o))
+
+/* Order in which the clients were called for their deadlines */
+static unsigned order[N_CALLS_MAX];
+static pa_atomic_t n_order = PA_ATOMIC_INIT(0);
+
+static pa_mainloop *mainloop;
+static pa_core *core;
+static pa_module module;
+
+static int client_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
+    test_client *c = TEST_CLIENT(o);
+
+    /* Messages are dispatched by the pool thread */
+    fail_unless(pa_thread_mq_get() != NULL);
+
+    pa_atomic_inc(&c->n_messages);
+
+    return code + 1;
+}
+
+static pa_usec_t client_process(void *userdata) {
+    test_client *c = userdata;
+    pa_usec_t now = pa_rtclock_now();
+
+    if (pa_atomic_inc(&c->n_calls) == 0)
+        c->start = now;
+    else if (c->deadline > 0 && now >= c->deadline) {
+        int k = pa_atomic_inc(&n_order);
+
+        if (k < N_CALLS_MAX)
+            order[k] = c->id;
+
+        c->deadline = 0;
+    } else if (c->deadline > 0)
+        /* Neither the deadline passed nor was there a message */
+        pa_atomic_store(&c->early, 1);
+
+    if (c->deadline == 0 && c->next_delay < c->n_delays)
+        c->deadline = c->start + c->delays[c->next_delay++];
+
+    return c->deadline;
+}
+
+static test_client* client_new(pa_io_thread_pool *p, unsigned id) {
+    test_client *c;
+
+    c = pa_msgobject_new(test_client);
+    c->parent.process_msg = client_process_msg;
+    c->id = id;
+    c->n_delays = 0;
+    c->start = c->deadline = 0;
+    c->next_delay = 0;
+    pa_atomic_store(&c->n_calls, 0);
+    pa_atomic_store(&c->n_messages, 0);
+    pa_atomic_store(&c->early, 0);
+
+    fail_unless(pa_thread_mq_init(&c->thread_mq, pa_mainloop_get_api(mainloop), NULL) == 0);
+    fail_unless((c->client = pa_io_thread_pool_client_new(p, &module, &c->thread_mq, client_process, c)) != NULL);
+
+    return c;
+}
+
+static void client_free(test_client *c) {
+    if (c->client)
+        pa_io_thread_pool_client_free(c->client);
+
+    pa_thread_mq_done(&c->thread_mq);
+    test_client_unref(c);
+}
+
+static void setup(void) {
+    fail_unless((mainloop = pa_mainloop_new()) != NULL);
+    fail_unless((core = pa_core_new(pa_mainloop_get_api(mainloop), false, false, 0)) != NULL);
+
+    pa_zero(module);
+    module.core = core;
+
+    pa_zero(order);
+    pa_atomic_store(&n_order, 0);
+}
+
+static void teardown(void) {
+    pa_core_unref(core);
+    pa_mainloop_free(mainloop);
+}
+
+START_TEST (io_thread_pool_attach_test) {
+    pa_io_thread_pool *p;
+    test_client *c;
+    int n;
+
+    p = pa_io_thread_pool_get(core);
+    fail_unless(pa_io_thread_pool_get(core) == p);
+    pa_io_thread_pool_unref(p);
+
+    c = client_new(p, 0);
+    fail_unless(pa_io_thread_pool_client_get_rtpoll(c->client) != NULL);
+
+    /* Nothing happens before the client is started */
+    pa_msleep(20);
+    fail_unless(pa_atomic_load(&c->n_calls) == 0);
+
+    pa_io_thread_pool_client_start(c->client);
+
+    /* Messages are dispatched, and the client gets processed after each */
+    fail_unless(pa_asyncmsgq_send(c->thread_mq.inq, PA_MSGOBJECT(c), PING, NULL, 0, NULL) == PING + 1);
+    fail_unless(pa_atomic_load(&c->n_messages) == 1);
+
+    while (pa_atomic_load(&c->n_calls) < 2)
+        pa_msleep(1);
+
+    /* No deadline was returned, so there are no more calls after detaching */
+    pa_io_thread_pool_client_free(c->client);
+    c->client = NULL;
+
+    n = pa_atomic_load(&c->n_calls);
+    pa_msleep(20);
+    fail_unless(pa_atomic_load(&c->n_calls) == n);
+
+    client_free(c);
+    pa_io_thread_pool_unref(p);
+}
+END_TEST
+
+START_TEST (io_thread_pool_deadline_test) {
+    pa_io_thread_pool *p;
+    test_client *a, *b;
+    unsigned k;
+
+    p = pa_io_thread_pool_get(core);
+
+    /* Interleaved deadlines, so the calls alternate between the clients
+     * whether they share a thread or not */
+    a = client_new(p, 0);
+    a->delays[0] = 20 * PA_USEC_PER_MSEC;
+    a->delays[1] = 60 * PA_USEC_PER_MSEC;
+    a->n_delays = 2;
+
+    b = client_new(p, 1);
+    b->delays[0] = 40 * PA_USEC_PER_MSEC;
+    b->delays[1] = 80 * PA_USEC_PER_MSEC;
+    b->n_delays = 2;
+
+    pa_io_thread_pool_client_start(a->client);
+    pa_io_thread_pool_client_start(b->client);
+
+    while (pa_atomic_load(&n_order) < 4)
+        pa_msleep(5);
+
+    /* Each client is called once per deadline, never before it */
+    pa_msleep(20);
+    fail_unless(pa_atomic_load(&n_order) == 4);
+    fail_unless(pa_atomic_load(&a->early) == 0);
+    fail_unless(pa_atomic_load(&b->early) == 0);
+
+    for (k = 0; k < 4; k++)
+        fail_unless(order[k] == k % 2);
+
+    client_free(a);
+    client_free(b);
+    pa_io_thread_pool_unref(p);
+}
+END_TEST
+
+START_TEST (io_thread_pool_shutdown_test) {
+    pa_io_thread_pool *p;
+    test_client *c[4];
+    unsigned k;
+
+    p = pa_io_thread_pool_get(core);
+
+    for (k = 0; k < PA_ELEMENTSOF(c); k++) {
+        c[k] = client_new(p, k);
+        c[k]->delays[0] = PA_USEC_PER_SEC;
+        c[k]->n_delays = 1;
+        pa_io_thread_pool_client_start(c[k]->client);
+    }
+
+    for (k = 0; k < PA_ELEMENTSOF(c); k++)
+        fail_unless(pa_asyncmsgq_send(c[k]->thread_mq.inq, PA_MSGOBJECT(c[k]), PING, NULL, 0, NULL) == PING + 1);
+
+    /* Clients with a pending deadline are detached, and dropping the
+     * last reference stops the threads */
+    for (k = 0; k < PA_ELEMENTSOF(c); k++)
+        client_free(c[k]);
+
+    pa_io_thread_pool_unref(p);
+    fail_unless(pa_shared_get(core, "io-thread-pool") == NULL);
+
+    /* A new pool can be created afterwards */
+    p = pa_io_thread_pool_get(core);
+    c[0] = client_new(p, 0);
+    pa_io_thread_pool_client_start(c[0]->client);
+    fail_unless(pa_asyncmsgq_send(c[0]->thread_mq.inq, PA_MSGOBJECT(c[0]), PING, NULL, 0, NULL) == PING + 1);
+    client_free(c[0]);
+    pa_io_thread_pool_unref(p);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("IO thread pool");
+    tc = tcase_create("io-thread-pool");
+    tcase_add_checked_fixture(tc, setup, teardown);
+    tcase_add_test(tc, io_thread_pool_attach_test);
+    tcase_add_test(tc, io_thread_pool_deadline_test);
+    tcase_add_test(tc, io_thread_pool_shutdown_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -30,6 +30,8 @@
 
 #include <pulsecore/core-util.h>
 #include <pulsecore/core-rtclock.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/log.h>
 
 #ifdef GLIB_MAIN_LOOP
 
@@ -40,6 +42,8 @@ static GMainLoop* glib_main_loop = NULL;
 
 #else /* GLIB_MAIN_LOOP */
 #include <pulse/mainloop.h>
+
+#include "runtime-test-util.h"
 #endif /* GLIB_MAIN_LOOP */
 
 typedef struct mainloop_events {
@@ -140,6 +144,203 @@ START_TEST (mainloop_test) {
 }
 END_TEST
 
+#ifndef GLIB_MAIN_LOOP
+
+#define N_TIMERS 500
+#define N_SCALE_MAX 256
+#define TIMES 100
+#define TIMES2 20
+
+static pa_mainloop *mainloop_new(bool use_epoll) {
+    pa_mainloop *m;
+
+    if (!use_epoll)
+        setenv("PULSE_NO_EPOLL", "1", 1);
+
+    m = pa_mainloop_new();
+    unsetenv("PULSE_NO_EPOLL");
+
+    return m;
+}
+
+typedef struct timer_order {
+    pa_usec_t times[N_TIMERS];
+    pa_usec_t last;
+    unsigned n_fired, n_expected;
+    unsigned n_rearmed;
+} timer_order;
+
+static timer_order order;
+
+static void order_tcb(pa_mainloop_api*a, pa_time_event *e, const struct timeval *tv, void *userdata) {
+    unsigned i = PA_PTR_TO_UINT(userdata);
+
+    /* The heap hands out expired events earliest first */
+    fail_unless(order.times[i] >= order.last);
+    order.last = order.times[i];
+
+    a->time_free(e);
+
+    if (++order.n_fired == order.n_expected)
+        a->quit(a, 0);
+}
+
+static void rearm_tcb(pa_mainloop_api*a, pa_time_event *e, const struct timeval *tv, void *userdata) {
+    struct timeval tv2;
+
+    /* The other expired events must not be starved */
+    fail_unless(order.n_rearmed++ < TIMES2);
+
+    a->time_restart(e, pa_timeval_rtstore(&tv2, order.times[0] / 2, true));
+}
+
+START_TEST (mainloop_timer_order_test) {
+    pa_time_event *te[N_TIMERS];
+    pa_mainloop_api *a;
+    pa_mainloop *m;
+    struct timeval tv;
+    pa_usec_t now;
+    unsigned i;
+
+    fail_if(!(m = pa_mainloop_new()));
+    a = pa_mainloop_get_api(m);
+
+    pa_zero(order);
+    now = pa_rtclock_now();
+
+    for (i = 0; i < N_TIMERS; i++) {
+        order.times[i] = now + (pa_usec_t) (rand() % 100) * PA_USEC_PER_MSEC / 2;
+        te[i] = a->time_new(a, pa_timeval_rtstore(&tv, order.times[i], true), order_tcb, PA_UINT_TO_PTR(i));
+    }
+
+    /* Move, disable and free some of them */
+    for (i = 0; i < N_TIMERS; i += 3) {
+        order.times[i] = now + (pa_usec_t) (rand() % 100) * PA_USEC_PER_MSEC / 2;
+        a->time_restart(te[i], pa_timeval_rtstore(&tv, order.times[i], true));
+    }
+
+    for (i = 1; i < N_TIMERS; i += 7)
+        a->time_restart(te[i], NULL);
+
+    for (i = 2; i < N_TIMERS; i += 7)
+        a->time_free(te[i]);
+
+    for (i = 0; i < N_TIMERS; i++)
+        if (i % 7 != 1 && i % 7 != 2)
+            order.n_expected++;
+
+    pa_mainloop_run(m, NULL);
+    fail_unless(order.n_fired == order.n_expected);
+
+    for (i = 1; i < N_TIMERS; i += 7)
+        a->time_free(te[i]);
+
+    pa_mainloop_free(m);
+
+    /* Expired events are all dispatched although one of them keeps
+     * rearming itself for the past */
+    fail_if(!(m = pa_mainloop_new()));
+    a = pa_mainloop_get_api(m);
+
+    pa_zero(order);
+    now = pa_rtclock_now();
+
+    a->time_new(a, pa_timeval_rtstore(&tv, now / 2, true), rearm_tcb, NULL);
+
+    for (i = 0; i < N_TIMERS; i++) {
+        order.times[i] = now - N_TIMERS + i;
+        a->time_new(a, pa_timeval_rtstore(&tv, order.times[i], true), order_tcb, PA_UINT_TO_PTR(i));
+    }
+
+    order.n_expected = N_TIMERS;
+    pa_mainloop_run(m, NULL);
+    fail_unless(order.n_fired == order.n_expected);
+
+    pa_mainloop_free(m);
+}
+END_TEST
+
+static void count_iocb(pa_mainloop_api*a, pa_io_event *e, int fd, pa_io_event_flags_t f, void *userdata) {
+    unsigned *n = userdata;
+    char c;
+
+    pa_assert_se(read(fd, &c, sizeof(c)) == 1);
+    (*n)++;
+}
+
+static void never_tcb(pa_mainloop_api*a, pa_time_event *e, const struct timeval *tv, void *userdata) {
+    ck_abort();
+}
+
+/* Many idle fds and timers, one fd becoming readable per iteration,
+ * the way the daemon's main loop serves lots of mostly idle clients */
+static void run_scaling_test(bool use_epoll, unsigned n) {
+    int fds[N_SCALE_MAX][2];
+    pa_io_event *ioe[N_SCALE_MAX], *ioe2;
+    pa_time_event *te[N_SCALE_MAX];
+    pa_mainloop_api *a;
+    pa_mainloop *m;
+    struct timeval tv;
+    unsigned i, k = 0, n_read = 0, n_written = 0;
+    pa_usec_t later;
+
+    pa_assert(n <= N_SCALE_MAX);
+
+    fail_if(!(m = mainloop_new(use_epoll)));
+    a = pa_mainloop_get_api(m);
+
+    later = pa_rtclock_now() + 3600 * PA_USEC_PER_SEC;
+
+    for (i = 0; i < n; i++) {
+        fail_unless(pipe(fds[i]) == 0);
+        ioe[i] = a->io_new(a, fds[i][0], PA_IO_EVENT_INPUT, count_iocb, &n_read);
+        te[i] = a->time_new(a, pa_timeval_rtstore(&tv, later + i, true), never_tcb, NULL);
+    }
+
+    /* A second event on the same fd is only ever woken up for errors */
+    ioe2 = a->io_new(a, fds[0][0], PA_IO_EVENT_NULL, count_iocb, &n_read);
+
+    pa_log_debug("Testing main loop with %u fds and timers, %s", n, use_epoll ? "epoll" : "poll");
+
+    PA_RUNTIME_TEST_RUN_START(use_epoll ? "epoll" : "poll", TIMES, TIMES2) {
+        pa_assert_se(write(fds[k % n][1], "x", 1) == 1);
+        n_written++;
+
+        a->time_restart(te[k % n], pa_timeval_rtstore(&tv, later + n + k, true));
+        k++;
+
+        pa_assert_se(pa_mainloop_iterate(m, 1, NULL) >= 0);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    fail_unless(n_read == n_written);
+
+    a->io_free(ioe2);
+
+    for (i = 0; i < n; i++) {
+        a->io_free(ioe[i]);
+        a->time_free(te[i]);
+        pa_close(fds[i][0]);
+        pa_close(fds[i][1]);
+    }
+
+    pa_mainloop_free(m);
+}
+
+START_TEST (mainloop_scaling_test) {
+    unsigned n;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    for (n = 4; n <= N_SCALE_MAX; n *= 4) {
+        run_scaling_test(false, n);
+        run_scaling_test(true, n);
+    }
+}
+END_TEST
+
+#endif /* GLIB_MAIN_LOOP */
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -149,6 +350,12 @@ int main(int argc, char *argv[]) {
     s = suite_create("MainLoop");
     tc = tcase_create("mainloop");
     tcase_add_test(tc, mainloop_test);
+#ifndef GLIB_MAIN_LOOP
+    tcase_add_test(tc, mainloop_timer_order_test);
+    tcase_add_test(tc, mainloop_scaling_test);
+    /* Ensure that the runtime tests don't time out */
+    tcase_set_timeout(tc, 120);
+#endif
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
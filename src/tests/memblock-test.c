@@ -20,15 +20,22 @@
 #endif
 
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <check.h>
 
+#include <pulse/rtclock.h>
 #include <pulse/xmalloc.h>
 
+#include <pulsecore/core-util.h>
 #include <pulsecore/log.h>
 #include <pulsecore/memblock.h>
 #include <pulsecore/macro.h>
+#include <pulsecore/thread.h>
+
+#define N_BLOCKS 64
+#define CACHE_ITERATIONS 100000
 
 static void release_cb(pa_memimport *i, uint32_t block_id, void *userdata) {
     pa_log("%s: Imported block %u is released.", (char*) userdata, block_id);
@@ -176,6 +183,326 @@ START_TEST (memblock_test) {
 }
 END_TEST
 
+START_TEST (memblock_size_class_test) {
+    pa_mempool *pool;
+    const pa_mempool_stat *stat;
+    pa_memblock *blocks[PA_MEMPOOL_SIZE_CLASSES][N_BLOCKS];
+    unsigned c, k;
+
+    pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true);
+    fail_unless(pool != NULL);
+    stat = pa_mempool_get_stat(pool);
+
+    /* Fill blocks of each size class with a pattern of their own */
+    for (c = 0; c < PA_MEMPOOL_SIZE_CLASSES; c++) {
+        size_t length = pa_mempool_class_size(pool, c) / 2;
+
+        for (k = 0; k < N_BLOCKS; k++) {
+            fail_unless((blocks[c][k] = pa_memblock_new_pool(pool, length)) != NULL);
+            fail_unless(pa_memblock_get_length(blocks[c][k]) == length);
+
+            memset(pa_memblock_acquire(blocks[c][k]), (int) (c * N_BLOCKS + k), length);
+            pa_memblock_release(blocks[c][k]);
+        }
+
+        pa_log_debug("Size class %u: %u blocks allocated, %u slots", c,
+                     (unsigned) pa_atomic_load(&stat->n_allocated_by_class[c]),
+                     (unsigned) pa_atomic_load(&stat->n_slots_by_class[c]));
+
+        fail_unless(pa_atomic_load(&stat->n_allocated_by_class[c]) == N_BLOCKS);
+    }
+
+    /* Blocks of a small size class share slots */
+    fail_unless(pa_atomic_load(&stat->n_slots_by_class[0]) == 1);
+
+    for (c = 0; c < PA_MEMPOOL_SIZE_CLASSES; c++)
+        for (k = 0; k < N_BLOCKS; k++) {
+            uint8_t *d = pa_memblock_acquire(blocks[c][k]);
+            size_t i, length = pa_memblock_get_length(blocks[c][k]);
+
+            for (i = 0; i < length; i++)
+                fail_unless(d[i] == (uint8_t) (c * N_BLOCKS + k));
+
+            pa_memblock_release(blocks[c][k]);
+            pa_memblock_unref(blocks[c][k]);
+        }
+
+    for (c = 0; c < PA_MEMPOOL_SIZE_CLASSES; c++)
+        fail_unless(pa_atomic_load(&stat->n_allocated_by_class[c]) == 0);
+
+    /* Freed blocks are reused */
+    for (k = 0; k < N_BLOCKS; k++)
+        fail_unless((blocks[0][k] = pa_memblock_new_pool(pool, 100)) != NULL);
+    for (k = 0; k < N_BLOCKS; k++)
+        pa_memblock_unref(blocks[0][k]);
+
+    fail_unless(pa_atomic_load(&stat->n_slots_by_class[0]) == 1);
+    fail_unless(pa_atomic_load(&stat->n_allocated) == 0);
+
+    pa_mempool_unref(pool);
+}
+END_TEST
+
+static pa_usec_t alloc_free_loop(pa_mempool *pool, size_t length) {
+    pa_memblock *blocks[4];
+    pa_usec_t start;
+    unsigned i, k;
+
+    start = pa_rtclock_now();
+
+    for (i = 0; i < CACHE_ITERATIONS; i++) {
+        for (k = 0; k < PA_ELEMENTSOF(blocks); k++)
+            pa_assert_se(blocks[k] = pa_memblock_new_pool(pool, length));
+        for (k = 0; k < PA_ELEMENTSOF(blocks); k++)
+            pa_memblock_unref(blocks[k]);
+    }
+
+    return pa_rtclock_now() - start;
+}
+
+static void thread_cache_func(void *userdata) {
+    pa_mempool *pool = userdata;
+    pa_usec_t shared, cached;
+
+    shared = alloc_free_loop(pool, 1000);
+
+    pa_mempool_enable_thread_cache(pool);
+    cached = alloc_free_loop(pool, 1000);
+
+    pa_log_debug("%u allocations: %llu usec without thread cache, %llu usec with thread cache",
+                 CACHE_ITERATIONS * 4, (unsigned long long) shared, (unsigned long long) cached);
+
+    /* The cache is flushed when the thread exits */
+}
+
+START_TEST (memblock_thread_cache_test) {
+    pa_mempool *pool;
+    const pa_mempool_stat *stat;
+    pa_thread *threads[4];
+    pa_memblock *b;
+    unsigned k;
+    int n;
+
+    pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true);
+    fail_unless(pool != NULL);
+
+    for (k = 0; k < PA_ELEMENTSOF(threads); k++)
+        fail_unless((threads[k] = pa_thread_new("memblock-test", thread_cache_func, pool)) != NULL);
+
+    for (k = 0; k < PA_ELEMENTSOF(threads); k++)
+        pa_thread_free(threads[k]);
+
+    fail_unless(pa_atomic_load(&pa_mempool_get_stat(pool)->n_allocated) == 0);
+
+    /* The cache counts its blocks by itself, and adds the counts to the
+     * pool statistics when they are read */
+    stat = pa_mempool_get_stat(pool);
+    pa_mempool_enable_thread_cache(pool);
+    fail_unless((b = pa_memblock_new_pool(pool, 1000)) != NULL);
+    fail_unless(pa_atomic_load(&stat->n_allocated) == 0);
+
+    stat = pa_mempool_get_stat(pool);
+    fail_unless(pa_atomic_load(&stat->n_allocated) == 1);
+    fail_unless(pa_atomic_load(&stat->n_allocated_by_type[PA_MEMBLOCK_POOL]) == 1);
+
+    for (k = 0, n = 0; k < PA_MEMPOOL_SIZE_CLASSES; k++)
+        n += pa_atomic_load(&stat->n_allocated_by_class[k]);
+    fail_unless(n == 1);
+
+    /* Blocks may be freed by another thread than the one that allocated them */
+    pa_mempool_disable_thread_cache();
+    pa_memblock_unref(b);
+
+    fail_unless(pa_atomic_load(&pa_mempool_get_stat(pool)->n_allocated) == 0);
+
+    pa_mempool_unref(pool);
+}
+END_TEST
+
+START_TEST (memblock_grow_test) {
+    pa_mempool *pool;
+    pa_memexport *export;
+    const pa_mempool_stat *stat;
+    pa_memblock *blocks[N_BLOCKS], *b;
+    uint32_t pool_shm_id, segment_shm_id = 0;
+    unsigned k, n = 0;
+    size_t length;
+
+    /* A pool of two slots, which grows by further segments of two slots */
+    if (!(pool = pa_mempool_new(PA_MEM_TYPE_SHARED_MEMFD, 2 * 64 * 1024, true))) {
+        pa_log_info("memfd not available, skipping");
+        return;
+    }
+
+    stat = pa_mempool_get_stat(pool);
+    length = pa_mempool_block_size_max(pool);
+    fail_unless(pa_mempool_get_shm_id(pool, &pool_shm_id) == 0);
+    fail_unless(pa_atomic_load(&stat->n_segments) == 1);
+
+    export = pa_memexport_new(pool, revoke_cb, (void*) "Grow");
+    fail_unless(export != NULL);
+
+    while (n < N_BLOCKS && (blocks[n] = pa_memblock_new_pool(pool, length))) {
+        memset(pa_memblock_acquire(blocks[n]), (int) n, length);
+        pa_memblock_release(blocks[n]);
+        n++;
+    }
+
+    pa_log_debug("Grown to %u segments with %u blocks", (unsigned) pa_atomic_load(&stat->n_segments), n);
+
+    fail_unless(pa_atomic_load(&stat->n_segments) > 1 || sizeof(void*) < 8);
+    fail_unless(n == 2 * (unsigned) pa_atomic_load(&stat->n_segments));
+
+    /* Blocks of grown segments are exported relative to their segment */
+    for (k = 0; k < n; k++) {
+        pa_mem_type_t type;
+        uint32_t block_id, shm_id;
+        size_t offset, size;
+
+        fail_unless(pa_memexport_put(export, blocks[k], &type, &block_id, &shm_id, &offset, &size) == 0);
+        fail_unless(type == PA_MEM_TYPE_SHARED_MEMFD);
+        fail_unless(offset + size <= 2 * 64 * 1024);
+        fail_unless((shm_id == pool_shm_id) == (k < 2));
+
+        if (k >= 2 && !segment_shm_id) {
+            int fd;
+
+            segment_shm_id = shm_id;
+            fail_unless((fd = pa_mempool_get_segment_memfd_fd(pool, shm_id)) >= 0);
+            fail_unless(pa_mempool_get_segment_memfd_fd(pool, shm_id) == -1);
+            pa_close(fd);
+        }
+
+        pa_memexport_process_release(export, block_id);
+    }
+
+    /* Once the pool cannot grow any further, blocks fall back to the heap */
+    b = pa_memblock_new(pool, length);
+    fail_unless(pa_atomic_load(&stat->n_shm_fallbacks) == 1);
+    pa_memblock_unref(b);
+
+    for (k = 0; k < n; k++) {
+        uint8_t *d = pa_memblock_acquire(blocks[k]);
+
+        fail_unless(d[0] == (uint8_t) k && d[length - 1] == (uint8_t) k);
+        pa_memblock_release(blocks[k]);
+        pa_memblock_unref(blocks[k]);
+    }
+
+    /* Releases the memory of all segments, they stay usable afterwards */
+    pa_mempool_vacuum(pool);
+
+    fail_unless((b = pa_memblock_new_pool(pool, length)) != NULL);
+    pa_memblock_unref(b);
+
+    pa_memexport_free(export);
+    pa_mempool_unref(pool);
+}
+END_TEST
+
+static void grow_cb(pa_mempool *p, void *userdata) {
+    unsigned *n_requests = userdata;
+
+    (*n_requests)++;
+}
+
+START_TEST (memblock_grow_callback_test) {
+    pa_mempool *pool;
+    const pa_mempool_stat *stat;
+    pa_memblock *blocks[4];
+    unsigned k, n_requests = 0;
+    size_t length;
+
+    if (!(pool = pa_mempool_new(PA_MEM_TYPE_SHARED_MEMFD, 2 * 64 * 1024, true))) {
+        pa_log_info("memfd not available, skipping");
+        return;
+    }
+
+    stat = pa_mempool_get_stat(pool);
+    length = pa_mempool_block_size_max(pool);
+
+    if (sizeof(void*) < 8) {
+        pa_log_info("Pool is not growable, skipping");
+        pa_mempool_unref(pool);
+        return;
+    }
+
+    /* With a grow callback, allocations only ask for the next segment
+     * once the last one runs full, and never map it themselves */
+    pa_mempool_set_grow_callback(pool, grow_cb, &n_requests);
+
+    fail_unless((blocks[0] = pa_memblock_new_pool(pool, length)) != NULL);
+    fail_unless(n_requests == 0);
+    fail_unless((blocks[1] = pa_memblock_new_pool(pool, length)) != NULL);
+    fail_unless(n_requests == 1);
+
+    fail_unless(pa_memblock_new_pool(pool, length) == NULL);
+    fail_unless(n_requests == 1);
+    fail_unless(pa_atomic_load(&stat->n_segments) == 1);
+
+    fail_unless(pa_mempool_grow(pool) == 0);
+    fail_unless(pa_atomic_load(&stat->n_segments) == 2);
+
+    fail_unless((blocks[2] = pa_memblock_new_pool(pool, length)) != NULL);
+    fail_unless(n_requests == 1);
+    fail_unless((blocks[3] = pa_memblock_new_pool(pool, length)) != NULL);
+    fail_unless(n_requests == 2);
+
+    for (k = 0; k < 4; k++)
+        pa_memblock_unref(blocks[k]);
+
+    pa_mempool_unref(pool);
+}
+END_TEST
+
+START_TEST (memblock_lock_test) {
+    pa_mempool *pool;
+    pa_memblock *b, *blocks[2];
+
+    pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 4 * 64 * 1024, true);
+    fail_unless(pool != NULL);
+    fail_unless(!pa_mempool_is_locked(pool));
+
+    if (pa_mempool_lock(pool) < 0) {
+        pa_log_info("Memory locking not permitted, skipping");
+        pa_mempool_unref(pool);
+        return;
+    }
+
+    fail_unless(pa_mempool_is_locked(pool));
+    fail_unless(pa_atomic_load(&pa_mempool_get_stat(pool)->locked_size) == 4 * 64 * 1024);
+
+    /* Locked pools keep their memory through vacuuming */
+    fail_unless((b = pa_memblock_new_pool(pool, 1000)) != NULL);
+    memset(pa_memblock_acquire(b), 0x55, 1000);
+    pa_memblock_release(b);
+    pa_memblock_unref(b);
+    pa_mempool_vacuum(pool);
+
+    pa_mempool_unref(pool);
+
+    if (sizeof(void*) < 8 || !(pool = pa_mempool_new(PA_MEM_TYPE_SHARED_MEMFD, 2 * 64 * 1024, true)))
+        return;
+
+    fail_unless(pa_mempool_lock(pool) == 0);
+
+    /* Locked pools do not grow from allocations */
+    fail_unless((blocks[0] = pa_memblock_new_pool(pool, 1000)) != NULL);
+    fail_unless((blocks[1] = pa_memblock_new_pool(pool, 64 * 1024)) != NULL);
+    fail_unless(pa_memblock_new_pool(pool, 64 * 1024) == NULL);
+    fail_unless(pa_atomic_load(&pa_mempool_get_stat(pool)->n_segments) == 1);
+
+    fail_unless(pa_mempool_grow(pool) == 0);
+    fail_unless(pa_atomic_load(&pa_mempool_get_stat(pool)->locked_size) == 4 * 64 * 1024);
+    fail_unless((b = pa_memblock_new_pool(pool, 64 * 1024)) != NULL);
+
+    pa_memblock_unref(b);
+    pa_memblock_unref(blocks[0]);
+    pa_memblock_unref(blocks[1]);
+    pa_mempool_unref(pool);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -188,6 +515,11 @@ int main(int argc, char *argv[]) {
     s = suite_create("Memblock");
     tc = tcase_create("memblock");
     tcase_add_test(tc, memblock_test);
+    tcase_add_test(tc, memblock_size_class_test);
+    tcase_add_test(tc, memblock_thread_cache_test);
+    tcase_add_test(tc, memblock_grow_test);
+    tcase_add_test(tc, memblock_grow_callback_test);
+    tcase_add_test(tc, memblock_lock_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
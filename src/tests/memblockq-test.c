@@ -30,9 +30,16 @@
 #include <pulsecore/macro.h>
 #include <pulsecore/strbuf.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/sample-util.h>
 
 #include <pulse/xmalloc.h>
 
+#include "runtime-test-util.h"
+
+#define RING_TEST_STEPS 2000
+#define TIMES 100
+#define TIMES2 20
+
 static const char *fixed[] = {
     "1122444411441144__22__11______3333______________________________",
     "__________________3333__________________________________________"
@@ -682,6 +689,282 @@ START_TEST (memblockq_test_push_to_middle) {
 }
 END_TEST
 
+/* Checks whether the queue hands out the memory of the given chunk
+ * itself, rather than a copy of its data */
+static void assert_peek_is(pa_memblockq *bq, const pa_memchunk *chunk, bool same) {
+    pa_memchunk out;
+
+    ck_assert_int_eq(pa_memblockq_peek(bq, &out), 0);
+    ck_assert_int_eq(out.length, chunk->length);
+
+    if (same) {
+        fail_unless(out.memblock == chunk->memblock);
+        ck_assert_int_eq(out.index, chunk->index);
+    } else
+        fail_unless(out.memblock != chunk->memblock);
+
+    pa_memblock_unref(out.memblock);
+}
+
+START_TEST (memblockq_test_push_align) {
+    pa_sample_spec ss = {
+        .format = PA_SAMPLE_S16BE,
+        .rate = 48000,
+        .channels = 1
+    };
+
+    pa_memchunk silence;
+    pa_mempool *p;
+    pa_memblockq *bq;
+    pa_memchunk chunk1, chunk2, chunk3, chunk4;
+    pa_memchunk out;
+
+    pa_strbuf *buf;
+    char *str;
+
+    p = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true);
+    ck_assert_ptr_ne(p, NULL);
+    silence = memchunk_from_str(p, "__");
+
+    bq = pa_memblockq_new("test memblockq", 0, 200, 10, &ss, 4, 4, 40, &silence);
+
+    /* Aligned chunks are queued as they are, without the aligner */
+    chunk1 = memchunk_from_str(p, "1234");
+    ck_assert_int_eq(pa_memblockq_push_align(bq, &chunk1), 0);
+    assert_peek_is(bq, &chunk1, true);
+    pa_memblockq_drop(bq, 4);
+
+    /* A partial frame is held back until it is completed */
+    chunk2 = memchunk_from_str(p, "567");
+    ck_assert_int_eq(pa_memblockq_push_align(bq, &chunk2), 0);
+    ck_assert_int_eq(pa_memblockq_get_length(bq), 2);
+    pa_memblockq_drop(bq, 2);
+
+    /* While it is, even aligned chunks go through the aligner, which
+     * copies them after the held back byte */
+    chunk3 = memchunk_from_str(p, "89");
+    ck_assert_int_eq(pa_memblockq_push_align(bq, &chunk3), 0);
+    ck_assert_int_eq(pa_memblockq_get_length(bq), 2);
+    assert_peek_is(bq, &chunk3, false);
+    pa_memblockq_drop(bq, 2);
+
+    /* The "9" is still held back, completing it empties the aligner */
+    chunk4 = memchunk_from_str(p, "abc");
+    ck_assert_int_eq(pa_memblockq_push_align(bq, &chunk4), 0);
+    ck_assert_int_eq(pa_memblockq_get_length(bq), 4);
+
+    pa_memblockq_peek_fixed_size(bq, 4, &out);
+
+    buf = pa_strbuf_new();
+    dump_chunk(&out, buf);
+    pa_memblock_unref(out.memblock);
+    str = pa_strbuf_to_string_free(buf);
+    fail_unless(pa_streq(str, "9abc"));
+    pa_xfree(str);
+
+    pa_memblockq_drop(bq, 4);
+
+    /* Aligned chunks bypass it again after that */
+    ck_assert_int_eq(pa_memblockq_push_align(bq, &chunk1), 0);
+    assert_peek_is(bq, &chunk1, true);
+
+    /* cleanup */
+    pa_memblockq_free(bq);
+    pa_memblock_unref(chunk1.memblock);
+    pa_memblock_unref(chunk2.memblock);
+    pa_memblock_unref(chunk3.memblock);
+    pa_memblock_unref(chunk4.memblock);
+    pa_memblock_unref(silence.memblock);
+    pa_mempool_unref(p);
+}
+END_TEST
+
+static void assert_same_peek(pa_memblockq *a, pa_memblockq *b) {
+    pa_memchunk ca, cb;
+    int ra, rb;
+
+    ra = pa_memblockq_peek(a, &ca);
+    rb = pa_memblockq_peek(b, &cb);
+    ck_assert_int_eq(ra, rb);
+
+    if (ra < 0)
+        return;
+
+    fail_unless(ca.memblock == cb.memblock);
+    ck_assert_int_eq(ca.index, cb.index);
+    ck_assert_int_eq(ca.length, cb.length);
+
+    pa_memblock_unref(ca.memblock);
+    pa_memblock_unref(cb.memblock);
+}
+
+START_TEST (memblockq_test_ring) {
+    pa_sample_spec ss = {
+        .format = PA_SAMPLE_S16LE,
+        .rate = 48000,
+        .channels = 2
+    };
+
+    pa_mempool *p;
+    pa_memblockq *list, *ring;
+    pa_memchunk silence, chunk;
+    unsigned i;
+
+    p = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true);
+    ck_assert_ptr_ne(p, NULL);
+
+    silence.memblock = pa_silence_memblock(pa_memblock_new(p, 64), &ss);
+    silence.index = 0;
+    silence.length = 64;
+
+    chunk.memblock = pa_memblock_new(p, 4096);
+    chunk.index = 0;
+    chunk.length = 4096;
+    pa_silence_memchunk(&chunk, &ss);
+
+    list = pa_memblockq_new("list memblockq", 0, 65536, 16384, &ss, 0, 4, 8192, &silence);
+    ring = pa_memblockq_new("ring memblockq", 0, 65536, 16384, &ss, 0, 4, 8192, &silence);
+    pa_memblockq_enable_ring(ring);
+    fail_unless(pa_memblockq_is_ring(ring));
+
+    srand(0);
+
+    /* Appending writes with holes in between, reads and rewinds must
+     * look the same on both queues */
+    for (i = 0; i < RING_TEST_STEPS; i++) {
+        pa_memchunk c = chunk;
+        size_t l;
+
+        c.index = (rand() % 256) * 4;
+        c.length = (rand() % 256 + 1) * 4;
+
+        if (rand() % 8 == 0) {
+            l = 4 * (rand() % 16);
+            pa_memblockq_seek(list, l, PA_SEEK_RELATIVE, true);
+            pa_memblockq_seek(ring, l, PA_SEEK_RELATIVE, true);
+        }
+
+        ck_assert_int_eq(pa_memblockq_push(list, &c), 0);
+        ck_assert_int_eq(pa_memblockq_push(ring, &c), 0);
+
+        assert_same_peek(list, ring);
+
+        l = (rand() % 384) * 4;
+        pa_memblockq_drop(list, l);
+        pa_memblockq_drop(ring, l);
+
+        if (rand() % 16 == 0) {
+            l = (rand() % 512) * 4;
+            pa_memblockq_rewind(list, l);
+            pa_memblockq_rewind(ring, l);
+        }
+
+        assert_same_peek(list, ring);
+
+        ck_assert_int_eq(pa_memblockq_get_length(list), pa_memblockq_get_length(ring));
+        ck_assert_int_eq(pa_memblockq_get_nblocks(list), pa_memblockq_get_nblocks(ring));
+        fail_unless(pa_memblockq_is_ring(ring));
+    }
+
+    /* Writing into the queued data leaves ring mode */
+    pa_memblockq_seek(list, 0, PA_SEEK_RELATIVE_ON_READ, true);
+    pa_memblockq_seek(ring, 0, PA_SEEK_RELATIVE_ON_READ, true);
+
+    for (i = 0; i < 4; i++) {
+        ck_assert_int_eq(pa_memblockq_push(list, &chunk), 0);
+        ck_assert_int_eq(pa_memblockq_push(ring, &chunk), 0);
+    }
+    fail_unless(pa_memblockq_is_ring(ring));
+
+    pa_memblockq_seek(list, -1024, PA_SEEK_RELATIVE_END, true);
+    pa_memblockq_seek(ring, -1024, PA_SEEK_RELATIVE_END, true);
+    chunk.length = 512;
+    ck_assert_int_eq(pa_memblockq_push(list, &chunk), 0);
+    ck_assert_int_eq(pa_memblockq_push(ring, &chunk), 0);
+    fail_unless(!pa_memblockq_is_ring(ring));
+
+    while (pa_memblockq_is_readable(list)) {
+        assert_same_peek(list, ring);
+        pa_memblockq_drop(list, 100);
+        pa_memblockq_drop(ring, 100);
+    }
+    fail_unless(!pa_memblockq_is_readable(ring));
+
+    pa_memblockq_free(list);
+    pa_memblockq_free(ring);
+    pa_memblock_unref(chunk.memblock);
+    pa_memblock_unref(silence.memblock);
+    pa_mempool_unref(p);
+}
+END_TEST
+
+/* Pushes small chunks and plays them back with a rewind now and then,
+ * the way a playback stream queue is used */
+static void memblockq_stream(pa_memblockq *bq, const pa_memchunk *chunk) {
+    unsigned i;
+
+    for (i = 0; i < 256; i++) {
+        pa_memchunk out;
+
+        pa_memblockq_push(bq, chunk);
+
+        if (pa_memblockq_peek(bq, &out) >= 0) {
+            pa_memblock_unref(out.memblock);
+            pa_memblockq_drop(bq, out.length);
+        }
+
+        if (i % 32 == 31)
+            pa_memblockq_rewind(bq, 16 * chunk->length);
+    }
+}
+
+START_TEST (memblockq_test_ring_perf) {
+    pa_sample_spec ss = {
+        .format = PA_SAMPLE_S16LE,
+        .rate = 48000,
+        .channels = 2
+    };
+
+    pa_mempool *p;
+    pa_memblockq *list, *ring;
+    pa_memchunk silence, chunk;
+
+    p = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true);
+    ck_assert_ptr_ne(p, NULL);
+
+    silence.memblock = pa_silence_memblock(pa_memblock_new(p, 64), &ss);
+    silence.index = 0;
+    silence.length = 64;
+
+    chunk.memblock = pa_memblock_new(p, 64);
+    chunk.index = 0;
+    chunk.length = 64;
+    pa_silence_memchunk(&chunk, &ss);
+
+    list = pa_memblockq_new("list memblockq", 0, 65536, 16384, &ss, 0, 4, 16384, &silence);
+    ring = pa_memblockq_new("ring memblockq", 0, 65536, 16384, &ss, 0, 4, 16384, &silence);
+    pa_memblockq_enable_ring(ring);
+
+    pa_log_debug("Testing memblockq performance with %u byte chunks", (unsigned) chunk.length);
+
+    PA_RUNTIME_TEST_RUN_START("ring", TIMES, TIMES2) {
+        memblockq_stream(ring, &chunk);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    PA_RUNTIME_TEST_RUN_START("list", TIMES, TIMES2) {
+        memblockq_stream(list, &chunk);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    fail_unless(pa_memblockq_is_ring(ring));
+
+    pa_memblockq_free(list);
+    pa_memblockq_free(ring);
+    pa_memblock_unref(chunk.memblock);
+    pa_memblock_unref(silence.memblock);
+    pa_mempool_unref(p);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -700,6 +983,11 @@ int main(int argc, char *argv[]) {
     tcase_add_test(tc, memblockq_test_pop_missing);
     tcase_add_test(tc, memblockq_test_tlength_change);
     tcase_add_test(tc, memblockq_test_push_to_middle);
+    tcase_add_test(tc, memblockq_test_push_align);
+    tcase_add_test(tc, memblockq_test_ring);
+    tcase_add_test(tc, memblockq_test_ring_perf);
+    /* Ensure that the runtime tests don't time out */
+    tcase_set_timeout(tc, 120);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -27,12 +27,15 @@
 #include <pulse/sample.h>
 #include <pulse/volume.h>
 
+#include <pulsecore/cpu.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/endianmacros.h>
 #include <pulsecore/memblock.h>
 #include <pulsecore/sample-util.h>
 #include <pulsecore/mix.h>
 
+#define MANY_STREAMS 37
+
 /* PA_SAMPLE_U8 */
 static const uint8_t u8_result[3][10] = {
 { 0x00, 0xff, 0x7f, 0x80, 0x9f, 0x3f, 0x01, 0xf0, 0x20, 0x21 },
@@ -278,7 +281,7 @@ static pa_memblock* generate_block(pa_mempool *pool, const pa_sample_spec *ss) {
     return r;
 }
 
-START_TEST (mix_test) {
+static void run_mix_test(void) {
     pa_mempool *pool;
     pa_sample_spec a;
     pa_cvolume v;
@@ -296,7 +299,8 @@ START_TEST (mix_test) {
 
     for (a.format = 0; a.format < PA_SAMPLE_MAX; a.format ++) {
         pa_memchunk i, j, k;
-        pa_mix_info m[2];
+        pa_mix_info m[2], many[MANY_STREAMS];
+        unsigned n;
         void *ptr;
 
         pa_log_debug("=== mixing: %s", pa_sample_format_to_string(a.format));
@@ -333,6 +337,30 @@ START_TEST (mix_test) {
 
         compare_block(&a, &k, 2);
 
+        /* Many streams are mixed in batches, muted ones must not change
+         * the result */
+        for (n = 0; n < MANY_STREAMS; n++) {
+            many[n].chunk = i;
+            many[n].volume.values[0] = PA_VOLUME_MUTED;
+            many[n].volume.channels = a.channels;
+        }
+        many[0].volume.values[0] = PA_VOLUME_NORM;
+        many[MANY_STREAMS - 1].chunk = j;
+        many[MANY_STREAMS - 1].volume.values[0] = PA_VOLUME_NORM;
+
+        ptr = pa_memblock_acquire_chunk(&k);
+        pa_mix(many, MANY_STREAMS, ptr, k.length, &a, NULL, false);
+        pa_memblock_release(k.memblock);
+
+        compare_block(&a, &k, 2);
+
+        /* A single stream is copied with the volume applied */
+        ptr = pa_memblock_acquire_chunk(&k);
+        pa_mix(m, 1, ptr, k.length, &a, &v, false);
+        pa_memblock_release(k.memblock);
+
+        compare_block(&a, &k, 1);
+
         pa_memblock_unref(i.memblock);
         pa_memblock_unref(j.memblock);
         pa_memblock_unref(k.memblock);
@@ -340,6 +368,19 @@ START_TEST (mix_test) {
 
     pa_mempool_unref(pool);
 }
+
+START_TEST (mix_test) {
+    run_mix_test();
+}
+END_TEST
+
+/* Same checks, using the optimized mixing functions of this CPU */
+START_TEST (mix_cpu_test) {
+    pa_cpu_info cpu_info;
+
+    pa_cpu_init(&cpu_info);
+    run_mix_test();
+}
 END_TEST
 
 int main(int argc, char *argv[]) {
@@ -351,6 +392,7 @@ int main(int argc, char *argv[]) {
     s = suite_create("Mix");
     tc = tcase_create("mix");
     tcase_add_test(tc, mix_test);
+    tcase_add_test(tc, mix_cpu_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -0,0 +1,224 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+#include <math.h>
+
+#include <pulse/sample.h>
+#include <pulse/volume.h>
+
+#include <pulsecore/cpu.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/memblock.h>
+#include <pulsecore/random.h>
+#include <pulsecore/mix.h>
+
+#include "runtime-test-util.h"
+
+#define FRAMES 1024
+#define CHANNELS 2
+#define MAX_STREAMS 64
+#define TIMES 100
+#define TIMES2 50
+
+/* Mixes the streams sample by sample, the way pa_mix() is specified */
+static void mix_reference(pa_mix_info m[], unsigned nstreams, pa_sample_format_t format, void *out) {
+    const void *d[MAX_STREAMS];
+    unsigned k, i;
+
+    for (k = 0; k < nstreams; k++)
+        d[k] = pa_memblock_acquire_chunk(&m[k].chunk);
+
+    for (i = 0; i < FRAMES * CHANNELS; i++) {
+        unsigned c = i % CHANNELS;
+
+        if (format == PA_SAMPLE_FLOAT32NE) {
+            double sum = 0;
+
+            for (k = 0; k < nstreams; k++)
+                sum += ((const float *) d[k])[i] * (float) pa_sw_volume_to_linear(m[k].volume.values[c]);
+
+            ((float *) out)[i] = (float) sum;
+        } else {
+            int64_t sum = 0;
+
+            for (k = 0; k < nstreams; k++) {
+                int32_t cv = (int32_t) lrint(pa_sw_volume_to_linear(m[k].volume.values[c]) * 0x10000);
+
+                sum += ((int64_t) ((const int16_t *) d[k])[i] * cv) >> 16;
+            }
+
+            ((int16_t *) out)[i] = (int16_t) PA_CLAMP_UNLIKELY(sum, -0x8000, 0x7FFF);
+        }
+    }
+
+    for (k = 0; k < nstreams; k++)
+        pa_memblock_release(m[k].chunk.memblock);
+}
+
+static void compare_mix(pa_sample_format_t format, unsigned nstreams, const char *label, const void *out, const void *out_ref) {
+    unsigned i;
+
+    for (i = 0; i < FRAMES * CHANNELS; i++) {
+        if (format == PA_SAMPLE_FLOAT32NE) {
+            float a = ((const float *) out)[i], b = ((const float *) out_ref)[i];
+
+            if (fabsf(a - b) > 0.0001f) {
+                pa_log_debug("%s, %u streams, %u: %.24f != %.24f", label, nstreams, i, a, b);
+                ck_abort();
+            }
+        } else {
+            int16_t a = ((const int16_t *) out)[i], b = ((const int16_t *) out_ref)[i];
+
+            if (a != b) {
+                pa_log_debug("%s, %u streams, %u: %d != %d", label, nstreams, i, a, b);
+                ck_abort();
+            }
+        }
+    }
+}
+
+/* Compares pa_mix_wide() and pa_mix() with a plain per sample mix */
+static void run_mix_wide_test(pa_mempool *pool, pa_sample_format_t format, unsigned nstreams, bool perf) {
+    pa_sample_spec ss;
+    pa_cvolume v;
+    pa_mix_info m[MAX_STREAMS];
+    size_t length;
+    void *out, *out_ref;
+    unsigned k, i;
+
+    pa_assert(nstreams <= MAX_STREAMS);
+
+    ss.format = format;
+    ss.rate = 44100;
+    ss.channels = CHANNELS;
+    length = FRAMES * pa_frame_size(&ss);
+
+    out = pa_xmalloc(length);
+    out_ref = pa_xmalloc(length);
+
+    for (k = 0; k < nstreams; k++) {
+        void *d;
+
+        m[k].chunk.memblock = pa_memblock_new(pool, length);
+        m[k].chunk.index = 0;
+        m[k].chunk.length = length;
+
+        d = pa_memblock_acquire(m[k].chunk.memblock);
+        if (format == PA_SAMPLE_FLOAT32NE) {
+            float *f = d;
+
+            for (i = 0; i < FRAMES * CHANNELS; i++)
+                f[i] = (float) (rand() - RAND_MAX / 2) / (RAND_MAX / 2);
+        } else
+            pa_random(d, length);
+        pa_memblock_release(m[k].chunk.memblock);
+
+        m[k].volume.channels = CHANNELS;
+        for (i = 0; i < CHANNELS; i++)
+            m[k].volume.values[i] = rand() % PA_VOLUME_NORM;
+    }
+
+    pa_cvolume_set(&v, CHANNELS, PA_VOLUME_NORM);
+
+    mix_reference(m, nstreams, format, out_ref);
+
+    pa_mix_wide(m, nstreams, out, length, &ss, &v, false);
+    compare_mix(format, nstreams, "wide", out, out_ref);
+
+    pa_mix(m, nstreams, out, length, &ss, &v, false);
+    compare_mix(format, nstreams, "orig", out, out_ref);
+
+    if (perf) {
+        pa_log_debug("Testing %s mixing performance of %u streams", pa_sample_format_to_string(format), nstreams);
+
+        PA_RUNTIME_TEST_RUN_START("wide", TIMES, TIMES2) {
+            pa_mix_wide(m, nstreams, out, length, &ss, &v, false);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig", TIMES, TIMES2) {
+            pa_mix(m, nstreams, out, length, &ss, &v, false);
+        } PA_RUNTIME_TEST_RUN_STOP
+    }
+
+    for (k = 0; k < nstreams; k++)
+        pa_memblock_unref(m[k].chunk.memblock);
+
+    pa_xfree(out);
+    pa_xfree(out_ref);
+}
+
+static void run_mix_wide_tests(pa_sample_format_t format) {
+    pa_mempool *pool;
+    unsigned nstreams;
+
+    fail_unless((pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true)) != NULL);
+
+    for (nstreams = 2; nstreams <= MAX_STREAMS; nstreams *= 2)
+        run_mix_wide_test(pool, format, nstreams, true);
+
+    /* Batches and tiles that are not filled completely */
+    run_mix_wide_test(pool, format, 11, false);
+
+    pa_mempool_unref(pool);
+}
+
+START_TEST (mix_wide_s16_test) {
+    pa_cpu_info cpu_info;
+
+    pa_cpu_init(&cpu_info);
+    run_mix_wide_tests(PA_SAMPLE_S16NE);
+}
+END_TEST
+
+START_TEST (mix_wide_float_test) {
+    pa_cpu_info cpu_info;
+
+    pa_cpu_init(&cpu_info);
+    run_mix_wide_tests(PA_SAMPLE_FLOAT32NE);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Mix-wide");
+    tc = tcase_create("mix-wide");
+    tcase_add_test(tc, mix_wide_s16_test);
+    tcase_add_test(tc, mix_wide_float_test);
+    /* Ensure that the runtime tests don't time out */
+    tcase_set_timeout(tc, 120);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
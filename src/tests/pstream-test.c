@@ -0,0 +1,638 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <check.h>
+
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+
+#include <pulse/mainloop.h>
+#include <pulsecore/iochannel.h>
+#include <pulsecore/memblock.h>
+#include <pulsecore/packet.h>
+#include <pulsecore/pstream.h>
+#include <pulsecore/core-util.h>
+
+/* The frame layout used by pulsecore/pstream.c */
+#define DESCRIPTOR_SIZE (5 * sizeof(uint32_t))
+#define DESCRIPTOR_LENGTH 0
+#define DESCRIPTOR_OFFSET_HI 2
+#define DESCRIPTOR_FLAGS 4
+
+#define FLAG_SHMDATA 0x80000000U
+#define FLAG_SHMRELEASE 0x40000000U
+#define FLAG_SHMREVOKE 0xC0000000U
+#define FLAG_SHMRELEASE_BATCH 0x50000000U
+#define FLAG_SHMREVOKE_BATCH 0xD0000000U
+#define FLAG_SHMMASK 0xFF000000U
+
+#define N_BLOCKS 20
+#define BLOCK_SIZE 64
+
+/* Frames do_writev() gathers behind the current one, and the byte count
+ * after which it stops gathering */
+#define GATHER_MAX 16
+#define GATHER_BYTES_MAX (64*1024)
+
+#define N_FRAMES 60
+
+static pa_memblock *blocks[N_BLOCKS];
+static unsigned n_blocks;
+
+static void memblock_received(pa_pstream *p, uint32_t channel, int64_t offset, pa_seek_mode_t seek, const pa_memchunk *chunk, void *userdata) {
+    fail_unless(n_blocks < N_BLOCKS);
+
+    blocks[n_blocks++] = pa_memblock_ref(chunk->memblock);
+}
+
+/* Reads everything the pstream wrote so far */
+static size_t read_all(int fd, uint8_t *buf, size_t size) {
+    size_t length = 0;
+    ssize_t r;
+
+    while ((r = read(fd, buf + length, size - length)) > 0)
+        length += (size_t) r;
+
+    fail_unless(r < 0 && errno == EAGAIN);
+
+    return length;
+}
+
+/* Returns the flags of the frames and the block IDs they carry, that is
+ * the released, revoked or sent SHM blocks */
+static unsigned parse_frames(const uint8_t *buf, size_t length, uint32_t *flags, unsigned *n_ids, uint32_t *ids) {
+    size_t i = 0;
+    unsigned n_frames = 0;
+
+    *n_ids = 0;
+
+    while (i < length) {
+        uint32_t descriptor[5], f;
+        size_t payload, j;
+
+        fail_unless(length - i >= DESCRIPTOR_SIZE);
+        memcpy(descriptor, buf + i, DESCRIPTOR_SIZE);
+        i += DESCRIPTOR_SIZE;
+
+        f = flags[n_frames++] = ntohl(descriptor[DESCRIPTOR_FLAGS]);
+        payload = ntohl(descriptor[DESCRIPTOR_LENGTH]);
+        fail_unless(length - i >= payload);
+
+        if (f == FLAG_SHMRELEASE || f == FLAG_SHMREVOKE)
+            ids[(*n_ids)++] = ntohl(descriptor[DESCRIPTOR_OFFSET_HI]);
+        else if (f == FLAG_SHMRELEASE_BATCH || f == FLAG_SHMREVOKE_BATCH)
+            for (j = 0; j < payload; j += sizeof(uint32_t)) {
+                uint32_t id;
+
+                memcpy(&id, buf + i + j, sizeof(id));
+                ids[(*n_ids)++] = ntohl(id);
+            }
+        else if ((f & FLAG_SHMMASK) == FLAG_SHMDATA) {
+            uint32_t id;
+
+            /* The block ID is the first field of the SHM info */
+            memcpy(&id, buf + i, sizeof(id));
+            ids[(*n_ids)++] = ntohl(id);
+        }
+
+        i += payload;
+    }
+
+    return n_frames;
+}
+
+static void send_blocks(pa_pstream *p, pa_mempool *mp) {
+    unsigned i;
+
+    for (i = 0; i < N_BLOCKS; i++) {
+        pa_memchunk chunk;
+
+        chunk.memblock = pa_memblock_new(mp, BLOCK_SIZE);
+        chunk.index = 0;
+        chunk.length = BLOCK_SIZE;
+
+        memset(pa_memblock_acquire(chunk.memblock), (int) i, BLOCK_SIZE);
+        pa_memblock_release(chunk.memblock);
+
+        pa_pstream_send_memblock(p, 0, 0, PA_SEEK_RELATIVE, &chunk, 0);
+        pa_memblock_unref(chunk.memblock);
+    }
+}
+
+/* Sends SHM memblocks from p1 to p2, drops them all at once on the p2
+ * side and returns the frames p2 wrote back for that. These are passed
+ * on to p1, which has to release all of its exported blocks then. */
+static unsigned release_run(bool batches, uint32_t *flags, unsigned *n_ids, uint32_t *ids) {
+    int pipefd[6];
+    pa_mainloop *ml = pa_mainloop_new();
+    pa_mempool *mp = pa_mempool_new(PA_MEM_TYPE_SHARED_POSIX, 0, true);
+    pa_pstream *p1, *p2;
+    uint8_t buf[4096];
+    size_t length;
+    unsigned i, n_frames;
+
+    fail_unless(mp != NULL);
+
+    /* p1 -> p2 on the first pipe, p2 writes to the second one, which
+     * is read here directly. p1 reads from the third one, which gets
+     * what p2 wrote. */
+    fail_unless(pipe(pipefd) == 0);
+    fail_unless(pipe(&pipefd[2]) == 0);
+    fail_unless(pipe(&pipefd[4]) == 0);
+    fail_unless(fcntl(pipefd[2], F_SETFL, O_NONBLOCK) == 0);
+
+    p1 = pa_pstream_new(pa_mainloop_get_api(ml), pa_iochannel_new(pa_mainloop_get_api(ml), pipefd[4], pipefd[1]), mp);
+    p2 = pa_pstream_new(pa_mainloop_get_api(ml), pa_iochannel_new(pa_mainloop_get_api(ml), pipefd[0], pipefd[3]), mp);
+    pa_pstream_enable_shm(p1, true);
+    pa_pstream_enable_shm(p2, true);
+
+    if (batches)
+        pa_pstream_enable_batches(p2);
+
+    n_blocks = 0;
+    pa_pstream_set_receive_memblock_callback(p2, memblock_received, NULL);
+
+    send_blocks(p1, mp);
+
+    while (n_blocks < N_BLOCKS)
+        pa_mainloop_iterate(ml, 1, NULL);
+
+    /* Nothing has been released yet */
+    fail_unless(read_all(pipefd[2], buf, sizeof(buf)) == 0);
+    fail_unless(pa_atomic_load(&pa_mempool_get_stat(mp)->n_exported) == N_BLOCKS);
+
+    for (i = 0; i < N_BLOCKS; i++)
+        pa_memblock_unref(blocks[i]);
+
+    while (pa_pstream_is_pending(p2))
+        pa_mainloop_iterate(ml, 1, NULL);
+
+    length = read_all(pipefd[2], buf, sizeof(buf));
+    n_frames = parse_frames(buf, length, flags, n_ids, ids);
+
+    fail_unless(pa_loop_write(pipefd[5], buf, length, NULL) == (ssize_t) length);
+
+    while (pa_atomic_load(&pa_mempool_get_stat(mp)->n_exported) > 0)
+        pa_mainloop_iterate(ml, 1, NULL);
+
+    pa_pstream_unref(p1);
+    pa_pstream_unref(p2);
+    pa_mempool_unref(mp);
+    pa_mainloop_free(ml);
+
+    pa_close(pipefd[2]);
+    pa_close(pipefd[5]);
+
+    return n_frames;
+}
+
+START_TEST (release_batch_test) {
+    uint32_t flags[N_BLOCKS], ids[N_BLOCKS];
+    unsigned i, j, n_ids;
+
+    /* All releases of the iteration go into a single frame */
+    fail_unless(release_run(true, flags, &n_ids, ids) == 1);
+    fail_unless(flags[0] == FLAG_SHMRELEASE_BATCH);
+    fail_unless(n_ids == N_BLOCKS);
+
+    for (i = 0; i < n_ids; i++)
+        for (j = 0; j < i; j++)
+            fail_unless(ids[i] != ids[j]);
+}
+END_TEST
+
+START_TEST (release_single_test) {
+    uint32_t flags[N_BLOCKS], ids[N_BLOCKS];
+    unsigned i, n_ids;
+
+    /* Without batches (protocol version 35), there is one frame per block */
+    fail_unless(release_run(false, flags, &n_ids, ids) == N_BLOCKS);
+    fail_unless(n_ids == N_BLOCKS);
+
+    for (i = 0; i < N_BLOCKS; i++)
+        fail_unless(flags[i] == FLAG_SHMRELEASE);
+}
+END_TEST
+
+/* Sends SHM memblocks from p1 to p2 through this test, which learns the
+ * block IDs on the way. p1 revokes them all, and p2 has to copy the data
+ * out of the blocks it still holds. */
+START_TEST (revoke_batch_test) {
+    int pipefd[6];
+    pa_mainloop *ml = pa_mainloop_new();
+    pa_mempool *mp = pa_mempool_new(PA_MEM_TYPE_SHARED_POSIX, 0, true);
+    pa_pstream *p1, *p2;
+    uint8_t buf[4096];
+    uint32_t flags[N_BLOCKS], ids[N_BLOCKS], revoked[N_BLOCKS];
+    size_t length;
+    unsigned i, j, n_ids;
+
+    fail_unless(mp != NULL);
+
+    /* p1 writes to the first pipe, which is passed on to p2 on the
+     * second one. p2 writes to the third one, which stays empty. */
+    fail_unless(pipe(pipefd) == 0);
+    fail_unless(pipe(&pipefd[2]) == 0);
+    fail_unless(pipe(&pipefd[4]) == 0);
+    fail_unless(fcntl(pipefd[0], F_SETFL, O_NONBLOCK) == 0);
+
+    p1 = pa_pstream_new(pa_mainloop_get_api(ml), pa_iochannel_new(pa_mainloop_get_api(ml), pipefd[4], pipefd[1]), mp);
+    p2 = pa_pstream_new(pa_mainloop_get_api(ml), pa_iochannel_new(pa_mainloop_get_api(ml), pipefd[2], pipefd[5]), mp);
+    pa_pstream_enable_shm(p1, true);
+    pa_pstream_enable_shm(p2, true);
+    pa_pstream_enable_batches(p1);
+
+    n_blocks = 0;
+    pa_pstream_set_receive_memblock_callback(p2, memblock_received, NULL);
+
+    send_blocks(p1, mp);
+
+    while (pa_pstream_is_pending(p1))
+        pa_mainloop_iterate(ml, 1, NULL);
+
+    length = read_all(pipefd[0], buf, sizeof(buf));
+    fail_unless(parse_frames(buf, length, flags, &n_ids, ids) == N_BLOCKS);
+    fail_unless(n_ids == N_BLOCKS);
+    fail_unless(pa_loop_write(pipefd[3], buf, length, NULL) == (ssize_t) length);
+
+    while (n_blocks < N_BLOCKS)
+        pa_mainloop_iterate(ml, 1, NULL);
+
+    fail_unless(pa_atomic_load(&pa_mempool_get_stat(mp)->n_imported) == N_BLOCKS);
+
+    for (i = 0; i < N_BLOCKS; i++)
+        pa_pstream_send_revoke(p1, ids[i]);
+
+    while (pa_pstream_is_pending(p1))
+        pa_mainloop_iterate(ml, 1, NULL);
+
+    /* All revokes of the iteration go into a single frame */
+    length = read_all(pipefd[0], buf, sizeof(buf));
+    fail_unless(parse_frames(buf, length, flags, &n_ids, revoked) == 1);
+    fail_unless(flags[0] == FLAG_SHMREVOKE_BATCH);
+    fail_unless(n_ids == N_BLOCKS);
+
+    for (i = 0; i < N_BLOCKS; i++)
+        fail_unless(revoked[i] == ids[i]);
+
+    fail_unless(pa_loop_write(pipefd[3], buf, length, NULL) == (ssize_t) length);
+
+    while (pa_atomic_load(&pa_mempool_get_stat(mp)->n_imported) > 0)
+        pa_mainloop_iterate(ml, 1, NULL);
+
+    for (i = 0; i < N_BLOCKS; i++) {
+        const uint8_t *d = pa_memblock_acquire(blocks[i]);
+
+        for (j = 0; j < BLOCK_SIZE; j++)
+            fail_unless(d[j] == i);
+
+        pa_memblock_release(blocks[i]);
+        pa_memblock_unref(blocks[i]);
+    }
+
+    pa_pstream_unref(p1);
+    pa_pstream_unref(p2);
+    pa_mempool_unref(mp);
+    pa_mainloop_free(ml);
+
+    pa_close(pipefd[0]);
+    pa_close(pipefd[3]);
+}
+END_TEST
+
+/* Revokes queued after a memblock frame must not join a batch that was
+ * queued before it, the memblock could be one of the revoked blocks */
+START_TEST (revoke_order_test) {
+    int pipefd[4];
+    pa_mainloop *ml = pa_mainloop_new();
+    pa_mempool *mp = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true);
+    pa_pstream *p;
+    pa_memchunk chunk;
+    uint8_t buf[4096];
+    uint32_t flags[8], ids[8];
+    size_t length;
+    unsigned n_ids;
+
+    fail_unless(pipe(pipefd) == 0);
+    fail_unless(pipe(&pipefd[2]) == 0);
+    fail_unless(fcntl(pipefd[0], F_SETFL, O_NONBLOCK) == 0);
+
+    p = pa_pstream_new(pa_mainloop_get_api(ml), pa_iochannel_new(pa_mainloop_get_api(ml), pipefd[2], pipefd[1]), mp);
+    pa_pstream_enable_batches(p);
+
+    pa_pstream_send_revoke(p, 1);
+    pa_pstream_send_revoke(p, 2);
+
+    chunk.memblock = pa_memblock_new(mp, BLOCK_SIZE);
+    chunk.index = 0;
+    chunk.length = BLOCK_SIZE;
+    pa_pstream_send_memblock(p, 0, 0, PA_SEEK_RELATIVE, &chunk, 0);
+    pa_memblock_unref(chunk.memblock);
+
+    pa_pstream_send_revoke(p, 3);
+
+    while (pa_pstream_is_pending(p))
+        pa_mainloop_iterate(ml, 1, NULL);
+
+    /* Once the batch is written, revokes go into a new one again */
+    pa_pstream_send_revoke(p, 4);
+    pa_pstream_send_revoke(p, 5);
+
+    while (pa_pstream_is_pending(p))
+        pa_mainloop_iterate(ml, 1, NULL);
+
+    length = read_all(pipefd[0], buf, sizeof(buf));
+    fail_unless(parse_frames(buf, length, flags, &n_ids, ids) == 4);
+    fail_unless(flags[0] == FLAG_SHMREVOKE_BATCH);
+    fail_unless((flags[1] & FLAG_SHMMASK) == 0);
+    fail_unless(flags[2] == FLAG_SHMREVOKE);
+    fail_unless(flags[3] == FLAG_SHMREVOKE_BATCH);
+
+    fail_unless(n_ids == 5);
+    fail_unless(ids[0] == 1 && ids[1] == 2 && ids[2] == 3 && ids[3] == 4 && ids[4] == 5);
+
+    pa_pstream_unref(p);
+    pa_mempool_unref(mp);
+    pa_mainloop_free(ml);
+
+    pa_close(pipefd[0]);
+    pa_close(pipefd[3]);
+}
+END_TEST
+
+/* Every third frame is a memblock, the others are packets. Their sizes
+ * vary, so that partial writes end at different points of the frames. */
+static bool frame_is_memblock(unsigned k) {
+    return k % 3 == 2;
+}
+
+static size_t frame_size(unsigned k) {
+    return frame_is_memblock(k) ? 1000 + k * 131 : 5 + (k * 997) % 3000;
+}
+
+static uint8_t frame_byte(unsigned k, size_t i) {
+    return (uint8_t) (k * 7 + i);
+}
+
+static unsigned next_frame;
+static size_t next_index;
+
+static void packet_received(pa_pstream *p, pa_packet *packet, pa_cmsg_ancil_data *ancil_data, void *userdata) {
+    const uint8_t *data;
+    size_t length, i;
+
+    fail_unless(next_frame < N_FRAMES);
+    fail_unless(!frame_is_memblock(next_frame));
+
+    data = pa_packet_data(packet, &length);
+    fail_unless(length == frame_size(next_frame));
+
+    for (i = 0; i < length; i++)
+        fail_unless(data[i] == frame_byte(next_frame, i));
+
+    next_frame++;
+}
+
+/* Memblock frames that arrive in pieces are passed on piece by piece */
+static void memblock_piece_received(pa_pstream *p, uint32_t channel, int64_t offset, pa_seek_mode_t seek, const pa_memchunk *chunk, void *userdata) {
+    const uint8_t *data;
+    size_t i;
+
+    fail_unless(next_frame < N_FRAMES);
+    fail_unless(frame_is_memblock(next_frame));
+    fail_unless(channel == next_frame);
+    fail_unless(next_index + chunk->length <= frame_size(next_frame));
+
+    data = pa_memblock_acquire_chunk(chunk);
+    for (i = 0; i < chunk->length; i++)
+        fail_unless(data[i] == frame_byte(next_frame, next_index + i));
+    pa_memblock_release(chunk->memblock);
+
+    next_index += chunk->length;
+
+    if (next_index == frame_size(next_frame)) {
+        next_frame++;
+        next_index = 0;
+    }
+}
+
+static void send_frames(pa_pstream *p, pa_mempool *mp, unsigned first, unsigned n) {
+    unsigned k;
+    size_t i;
+
+    for (k = first; k < first + n; k++) {
+        uint8_t *data;
+
+        if (frame_is_memblock(k)) {
+            pa_memchunk chunk;
+
+            chunk.memblock = pa_memblock_new(mp, frame_size(k));
+            chunk.index = 0;
+            chunk.length = frame_size(k);
+
+            data = pa_memblock_acquire(chunk.memblock);
+            for (i = 0; i < chunk.length; i++)
+                data[i] = frame_byte(k, i);
+            pa_memblock_release(chunk.memblock);
+
+            pa_pstream_send_memblock(p, k, 0, PA_SEEK_RELATIVE, &chunk, 0);
+            pa_memblock_unref(chunk.memblock);
+        } else {
+            pa_packet *packet = pa_packet_new(frame_size(k));
+            size_t length;
+
+            data = (uint8_t *) pa_packet_data(packet, &length);
+            for (i = 0; i < length; i++)
+                data[i] = frame_byte(k, i);
+
+            pa_pstream_send_packet(p, packet, NULL);
+            pa_packet_unref(packet);
+        }
+    }
+}
+
+START_TEST (writev_partial_test) {
+    int pipefd[4];
+    pa_mainloop *ml = pa_mainloop_new();
+    pa_mempool *mp = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true);
+    pa_pstream *p1, *p2;
+
+    fail_unless(pipe(pipefd) == 0);
+    fail_unless(pipe(&pipefd[2]) == 0);
+
+#ifdef F_SETPIPE_SZ
+    /* A small pipe, so that most of the gathered writes are partial */
+    fcntl(pipefd[1], F_SETPIPE_SZ, 4096);
+#endif
+
+    p1 = pa_pstream_new(pa_mainloop_get_api(ml), pa_iochannel_new(pa_mainloop_get_api(ml), pipefd[2], pipefd[1]), mp);
+    p2 = pa_pstream_new(pa_mainloop_get_api(ml), pa_iochannel_new(pa_mainloop_get_api(ml), pipefd[0], pipefd[3]), mp);
+
+    next_frame = 0;
+    next_index = 0;
+    pa_pstream_set_receive_packet_callback(p2, packet_received, NULL);
+    pa_pstream_set_receive_memblock_callback(p2, memblock_piece_received, NULL);
+
+    /* Everything is queued before the first write, and arrives in order */
+    send_frames(p1, mp, 0, N_FRAMES);
+
+    while (next_frame < N_FRAMES)
+        pa_mainloop_iterate(ml, 1, NULL);
+
+    fail_unless(!pa_pstream_is_pending(p1));
+
+    pa_pstream_unref(p1);
+    pa_pstream_unref(p2);
+    pa_mempool_unref(mp);
+    pa_mainloop_free(ml);
+}
+END_TEST
+
+/* Returns the number of frames in each of the records written to the
+ * socket so far. Each record is one writev() call. */
+static unsigned read_records(int fd, unsigned *n_frames, unsigned max) {
+    static uint8_t buf[256*1024];
+    unsigned n_records = 0;
+    ssize_t r;
+
+    while ((r = recv(fd, buf, sizeof(buf), 0)) > 0) {
+        size_t i = 0;
+
+        fail_unless(n_records < max);
+        n_frames[n_records] = 0;
+
+        /* Records hold complete frames only */
+        while (i < (size_t) r) {
+            uint32_t length;
+
+            fail_unless((size_t) r - i >= DESCRIPTOR_SIZE);
+            memcpy(&length, buf + i + DESCRIPTOR_LENGTH * sizeof(uint32_t), sizeof(length));
+            i += DESCRIPTOR_SIZE + ntohl(length);
+            n_frames[n_records]++;
+        }
+
+        fail_unless(i == (size_t) r);
+        n_records++;
+    }
+
+    fail_unless(r < 0 && errno == EAGAIN);
+
+    return n_records;
+}
+
+START_TEST (writev_gather_test) {
+    int fds[2], pipefd[2];
+    pa_mainloop *ml = pa_mainloop_new();
+    pa_mempool *mp = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true);
+    pa_pstream *p;
+    unsigned n_frames[8];
+    unsigned k;
+
+    /* A packet socket keeps the boundaries of the writes */
+    fail_unless(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) == 0);
+    fail_unless(fcntl(fds[1], F_SETFL, O_NONBLOCK) == 0);
+    fail_unless(pipe(pipefd) == 0);
+
+    p = pa_pstream_new(pa_mainloop_get_api(ml), pa_iochannel_new(pa_mainloop_get_api(ml), pipefd[0], fds[0]), mp);
+
+    /* Small frames are written GATHER_MAX + 1 at a time */
+    for (k = 0; k < 2 * (GATHER_MAX + 1) + 6; k++) {
+        pa_packet *packet = pa_packet_new(100);
+
+        pa_pstream_send_packet(p, packet, NULL);
+        pa_packet_unref(packet);
+    }
+
+    while (pa_pstream_is_pending(p))
+        pa_mainloop_iterate(ml, 1, NULL);
+
+    fail_unless(read_records(fds[1], n_frames, PA_ELEMENTSOF(n_frames)) == 3);
+    fail_unless(n_frames[0] == GATHER_MAX + 1);
+    fail_unless(n_frames[1] == GATHER_MAX + 1);
+    fail_unless(n_frames[2] == 6);
+
+    /* Gathering stops once GATHER_BYTES_MAX are reached, which the
+     * second of the big memblocks passes */
+    for (k = 0; k < 4; k++) {
+        if (k == 1 || k == 2) {
+            pa_memchunk chunk;
+
+            chunk.memblock = pa_memblock_new(mp, 40*1024);
+            chunk.index = 0;
+            chunk.length = 40*1024;
+            pa_pstream_send_memblock(p, k, 0, PA_SEEK_RELATIVE, &chunk, 0);
+            pa_memblock_unref(chunk.memblock);
+        } else {
+            pa_packet *packet = pa_packet_new(100);
+
+            pa_pstream_send_packet(p, packet, NULL);
+            pa_packet_unref(packet);
+        }
+    }
+
+    while (pa_pstream_is_pending(p))
+        pa_mainloop_iterate(ml, 1, NULL);
+
+    fail_unless(read_records(fds[1], n_frames, PA_ELEMENTSOF(n_frames)) == 2);
+    fail_unless(n_frames[0] == 3);
+    fail_unless(n_frames[1] == 1);
+
+    pa_pstream_unref(p);
+    pa_mempool_unref(mp);
+    pa_mainloop_free(ml);
+
+    pa_close(fds[1]);
+    pa_close(pipefd[1]);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("pstream");
+    tc = tcase_create("pstream");
+    tcase_add_test(tc, release_batch_test);
+    tcase_add_test(tc, release_single_test);
+    tcase_add_test(tc, revoke_batch_test);
+    tcase_add_test(tc, revoke_order_test);
+    tcase_add_test(tc, writev_partial_test);
+    tcase_add_test(tc, writev_gather_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -94,7 +94,7 @@ int main(int argc, char *argv[]) {
                 pa_log_info("Converting from '%s' to '%s' with flags %s.", pa_channel_map_snprint(a, sizeof(a), &maps[i]),
                             pa_channel_map_snprint(b, sizeof(b), &maps[j]), flag_sets[k].str);
 
-                r = pa_resampler_new(pool, &ss1, &maps[i], &ss2, &maps[j], crossover_freq, PA_RESAMPLER_AUTO,
+                r = pa_resampler_new(pool, NULL, &ss1, &maps[i], &ss2, &maps[j], crossover_freq, PA_RESAMPLER_AUTO,
                                      flag_sets[k].value);
 
                 /* We don't really care for the resampler. We just want to
@@ -189,6 +189,7 @@ static void help(const char *argv0) {
            "      --frequency=unsigned            Frequency of square wave\n"
            "      --samples=unsigned              Number of samples for square wave\n"
            "      --rewind=unsigned               Number of output samples to rewind\n"
+           "      --max-difference=float          Fail if the outputs differ by more than this\n"
            "\n"
            "This test generates samples for a square wave of given frequency, number of samples\n"
            "and input sample rate. Then this input data is resampled to the output rate, rewound\n"
@@ -206,6 +207,7 @@ enum {
     ARG_FREQUENCY,
     ARG_SAMPLES,
     ARG_REWIND,
+    ARG_MAX_DIFFERENCE,
     ARG_RESAMPLE_METHOD,
     ARG_DUMP_RESAMPLE_METHODS
 };
@@ -231,7 +233,7 @@ int main(int argc, char *argv[]) {
     pa_usec_t ts;
     pa_memblockq *history_queue = NULL;
     size_t in_rewind_size, in_frame_size, history_size, out_rewind_size, old_length, in_resampler_buffer, n_out_expected;
-    float max_diff;
+    float max_diff, max_allowed_diff = -1;
     double delay_before, delay_after, delay_expected;
 
     static const struct option long_options[] = {
@@ -243,6 +245,7 @@ int main(int argc, char *argv[]) {
         {"frequency",             1, NULL, ARG_FREQUENCY},
         {"samples",               1, NULL, ARG_SAMPLES},
         {"rewind",                1, NULL, ARG_REWIND},
+        {"max-difference",        1, NULL, ARG_MAX_DIFFERENCE},
         {"resample-method",       1, NULL, ARG_RESAMPLE_METHOD},
         {"dump-resample-methods", 0, NULL, ARG_DUMP_RESAMPLE_METHODS},
         {NULL,                    0, NULL, 0}
@@ -309,6 +312,10 @@ int main(int argc, char *argv[]) {
                 rewind = (unsigned) atoi(optarg);
                 break;
 
+            case ARG_MAX_DIFFERENCE:
+                max_allowed_diff = (float) atof(optarg);
+                break;
+
             case ARG_RESAMPLE_METHOD:
                 if (*optarg == '\0' || pa_streq(optarg, "help")) {
                     dump_resample_methods();
@@ -333,7 +340,7 @@ int main(int argc, char *argv[]) {
 
     /* Setup resampler */
     ts = pa_rtclock_now();
-    pa_assert_se(resampler = pa_resampler_new(pool, &a, NULL, &b, NULL, crossover_freq, method, 0));
+    pa_assert_se(resampler = pa_resampler_new(pool, NULL, &a, NULL, &b, NULL, crossover_freq, method, 0));
     pa_log_info("Init took %llu usec", (long long unsigned)(pa_rtclock_now() - ts));
 
     /* Generate input data */
@@ -419,6 +426,11 @@ int main(int argc, char *argv[]) {
     max_diff = compare_blocks(&b, &out_chunk, &rewound_chunk);
     pa_log_info("Maximum difference is %.*g", 6, max_diff);
 
+    if (max_allowed_diff >= 0 && max_diff > max_allowed_diff) {
+        pa_log_warn("Maximum difference %.*g is larger than the allowed %.*g", 6, max_diff, 6, max_allowed_diff);
+        ret = 1;
+    }
+
     pa_memblock_unref(rewound_chunk.memblock);
 
 quit1:
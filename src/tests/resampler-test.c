@@ -418,7 +418,7 @@ int main(int argc, char *argv[]) {
                    b.rate, b.channels, pa_sample_format_to_string(b.format));
 
         ts = pa_rtclock_now();
-        pa_assert_se(resampler = pa_resampler_new(pool, &a, NULL, &b, NULL, crossover_freq, method, 0));
+        pa_assert_se(resampler = pa_resampler_new(pool, NULL, &a, NULL, &b, NULL, crossover_freq, method, 0));
         pa_log_info("init: %llu", (long long unsigned)(pa_rtclock_now() - ts));
 
         i.memblock = pa_memblock_new(pool, pa_usec_to_bytes(1*PA_USEC_PER_SEC, &a));
@@ -449,22 +449,28 @@ int main(int argc, char *argv[]) {
                        pa_sample_format_to_string(b.format),
                        pa_sample_format_to_string(a.format));
 
-            pa_assert_se(forth = pa_resampler_new(pool, &a, NULL, &b, NULL, crossover_freq, method, 0));
-            pa_assert_se(back = pa_resampler_new(pool, &b, NULL, &a, NULL, crossover_freq, method, 0));
+            pa_assert_se(forth = pa_resampler_new(pool, NULL, &a, NULL, &b, NULL, crossover_freq, method, 0));
+            pa_assert_se(back = pa_resampler_new(pool, NULL, &b, NULL, &a, NULL, crossover_freq, method, 0));
 
             i.memblock = generate_block(pool, &a);
             i.length = pa_memblock_get_length(i.memblock);
             i.index = 0;
             pa_resampler_run(forth, &i, &j);
-            pa_resampler_run(back, &j, &k);
-
             dump_block("before", &a, &i);
-            dump_block("after", &b, &j);
-            dump_block("reverse", &a, &k);
-
             pa_memblock_unref(i.memblock);
-            pa_memblock_unref(j.memblock);
-            pa_memblock_unref(k.memblock);
+
+            /* Resamplers with a filter delay may not return anything for
+             * such a short block yet */
+            if (j.memblock) {
+                dump_block("after", &b, &j);
+                pa_resampler_run(back, &j, &k);
+                pa_memblock_unref(j.memblock);
+
+                if (k.memblock) {
+                    dump_block("reverse", &a, &k);
+                    pa_memblock_unref(k.memblock);
+                }
+            }
 
             pa_resampler_free(forth);
             pa_resampler_free(back);
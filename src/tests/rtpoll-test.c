@@ -21,7 +21,12 @@
 
 #include <check.h>
 #include <signal.h>
+#include <unistd.h>
 
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+
+#include <pulsecore/core-util.h>
 #include <pulsecore/poll.h>
 #include <pulsecore/log.h>
 #include <pulsecore/rtpoll.h>
@@ -82,15 +87,155 @@ START_TEST (rtpoll_test) {
 }
 END_TEST
 
+static pa_rtpoll *rtpoll_new(bool epoll) {
+    pa_rtpoll *p;
+
+    if (epoll)
+        unsetenv("PULSE_NO_EPOLL");
+    else
+        setenv("PULSE_NO_EPOLL", "1", 1);
+
+    p = pa_rtpoll_new();
+    unsetenv("PULSE_NO_EPOLL");
+
+    return p;
+}
+
+/* Changes fds and events behind the back of the rtpoll, which needs to
+ * notice that with persistent registrations */
+static void run_fd_test(bool epoll) {
+    pa_rtpoll *p;
+    pa_rtpoll_item *i, *j;
+    struct pollfd *pollfd;
+    int a[2], b[2];
+    char x = 'x';
+
+    pa_log_debug("Testing fd changes %s epoll", epoll ? "with" : "without");
+
+    fail_unless(pipe(a) == 0);
+    fail_unless(pipe(b) == 0);
+
+    p = rtpoll_new(epoll);
+
+    i = pa_rtpoll_item_new(p, PA_RTPOLL_NEVER, 1);
+    pollfd = pa_rtpoll_item_get_pollfd(i, NULL);
+    pollfd->fd = a[0];
+    pollfd->events = POLLIN;
+
+    fail_unless(write(a[1], &x, 1) == 1);
+
+    fail_unless(pa_rtpoll_run(p) > 0);
+    fail_unless(!pa_rtpoll_timer_elapsed(p));
+    fail_unless(pollfd->revents == POLLIN);
+
+    /* Still readable, but we don't ask anymore */
+    pollfd->events = 0;
+    pa_rtpoll_set_timer_relative(p, 10 * PA_USEC_PER_MSEC);
+    fail_unless(pa_rtpoll_run(p) > 0);
+    fail_unless(pa_rtpoll_timer_elapsed(p));
+    fail_unless(pollfd->revents == 0);
+
+    /* Same slot, different fd */
+    pollfd->fd = b[0];
+    pollfd->events = POLLIN;
+    fail_unless(write(b[1], &x, 1) == 1);
+    pa_rtpoll_set_timer_disabled(p);
+    fail_unless(pa_rtpoll_run(p) > 0);
+    fail_unless(!pa_rtpoll_timer_elapsed(p));
+    fail_unless(pollfd->revents == POLLIN);
+    fail_unless(read(b[0], &x, 1) == 1);
+
+    /* A second item watching the same fd, which moves the first one */
+    j = pa_rtpoll_item_new(p, PA_RTPOLL_EARLY, 1);
+    pollfd = pa_rtpoll_item_get_pollfd(j, NULL);
+    pollfd->fd = a[0];
+    pollfd->events = POLLIN;
+    pollfd = pa_rtpoll_item_get_pollfd(i, NULL);
+    pollfd->fd = a[0];
+    pollfd->events = POLLIN;
+
+    fail_unless(pa_rtpoll_run(p) > 0);
+    fail_unless(pa_rtpoll_item_get_pollfd(i, NULL)->revents == POLLIN);
+    fail_unless(pa_rtpoll_item_get_pollfd(j, NULL)->revents == POLLIN);
+
+    /* Nothing to read anymore, so only the timer can wake us up */
+    fail_unless(read(a[0], &x, 1) == 1);
+    pa_rtpoll_set_timer_relative(p, 10 * PA_USEC_PER_MSEC);
+    fail_unless(pa_rtpoll_run(p) > 0);
+    fail_unless(pa_rtpoll_timer_elapsed(p));
+    fail_unless(pa_rtpoll_item_get_pollfd(i, NULL)->revents == 0);
+    fail_unless(pa_rtpoll_item_get_pollfd(j, NULL)->revents == 0);
+
+    pa_rtpoll_item_free(j);
+    pa_rtpoll_item_free(i);
+    pa_rtpoll_free(p);
+
+    pa_close_pipe(a);
+    pa_close_pipe(b);
+}
+
+START_TEST (rtpoll_fd_test) {
+    run_fd_test(true);
+    run_fd_test(false);
+}
+END_TEST
+
+#define TIMER_PERIOD (2 * PA_USEC_PER_MSEC)
+#define TIMER_RUNS 100
+
+/* Wakes up at absolute deadlines and checks that we never wake up
+ * early. Reports how late we were on average. */
+static void run_timer_test(bool epoll) {
+    pa_rtpoll *p;
+    pa_usec_t start, deadline, now, late = 0, max_late = 0;
+    unsigned k;
+
+    p = rtpoll_new(epoll);
+
+    start = pa_rtclock_now();
+
+    for (k = 1; k <= TIMER_RUNS; k++) {
+        deadline = start + k * TIMER_PERIOD;
+        pa_rtpoll_set_timer_absolute(p, deadline);
+
+        fail_unless(pa_rtpoll_run(p) > 0);
+        fail_unless(pa_rtpoll_timer_elapsed(p));
+
+        now = pa_rtclock_now();
+        fail_unless(now >= deadline);
+
+        late += now - deadline;
+        max_late = PA_MAX(max_late, now - deadline);
+    }
+
+    pa_log_debug("%s: %llu us late on average, %llu us at most",
+                 epoll ? "epoll" : "poll",
+                 (unsigned long long) (late / TIMER_RUNS),
+                 (unsigned long long) max_late);
+
+    pa_rtpoll_free(p);
+}
+
+START_TEST (rtpoll_timer_test) {
+    run_timer_test(true);
+    run_timer_test(false);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
     TCase *tc;
     SRunner *sr;
 
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
     s = suite_create("RT Poll");
     tc = tcase_create("rtpoll");
     tcase_add_test(tc, rtpoll_test);
+    tcase_add_test(tc, rtpoll_fd_test);
+    tcase_add_test(tc, rtpoll_timer_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
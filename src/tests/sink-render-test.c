@@ -0,0 +1,275 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+
+#include <pulse/mainloop.h>
+#include <pulse/volume.h>
+
+#include <pulsecore/core.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/rtpoll.h>
+#include <pulsecore/sink.h>
+#include <pulsecore/sink-input.h>
+#include <pulsecore/source-output.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/thread-mq.h>
+
+/* Renders with pa_sink_render() or pa_sink_render_into() in the IO
+ * thread, the chunk is passed as data */
+enum {
+    SINK_MESSAGE_RENDER = PA_SINK_MESSAGE_MAX,
+    SINK_MESSAGE_RENDER_INTO
+};
+
+#define N_FRAMES 256
+#define SAMPLE 0x4000
+
+static const pa_sample_spec ss = {
+    .format = PA_SAMPLE_S16NE,
+    .rate = 48000,
+    .channels = 2
+};
+
+static pa_channel_map map;
+
+static pa_mainloop *mainloop;
+static pa_core *core;
+static pa_rtpoll *rtpoll;
+static pa_thread_mq thread_mq;
+static pa_thread *thread;
+static pa_sink *sink;
+static pa_sink_input *input;
+static pa_source_output *output;
+
+/* First sample the monitor passed to the direct output, -1 if none */
+static int monitor_sample;
+
+static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
+    pa_sink *s = PA_SINK(o);
+
+    switch (code) {
+        case SINK_MESSAGE_RENDER:
+            pa_sink_render(s, (size_t) offset, data);
+            return 0;
+
+        case SINK_MESSAGE_RENDER_INTO:
+            pa_sink_render_into(s, data);
+            return 0;
+    }
+
+    return pa_sink_process_msg(o, code, data, offset, chunk);
+}
+
+static void thread_func(void *userdata) {
+    pa_thread_mq_install(&thread_mq);
+
+    while (pa_rtpoll_run(rtpoll) > 0)
+        ;
+}
+
+static int input_pop(pa_sink_input *i, size_t length, pa_memchunk *chunk) {
+    int16_t *d;
+    size_t n;
+
+    chunk->memblock = pa_memblock_new(core->mempool, length);
+    chunk->index = 0;
+    chunk->length = length;
+
+    d = pa_memblock_acquire(chunk->memblock);
+    for (n = 0; n < length / sizeof(int16_t); n++)
+        d[n] = SAMPLE;
+    pa_memblock_release(chunk->memblock);
+
+    return 0;
+}
+
+static void input_process_rewind(pa_sink_input *i, size_t nbytes) {
+}
+
+static void input_kill(pa_sink_input *i) {
+    fail_unless(false);
+}
+
+static void output_push(pa_source_output *o, const pa_memchunk *chunk) {
+    const int16_t *d;
+
+    if (monitor_sample >= 0)
+        return;
+
+    d = pa_memblock_acquire_chunk(chunk);
+    monitor_sample = d[0];
+    pa_memblock_release(chunk->memblock);
+}
+
+static void output_kill(pa_source_output *o) {
+    fail_unless(false);
+}
+
+static void setup(void) {
+    pa_sink_new_data sink_data;
+    pa_sink_input_new_data input_data;
+    pa_source_output_new_data output_data;
+    pa_cvolume volume;
+
+    fail_unless((mainloop = pa_mainloop_new()) != NULL);
+    fail_unless((core = pa_core_new(pa_mainloop_get_api(mainloop), false, false, 0)) != NULL);
+
+    /* Otherwise the sink volume would follow the input, and the input
+     * would play at unity relative to it */
+    core->flat_volumes = false;
+
+    pa_channel_map_init_stereo(&map);
+
+    rtpoll = pa_rtpoll_new();
+    fail_unless(pa_thread_mq_init(&thread_mq, pa_mainloop_get_api(mainloop), rtpoll) == 0);
+
+    pa_sink_new_data_init(&sink_data);
+    sink_data.driver = __FILE__;
+    pa_sink_new_data_set_name(&sink_data, "test_sink");
+    pa_sink_new_data_set_sample_spec(&sink_data, &ss);
+    pa_sink_new_data_set_channel_map(&sink_data, &map);
+    fail_unless((sink = pa_sink_new(core, &sink_data, 0)) != NULL);
+    pa_sink_new_data_done(&sink_data);
+
+    sink->parent.process_msg = sink_process_msg;
+    pa_sink_set_asyncmsgq(sink, thread_mq.inq);
+    pa_sink_set_rtpoll(sink, rtpoll);
+
+    fail_unless((thread = pa_thread_new("sink-render-test", thread_func, NULL)) != NULL);
+    pa_sink_put(sink);
+
+    pa_sink_input_new_data_init(&input_data);
+    input_data.driver = __FILE__;
+    pa_sink_input_new_data_set_sink(&input_data, sink, false, true);
+    pa_sink_input_new_data_set_sample_spec(&input_data, &ss);
+    pa_sink_input_new_data_set_channel_map(&input_data, &map);
+    pa_cvolume_set(&volume, ss.channels, pa_sw_volume_from_linear(0.5));
+    pa_sink_input_new_data_set_volume(&input_data, &volume);
+    fail_unless(pa_sink_input_new(&input, core, &input_data) == 0);
+    pa_sink_input_new_data_done(&input_data);
+
+    input->pop = input_pop;
+    input->process_rewind = input_process_rewind;
+    input->kill = input_kill;
+    pa_sink_input_put(input);
+
+    /* Gets the input's data as rendered by the monitor path of the sink */
+    pa_source_output_new_data_init(&output_data);
+    output_data.driver = __FILE__;
+    output_data.direct_on_input = input;
+    pa_source_output_new_data_set_source(&output_data, sink->monitor_source, false, true);
+    pa_source_output_new_data_set_sample_spec(&output_data, &ss);
+    pa_source_output_new_data_set_channel_map(&output_data, &map);
+    fail_unless(pa_source_output_new(&output, core, &output_data) == 0);
+    pa_source_output_new_data_done(&output_data);
+
+    output->push = output_push;
+    output->kill = output_kill;
+    pa_source_output_put(output);
+
+    monitor_sample = -1;
+}
+
+static void teardown(void) {
+    pa_source_output_unlink(output);
+    pa_source_output_unref(output);
+    pa_sink_input_unlink(input);
+    pa_sink_input_unref(input);
+    pa_sink_unlink(sink);
+
+    pa_asyncmsgq_send(thread_mq.inq, NULL, PA_MESSAGE_SHUTDOWN, NULL, 0, NULL);
+    pa_thread_free(thread);
+
+    pa_sink_unref(sink);
+    pa_thread_mq_done(&thread_mq);
+    pa_rtpoll_free(rtpoll);
+    pa_core_unref(core);
+    pa_mainloop_free(mainloop);
+}
+
+static void check_chunk(const pa_memchunk *chunk, int16_t expected) {
+    const int16_t *d;
+    size_t n;
+
+    fail_unless(chunk->length > 0);
+
+    d = pa_memblock_acquire_chunk(chunk);
+    for (n = 0; n < chunk->length / sizeof(int16_t); n++)
+        ck_assert_int_eq(d[n], expected);
+    pa_memblock_release(chunk->memblock);
+}
+
+/* A single input at half volume renders at half of its amplitude, with
+ * the volume applied once, not once by the sink and once by the mixer */
+START_TEST (sink_render_test) {
+    pa_memchunk chunk;
+
+    pa_assert_se(pa_asyncmsgq_send(sink->asyncmsgq, PA_MSGOBJECT(sink), SINK_MESSAGE_RENDER, &chunk, N_FRAMES * pa_frame_size(&ss), NULL) == 0);
+
+    check_chunk(&chunk, SAMPLE / 2);
+    pa_memblock_unref(chunk.memblock);
+
+    /* The monitor gets the input at its own volume, also applied once */
+    ck_assert_int_eq(monitor_sample, SAMPLE / 2);
+}
+END_TEST
+
+START_TEST (sink_render_into_test) {
+    pa_memchunk chunk;
+
+    chunk.memblock = pa_memblock_new(core->mempool, N_FRAMES * pa_frame_size(&ss));
+    chunk.index = 0;
+    chunk.length = N_FRAMES * pa_frame_size(&ss);
+
+    pa_assert_se(pa_asyncmsgq_send(sink->asyncmsgq, PA_MSGOBJECT(sink), SINK_MESSAGE_RENDER_INTO, &chunk, 0, NULL) == 0);
+
+    check_chunk(&chunk, SAMPLE / 2);
+    pa_memblock_unref(chunk.memblock);
+
+    ck_assert_int_eq(monitor_sample, SAMPLE / 2);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Sink render");
+    tc = tcase_create("sink-render");
+    tcase_add_checked_fixture(tc, setup, teardown);
+    tcase_add_test(tc, sink_render_test);
+    tcase_add_test(tc, sink_render_into_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -80,8 +80,7 @@ static void packet_test(unsigned npackets, size_t plength, pa_mainloop *ml, pa_p
     pa_packet_unref(packet);
 }
 
-START_TEST (srbchannel_test) {
-
+static void srbchannel_run(size_t capacity, pa_usec_t busy_poll) {
     int pipefd[4];
 
     pa_mainloop *ml = pa_mainloop_new();
@@ -105,20 +104,40 @@ START_TEST (srbchannel_test) {
 
     pa_log_debug("And now the same thing with srbchannel...");
 
-    sr1 = pa_srbchannel_new(pa_mainloop_get_api(ml), mp);
+    sr1 = pa_srbchannel_new(pa_mainloop_get_api(ml), mp, capacity);
+    fail_unless(sr1 != NULL);
+    pa_srbchannel_set_busy_poll(sr1, busy_poll);
     pa_srbchannel_export(sr1, &srt);
     pa_pstream_set_srbchannel(p1, sr1);
     sr2 = pa_srbchannel_new_from_template(pa_mainloop_get_api(ml), &srt);
+    fail_unless(sr2 != NULL);
     pa_pstream_set_srbchannel(p2, sr2);
 
+    /* The other side takes the capacity over from the shm block */
+    if (capacity > 0)
+        fail_unless(pa_srbchannel_get_capacity(sr1) == capacity);
+    fail_unless(pa_srbchannel_get_capacity(sr2) == pa_srbchannel_get_capacity(sr1));
+
     packet_test(250, 5, ml, p1, p2);
     packet_test(10, 1234567, ml, p1, p2);
 
+    /* The large packets can't have fit into the ringbuffer at once */
+    fail_unless(pa_srbchannel_get_stat(sr1)->n_full > 0);
+
     pa_pstream_unref(p1);
     pa_pstream_unref(p2);
     pa_mempool_unref(mp);
     pa_mainloop_free(ml);
 }
+
+START_TEST (srbchannel_test) {
+    srbchannel_run(0, 0);
+}
+END_TEST
+
+START_TEST (srbchannel_capacity_test) {
+    srbchannel_run(4096, 20);
+}
 END_TEST
 
 
@@ -134,6 +153,7 @@ int main(int argc, char *argv[]) {
     s = suite_create("srbchannel");
     tc = tcase_create("srbchannel");
     tcase_add_test(tc, srbchannel_test);
+    tcase_add_test(tc, srbchannel_capacity_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
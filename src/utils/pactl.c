@@ -144,6 +144,7 @@ static enum {
     SET_SINK_FORMATS,
     SET_PORT_LATENCY_OFFSET,
     SEND_MESSAGE,
+    GET_SINK_TIMING_STATS,
     SUBSCRIBE
 } action = NONE;
 
@@ -1768,6 +1769,87 @@ static void list_handlers_callback(pa_context *c, int success, char *response, v
     complete_action();
 }
 
+static int print_timing_histogram(const pa_json_object *o, const char *name, const char *label) {
+    const pa_json_object *h, *count, *median, *p99, *max;
+
+    if (!(h = pa_json_object_get_object_member(o, name)) || pa_json_object_get_type(h) != PA_JSON_TYPE_OBJECT)
+        return -1;
+
+    count = pa_json_object_get_object_member(h, "count");
+    median = pa_json_object_get_object_member(h, "median");
+    p99 = pa_json_object_get_object_member(h, "p99");
+    max = pa_json_object_get_object_member(h, "max");
+
+    if (!count || pa_json_object_get_type(count) != PA_JSON_TYPE_INT ||
+        !median || pa_json_object_get_type(median) != PA_JSON_TYPE_INT ||
+        !p99 || pa_json_object_get_type(p99) != PA_JSON_TYPE_INT ||
+        !max || pa_json_object_get_type(max) != PA_JSON_TYPE_INT)
+        return -1;
+
+    printf(_("%s: %lli samples, median < %lli usec, 99%% < %lli usec, max %lli usec\n"),
+           label,
+           (long long) pa_json_object_get_int(count),
+           (long long) pa_json_object_get_int(median),
+           (long long) pa_json_object_get_int(p99),
+           (long long) pa_json_object_get_int(max));
+
+    return 0;
+}
+
+static void get_sink_timing_stats_message_callback(pa_context *c, int success, char *response, void *userdata) {
+    pa_json_object *o;
+
+    if (!success) {
+        pa_log(_("get-timing-stats message failed: %s"), pa_strerror(pa_context_errno(c)));
+        quit(1);
+        return;
+    }
+
+    // The response is already JSON encoded
+    if (format == JSON) {
+        printf("%s\n", response);
+        fflush(stdout);
+        complete_action();
+        return;
+    }
+
+    if (!(o = pa_json_parse(response)) ||
+        pa_json_object_get_type(o) != PA_JSON_TYPE_OBJECT ||
+        print_timing_histogram(o, "wakeup-lateness", _("Wakeup lateness")) < 0 ||
+        print_timing_histogram(o, "render-time", _("Render time")) < 0 ||
+        print_timing_histogram(o, "slack", _("Slack")) < 0) {
+        pa_log(_("get-timing-stats message response could not be parsed correctly"));
+        if (o)
+            pa_json_object_free(o);
+        quit(1);
+        return;
+    }
+
+    pa_json_object_free(o);
+
+    complete_action();
+}
+
+static void get_sink_timing_stats_callback(pa_context *c, const pa_sink_info *i, int is_last, void *userdata) {
+    char *path;
+
+    if (is_last < 0) {
+        pa_log(_("Failed to get sink information: %s"), pa_strerror(pa_context_errno(c)));
+        quit(1);
+        return;
+    }
+
+    if (is_last)
+        return;
+
+    pa_assert(i);
+
+    /* Sinks register their message handler under their name */
+    path = pa_sprintf_malloc("/sink/%s", i->name);
+    pa_operation_unref(pa_context_send_message_to_object(c, path, "get-timing-stats", NULL, get_sink_timing_stats_message_callback, NULL));
+    pa_xfree(path);
+}
+
 static void volume_relative_adjust(pa_cvolume *cv) {
     pa_assert(volume_flags & VOL_RELATIVE);
 
@@ -2522,6 +2604,10 @@ static void context_state_callback(pa_context *c, void *userdata) {
                     o = pa_context_send_message_to_object(c, object_path, message, message_args, send_message_callback, NULL);
                     break;
 
+                case GET_SINK_TIMING_STATS:
+                    o = pa_context_get_sink_info_by_name(c, sink_name, get_sink_timing_stats_callback, NULL);
+                    break;
+
                 case SUBSCRIBE:
                     pa_context_set_subscribe_callback(c, context_subscribe_callback, NULL);
 
@@ -2713,6 +2799,7 @@ static void help(const char *argv0) {
     printf("%s %s %s %s\n", argv0, _("[options]"), "set-sink-formats", _("#N FORMATS"));
     printf("%s %s %s %s\n", argv0, _("[options]"), "set-port-latency-offset", _("CARD-NAME|CARD-#N PORT OFFSET"));
     printf("%s %s %s %s\n", argv0, _("[options]"), "send-message", _("RECIPIENT MESSAGE [MESSAGE_PARAMETERS]"));
+    printf("%s %s %s %s\n", argv0, _("[options]"), "get-sink-timing-stats", _("NAME|#N"));
     printf("%s %s %s\n",    argv0, _("[options]"), "subscribe");
     printf(_("\nThe special names @DEFAULT_SINK@, @DEFAULT_SOURCE@ and @DEFAULT_MONITOR@\n"
              "can be used to specify the default sink, source and monitor.\n"));
@@ -3227,6 +3314,16 @@ int main(int argc, char *argv[]) {
             if (argc > optind+4)
                 pa_log(_("Excess arguments given, they will be ignored. Note that all message parameters must be given as a single string."));
 
+        } else if (pa_streq(argv[optind], "get-sink-timing-stats")) {
+            action = GET_SINK_TIMING_STATS;
+
+            if (argc < optind+2) {
+                pa_log(_("You have to specify a sink name/index"));
+                goto quit;
+            }
+
+            sink_name = pa_xstrdup(argv[optind+1]);
+
         } else if (pa_streq(argv[optind], "subscribe"))
 
             action = SUBSCRIBE;